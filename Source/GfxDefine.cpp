@@ -9,14 +9,10 @@ uint32_t GetFormatStride(Format format)
         case FORMAT_R32G32B32A32_FLOAT:
         case FORMAT_R32G32B32A32_UINT:
         case FORMAT_R32G32B32A32_SINT:
-        case FORMAT_BC1_UNORM:
-        case FORMAT_BC1_UNORM_SRGB:
         case FORMAT_BC2_UNORM:
         case FORMAT_BC2_UNORM_SRGB:
         case FORMAT_BC3_UNORM:
         case FORMAT_BC3_UNORM_SRGB:
-        case FORMAT_BC4_SNORM:
-        case FORMAT_BC4_UNORM:
         case FORMAT_BC5_SNORM:
         case FORMAT_BC5_UNORM:
         case FORMAT_BC6H_UF16:
@@ -35,6 +31,10 @@ uint32_t GetFormatStride(Format format)
         case FORMAT_R16G16B16A16_UINT:
         case FORMAT_R16G16B16A16_SNORM:
         case FORMAT_R16G16B16A16_SINT:
+        case FORMAT_BC1_UNORM:
+        case FORMAT_BC1_UNORM_SRGB:
+        case FORMAT_BC4_SNORM:
+        case FORMAT_BC4_UNORM:
             return 8;
 
         case FORMAT_R32G32_FLOAT:
@@ -94,6 +94,41 @@ uint32_t GetFormatStride(Format format)
     return 0;
 }
 
+uint32_t GetFormatBlockDimension(Format format)
+{
+    switch (format)
+    {
+        case FORMAT_BC1_UNORM:
+        case FORMAT_BC1_UNORM_SRGB:
+        case FORMAT_BC2_UNORM:
+        case FORMAT_BC2_UNORM_SRGB:
+        case FORMAT_BC3_UNORM:
+        case FORMAT_BC3_UNORM_SRGB:
+        case FORMAT_BC4_SNORM:
+        case FORMAT_BC4_UNORM:
+        case FORMAT_BC5_SNORM:
+        case FORMAT_BC5_UNORM:
+        case FORMAT_BC6H_UF16:
+        case FORMAT_BC6H_SF16:
+        case FORMAT_BC7_UNORM:
+        case FORMAT_BC7_UNORM_SRGB:
+            return 4;
+
+        default:
+            break;
+    }
+
+    return 1;
+}
+
+uint64_t GetSubresourceSize(Format format, uint32_t width, uint32_t height, uint32_t depth)
+{
+    uint32_t block = GetFormatBlockDimension(format);
+    uint64_t blocks_x = (width + block - 1) / block;
+    uint64_t blocks_y = (height + block - 1) / block;
+    return blocks_x * blocks_y * depth * GetFormatStride(format);
+}
+
 bool IsFormatStencilSupport(Format format)
 {
     switch (format)
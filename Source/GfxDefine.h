@@ -2,7 +2,9 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
+#include <functional>
 #include <vector>
 
 #if WIN32
@@ -309,6 +311,14 @@ enum MemoryUsage
     MEMORY_USAGE_GPU_TO_CPU = 2
 };
 
+enum MemoryCategory
+{
+    MEMORY_CATEGORY_BUFFER = 0,
+    MEMORY_CATEGORY_TEXTURE = 1,
+    MEMORY_CATEGORY_STAGING = 2,
+    MEMORY_CATEGORY_COUNT = 3
+};
+
 enum ResourceUsage
 {
     RESOURCE_USAGE_UNDEFINED = 0,
@@ -367,6 +377,14 @@ enum QueueType
     QUEUE_COPY = 2
 };
 
+enum StreamPriority
+{
+    STREAM_PRIORITY_HIGH = 0,
+    STREAM_PRIORITY_NORMAL = 1,
+    STREAM_PRIORITY_LOW = 2,
+    STREAM_PRIORITY_COUNT = 3
+};
+
 enum ShaderStage
 {
     SHADER_STAGE_NONE = 0,
@@ -576,6 +594,13 @@ struct GfxBufferDesc
     uint32_t size;
     MemoryUsage mem_usage;
     ResourceUsage res_usage;
+    // GPU_ONLY buffers are placed in device local memory that is also host visible when available,
+    // they are then mapped and UpdateBuffer writes them without a staging copy
+    bool write_direct = false;
+    // Registers RW_BUFFER buffers in the bindless buffer heap, see GfxDevice::GetBindlessIndex
+    bool bindless = false;
+    // Optional initial contents, size bytes
+    const void* data = nullptr;
 };
 
 class GfxBuffer : public GfxResource
@@ -590,10 +615,39 @@ public:
         return ResourceType::BUFFER;
     }
 
+    // Host visible buffers are mapped for their whole lifetime, nullptr otherwise
+    void* GetMappedData() const
+    {
+        return mapped_data;
+    }
+
 public:
     uint32_t size{};
     MemoryUsage mem_usage;
     ResourceUsage res_usage;
+    bool write_direct = false;
+    void* mapped_data = nullptr;
+};
+
+struct GfxMemoryHeapDesc
+{
+    uint64_t size = 0;
+};
+
+class GfxMemoryHeap
+{
+public:
+    GfxMemoryHeap() = default;
+
+    virtual ~GfxMemoryHeap() = default;
+
+    const GfxMemoryHeapDesc& GetDesc() const
+    {
+        return desc;
+    }
+
+public:
+    GfxMemoryHeapDesc desc;
 };
 
 struct GfxTextureDesc
@@ -609,6 +663,13 @@ struct GfxTextureDesc
     ResourceState state;
     MemoryUsage mem_usage;
     ResourceUsage res_usage;
+    // Placed textures alias heap memory with textures whose [lifetime_begin, lifetime_end] does not overlap
+    GfxMemoryHeap* heap = nullptr;
+    uint32_t lifetime_begin = 0;
+    uint32_t lifetime_end = 0;
+    // Registers every SRV and UAV view in the bindless heaps. Accesses through bindless indices are not tracked,
+    // so these textures are never moved by Defragment
+    bool bindless = false;
 };
 
 class GfxTexture : public GfxResource
@@ -869,6 +930,101 @@ public:
     virtual ~GfxCommandBuffer() = default;
 };
 
+class GfxReadback
+{
+public:
+    GfxReadback() = default;
+
+    virtual ~GfxReadback() = default;
+
+    uint64_t GetSize() const
+    {
+        return size;
+    }
+
+public:
+    uint64_t size = 0;
+};
+
+struct GfxTransientAllocation
+{
+    GfxBuffer* buffer = nullptr;
+    uint64_t offset = 0;
+    void* data = nullptr;
+};
+
+static const uint32_t BLAST_MAX_MEMORY_TYPES = 32;
+static const uint32_t BLAST_MAX_MEMORY_HEAPS = 16;
+struct GfxMemoryTypeStats
+{
+    uint32_t heap_index = 0;
+    // Device memory obtained from the driver
+    uint64_t allocated_bytes = 0;
+    // Part of it handed out to resources
+    uint64_t used_bytes = 0;
+    uint32_t block_count = 0;
+    uint32_t allocation_count = 0;
+};
+
+struct GfxMemoryHeapStats
+{
+    uint64_t size = 0;
+    // Without VK_EXT_memory_budget budget is the heap size and usage only counts this device
+    uint64_t budget = 0;
+    uint64_t usage = 0;
+    bool device_local = false;
+};
+
+struct GfxMemoryCategoryStats
+{
+    uint64_t bytes = 0;
+    uint32_t count = 0;
+};
+
+struct GfxMemoryStats
+{
+    uint32_t num_types = 0;
+    GfxMemoryTypeStats types[BLAST_MAX_MEMORY_TYPES];
+    uint32_t num_heaps = 0;
+    GfxMemoryHeapStats heaps[BLAST_MAX_MEMORY_HEAPS];
+    GfxMemoryCategoryStats categories[MEMORY_CATEGORY_COUNT];
+    // Drivers do not expose descriptor pool memory, so only pool and descriptor counts are reported
+    uint32_t descriptor_pool_count = 0;
+    uint64_t descriptor_count = 0;
+    uint64_t total_allocated_bytes = 0;
+    uint64_t total_used_bytes = 0;
+};
+
+struct GfxDescriptorStats
+{
+    // Flushes whose binding contents matched a set already written in the same frame and command buffer
+    uint64_t cache_hits = 0;
+    // Flushes that allocated and wrote a new descriptor set
+    uint64_t cache_misses = 0;
+    // Flushes recorded with push descriptors, they bypass the cache and the descriptor pools
+    uint64_t pushes = 0;
+    // Descriptor sets allocated from the per-frame pools
+    uint64_t allocations = 0;
+    // Pools chained because the existing ones ran out, they are kept and reused in later frames
+    uint64_t pool_creations = 0;
+};
+
+struct GfxStreamRequest
+{
+    // Either buffer or texture is the upload target
+    GfxBuffer* buffer = nullptr;
+    uint64_t buffer_offset = 0;
+    GfxTexture* texture = nullptr;
+    uint32_t layer = 0;
+    uint32_t level = 0;
+    // Read by the streaming thread, must stay valid until the upload is resident. Zero size means the whole target
+    const void* data = nullptr;
+    uint64_t size = 0;
+    StreamPriority priority = STREAM_PRIORITY_NORMAL;
+    // Invoked on the streaming thread once the upload is resident
+    std::function<void()> callback;
+};
+
 struct GfxBufferCopyRange
 {
     uint32_t src_offset;
@@ -900,16 +1056,38 @@ struct GfxBufferImageCopyRange
     GfxTexture* dst_texture = nullptr;
 };
 
+struct GfxTextureRegion
+{
+    uint32_t layer = 0;
+    uint32_t level = 0;
+    // Tightly packed data of the whole subresource
+    const void* data = nullptr;
+};
+
 struct GfxResourceBarrier
 {
     GfxResource* resource = nullptr;
     ResourceState new_state = RESOURCE_STATE_COMMON;
+    // Placed texture takes over aliased heap memory, previous contents are discarded
+    bool aliasing = false;
 };
 
 static const uint32_t BLAST_CBV_COUNT = 15;
 static const uint32_t BLAST_SRV_COUNT = 64;
 static const uint32_t BLAST_UAV_COUNT = 16;
 static const uint32_t BLAST_SAMPLER_COUNT = 16;
+// Binding table slots are grouped into descriptor sets by the set index declared in the shader. Sets are ordered
+// by update frequency so changing a per-draw slot only rewrites and rebinds the draw set
+static const uint32_t BLAST_FRAME_SET = 0;
+static const uint32_t BLAST_PASS_SET = 1;
+static const uint32_t BLAST_MATERIAL_SET = 2;
+static const uint32_t BLAST_DRAW_SET = 3;
+static const uint32_t BLAST_BINDING_SET_COUNT = 4;
+// Bindless heaps are unsized arrays at binding 0 of these sets, the sets below them belong to the binding table
+static const uint32_t BLAST_BINDLESS_TEXTURE_SET = 4;
+static const uint32_t BLAST_BINDLESS_RW_TEXTURE_SET = 5;
+static const uint32_t BLAST_BINDLESS_BUFFER_SET = 6;
+static const uint32_t BLAST_BINDLESS_SAMPLER_SET = 7;
 struct GfxBindingTable
 {
     GfxBuffer* cbv[BLAST_CBV_COUNT];
@@ -922,8 +1100,15 @@ struct GfxBindingTable
     GfxSampler* sam[BLAST_SAMPLER_COUNT];
 };
 
+// Bytes per texel, or per block for block compressed formats
 uint32_t GetFormatStride(Format format);
 
+// Width and height in texels of a block, 1 for uncompressed formats
+uint32_t GetFormatBlockDimension(Format format);
+
+// Tightly packed size of a width x height x depth region, rows are rounded up to whole blocks
+uint64_t GetSubresourceSize(Format format, uint32_t width, uint32_t height, uint32_t depth);
+
 bool IsFormatStencilSupport(Format format);
 
 inline constexpr uint32_t GetNextPowerOfTwo(uint32_t x)
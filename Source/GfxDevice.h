@@ -17,6 +17,8 @@ public:
 
     virtual GfxTexture* CreateTexture(const GfxTextureDesc& desc) = 0;
 
+    virtual GfxMemoryHeap* CreateMemoryHeap(const GfxMemoryHeapDesc& desc) = 0;
+
     virtual int32_t CreateSubresource(GfxTexture*, SubResourceType, uint32_t, uint32_t, uint32_t, uint32_t) = 0;
 
     virtual GfxSampler* CreateSampler(const GfxSamplerDesc& desc) = 0;
@@ -77,12 +79,77 @@ public:
 
     virtual void Dispatch(GfxCommandBuffer* cmd, uint32_t thread_group_x, uint32_t thread_group_y, uint32_t thread_group_z) = 0;
 
+    // CPU_TO_GPU and mapped write_direct buffers are written through their mapping immediately, other buffers record a staged copy into cmd
     virtual void UpdateBuffer(GfxCommandBuffer* cmd, GfxBuffer* buffer, const void* data, uint64_t size = 0, uint64_t offset = 0) = 0;
 
     virtual void UpdateTexture(GfxCommandBuffer* cmd, GfxTexture* texture, const void* data, uint32_t layer = 0, uint32_t level = 0) = 0;
 
+    // Uploads any set of subresources with a single copy, texture must be in RESOURCE_STATE_COPY_DEST
+    virtual void UpdateTextureRegions(GfxCommandBuffer* cmd, GfxTexture* texture, uint32_t num_regions, const GfxTextureRegion* regions) = 0;
+
+    // Same as UpdateTextureRegions but the data of the regions is ignored, dst receives the staging memory of each region instead.
+    // The memory may be written from any thread until SubmitAllCommandBuffer
+    virtual void MapTextureRegions(GfxCommandBuffer* cmd, GfxTexture* texture, uint32_t num_regions, const GfxTextureRegion* regions, void** dst) = 0;
+
     virtual void SetBarrier(GfxCommandBuffer* cmd, uint32_t num_barriers, GfxResourceBarrier* barriers) = 0;
 
+    // Fills every mip below level 0 from level 0, leaves texture in RESOURCE_STATE_SHADER_RESOURCE.
+    // Uses compute when the texture has UAV usage and a storage capable format, blits on a graphics cmd otherwise
+    virtual void GenerateMips(GfxCommandBuffer* cmd, GfxTexture* texture) = 0;
+
+    // Mapped memory that lives until the frame of cmd retires, offsets are aligned for usage
+    virtual GfxTransientAllocation AllocateTransient(GfxCommandBuffer* cmd, uint64_t size, ResourceUsage usage) = 0;
+
+    // Counters are kept up to date by the allocator, the call is cheap enough for every frame
+    virtual void GetMemoryStats(GfxMemoryStats& stats) = 0;
+
+    // Totals since the device was created, command buffers are counted when they are submitted
+    virtual void GetDescriptorStats(GfxDescriptorStats& stats) = 0;
+
+    // Pipelines and compute shaders created afterwards record their highest binding set with push descriptors instead
+    // of allocating sets when it holds at most max_descriptors descriptors. Clamped to the device limit, 0 (the default) disables it
+    virtual void SetPushDescriptorLimit(uint32_t max_descriptors) = 0;
+
+    // Needs descriptor indexing with update after bind for sampled images, storage images and storage buffers
+    virtual bool IsBindlessSupported() = 0;
+
+    // Slot of a view in its bindless heap, -1 when the resource was not created bindless. Texture views take the
+    // subresource returned by CreateSubresource, a buffer has one slot shared by SRV and UAV.
+    // Shaders receive the slot through push constants or a buffer
+    virtual int32_t GetBindlessIndex(GfxResource* resource, SubResourceType type, int32_t subresource = -1) = 0;
+
+    // Every sampler is registered while bindless is supported
+    virtual int32_t GetBindlessIndex(GfxSampler* sampler) = 0;
+
+    // Moves up to max_bytes of immutable GPU_ONLY resources out of sparse memory blocks, returns the bytes moved.
+    // Call between frames, before any command buffer of the frame is requested
+    virtual uint64_t Defragment(uint64_t max_bytes) = 0;
+
+    // Copies size bytes of buffer into readback memory after the commands already recorded in cmd
+    virtual GfxReadback* ReadbackBuffer(GfxCommandBuffer* cmd, GfxBuffer* buffer, uint64_t size = 0, uint64_t offset = 0) = 0;
+
+    // texture must be in RESOURCE_STATE_COPY_SOURCE, rows are tightly packed
+    virtual GfxReadback* ReadbackTexture(GfxCommandBuffer* cmd, GfxTexture* texture, uint32_t layer = 0, uint32_t level = 0) = 0;
+
+    // Returns the mapped result once the GPU has finished the copy, nullptr otherwise. Never blocks
+    virtual const void* GetReadbackData(GfxReadback* readback) = 0;
+
+    // Blocks until the copy has finished, returns false if the command buffer of readback was not submitted yet
+    virtual bool WaitReadback(GfxReadback* readback) = 0;
+
+    // Queues an upload on the streaming thread and returns a ticket for it, 0 when the request is out of range.
+    // A texture upload covers a whole subresource, a nonzero size must match it.
+    // The target must not be used or destroyed before the upload is resident
+    virtual uint64_t StreamUpload(const GfxStreamRequest& request) = 0;
+
+    virtual bool IsStreamResident(uint64_t ticket) = 0;
+
+    // Makes cmd wait for the upload on the GPU, a pending upload is moved ahead of the budget
+    virtual void WaitStream(GfxCommandBuffer* cmd, uint64_t ticket) = 0;
+
+    // Maximum bytes the streaming thread stages per frame
+    virtual void SetStreamBudget(uint64_t bytes_per_frame) = 0;
+
 private:
     virtual void DestroySampler(GfxSampler*) = 0;
 
@@ -90,6 +157,10 @@ private:
 
     virtual void DestroyTexture(GfxTexture*) = 0;
 
+    virtual void DestroyMemoryHeap(GfxMemoryHeap*) = 0;
+
+    virtual void DestroyReadback(GfxReadback*) = 0;
+
     virtual void DestroySwapChain(GfxSwapChain*) = 0;
 
     virtual void DestroyRenderPass(GfxRenderPass*) = 0;
@@ -0,0 +1,625 @@
+#include "GfxTextureLoader.h"
+#include "GfxTextureTranscoder.h"
+#include <zstd/zstd.h>
+#include <algorithm>
+
+#if !WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace blast
+{
+struct TextureLayout
+{
+    GfxTextureDesc desc;
+    std::vector<GfxTextureRegion> regions;
+    // Basis Universal数据, 整个文件交给转码器, 不生成区域
+    bool basis = false;
+    // zstd超压缩时解压后的每一级数据, 区域指向其中
+    std::vector<std::vector<uint8_t>> inflated;
+};
+
+static const uint8_t ktx2_identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+static const uint32_t KTX2_SUPERCOMPRESSION_NONE = 0;
+static const uint32_t KTX2_SUPERCOMPRESSION_ZSTD = 2;
+
+struct Ktx2Header
+{
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+    uint32_t dfd_byte_offset;
+    uint32_t dfd_byte_length;
+    uint32_t kvd_byte_offset;
+    uint32_t kvd_byte_length;
+    uint64_t sgd_byte_offset;
+    uint64_t sgd_byte_length;
+};
+
+struct Ktx2LevelIndex
+{
+    uint64_t byte_offset;
+    uint64_t byte_length;
+    uint64_t uncompressed_byte_length;
+};
+
+struct DdsPixelFormat
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t four_cc;
+    uint32_t rgb_bit_count;
+    uint32_t r_bit_mask;
+    uint32_t g_bit_mask;
+    uint32_t b_bit_mask;
+    uint32_t a_bit_mask;
+};
+
+struct DdsHeader
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitch_or_linear_size;
+    uint32_t depth;
+    uint32_t mip_map_count;
+    uint32_t reserved1[11];
+    DdsPixelFormat pixel_format;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+};
+
+struct DdsHeaderDxt10
+{
+    uint32_t dxgi_format;
+    uint32_t resource_dimension;
+    uint32_t misc_flag;
+    uint32_t array_size;
+    uint32_t misc_flags2;
+};
+
+#define BLAST_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+static const uint32_t DDS_MAGIC = BLAST_FOURCC('D', 'D', 'S', ' ');
+static const uint32_t DDS_PIXEL_FORMAT_FOURCC = 0x4;
+static const uint32_t DDS_PIXEL_FORMAT_RGB = 0x40;
+static const uint32_t DDS_CAPS2_CUBEMAP = 0x200;
+static const uint32_t DDS_CAPS2_VOLUME = 0x200000;
+static const uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+static const uint32_t DDS_DIMENSION_TEXTURE3D = 4;
+
+// KTX2中保存的是VkFormat的数值
+static Format FromKtx2Format(uint32_t vk_format)
+{
+    switch (vk_format)
+    {
+        case 9:
+            return FORMAT_R8_UNORM;
+        case 10:
+            return FORMAT_R8_SNORM;
+        case 16:
+            return FORMAT_R8G8_UNORM;
+        case 17:
+            return FORMAT_R8G8_SNORM;
+        case 37:
+            return FORMAT_R8G8B8A8_UNORM;
+        case 38:
+            return FORMAT_R8G8B8A8_SNORM;
+        case 43:
+            return FORMAT_R8G8B8A8_UNORM_SRGB;
+        case 44:
+            return FORMAT_B8G8R8A8_UNORM;
+        case 50:
+            return FORMAT_B8G8R8A8_UNORM_SRGB;
+        case 64:
+            return FORMAT_R10G10B10A2_UNORM;
+        case 70:
+            return FORMAT_R16_UNORM;
+        case 76:
+            return FORMAT_R16_FLOAT;
+        case 77:
+            return FORMAT_R16G16_UNORM;
+        case 83:
+            return FORMAT_R16G16_FLOAT;
+        case 91:
+            return FORMAT_R16G16B16A16_UNORM;
+        case 97:
+            return FORMAT_R16G16B16A16_FLOAT;
+        case 100:
+            return FORMAT_R32_FLOAT;
+        case 103:
+            return FORMAT_R32G32_FLOAT;
+        case 106:
+            return FORMAT_R32G32B32_FLOAT;
+        case 109:
+            return FORMAT_R32G32B32A32_FLOAT;
+        case 122:
+            return FORMAT_R11G11B10_FLOAT;
+        case 133:
+            return FORMAT_BC1_UNORM;
+        case 134:
+            return FORMAT_BC1_UNORM_SRGB;
+        case 135:
+            return FORMAT_BC2_UNORM;
+        case 136:
+            return FORMAT_BC2_UNORM_SRGB;
+        case 137:
+            return FORMAT_BC3_UNORM;
+        case 138:
+            return FORMAT_BC3_UNORM_SRGB;
+        case 139:
+            return FORMAT_BC4_UNORM;
+        case 140:
+            return FORMAT_BC4_SNORM;
+        case 141:
+            return FORMAT_BC5_UNORM;
+        case 142:
+            return FORMAT_BC5_SNORM;
+        case 143:
+            return FORMAT_BC6H_UF16;
+        case 144:
+            return FORMAT_BC6H_SF16;
+        case 145:
+            return FORMAT_BC7_UNORM;
+        case 146:
+            return FORMAT_BC7_UNORM_SRGB;
+        default:
+            break;
+    }
+    return FORMAT_UNKNOWN;
+}
+
+static Format FromDxgiFormat(uint32_t dxgi_format)
+{
+    switch (dxgi_format)
+    {
+        case 2:
+            return FORMAT_R32G32B32A32_FLOAT;
+        case 6:
+            return FORMAT_R32G32B32_FLOAT;
+        case 10:
+            return FORMAT_R16G16B16A16_FLOAT;
+        case 11:
+            return FORMAT_R16G16B16A16_UNORM;
+        case 13:
+            return FORMAT_R16G16B16A16_SNORM;
+        case 16:
+            return FORMAT_R32G32_FLOAT;
+        case 24:
+            return FORMAT_R10G10B10A2_UNORM;
+        case 26:
+            return FORMAT_R11G11B10_FLOAT;
+        case 28:
+            return FORMAT_R8G8B8A8_UNORM;
+        case 29:
+            return FORMAT_R8G8B8A8_UNORM_SRGB;
+        case 31:
+            return FORMAT_R8G8B8A8_SNORM;
+        case 34:
+            return FORMAT_R16G16_FLOAT;
+        case 35:
+            return FORMAT_R16G16_UNORM;
+        case 41:
+            return FORMAT_R32_FLOAT;
+        case 49:
+            return FORMAT_R8G8_UNORM;
+        case 54:
+            return FORMAT_R16_FLOAT;
+        case 56:
+            return FORMAT_R16_UNORM;
+        case 61:
+            return FORMAT_R8_UNORM;
+        case 71:
+            return FORMAT_BC1_UNORM;
+        case 72:
+            return FORMAT_BC1_UNORM_SRGB;
+        case 74:
+            return FORMAT_BC2_UNORM;
+        case 75:
+            return FORMAT_BC2_UNORM_SRGB;
+        case 77:
+            return FORMAT_BC3_UNORM;
+        case 78:
+            return FORMAT_BC3_UNORM_SRGB;
+        case 80:
+            return FORMAT_BC4_UNORM;
+        case 81:
+            return FORMAT_BC4_SNORM;
+        case 83:
+            return FORMAT_BC5_UNORM;
+        case 84:
+            return FORMAT_BC5_SNORM;
+        case 87:
+            return FORMAT_B8G8R8A8_UNORM;
+        case 91:
+            return FORMAT_B8G8R8A8_UNORM_SRGB;
+        case 95:
+            return FORMAT_BC6H_UF16;
+        case 96:
+            return FORMAT_BC6H_SF16;
+        case 98:
+            return FORMAT_BC7_UNORM;
+        case 99:
+            return FORMAT_BC7_UNORM_SRGB;
+        default:
+            break;
+    }
+    return FORMAT_UNKNOWN;
+}
+
+static Format FromDdsPixelFormat(const DdsPixelFormat& pixel_format)
+{
+    if (pixel_format.flags & DDS_PIXEL_FORMAT_FOURCC)
+    {
+        switch (pixel_format.four_cc)
+        {
+            case BLAST_FOURCC('D', 'X', 'T', '1'):
+                return FORMAT_BC1_UNORM;
+            case BLAST_FOURCC('D', 'X', 'T', '2'):
+            case BLAST_FOURCC('D', 'X', 'T', '3'):
+                return FORMAT_BC2_UNORM;
+            case BLAST_FOURCC('D', 'X', 'T', '4'):
+            case BLAST_FOURCC('D', 'X', 'T', '5'):
+                return FORMAT_BC3_UNORM;
+            case BLAST_FOURCC('A', 'T', 'I', '1'):
+            case BLAST_FOURCC('B', 'C', '4', 'U'):
+                return FORMAT_BC4_UNORM;
+            case BLAST_FOURCC('B', 'C', '4', 'S'):
+                return FORMAT_BC4_SNORM;
+            case BLAST_FOURCC('A', 'T', 'I', '2'):
+            case BLAST_FOURCC('B', 'C', '5', 'U'):
+                return FORMAT_BC5_UNORM;
+            case BLAST_FOURCC('B', 'C', '5', 'S'):
+                return FORMAT_BC5_SNORM;
+            // D3DFMT_A16B16G16R16F
+            case 113:
+                return FORMAT_R16G16B16A16_FLOAT;
+            // D3DFMT_A32B32G32R32F
+            case 116:
+                return FORMAT_R32G32B32A32_FLOAT;
+            default:
+                break;
+        }
+        return FORMAT_UNKNOWN;
+    }
+
+    if ((pixel_format.flags & DDS_PIXEL_FORMAT_RGB) && pixel_format.rgb_bit_count == 32)
+    {
+        if (pixel_format.r_bit_mask == 0x000000ff && pixel_format.g_bit_mask == 0x0000ff00 && pixel_format.b_bit_mask == 0x00ff0000)
+        {
+            return FORMAT_R8G8B8A8_UNORM;
+        }
+
+        if (pixel_format.r_bit_mask == 0x00ff0000 && pixel_format.g_bit_mask == 0x0000ff00 && pixel_format.b_bit_mask == 0x000000ff)
+        {
+            return FORMAT_B8G8R8A8_UNORM;
+        }
+    }
+    return FORMAT_UNKNOWN;
+}
+
+static uint64_t GetRegionSize(const GfxTextureDesc& desc, uint32_t level)
+{
+    return GetSubresourceSize(desc.format, std::max(desc.width >> level, 1u), std::max(desc.height >> level, 1u), std::max(desc.depth >> level, 1u));
+}
+
+// 逐个子资源检查, 避免偏移和大小相加时溢出
+static bool IsRegionInRange(uint64_t offset, uint64_t region_size, uint64_t size)
+{
+    return offset <= size && region_size <= size - offset;
+}
+
+static bool ParseKtx2(const uint8_t* data, uint64_t size, TextureLayout& layout)
+{
+    if (size < sizeof(ktx2_identifier) + sizeof(Ktx2Header))
+    {
+        return false;
+    }
+
+    Ktx2Header header;
+    memcpy(&header, data + sizeof(ktx2_identifier), sizeof(Ktx2Header));
+
+    GfxTextureDesc& desc = layout.desc;
+    if (header.vk_format == 0)
+    {
+        // VK_FORMAT_UNDEFINED时为UASTC(可带zstd超压缩)或BasisLZ超压缩的ETC1S, 由转码器解析
+        desc.format = GfxTextureTranscoder::GetTargetFormat(data, size);
+        layout.basis = true;
+    }
+    else if (header.supercompression_scheme == KTX2_SUPERCOMPRESSION_NONE || header.supercompression_scheme == KTX2_SUPERCOMPRESSION_ZSTD)
+    {
+        desc.format = FromKtx2Format(header.vk_format);
+    }
+    else
+    {
+        BLAST_LOGE("unsupported ktx2 supercompression scheme %u\n", header.supercompression_scheme);
+        return false;
+    }
+
+    if (desc.format == FORMAT_UNKNOWN)
+    {
+        BLAST_LOGE("unsupported ktx2 format %u\n", header.vk_format);
+        return false;
+    }
+
+    uint32_t num_faces = std::max(header.face_count, 1u);
+    uint32_t num_layers = std::max(header.layer_count, 1u);
+    desc.width = header.pixel_width;
+    desc.height = std::max(header.pixel_height, 1u);
+    desc.depth = std::max(header.pixel_depth, 1u);
+    desc.num_layers = num_layers * num_faces;
+    desc.num_levels = std::max(header.level_count, 1u);
+    if (num_faces == 6)
+    {
+        desc.res_usage = RESOURCE_USAGE_CUBE_TEXTURE;
+    }
+
+    if (layout.basis)
+    {
+        return true;
+    }
+
+    uint64_t index_offset = sizeof(ktx2_identifier) + sizeof(Ktx2Header);
+    if (index_offset + desc.num_levels * sizeof(Ktx2LevelIndex) > size)
+    {
+        return false;
+    }
+
+    // 每一级依次存放所有层的所有面
+    layout.inflated.reserve(desc.num_levels);
+    for (uint32_t level = 0; level < desc.num_levels; ++level)
+    {
+        Ktx2LevelIndex level_index;
+        memcpy(&level_index, data + index_offset + level * sizeof(Ktx2LevelIndex), sizeof(Ktx2LevelIndex));
+
+        uint64_t region_size = GetRegionSize(desc, level);
+        if (!IsRegionInRange(level_index.byte_offset, level_index.byte_length, size))
+        {
+            BLAST_LOGE("ktx2 level %u is out of range\n", level);
+            return false;
+        }
+
+        const uint8_t* level_data = data + level_index.byte_offset;
+        uint64_t level_size = level_index.byte_length;
+        if (header.supercompression_scheme == KTX2_SUPERCOMPRESSION_ZSTD)
+        {
+            // 每一级是一个独立的zstd帧, 解压到布局持有的内存中
+            layout.inflated.emplace_back((size_t)(region_size * desc.num_layers));
+            std::vector<uint8_t>& inflated = layout.inflated.back();
+            size_t result = ZSTD_decompress(inflated.data(), inflated.size(), level_data, (size_t)level_size);
+            if (ZSTD_isError(result) || result != inflated.size())
+            {
+                BLAST_LOGE("failed to inflate ktx2 level %u\n", level);
+                return false;
+            }
+            level_data = inflated.data();
+            level_size = inflated.size();
+        }
+
+        for (uint32_t layer = 0; layer < desc.num_layers; ++layer)
+        {
+            if (!IsRegionInRange(region_size * layer, region_size, level_size))
+            {
+                BLAST_LOGE("ktx2 level %u layer %u is out of range\n", level, layer);
+                return false;
+            }
+
+            GfxTextureRegion region;
+            region.layer = layer;
+            region.level = level;
+            region.data = level_data + region_size * layer;
+            layout.regions.push_back(region);
+        }
+    }
+    return true;
+}
+
+static bool ParseDds(const uint8_t* data, uint64_t size, TextureLayout& layout)
+{
+    uint64_t offset = sizeof(uint32_t) + sizeof(DdsHeader);
+    if (size < offset)
+    {
+        return false;
+    }
+
+    DdsHeader header;
+    memcpy(&header, data + sizeof(uint32_t), sizeof(DdsHeader));
+
+    GfxTextureDesc& desc = layout.desc;
+    desc.width = header.width;
+    desc.height = std::max(header.height, 1u);
+    desc.depth = (header.caps2 & DDS_CAPS2_VOLUME) ? std::max(header.depth, 1u) : 1;
+    desc.num_levels = std::max(header.mip_map_count, 1u);
+    desc.num_layers = 1;
+
+    bool cube = (header.caps2 & DDS_CAPS2_CUBEMAP) != 0;
+    if ((header.pixel_format.flags & DDS_PIXEL_FORMAT_FOURCC) && header.pixel_format.four_cc == BLAST_FOURCC('D', 'X', '1', '0'))
+    {
+        if (size < offset + sizeof(DdsHeaderDxt10))
+        {
+            return false;
+        }
+
+        DdsHeaderDxt10 header_dxt10;
+        memcpy(&header_dxt10, data + offset, sizeof(DdsHeaderDxt10));
+        offset += sizeof(DdsHeaderDxt10);
+
+        desc.format = FromDxgiFormat(header_dxt10.dxgi_format);
+        desc.num_layers = std::max(header_dxt10.array_size, 1u);
+        cube = (header_dxt10.misc_flag & DDS_RESOURCE_MISC_TEXTURECUBE) != 0;
+        if (header_dxt10.resource_dimension != DDS_DIMENSION_TEXTURE3D)
+        {
+            desc.depth = 1;
+        }
+    }
+    else
+    {
+        desc.format = FromDdsPixelFormat(header.pixel_format);
+    }
+
+    if (desc.format == FORMAT_UNKNOWN)
+    {
+        BLAST_LOGE("unsupported dds format\n");
+        return false;
+    }
+
+    if (cube)
+    {
+        desc.num_layers *= 6;
+        desc.res_usage = RESOURCE_USAGE_CUBE_TEXTURE;
+    }
+
+    // 每一层依次存放所有mip
+    for (uint32_t layer = 0; layer < desc.num_layers; ++layer)
+    {
+        for (uint32_t level = 0; level < desc.num_levels; ++level)
+        {
+            uint64_t region_size = GetRegionSize(desc, level);
+            if (!IsRegionInRange(offset, region_size, size))
+            {
+                BLAST_LOGE("dds level %u layer %u is out of range\n", level, layer);
+                return false;
+            }
+
+            GfxTextureRegion region;
+            region.layer = layer;
+            region.level = level;
+            region.data = data + offset;
+            layout.regions.push_back(region);
+            offset += region_size;
+        }
+    }
+    return true;
+}
+
+GfxTexture* GfxTextureLoader::Load(GfxDevice* device, GfxCommandBuffer* cmd, const char* path, ResourceUsage usage)
+{
+    GfxTexture* texture = nullptr;
+
+#if WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        BLAST_LOGE("failed to open %s\n", path);
+        return nullptr;
+    }
+
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping)
+    {
+        const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (data)
+        {
+            texture = Load(device, cmd, data, (uint64_t)file_size.QuadPart, usage);
+            UnmapViewOfFile(data);
+        }
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+    {
+        BLAST_LOGE("failed to open %s\n", path);
+        return nullptr;
+    }
+
+    struct stat file_stat;
+    if (fstat(file, &file_stat) == 0 && file_stat.st_size > 0)
+    {
+        void* data = mmap(nullptr, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data != MAP_FAILED)
+        {
+            // 数据只会被顺序读取一次
+            madvise(data, (size_t)file_stat.st_size, MADV_SEQUENTIAL);
+            texture = Load(device, cmd, data, (uint64_t)file_stat.st_size, usage);
+            munmap(data, (size_t)file_stat.st_size);
+        }
+    }
+    close(file);
+#endif
+
+    if (texture == nullptr)
+    {
+        BLAST_LOGE("failed to load %s\n", path);
+    }
+    return texture;
+}
+
+GfxTexture* GfxTextureLoader::Load(GfxDevice* device, GfxCommandBuffer* cmd, const void* data, uint64_t size, ResourceUsage usage)
+{
+    TextureLayout layout;
+    layout.desc.res_usage = RESOURCE_USAGE_UNDEFINED;
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    bool parsed = false;
+    if (size >= sizeof(ktx2_identifier) && memcmp(bytes, ktx2_identifier, sizeof(ktx2_identifier)) == 0)
+    {
+        parsed = ParseKtx2(bytes, size, layout);
+    }
+    else if (size >= sizeof(uint32_t) && memcmp(bytes, &DDS_MAGIC, sizeof(uint32_t)) == 0)
+    {
+        parsed = ParseDds(bytes, size, layout);
+    }
+
+    if (!parsed)
+    {
+        return nullptr;
+    }
+
+    if (layout.basis && layout.desc.depth > 1)
+    {
+        BLAST_LOGE("basis universal ktx2 must be a 2d or cube texture\n");
+        return nullptr;
+    }
+
+    layout.desc.res_usage = (ResourceUsage)(layout.desc.res_usage | usage | RESOURCE_USAGE_SHADER_RESOURCE);
+    layout.desc.mem_usage = MEMORY_USAGE_GPU_ONLY;
+    layout.desc.state = RESOURCE_STATE_SHADER_RESOURCE;
+    GfxTexture* texture = device->CreateTexture(layout.desc);
+    if (texture == nullptr)
+    {
+        BLAST_LOGE("failed to create texture %ux%u\n", layout.desc.width, layout.desc.height);
+        return nullptr;
+    }
+
+    GfxResourceBarrier barrier;
+    barrier.resource = texture;
+    barrier.new_state = RESOURCE_STATE_COPY_DEST;
+    device->SetBarrier(cmd, 1, &barrier);
+
+    if (layout.basis)
+    {
+        // 转码结果直接写入上传缓存
+        if (!GfxTextureTranscoder::Transcode(device, cmd, texture, data, size))
+        {
+            BLAST_SAFE_DELETE(texture);
+            return nullptr;
+        }
+    }
+    else
+    {
+        // 区域数据直接从映射的文件拷贝到上传缓存
+        device->UpdateTextureRegions(cmd, texture, (uint32_t)layout.regions.size(), layout.regions.data());
+    }
+
+    barrier.new_state = RESOURCE_STATE_SHADER_RESOURCE;
+    device->SetBarrier(cmd, 1, &barrier);
+    return texture;
+}
+}// namespace blast
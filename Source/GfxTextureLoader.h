@@ -0,0 +1,17 @@
+#pragma once
+#include "GfxDevice.h"
+
+namespace blast
+{
+class GfxTextureLoader
+{
+public:
+    // Creates the texture stored in a KTX2 or DDS file and records its upload into cmd.
+    // The file is memory mapped and every subresource is copied straight into staging memory.
+    // The texture is left in RESOURCE_STATE_SHADER_RESOURCE, nullptr is returned for unsupported files
+    static GfxTexture* Load(GfxDevice* device, GfxCommandBuffer* cmd, const char* path, ResourceUsage usage = RESOURCE_USAGE_SHADER_RESOURCE);
+
+    // Same as Load for a container that is already in memory
+    static GfxTexture* Load(GfxDevice* device, GfxCommandBuffer* cmd, const void* data, uint64_t size, ResourceUsage usage = RESOURCE_USAGE_SHADER_RESOURCE);
+};
+}// namespace blast
@@ -0,0 +1,259 @@
+#include "GfxTextureTranscoder.h"
+#include <transcoder/basisu_transcoder.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace blast
+{
+// 常驻的工作线程, 按需创建后一直保留到程序退出, 调用线程同样参与执行
+class WorkerPool
+{
+public:
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(locker);
+            running = false;
+        }
+        condition.notify_all();
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    void ParallelFor(uint32_t num_threads, uint32_t count, const std::function<void(uint32_t)>& func)
+    {
+        // 同一时间只执行一个任务
+        std::lock_guard<std::mutex> job_lock(job_locker);
+
+        uint32_t num_workers = std::min(std::min(num_threads, count), std::max(std::thread::hardware_concurrency(), 1u));
+        num_workers = num_workers > 0 ? num_workers - 1 : 0;
+        {
+            std::lock_guard<std::mutex> lock(locker);
+            while (threads.size() < num_workers)
+            {
+                threads.emplace_back(&WorkerPool::Run, this);
+            }
+            job = &func;
+            job_count = count;
+            next = 0;
+            max_joined = num_workers;
+            joined = 0;
+            generation++;
+        }
+        condition.notify_all();
+
+        Execute(func, count);
+
+        // 不再允许新的线程加入, 等待已经加入的线程结束
+        std::unique_lock<std::mutex> lock(locker);
+        max_joined = 0;
+        done_condition.wait(lock, [this]() { return active == 0; });
+        job = nullptr;
+    }
+
+private:
+    void Execute(const std::function<void(uint32_t)>& func, uint32_t count)
+    {
+        for (uint32_t i = next++; i < count; i = next++)
+        {
+            func(i);
+        }
+    }
+
+    void Run()
+    {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(locker);
+        while (true)
+        {
+            condition.wait(lock, [this, &seen]() { return !running || (generation != seen && joined < max_joined); });
+            if (!running)
+            {
+                return;
+            }
+
+            seen = generation;
+            joined++;
+            active++;
+            const std::function<void(uint32_t)>* func = job;
+            uint32_t count = job_count;
+            lock.unlock();
+
+            Execute(*func, count);
+
+            lock.lock();
+            if (--active == 0)
+            {
+                done_condition.notify_all();
+            }
+        }
+    }
+
+    std::mutex job_locker;
+    std::mutex locker;
+    std::condition_variable condition;
+    std::condition_variable done_condition;
+    std::vector<std::thread> threads;
+    bool running = true;
+    const std::function<void(uint32_t)>* job = nullptr;
+    uint32_t job_count = 0;
+    std::atomic<uint32_t> next{0};
+    uint32_t max_joined = 0;
+    uint32_t joined = 0;
+    uint32_t active = 0;
+    uint64_t generation = 0;
+};
+
+static void ParallelFor(uint32_t num_threads, uint32_t count, const std::function<void(uint32_t)>& func)
+{
+    static WorkerPool pool;
+    pool.ParallelFor(num_threads, count, func);
+}
+
+// 目标格式对应的basis_universal输出格式
+static bool ToTranscoderFormat(Format format, basist::transcoder_texture_format& target)
+{
+    switch (format)
+    {
+        case FORMAT_BC1_UNORM:
+        case FORMAT_BC1_UNORM_SRGB:
+            target = basist::transcoder_texture_format::cTFBC1_RGB;
+            return true;
+        case FORMAT_BC3_UNORM:
+        case FORMAT_BC3_UNORM_SRGB:
+            target = basist::transcoder_texture_format::cTFBC3_RGBA;
+            return true;
+        case FORMAT_BC4_UNORM:
+            target = basist::transcoder_texture_format::cTFBC4_R;
+            return true;
+        case FORMAT_BC5_UNORM:
+            target = basist::transcoder_texture_format::cTFBC5_RG;
+            return true;
+        case FORMAT_BC7_UNORM:
+        case FORMAT_BC7_UNORM_SRGB:
+            target = basist::transcoder_texture_format::cTFBC7_RGBA;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// 全局查找表只需初始化一次
+static void InitTranscoder()
+{
+    static std::once_flag flag;
+    std::call_once(flag, []() { basist::basisu_transcoder_init(); });
+}
+
+static bool InitKtx2(basist::ktx2_transcoder& transcoder, const void* data, uint64_t size)
+{
+    InitTranscoder();
+    if (size > UINT32_MAX || !transcoder.init(data, (uint32_t)size))
+    {
+        return false;
+    }
+    return transcoder.is_uastc() || transcoder.is_etc1s();
+}
+
+Format GfxTextureTranscoder::SelectFormat(TranscodeSource source, bool alpha, bool srgb)
+{
+    if (source == TRANSCODE_SOURCE_UASTC)
+    {
+        return srgb ? FORMAT_BC7_UNORM_SRGB : FORMAT_BC7_UNORM;
+    }
+
+    if (alpha)
+    {
+        return srgb ? FORMAT_BC3_UNORM_SRGB : FORMAT_BC3_UNORM;
+    }
+    return srgb ? FORMAT_BC1_UNORM_SRGB : FORMAT_BC1_UNORM;
+}
+
+Format GfxTextureTranscoder::GetTargetFormat(const void* data, uint64_t size)
+{
+    basist::ktx2_transcoder transcoder;
+    if (!InitKtx2(transcoder, data, size))
+    {
+        return FORMAT_UNKNOWN;
+    }
+
+    TranscodeSource source = transcoder.is_uastc() ? TRANSCODE_SOURCE_UASTC : TRANSCODE_SOURCE_ETC1S;
+    bool srgb = transcoder.get_dfd_transfer_func() == basist::KTX2_KHR_DF_TRANSFER_SRGB;
+    return SelectFormat(source, transcoder.get_has_alpha(), srgb);
+}
+
+bool GfxTextureTranscoder::Transcode(GfxDevice* device, GfxCommandBuffer* cmd, GfxTexture* texture, const void* data, uint64_t size, uint32_t num_threads)
+{
+    basist::transcoder_texture_format target;
+    if (!ToTranscoderFormat(texture->format, target) || texture->depth > 1)
+    {
+        BLAST_LOGE("unsupported transcode target format %d\n", texture->format);
+        return false;
+    }
+
+    // start_transcoding解码ETC1S的全局码本, 之后transcode_image_level可以在多个线程中使用各自的状态并行调用
+    basist::ktx2_transcoder transcoder;
+    if (!InitKtx2(transcoder, data, size) || !transcoder.start_transcoding())
+    {
+        BLAST_LOGE("invalid basis universal ktx2\n");
+        return false;
+    }
+
+    uint32_t num_layers = std::max(transcoder.get_layers(), 1u);
+    uint32_t num_faces = transcoder.get_faces();
+    if (transcoder.get_width() != texture->width || transcoder.get_height() != texture->height ||
+        transcoder.get_levels() != texture->num_levels || num_layers * num_faces != texture->num_layers)
+    {
+        BLAST_LOGE("basis universal ktx2 does not match texture %ux%u\n", texture->width, texture->height);
+        return false;
+    }
+
+    if (num_threads == 0)
+    {
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // 每一级依次存放所有层的所有面
+    uint32_t num_regions = texture->num_levels * texture->num_layers;
+    std::vector<GfxTextureRegion> regions(num_regions);
+    std::vector<void*> dst(num_regions);
+    for (uint32_t i = 0; i < num_regions; ++i)
+    {
+        regions[i].layer = i % texture->num_layers;
+        regions[i].level = i / texture->num_layers;
+    }
+    device->MapTextureRegions(cmd, texture, num_regions, regions.data(), dst.data());
+
+    // zstd超压缩时状态中缓存了解压后的整级数据, 同一级的区域放在一个任务里只解压一次
+    bool zstd = transcoder.get_header().m_supercompression_scheme == basist::KTX2_SS_ZSTANDARD;
+    uint32_t regions_per_task = zstd ? texture->num_layers : 1;
+
+    std::atomic<bool> failed(false);
+    ParallelFor(num_threads, num_regions / regions_per_task, [&](uint32_t task) {
+        basist::ktx2_transcoder_state state;
+        for (uint32_t i = task * regions_per_task; i < (task + 1) * regions_per_task; ++i)
+        {
+            uint32_t level = regions[i].level;
+            uint32_t num_blocks_x = (std::max(texture->width >> level, 1u) + 3) / 4;
+            uint32_t num_blocks_y = (std::max(texture->height >> level, 1u) + 3) / 4;
+            if (!transcoder.transcode_image_level(level, regions[i].layer / num_faces, regions[i].layer % num_faces, dst[i],
+                                                  num_blocks_x * num_blocks_y, target, 0, 0, 0, -1, -1, &state))
+            {
+                failed = true;
+            }
+        }
+    });
+
+    if (failed)
+    {
+        BLAST_LOGE("failed to transcode basis universal ktx2 to format %d\n", texture->format);
+        return false;
+    }
+    return true;
+}
+}// namespace blast
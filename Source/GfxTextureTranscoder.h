@@ -0,0 +1,34 @@
+#pragma once
+#include "GfxDevice.h"
+
+namespace blast
+{
+enum TranscodeSource
+{
+    TRANSCODE_SOURCE_UASTC = 0,
+    // ETC1S with BasisLZ supercompression
+    TRANSCODE_SOURCE_ETC1S = 1,
+};
+
+// Transcode stage between a Basis Universal KTX2 file and the staging memory of its upload,
+// built on the transcoder of the basis_universal submodule (External/basis_universal).
+// UASTC and ETC1S payloads are converted block to block without going through RGBA8,
+// zstd supercompressed UASTC is inflated by the same transcoder
+class GfxTextureTranscoder
+{
+public:
+    // BC7 for UASTC, BC3 or BC1 for ETC1S depending on alpha
+    static Format SelectFormat(TranscodeSource source, bool alpha, bool srgb);
+
+    // Reads the header of a Basis Universal KTX2 file, returns the format SelectFormat picks for it
+    // or FORMAT_UNKNOWN when data is not a valid Basis Universal KTX2 file
+    static Format GetTargetFormat(const void* data, uint64_t size);
+
+    // Transcodes every level, layer and face of a Basis Universal KTX2 file to the format of texture on a persistent
+    // worker pool, the blocks are written straight into the staging memory of the upload recorded into cmd.
+    // Supports BC1, BC3, BC4, BC5 and BC7 (UNORM and SRGB), only 2d and cube textures matching the file.
+    // texture must be in RESOURCE_STATE_COPY_DEST, num_threads 0 uses every hardware thread.
+    // A failing transcode leaves the recorded upload with undefined content
+    static bool Transcode(GfxDevice* device, GfxCommandBuffer* cmd, GfxTexture* texture, const void* data, uint64_t size, uint32_t num_threads = 0);
+};
+}// namespace blast
@@ -47,6 +47,37 @@ private:
     bool is_copy = false;
 };
 
+struct VulkanAllocation
+{
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint8_t* mapped = nullptr;
+    uint32_t memory_type = 0;
+    uint32_t pool = 0;
+    // 独立分配时为-1
+    uint32_t block = -1;
+    uint32_t order = 0;
+    uint32_t category = MEMORY_CATEGORY_BUFFER;
+};
+
+struct VulkanSubresourceRange
+{
+    uint32_t first_slice = 0;
+    uint32_t slice_count = 0;
+    uint32_t first_mip = 0;
+    uint32_t mip_count = 0;
+};
+
+// 描述符更新模板数据块中的一项, 按layout_bindings的顺序紧密排列
+union VulkanDescriptorData
+{
+    VkDescriptorImageInfo image;
+    VkDescriptorBufferInfo buffer;
+    VkBufferView texel_buffer_view;
+    VkAccelerationStructureKHR acceleration_structure;
+};
+
 VkSampleCountFlagBits ToVulkanSampleCount(SampleCount sample_count);
 
 VkFormat ToVulkanFormat(Format format);
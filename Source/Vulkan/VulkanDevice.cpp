@@ -1,9 +1,159 @@
 #include "VulkanDevice.h"
 #include "VulkanResource.h"
+#include "VulkanShaderCompiler.h"
 #include "spirv_reflect.h"
 
 namespace blast
 {
+// 每次dispatch从一个mip生成之后最多4级mip, 8x8线程组通过共享内存逐级归约
+static const char* mip_generation_source = R"(
+#version 450
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+#ifdef IMAGE_ARRAY
+#define IMAGE image2DArray
+#define COORD(p) ivec3(p, int(gl_GlobalInvocationID.z))
+#else
+#define IMAGE image2D
+#define COORD(p) (p)
+#endif
+
+layout(set = 0, binding = 2000, IMAGE_FORMAT) uniform readonly IMAGE src_mip;
+layout(set = 0, binding = 2001, IMAGE_FORMAT) uniform writeonly IMAGE dst_mip1;
+layout(set = 0, binding = 2002, IMAGE_FORMAT) uniform writeonly IMAGE dst_mip2;
+layout(set = 0, binding = 2003, IMAGE_FORMAT) uniform writeonly IMAGE dst_mip3;
+layout(set = 0, binding = 2004, IMAGE_FORMAT) uniform writeonly IMAGE dst_mip4;
+
+layout(push_constant) uniform Params
+{
+    ivec2 src_size;
+    int num_mips;
+} params;
+
+shared vec4 tile[64];
+
+void main()
+{
+    ivec2 dst = ivec2(gl_GlobalInvocationID.xy);
+    uint index = gl_LocalInvocationIndex;
+
+    ivec2 src_max = params.src_size - 1;
+    vec4 color = imageLoad(src_mip, COORD(min(dst * 2, src_max)));
+    color += imageLoad(src_mip, COORD(min(dst * 2 + ivec2(1, 0), src_max)));
+    color += imageLoad(src_mip, COORD(min(dst * 2 + ivec2(0, 1), src_max)));
+    color += imageLoad(src_mip, COORD(min(dst * 2 + ivec2(1, 1), src_max)));
+    color *= 0.25;
+
+    if (all(lessThan(dst, max(params.src_size >> 1, ivec2(1)))))
+    {
+        imageStore(dst_mip1, COORD(dst), color);
+    }
+
+    if (params.num_mips == 1)
+    {
+        return;
+    }
+
+    tile[index] = color;
+    barrier();
+
+    if ((index & 0x9u) == 0u)
+    {
+        color = 0.25 * (color + tile[index + 1u] + tile[index + 8u] + tile[index + 9u]);
+        tile[index] = color;
+        if (all(lessThan(dst >> 1, max(params.src_size >> 2, ivec2(1)))))
+        {
+            imageStore(dst_mip2, COORD(dst >> 1), color);
+        }
+    }
+
+    if (params.num_mips == 2)
+    {
+        return;
+    }
+
+    barrier();
+
+    if ((index & 0x1Bu) == 0u)
+    {
+        color = 0.25 * (color + tile[index + 2u] + tile[index + 16u] + tile[index + 18u]);
+        tile[index] = color;
+        if (all(lessThan(dst >> 2, max(params.src_size >> 3, ivec2(1)))))
+        {
+            imageStore(dst_mip3, COORD(dst >> 2), color);
+        }
+    }
+
+    if (params.num_mips == 3)
+    {
+        return;
+    }
+
+    barrier();
+
+    if (index == 0u)
+    {
+        color = 0.25 * (color + tile[index + 4u] + tile[index + 32u] + tile[index + 36u]);
+        if (all(lessThan(dst >> 3, max(params.src_size >> 4, ivec2(1)))))
+        {
+            imageStore(dst_mip4, COORD(dst >> 3), color);
+        }
+    }
+}
+)";
+
+static const char* ToGlslImageFormat(Format format)
+{
+    switch (format)
+    {
+        case FORMAT_R32G32B32A32_FLOAT:
+            return "rgba32f";
+        case FORMAT_R16G16B16A16_FLOAT:
+            return "rgba16f";
+        case FORMAT_R16G16B16A16_UNORM:
+            return "rgba16";
+        case FORMAT_R16G16B16A16_SNORM:
+            return "rgba16_snorm";
+        case FORMAT_R32G32_FLOAT:
+            return "rg32f";
+        case FORMAT_R10G10B10A2_UNORM:
+            return "rgb10_a2";
+        case FORMAT_R11G11B10_FLOAT:
+            return "r11f_g11f_b10f";
+        case FORMAT_R8G8B8A8_UNORM:
+            return "rgba8";
+        case FORMAT_R8G8B8A8_SNORM:
+            return "rgba8_snorm";
+        case FORMAT_R16G16_FLOAT:
+            return "rg16f";
+        case FORMAT_R16G16_UNORM:
+            return "rg16";
+        case FORMAT_R16G16_SNORM:
+            return "rg16_snorm";
+        case FORMAT_R32_FLOAT:
+            return "r32f";
+        case FORMAT_R8G8_UNORM:
+            return "rg8";
+        case FORMAT_R8G8_SNORM:
+            return "rg8_snorm";
+        case FORMAT_R16_FLOAT:
+            return "r16f";
+        case FORMAT_R16_UNORM:
+            return "r16";
+        case FORMAT_R16_SNORM:
+            return "r16_snorm";
+        case FORMAT_R8_UNORM:
+            return "r8";
+        case FORMAT_R8_SNORM:
+            return "r8_snorm";
+        default:
+            break;
+    }
+
+    // 整数与sRGB格式不做平均
+    return nullptr;
+}
+
 static bool IsLayerSupported(const char* required, const std::vector<VkLayerProperties>& available)
 {
     for (const VkLayerProperties& availableLayer : available)
@@ -74,189 +224,509 @@ VKAPI_ATTR VkBool32 VKAPI_CALL DebugReportCallback(VkDebugReportFlagsEXT flags,
 }
 #endif
 
-void VulkanDevice::StageBuffer::Init(VulkanDevice* device)
+void VulkanDevice::StageBuffer::Init(VulkanDevice* device, bool per_frame)
 {
     this->device = device;
+    this->per_frame = per_frame;
 }
 
-VulkanDevice::StageBuffer::Allocation VulkanDevice::StageBuffer::Allocate(uint32_t data_size)
+bool VulkanDevice::StageBuffer::IsRetired(const Chunk& chunk) const
 {
-    if (device->frame_count != frame_index)
+    if (chunk.retired)
     {
-        offset = 0;
-        frame_index = device->frame_count;
+        return true;
     }
 
-    const uint64_t free_space = size - offset;
-    if (data_size > free_space || buffer == nullptr)
+    // 写入该块的帧的fence已经等待过, 拷贝队列的命令缓存可能跨越多帧, 只能等待Reset
+    return per_frame && chunk.frame_index + BLAST_BUFFER_COUNT <= device->frame_count;
+}
+
+VulkanDevice::StageBuffer::Allocation VulkanDevice::StageBuffer::Allocate(uint64_t data_size, uint64_t alignment)
+{
+    uint64_t offset = 0;
+    if (!chunks.empty())
     {
-        if (buffer)
-        {
-            device->DestroyBuffer(buffer);
-        }
+        offset = AlignTo(chunks[head].offset, alignment);
+    }
 
-        size = AlignTo((size + data_size) * 2, 8);
+    if (chunks.empty() || offset + data_size > chunks[head].buffer->size)
+    {
         offset = 0;
 
-        GfxBufferDesc desc;
-        desc.size = size;
-        desc.mem_usage = MEMORY_USAGE_CPU_TO_GPU;
-        desc.res_usage = RESOURCE_USAGE_RW_BUFFER;
-        buffer = device->CreateBuffer(desc);
+        uint32_t next = chunks.empty() ? 0 : (head + 1) % chunks.size();
+        if (!chunks.empty() && IsRetired(chunks[next]) && chunks[next].buffer->size >= data_size)
+        {
+            head = next;
+        }
+        else
+        {
+            // 环上的下一个块仍在使用中, 在当前块之后插入新块
+            GfxBufferDesc desc;
+            desc.size = AlignTo(data_size, chunk_size);
+            desc.mem_usage = MEMORY_USAGE_CPU_TO_GPU;
+            desc.res_usage = RESOURCE_USAGE_RW_BUFFER;
+
+            Chunk chunk;
+            chunk.buffer = device->CreateBuffer(desc);
+            device->memory_allocator.SetCategory(((VulkanBuffer*)chunk.buffer)->allocation, MEMORY_CATEGORY_STAGING);
+
+            head = chunks.empty() ? 0 : head + 1;
+            chunks.insert(chunks.begin() + head, chunk);
+        }
     }
 
+    Chunk& chunk = chunks[head];
+    chunk.offset = offset + data_size;
+    chunk.frame_index = device->frame_count;
+    chunk.retired = false;
+
     Allocation allocation;
-    allocation.buffer = buffer;
+    allocation.buffer = chunk.buffer;
     allocation.offset = offset;
-
-    offset += AlignTo(data_size, 8);
+    allocation.data = (uint8_t*)chunk.buffer->GetMappedData() + offset;
 
     return allocation;
 }
 
+void VulkanDevice::StageBuffer::Reset()
+{
+    for (auto& chunk : chunks)
+    {
+        chunk.offset = 0;
+        chunk.retired = true;
+    }
+}
+
 void VulkanDevice::StageBuffer::Destroy()
 {
-    if (buffer)
+    for (auto& chunk : chunks)
     {
-        device->DestroyBuffer(buffer);
+        BLAST_SAFE_DELETE(chunk.buffer);
+    }
+    chunks.clear();
+}
+
+// 下标与DescriptorPool中的使用量一致
+static const VkDescriptorType descriptor_pool_types[] = {
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER,
+    VK_DESCRIPTOR_TYPE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+};
+
+static uint32_t GetDescriptorPoolTypeIndex(VkDescriptorType type)
+{
+    for (uint32_t i = 0; i < sizeof(descriptor_pool_types) / sizeof(descriptor_pool_types[0]); ++i)
+    {
+        if (descriptor_pool_types[i] == type)
+        {
+            return i;
+        }
     }
+    assert(0);
+    return 0;
 }
 
 void VulkanDevice::Frame::DescriptorPool::Init(VulkanDevice* device)
 {
     this->device = device;
+}
 
-    // Create descriptor pool:
-    VkDescriptorPoolSize pool_sizes[9] = {};
-    uint32_t count = 0;
+void VulkanDevice::Frame::DescriptorPool::Destroy()
+{
+    if (!descriptor_pools.empty())
+    {
+        device->resource_manager.destroy_locker.lock();
+        for (auto& descriptor_pool : descriptor_pools)
+        {
+            device->resource_manager.destroyer_descriptor_pools.push_back(std::make_pair(descriptor_pool, device->frame_count));
+        }
+        device->resource_manager.destroy_locker.unlock();
+    }
+    descriptor_pools.clear();
+    current = 0;
+    descriptor_count = 0;
+    cached_sets.clear();
+    cached_data.clear();
+}
+
+void VulkanDevice::Frame::DescriptorPool::Reset()
+{
+    // 该帧的fence已经等待, 整条链上的描述符集都不再被GPU使用
+    for (auto& descriptor_pool : descriptor_pools)
+    {
+        VK_ASSERT(vkResetDescriptorPool(device->device, descriptor_pool, 0));
+    }
+    current = 0;
+
+    peak_sets = std::max(peak_sets, frame_sets);
+    frame_sets = 0;
+    for (uint32_t i = 0; i < DESCRIPTOR_TYPE_COUNT; ++i)
+    {
+        peak_descriptors[i] = std::max(peak_descriptors[i], frame_descriptors[i]);
+        frame_descriptors[i] = 0;
+    }
 
-    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    pool_sizes[0].descriptorCount = BLAST_CBV_COUNT * pool_size;
-    count++;
+    cached_sets.clear();
+    cached_data.clear();
+}
 
-    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-    pool_sizes[1].descriptorCount = BLAST_SRV_COUNT * pool_size;
-    count++;
+VkDescriptorSet VulkanDevice::Frame::DescriptorPool::Allocate(VkDescriptorSetLayout layout, const std::vector<VkDescriptorPoolSize>& pool_sizes)
+{
+    frame_sets++;
+    for (auto& x : pool_sizes)
+    {
+        frame_descriptors[GetDescriptorPoolTypeIndex(x.type)] += x.descriptorCount;
+    }
 
-    pool_sizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
-    pool_sizes[2].descriptorCount = BLAST_SRV_COUNT * pool_size;
-    count++;
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &layout;
 
-    pool_sizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    pool_sizes[3].descriptorCount = BLAST_SRV_COUNT * pool_size;
-    count++;
+    VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+    while (current < descriptor_pools.size())
+    {
+        alloc_info.descriptorPool = descriptor_pools[current];
+        VkResult res = vkAllocateDescriptorSets(device->device, &alloc_info, &descriptor_set);
+        if (res == VK_SUCCESS)
+        {
+            return descriptor_set;
+        }
+        assert(res == VK_ERROR_OUT_OF_POOL_MEMORY || res == VK_ERROR_FRAGMENTED_POOL);
+        current++;
+    }
 
-    pool_sizes[4].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-    pool_sizes[4].descriptorCount = BLAST_UAV_COUNT * pool_size;
-    count++;
+    CreatePool(pool_sizes);
+    alloc_info.descriptorPool = descriptor_pools[current];
+    VK_ASSERT(vkAllocateDescriptorSets(device->device, &alloc_info, &descriptor_set));
+    return descriptor_set;
+}
 
-    pool_sizes[5].type = VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
-    pool_sizes[5].descriptorCount = BLAST_UAV_COUNT * pool_size;
-    count++;
+void VulkanDevice::Frame::DescriptorPool::CreatePool(const std::vector<VkDescriptorPoolSize>& pool_sizes)
+{
+    // 峰值减去已使用的数量是本帧剩余的预期需求, 超出峰值后按已使用的数量增长
+    uint32_t max_sets = std::max(pool_size, std::max(peak_sets > frame_sets ? peak_sets - frame_sets : 0, frame_sets));
 
-    pool_sizes[6].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    pool_sizes[6].descriptorCount = BLAST_UAV_COUNT * pool_size;
-    count++;
+    uint32_t required[DESCRIPTOR_TYPE_COUNT] = {};
+    for (auto& x : pool_sizes)
+    {
+        required[GetDescriptorPoolTypeIndex(x.type)] += x.descriptorCount;
+    }
 
-    pool_sizes[7].type = VK_DESCRIPTOR_TYPE_SAMPLER;
-    pool_sizes[7].descriptorCount = BLAST_SAMPLER_COUNT * pool_size;
-    count++;
+    VkDescriptorPoolSize sizes[DESCRIPTOR_TYPE_COUNT] = {};
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < DESCRIPTOR_TYPE_COUNT; ++i)
+    {
+        uint32_t used = frame_descriptors[i];
+        uint32_t expected = std::max(peak_descriptors[i] > used ? peak_descriptors[i] - used : 0, used);
+        // 加速结构只在使用过后才分配, 其余类型每个描述符集至少预留一个
+        if (descriptor_pool_types[i] != VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR)
+        {
+            expected = std::max(expected, max_sets);
+        }
+        expected = std::max(expected, required[i]);
+        if (expected == 0)
+        {
+            continue;
+        }
 
-    pool_sizes[8].type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
-    pool_sizes[8].descriptorCount = BLAST_SRV_COUNT * pool_size;
-    count++;
+        sizes[count].type = descriptor_pool_types[i];
+        sizes[count].descriptorCount = expected;
+        count++;
+    }
 
     VkDescriptorPoolCreateInfo pool_info = {};
     pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     pool_info.poolSizeCount = count;
-    pool_info.pPoolSizes = pool_sizes;
-    pool_info.maxSets = pool_size;
+    pool_info.pPoolSizes = sizes;
+    pool_info.maxSets = max_sets;
+
+    VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
     VK_ASSERT(vkCreateDescriptorPool(device->device, &pool_info, nullptr, &descriptor_pool));
+    current = (uint32_t)descriptor_pools.size();
+    descriptor_pools.push_back(descriptor_pool);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        descriptor_count += sizes[i].descriptorCount;
+    }
 }
 
-void VulkanDevice::Frame::DescriptorPool::Destroy()
+void VulkanDevice::ReadbackRing::Init(VulkanDevice* device)
 {
-    if (descriptor_pool != VK_NULL_HANDLE)
+    this->device = device;
+}
+
+void VulkanDevice::ReadbackRing::Destroy()
+{
+    for (auto& chunk : chunks)
     {
-        device->resource_manager.destroy_locker.lock();
-        device->resource_manager.destroyer_descriptor_pools.push_back(std::make_pair(descriptor_pool, device->frame_count));
-        descriptor_pool = VK_NULL_HANDLE;
-        device->resource_manager.destroy_locker.unlock();
+        BLAST_SAFE_DELETE(chunk.buffer);
     }
+    chunks.clear();
+    head = -1;
 }
-void VulkanDevice::Frame::DescriptorPool::Reset()
+
+VulkanBuffer* VulkanDevice::ReadbackRing::Allocate(uint64_t size, uint64_t alignment, uint32_t& chunk_index, uint64_t& offset)
 {
-    if (descriptor_pool != VK_NULL_HANDLE)
+    locker.lock();
+    if (head != (uint32_t)-1)
     {
-        VK_ASSERT(vkResetDescriptorPool(device->device, descriptor_pool, 0));
+        offset = AlignTo(chunks[head].offset, alignment);
+    }
+
+    if (head == (uint32_t)-1 || offset + size > chunks[head].buffer->size)
+    {
+        offset = 0;
+        head = -1;
+        for (uint32_t i = 0; i < chunks.size(); ++i)
+        {
+            Chunk& chunk = chunks[i];
+            if (chunk.refs == 0 && chunk.frame_index + BLAST_BUFFER_COUNT <= device->frame_count && chunk.buffer->size >= size)
+            {
+                chunk.offset = 0;
+                head = i;
+                break;
+            }
+        }
+
+        if (head == (uint32_t)-1)
+        {
+            GfxBufferDesc desc;
+            desc.size = AlignTo(size, chunk_size);
+            desc.mem_usage = MEMORY_USAGE_GPU_TO_CPU;
+            desc.res_usage = RESOURCE_USAGE_RW_BUFFER;
+
+            Chunk chunk;
+            chunk.buffer = (VulkanBuffer*)device->CreateBuffer(desc);
+            head = chunks.size();
+            chunks.push_back(chunk);
+        }
+    }
+
+    Chunk& chunk = chunks[head];
+    chunk.offset = offset + size;
+    chunk.frame_index = device->frame_count;
+    chunk.refs++;
+    chunk_index = head;
+    VulkanBuffer* buffer = chunk.buffer;
+    locker.unlock();
+    return buffer;
+}
+
+void VulkanDevice::ReadbackRing::Release(uint32_t chunk)
+{
+    locker.lock();
+    chunks[chunk].refs--;
+    locker.unlock();
+}
+
+void VulkanDevice::Frame::TransientAllocator::Init(VulkanDevice* device)
+{
+    this->device = device;
+}
+
+void VulkanDevice::Frame::TransientAllocator::Destroy()
+{
+    for (auto& buffer : buffers)
+    {
+        BLAST_SAFE_DELETE(buffer);
+    }
+    buffers.clear();
+}
+
+void VulkanDevice::Frame::TransientAllocator::Reset()
+{
+    current = 0;
+    offset = 0;
+}
+
+GfxTransientAllocation VulkanDevice::Frame::TransientAllocator::Allocate(uint64_t size, uint64_t alignment)
+{
+    offset = AlignTo(offset, alignment);
+    while (current < buffers.size() && offset + size > buffers[current]->size)
+    {
+        current++;
+        offset = 0;
+    }
+
+    if (current == buffers.size())
+    {
+        GfxBufferDesc desc;
+        desc.size = AlignTo(size, block_size);
+        desc.mem_usage = MEMORY_USAGE_CPU_TO_GPU;
+        desc.res_usage = RESOURCE_USAGE_UNIFORM_BUFFER | RESOURCE_USAGE_VERTEX_BUFFER | RESOURCE_USAGE_INDEX_BUFFER | RESOURCE_USAGE_INDIRECT_BUFFER | RESOURCE_USAGE_RW_BUFFER;
+        buffers.push_back(device->CreateBuffer(desc));
     }
+
+    GfxTransientAllocation allocation;
+    allocation.buffer = buffers[current];
+    allocation.offset = offset;
+    allocation.data = (uint8_t*)buffers[current]->GetMappedData() + offset;
+
+    offset += size;
+    return allocation;
 }
 
 void VulkanDevice::DescriptorBinder::Init(VulkanDevice* device)
 {
     this->device = device;
-    descriptor_writes.reserve(128);
-    buffer_infos.reserve(128);
-    image_infos.reserve(128);
-    texel_buffer_views.reserve(128);
-    acceleration_structure_views.reserve(128);
+    descriptor_data.reserve(128);
+    dynamic_offsets.reserve(BLAST_CBV_COUNT);
 }
 
 void VulkanDevice::DescriptorBinder::Reset()
 {
     table = {};
-    dirty = true;
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        for (uint32_t j = 0; j < BLAST_BINDING_SET_COUNT; ++j)
+        {
+            descriptor_sets[i][j] = VK_NULL_HANDLE;
+        }
+        bound_layouts[i] = nullptr;
+        bindless_layouts[i] = VK_NULL_HANDLE;
+        dirty_slots[i] = {};
+    }
 }
 
-void VulkanDevice::DescriptorBinder::Flush(bool graphics, uint32_t cmd)
+void VulkanDevice::DescriptorBinder::Invalidate()
 {
-    if (!dirty)
-        return;
-    dirty = false;
-
-    auto& binder_pool = device->GetFrameResources().descriptor_pools[cmd];
-    auto internal_pso = graphics ? (VulkanPipeline*)device->active_pipeline[cmd] : nullptr;
-    auto internal_cs = graphics ? nullptr : (VulkanShader*)device->active_cs[cmd];
+    for (auto& slots : dirty_slots)
+    {
+        slots.cbv = ~0u;
+        slots.srv = ~0ull;
+        slots.uav = ~0u;
+        slots.sampler = ~0u;
+    }
+}
 
-    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
-    VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
+void VulkanDevice::DescriptorBinder::Flush(bool graphics, uint32_t cmd)
+{
+    uint32_t bind_index = graphics ? 0 : 1;
+    VkDescriptorSet* sets = descriptor_sets[bind_index];
+    VulkanPipelineLayout* layout = nullptr;
+    VkPipelineBindPoint bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS;
     if (graphics)
     {
-        pipeline_layout = internal_pso->pipeline_layout;
-        descriptor_set_layout = internal_pso->descriptor_set_layout;
+        layout = ((VulkanPipeline*)device->active_pipeline[cmd])->layout;
     }
     else
     {
-        pipeline_layout = internal_cs->pipeline_layout_cs;
-        descriptor_set_layout = internal_cs->descriptor_set_layout;
+        layout = ((VulkanShader*)device->active_cs[cmd])->layout;
+        bind_point = VK_PIPELINE_BIND_POINT_COMPUTE;
+        if (device->active_cs[cmd]->stage == SHADER_STAGE_RAYTRACING)
+        {
+            bind_point = VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR;
+        }
     }
 
-    VkDescriptorSetAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info.descriptorPool = binder_pool.descriptor_pool;
-    alloc_info.descriptorSetCount = 1;
-    alloc_info.pSetLayouts = &descriptor_set_layout;
+    // write_sets需要重新写入描述符, bind_sets只需要用新的动态偏移重新绑定
+    uint32_t write_sets = 0;
+    uint32_t bind_sets = 0;
+    DirtySlots& slots = dirty_slots[bind_index];
+    if (bound_layouts[bind_index] != layout)
+    {
+        bound_layouts[bind_index] = layout;
+        write_sets = layout->used_sets;
+    }
+    else
+    {
+        for (uint32_t i = 0; i < layout->set_count; ++i)
+        {
+            const auto& set = layout->sets[i];
+            // 超出动态常量缓存上限的CBV在偏移变化时也需要重写描述符
+            uint32_t cbv_mask = set.cbv_mask & (slots.cbv | (slots.cbv_offset & ~set.dynamic_cbv_mask));
+            if (cbv_mask || (set.srv_mask & slots.srv) || (set.uav_mask & slots.uav) || (set.sampler_mask & slots.sampler))
+            {
+                write_sets |= 1u << i;
+            }
+            else if (set.dynamic_cbv_mask & slots.cbv_offset)
+            {
+                bind_sets |= 1u << i;
+            }
+        }
+    }
+    slots = {};
 
-    VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
-    VkResult res = vkAllocateDescriptorSets(device->device, &alloc_info, &descriptor_set);
-    while (res == VK_ERROR_OUT_OF_POOL_MEMORY)
+    VkPipelineLayout pipeline_layout = layout->pipeline_layout;
+    for (uint32_t i = 0; i < layout->set_count; ++i)
+    {
+        if ((write_sets & (1u << i)) == 0)
+        {
+            continue;
+        }
+
+        WriteDescriptorData(layout, i);
+
+        // 直接记录到命令缓存, 不经过描述符池和缓存
+        if ((int32_t)i == layout->push_set)
+        {
+            pushes++;
+            sets[i] = VK_NULL_HANDLE;
+            vkCmdPushDescriptorSetWithTemplateKHR(device->GetCommandBuffer(cmd), layout->sets[i].descriptor_update_template, pipeline_layout, i, descriptor_data.data());
+            continue;
+        }
+
+        sets[i] = AcquireDescriptorSet(cmd, layout, i);
+        bind_sets |= 1u << i;
+    }
+
+    // 布局兼容时其余set保持有效, 只从第一个变化的set开始绑定, 连续的set合并为一次调用
+    uint32_t i = 0;
+    while (bind_sets >> i)
     {
-        binder_pool.pool_size *= 2;
-        binder_pool.Destroy();
-        binder_pool.Init(device);
-        alloc_info.descriptorPool = binder_pool.descriptor_pool;
-        res = vkAllocateDescriptorSets(device->device, &alloc_info, &descriptor_set);
+        if ((bind_sets & (1u << i)) == 0)
+        {
+            i++;
+            continue;
+        }
+
+        // 动态偏移的顺序与各set的layout_bindings一致
+        uint32_t first = i;
+        dynamic_offsets.clear();
+        while (bind_sets & (1u << i))
+        {
+            for (auto& x : layout->sets[i].layout_bindings)
+            {
+                if (x.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC)
+                {
+                    for (uint32_t descriptor_index = 0; descriptor_index < x.descriptorCount; ++descriptor_index)
+                    {
+                        uint32_t original_binding = x.binding + descriptor_index - VULKAN_BINDING_SHIFT_B;
+                        dynamic_offsets.push_back((uint32_t)table.cbv_offset[original_binding]);
+                    }
+                }
+            }
+            i++;
+        }
+
+        vkCmdBindDescriptorSets(
+            device->GetCommandBuffer(cmd),
+            bind_point,
+            pipeline_layout,
+            first,
+            i - first,
+            &sets[first],
+            (uint32_t)dynamic_offsets.size(),
+            dynamic_offsets.data());
     }
-    assert(res == VK_SUCCESS);
 
-    descriptor_writes.clear();
-    buffer_infos.clear();
-    image_infos.clear();
-    texel_buffer_views.clear();
-    acceleration_structure_views.clear();
+    BindBindlessSets(graphics, cmd, pipeline_layout, bind_point);
+}
+
+void VulkanDevice::DescriptorBinder::WriteDescriptorData(const VulkanPipelineLayout* layout, uint32_t set)
+{
+    const auto& layout_bindings = layout->sets[set].layout_bindings;
+    const auto& image_view_types = layout->sets[set].image_view_types;
 
-    const auto& layout_bindings = graphics ? internal_pso->layout_bindings : internal_cs->layout_bindings;
-    const auto& image_view_types = graphics ? internal_pso->image_view_types : internal_cs->image_view_types;
+    // 每项先清零以便直接比较内容
+    descriptor_data.clear();
 
     uint32_t i = 0;
     for (auto& x : layout_bindings)
@@ -273,39 +743,25 @@ void VulkanDevice::DescriptorBinder::Flush(bool graphics, uint32_t cmd)
         {
             uint32_t unrolled_binding = x.binding + descriptor_index;
 
-            descriptor_writes.emplace_back();
-            auto& write = descriptor_writes.back();
-            write = {};
-            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write.dstSet = descriptor_set;
-            write.dstArrayElement = descriptor_index;
-            write.descriptorType = x.descriptorType;
-            write.dstBinding = x.binding;
-            write.descriptorCount = 1;
+            descriptor_data.emplace_back();
+            auto& data = descriptor_data.back();
+            memset(&data, 0, sizeof(data));
 
             switch (x.descriptorType)
             {
                 case VK_DESCRIPTOR_TYPE_SAMPLER:
                 {
-                    image_infos.emplace_back();
-                    write.pImageInfo = &image_infos.back();
-                    image_infos.back() = {};
-
                     const uint32_t original_binding = unrolled_binding - VULKAN_BINDING_SHIFT_S;
                     const GfxSampler* sampler = table.sam[original_binding];
                     if (sampler != nullptr)
                     {
-                        image_infos.back().sampler = ((VulkanSampler*)sampler)->sampler;
+                        data.image.sampler = ((VulkanSampler*)sampler)->sampler;
                     }
                 }
                 break;
 
                 case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
                 {
-                    image_infos.emplace_back();
-                    write.pImageInfo = &image_infos.back();
-                    image_infos.back() = {};
-
                     uint32_t original_binding = unrolled_binding - VULKAN_BINDING_SHIFT_T;
                     GfxResource* resource = table.srv[original_binding];
                     if (resource != nullptr)
@@ -314,24 +770,21 @@ void VulkanDevice::DescriptorBinder::Flush(bool graphics, uint32_t cmd)
                         VulkanTexture* internal_texture = (VulkanTexture*)resource;
                         if (subresource >= 0)
                         {
-                            image_infos.back().imageView = internal_texture->subresources_srv[subresource];
+                            data.image.imageView = internal_texture->subresources_srv[subresource];
                         }
                         else
                         {
-                            image_infos.back().imageView = internal_texture->srv;
+                            data.image.imageView = internal_texture->srv;
                         }
 
-                        image_infos.back().imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                        data.image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
                     }
                 }
                 break;
 
                 case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
                 {
-                    image_infos.emplace_back();
-                    write.pImageInfo = &image_infos.back();
-                    image_infos.back() = {};
-                    image_infos.back().imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                    data.image.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
                     uint32_t original_binding = unrolled_binding - VULKAN_BINDING_SHIFT_U;
                     GfxResource* resource = table.uav[original_binding];
@@ -341,43 +794,58 @@ void VulkanDevice::DescriptorBinder::Flush(bool graphics, uint32_t cmd)
                         VulkanTexture* internal_texture = (VulkanTexture*)resource;
                         if (subresource >= 0)
                         {
-                            image_infos.back().imageView = internal_texture->subresources_uav[subresource];
+                            data.image.imageView = internal_texture->subresources_uav[subresource];
                         }
                         else
                         {
-                            image_infos.back().imageView = internal_texture->uav;
+                            data.image.imageView = internal_texture->uav;
                         }
                     }
                 }
                 break;
 
-                case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+                case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
                 {
-                    buffer_infos.emplace_back();
-                    write.pBufferInfo = &buffer_infos.back();
-                    buffer_infos.back() = {};
-
-                    uint32_t original_binding = unrolled_binding - VULKAN_BINDING_SHIFT_B;
-                    GfxBuffer* buffer = table.cbv[original_binding];
-                    uint64_t offset = table.cbv_offset[original_binding];
+                    uint32_t original_binding = unrolled_binding - VULKAN_BINDING_SHIFT_T;
+                    GfxResource* resource = table.srv[original_binding];
+                    if (resource != nullptr)
+                    {
+                        data.texel_buffer_view = ((VulkanBuffer*)resource)->srv;
+                    }
+                }
+                break;
+
+                case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+                {
+                    uint32_t original_binding = unrolled_binding - VULKAN_BINDING_SHIFT_U;
+                    GfxResource* resource = table.uav[original_binding];
+                    if (resource != nullptr)
+                    {
+                        data.texel_buffer_view = ((VulkanBuffer*)resource)->uav;
+                    }
+                }
+                break;
+
+                case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+                case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+                {
+                    uint32_t original_binding = unrolled_binding - VULKAN_BINDING_SHIFT_B;
+                    GfxBuffer* buffer = table.cbv[original_binding];
+                    uint64_t offset = table.cbv_offset[original_binding];
                     uint64_t size = table.cbv_size[original_binding];
 
                     if (buffer != nullptr)
                     {
                         VulkanBuffer* internal_buffer = (VulkanBuffer*)buffer;
-                        buffer_infos.back().buffer = internal_buffer->resource;
-                        buffer_infos.back().offset = offset;
-                        buffer_infos.back().range = size;
+                        data.buffer.buffer = internal_buffer->resource;
+                        data.buffer.offset = x.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ? 0 : offset;
+                        data.buffer.range = size;
                     }
                 }
                 break;
 
                 case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
                 {
-                    buffer_infos.emplace_back();
-                    write.pBufferInfo = &buffer_infos.back();
-                    buffer_infos.back() = {};
-
                     if (x.binding < VULKAN_BINDING_SHIFT_U)
                     {
                         // SRV
@@ -385,10 +853,9 @@ void VulkanDevice::DescriptorBinder::Flush(bool graphics, uint32_t cmd)
                         GfxResource* resource = table.srv[original_binding];
                         if (resource != nullptr)
                         {
-                            int32_t subresource = table.srv_index[original_binding];
                             VulkanBuffer* internal_buffer = (VulkanBuffer*)resource;
-                            buffer_infos.back().buffer = internal_buffer->resource;
-                            buffer_infos.back().range = VK_WHOLE_SIZE;
+                            data.buffer.buffer = internal_buffer->resource;
+                            data.buffer.range = VK_WHOLE_SIZE;
                         }
                     }
                     else
@@ -398,10 +865,9 @@ void VulkanDevice::DescriptorBinder::Flush(bool graphics, uint32_t cmd)
                         GfxResource* resource = table.uav[original_binding];
                         if (resource != nullptr)
                         {
-                            int32_t subresource = table.uav_index[original_binding];
                             VulkanBuffer* internal_buffer = (VulkanBuffer*)resource;
-                            buffer_infos.back().buffer = internal_buffer->resource;
-                            buffer_infos.back().range = VK_WHOLE_SIZE;
+                            data.buffer.buffer = internal_buffer->resource;
+                            data.buffer.range = VK_WHOLE_SIZE;
                         }
                     }
                 }
@@ -409,12 +875,6 @@ void VulkanDevice::DescriptorBinder::Flush(bool graphics, uint32_t cmd)
 
                 case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
                 {
-                    acceleration_structure_views.emplace_back();
-                    write.pNext = &acceleration_structure_views.back();
-                    acceleration_structure_views.back() = {};
-                    acceleration_structure_views.back().sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
-                    acceleration_structure_views.back().accelerationStructureCount = 1;
-
                     uint32_t original_binding = unrolled_binding - VULKAN_BINDING_SHIFT_T;
                     GfxResource* resource = table.srv[original_binding];
                     if (resource != nullptr)
@@ -426,36 +886,209 @@ void VulkanDevice::DescriptorBinder::Flush(bool graphics, uint32_t cmd)
             }
         }
     }
+}
 
-    vkUpdateDescriptorSets(
-        device->device,
-        (uint32_t)descriptor_writes.size(),
-        descriptor_writes.data(),
-        0,
-        nullptr);
+VkDescriptorSet VulkanDevice::DescriptorBinder::AcquireDescriptorSet(uint32_t cmd, const VulkanPipelineLayout* layout, uint32_t set)
+{
+    auto& binder_pool = device->GetFrameResources().descriptor_pools[cmd];
+    VkDescriptorSetLayout descriptor_set_layout = layout->sets[set].descriptor_set_layout;
 
-    VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    if (!graphics)
+    // 缓存键使用实际写入的Vulkan句柄, 碎片整理重建视图后不会命中旧的描述符集
+    size_t hash = 0;
+    hash_combine(hash, descriptor_set_layout);
+    const uint64_t* words = (const uint64_t*)descriptor_data.data();
+    const size_t word_count = descriptor_data.size() * sizeof(VulkanDescriptorData) / sizeof(uint64_t);
+    for (size_t j = 0; j < word_count; ++j)
     {
-        bindPoint = VK_PIPELINE_BIND_POINT_COMPUTE;
+        hash_combine(hash, words[j]);
+    }
 
-        if (device->active_cs[cmd]->stage == SHADER_STAGE_RAYTRACING)
+    auto range = binder_pool.cached_sets.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        const auto& cached = it->second;
+        if (cached.layout == descriptor_set_layout && cached.data_count == descriptor_data.size() &&
+            (descriptor_data.empty() || memcmp(binder_pool.cached_data.data() + cached.data_offset, descriptor_data.data(), descriptor_data.size() * sizeof(VulkanDescriptorData)) == 0))
         {
-            bindPoint = VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR;
+            cache_hits++;
+            return cached.descriptor_set;
         }
     }
 
+    cache_misses++;
+    allocations++;
+
+    size_t pool_count = binder_pool.descriptor_pools.size();
+    VkDescriptorSet descriptor_set = binder_pool.Allocate(descriptor_set_layout, layout->sets[set].pool_sizes);
+    pool_creations += binder_pool.descriptor_pools.size() - pool_count;
+
+    if (layout->sets[set].descriptor_update_template != VK_NULL_HANDLE)
+    {
+        vkUpdateDescriptorSetWithTemplate(device->device, descriptor_set, layout->sets[set].descriptor_update_template, descriptor_data.data());
+    }
+
+    Frame::DescriptorPool::CachedSet cached;
+    cached.layout = descriptor_set_layout;
+    cached.data_offset = (uint32_t)binder_pool.cached_data.size();
+    cached.data_count = (uint32_t)descriptor_data.size();
+    cached.descriptor_set = descriptor_set;
+    binder_pool.cached_data.insert(binder_pool.cached_data.end(), descriptor_data.begin(), descriptor_data.end());
+    binder_pool.cached_sets.emplace(hash, cached);
+    return descriptor_set;
+}
+
+void VulkanDevice::DescriptorBinder::BindBindlessSets(bool graphics, uint32_t cmd, VkPipelineLayout pipeline_layout, VkPipelineBindPoint bind_point)
+{
+    // 不兼容的低位set会使之后的描述符集失效, 所以在绑定表的set之后绑定
+    VkPipelineLayout& bindless_layout = bindless_layouts[graphics ? 0 : 1];
+    if (!device->bindless_supported || bindless_layout == pipeline_layout)
+    {
+        return;
+    }
+
+    bindless_layout = pipeline_layout;
+    VkDescriptorSet bindless_sets[BINDLESS_HEAP_COUNT];
+    for (uint32_t i = 0; i < BINDLESS_HEAP_COUNT; ++i)
+    {
+        bindless_sets[i] = device->bindless_heaps[i].descriptor_set;
+    }
     vkCmdBindDescriptorSets(
         device->GetCommandBuffer(cmd),
-        bindPoint,
+        bind_point,
         pipeline_layout,
-        0,
-        1,
-        &descriptor_set,
+        BLAST_BINDLESS_TEXTURE_SET,
+        BINDLESS_HEAP_COUNT,
+        bindless_sets,
         0,
         nullptr);
 }
 
+void VulkanDevice::BindlessHeap::Init(VulkanDevice* device, VkDescriptorType type, uint32_t capacity)
+{
+    this->device = device;
+    this->type = type;
+    this->capacity = capacity;
+
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = type;
+    binding.descriptorCount = capacity;
+    binding.stageFlags = VK_SHADER_STAGE_ALL;
+
+    // 着色器只访问已经写入的下标, 其余下标可以在命令缓存执行期间更新
+    VkDescriptorBindingFlags binding_flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bfci = {};
+    bfci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bfci.bindingCount = 1;
+    bfci.pBindingFlags = &binding_flags;
+
+    VkDescriptorSetLayoutCreateInfo dslci = {};
+    dslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    dslci.pNext = &bfci;
+    dslci.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    dslci.bindingCount = 1;
+    dslci.pBindings = &binding;
+    VK_ASSERT(vkCreateDescriptorSetLayout(device->device, &dslci, nullptr, &descriptor_set_layout));
+
+    VkDescriptorPoolSize pool_size = {};
+    pool_size.type = type;
+    pool_size.descriptorCount = capacity;
+
+    VkDescriptorPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    pool_info.maxSets = 1;
+    VK_ASSERT(vkCreateDescriptorPool(device->device, &pool_info, nullptr, &descriptor_pool));
+
+    VkDescriptorSetAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &descriptor_set_layout;
+    VK_ASSERT(vkAllocateDescriptorSets(device->device, &alloc_info, &descriptor_set));
+}
+
+void VulkanDevice::BindlessHeap::Destroy()
+{
+    if (descriptor_pool != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorPool(device->device, descriptor_pool, nullptr);
+        descriptor_pool = VK_NULL_HANDLE;
+        descriptor_set = VK_NULL_HANDLE;
+    }
+    if (descriptor_set_layout != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorSetLayout(device->device, descriptor_set_layout, nullptr);
+        descriptor_set_layout = VK_NULL_HANDLE;
+    }
+    free_indices.clear();
+    pending_frees.clear();
+    next_index = 0;
+}
+
+int32_t VulkanDevice::BindlessHeap::Allocate()
+{
+    std::lock_guard<std::mutex> lock(locker);
+    if (!free_indices.empty())
+    {
+        int32_t index = free_indices.back();
+        free_indices.pop_back();
+        return index;
+    }
+
+    if (next_index >= (int32_t)capacity)
+    {
+        return -1;
+    }
+    return next_index++;
+}
+
+void VulkanDevice::BindlessHeap::Free(int32_t index, uint64_t frame)
+{
+    if (index < 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(locker);
+    pending_frees.push_back(std::make_pair(index, frame));
+}
+
+void VulkanDevice::BindlessHeap::Write(int32_t index, const VulkanDescriptorData& data)
+{
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = descriptor_set;
+    write.dstBinding = 0;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = type;
+    if (type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+    {
+        write.pBufferInfo = &data.buffer;
+    }
+    else
+    {
+        write.pImageInfo = &data.image;
+    }
+
+    // 同一个描述符集的更新需要外部同步
+    std::lock_guard<std::mutex> lock(locker);
+    vkUpdateDescriptorSets(device->device, 1, &write, 0, nullptr);
+}
+
+void VulkanDevice::BindlessHeap::Update(uint64_t current_frame_count, uint32_t buffer_count)
+{
+    std::lock_guard<std::mutex> lock(locker);
+    while (!pending_frees.empty() && pending_frees.front().second + buffer_count < current_frame_count)
+    {
+        free_indices.push_back(pending_frees.front().first);
+        pending_frees.pop_front();
+    }
+}
+
 void VulkanDevice::Queue::Submit(VkFence fence)
 {
     VkSubmitInfo submit_info = {};
@@ -546,7 +1179,7 @@ uint32_t VulkanDevice::CopyCommandBufferPool::Allocate()
         cmd.id = next_id++;
 
         cmd.stage_buffer = new StageBuffer();
-        cmd.stage_buffer->Init(device);
+        cmd.stage_buffer->Init(device, false);
 
         VkCommandPoolCreateInfo pool_info = {};
         pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -569,6 +1202,9 @@ uint32_t VulkanDevice::CopyCommandBufferPool::Allocate()
     freelist.pop_back();
     submitlist.push_back(cmd);
 
+    // 回到freelist的命令缓存已经执行完毕
+    cmd.stage_buffer->Reset();
+
     vkResetCommandPool(device->device, cmd.command_pool, 0);
 
     VkCommandBufferBeginInfo begin_info = {};
@@ -614,7 +1250,9 @@ uint64_t VulkanDevice::CopyCommandBufferPool::Submit()
 
         submit_info.pNext = &timeline_info;
 
+        device->copy_queue_locker.lock();
         VK_ASSERT(vkQueueSubmit(device->copy_queue, 1, &submit_info, VK_NULL_HANDLE));
+        device->copy_queue_locker.unlock();
     }
 
     uint64_t completed_fence_value;
@@ -633,2644 +1271,5440 @@ uint64_t VulkanDevice::CopyCommandBufferPool::Submit()
     return submit_wait;
 }
 
-void VulkanDevice::ResourceManager::Update(uint64_t current_frame_count, uint32_t buffer_count)
+void VulkanDevice::StreamingService::Init(VulkanDevice* device)
+{
+    this->device = device;
+
+    VkSemaphoreTypeCreateInfo timeline_info = {};
+    timeline_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timeline_info.pNext = nullptr;
+    timeline_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timeline_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_info = {};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &timeline_info;
+    semaphore_info.flags = 0;
+
+    VK_ASSERT(vkCreateSemaphore(device->device, &semaphore_info, nullptr, &semaphore));
+
+    running = true;
+    thread = std::thread(&StreamingService::Run, this);
+}
+
+void VulkanDevice::StreamingService::Destroy()
 {
-    destroy_locker.lock();
-    frame_count = current_frame_count;
-    while (!destroyer_images.empty())
     {
-        if (destroyer_images.front().second + buffer_count < frame_count)
-        {
-            auto item = destroyer_images.front();
-            destroyer_images.pop_front();
-            vkDestroyImage(device, item.first.first, nullptr);
-            vkFreeMemory(device, item.first.second, nullptr);
-        }
-        else
-        {
-            break;
-        }
+        std::lock_guard<std::mutex> lock(locker);
+        running = false;
     }
-    while (!destroyer_imageviews.empty())
+    condition.notify_all();
+    thread.join();
+
+    // 未提交的请求直接丢弃
+    device->copy_queue_locker.lock();
+    vkQueueWaitIdle(device->copy_queue);
+    device->copy_queue_locker.unlock();
+
+    worklist.insert(worklist.end(), freelist.begin(), freelist.end());
+    for (auto& batch : worklist)
     {
-        if (destroyer_imageviews.front().second + buffer_count < frame_count)
-        {
-            auto item = destroyer_imageviews.front();
-            destroyer_imageviews.pop_front();
-            vkDestroyImageView(device, item.first, nullptr);
-        }
-        else
-        {
-            break;
-        }
+        batch->stage_buffer->Destroy();
+        BLAST_SAFE_DELETE(batch->stage_buffer);
+        vkDestroyCommandPool(device->device, batch->command_pool, nullptr);
+        BLAST_SAFE_DELETE(batch);
     }
-    while (!destroyer_buffers.empty())
+    freelist.clear();
+    worklist.clear();
+    vkDestroySemaphore(device->device, semaphore, nullptr);
+}
+
+uint64_t VulkanDevice::StreamingService::Enqueue(const GfxStreamRequest& request)
+{
+    Request internal_request;
+    internal_request.desc = request;
+    if (request.buffer)
     {
-        if (destroyer_buffers.front().second + buffer_count < frame_count)
+        if (internal_request.desc.size == 0)
         {
-            auto item = destroyer_buffers.front();
-            destroyer_buffers.pop_front();
-            vkDestroyBuffer(device, item.first.first, nullptr);
-            vkFreeMemory(device, item.first.second, nullptr);
+            internal_request.desc.size = request.buffer->size - request.buffer_offset;
         }
-        else
+
+        if (request.buffer_offset + internal_request.desc.size > request.buffer->size)
         {
-            break;
+            BLAST_LOGE("stream upload of %llu bytes at offset %llu exceeds the buffer size\n", (unsigned long long)internal_request.desc.size, (unsigned long long)request.buffer_offset);
+            return 0;
         }
     }
-    while (!destroyer_bufferviews.empty())
+    else
     {
-        if (destroyer_bufferviews.front().second + buffer_count < frame_count)
+        // 纹理总是拷贝整个子资源, 数据大小必须与之一致
+        GfxTexture* texture = request.texture;
+        uint64_t subresource_size = GetSubresourceSize(texture->format, std::max(texture->width >> request.level, 1u), std::max(texture->height >> request.level, 1u), std::max(texture->depth >> request.level, 1u));
+        if (request.level >= texture->num_levels || request.layer >= texture->num_layers || (internal_request.desc.size != 0 && internal_request.desc.size != subresource_size))
         {
-            auto item = destroyer_bufferviews.front();
-            destroyer_bufferviews.pop_front();
-            vkDestroyBufferView(device, item.first, nullptr);
-        }
-        else
-        {
-            break;
+            BLAST_LOGE("stream upload of %llu bytes does not match level %u layer %u of the texture\n", (unsigned long long)internal_request.desc.size, request.level, request.layer);
+            return 0;
         }
+        internal_request.desc.size = subresource_size;
     }
-    while (!destroyer_bvhs.empty())
+
+    // 流式上传的目标可能在多帧内被copy_queue写入, 不参与碎片整理
+    device->resource_manager.destroy_locker.lock();
+    if (request.buffer)
     {
-        if (destroyer_bvhs.front().second + buffer_count < frame_count)
-        {
-            auto item = destroyer_bvhs.front();
-            destroyer_bvhs.pop_front();
-            vkDestroyAccelerationStructureKHR(device, item.first, nullptr);
-        }
-        else
-        {
-            break;
-        }
+        device->movable_resources.buffers.erase((VulkanBuffer*)request.buffer);
     }
-    while (!destroyer_samplers.empty())
+    else
     {
-        if (destroyer_samplers.front().second + buffer_count < frame_count)
-        {
-            auto item = destroyer_samplers.front();
-            destroyer_samplers.pop_front();
-            vkDestroySampler(device, item.first, nullptr);
-        }
-        else
+        device->movable_resources.textures.erase((VulkanTexture*)request.texture);
+    }
+    device->resource_manager.destroy_locker.unlock();
+
+    // 上传提交之前就让绑定它的命令缓存记录下来
+    {
+        std::lock_guard<std::mutex> lock(device->acquire_locker);
+        GfxResource* target = request.buffer ? (GfxResource*)request.buffer : (GfxResource*)request.texture;
+        device->CheckCopyQueueWrite(target);
+        device->pending_acquires[target].stream_requests++;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(locker);
+        internal_request.ticket = next_ticket++;
+        tickets[internal_request.ticket] = 0;
+        requests[request.priority].push_back(internal_request);
+
+        // 状态只在调用线程上修改, 使用该纹理的命令缓存会等待上传完成, 因此可以提前设置为上传后的状态
+        VulkanTexture* internal_texture = (VulkanTexture*)request.texture;
+        if (internal_texture && internal_texture->res_state != RESOURCE_STATE_SHADER_RESOURCE)
         {
-            break;
+            initial_states.emplace(internal_texture, internal_texture->res_state);
+            internal_texture->res_state = RESOURCE_STATE_SHADER_RESOURCE;
         }
     }
-    while (!destroyer_descriptor_pools.empty())
+    condition.notify_all();
+    return internal_request.ticket;
+}
+
+bool VulkanDevice::StreamingService::IsResident(uint64_t ticket)
+{
+    uint64_t value = 0;
     {
-        if (destroyer_descriptor_pools.front().second + buffer_count < frame_count)
+        std::lock_guard<std::mutex> lock(locker);
+        auto it = tickets.find(ticket);
+        if (it == tickets.end())
         {
-            auto item = destroyer_descriptor_pools.front();
-            destroyer_descriptor_pools.pop_front();
-            vkDestroyDescriptorPool(device, item.first, nullptr);
+            return true;
         }
-        else
+        value = it->second;
+    }
+
+    if (value == 0)
+    {
+        return false;
+    }
+
+    uint64_t completed_value;
+    VK_ASSERT(vkGetSemaphoreCounterValue(device->device, semaphore, &completed_value));
+    return value <= completed_value;
+}
+
+uint64_t VulkanDevice::StreamingService::Require(uint64_t ticket)
+{
+    std::unique_lock<std::mutex> lock(locker);
+    auto it = tickets.find(ticket);
+    if (it == tickets.end())
+    {
+        return 0;
+    }
+
+    if (it->second == 0)
+    {
+        for (uint32_t i = 0; i < STREAM_PRIORITY_COUNT; ++i)
         {
-            break;
+            auto request = std::find_if(requests[i].begin(), requests[i].end(), [ticket](const Request& x) { return x.ticket == ticket; });
+            if (request != requests[i].end())
+            {
+                requests[STREAM_PRIORITY_COUNT].push_back(*request);
+                requests[i].erase(request);
+                break;
+            }
         }
+        condition.notify_all();
+        condition.wait(lock, [this, ticket]() {
+            auto x = tickets.find(ticket);
+            return x == tickets.end() || x->second != 0;
+        });
+        it = tickets.find(ticket);
+    }
+    return it == tickets.end() ? 0 : it->second;
+}
+
+void VulkanDevice::StreamingService::SetBudget(uint64_t bytes_per_frame)
+{
+    std::lock_guard<std::mutex> lock(locker);
+    budget = bytes_per_frame;
+}
+
+void VulkanDevice::StreamingService::OnFrame(uint64_t frame_count)
+{
+    {
+        std::lock_guard<std::mutex> lock(locker);
+        frame_index = frame_count;
     }
-    while (!destroyer_descriptor_set_layouts.empty())
+    condition.notify_all();
+}
+
+void VulkanDevice::StreamingService::Run()
+{
+    std::vector<Request> pending;
+    std::vector<std::function<void()>> callbacks;
+
+    std::unique_lock<std::mutex> lock(locker);
+    while (running)
     {
-        if (destroyer_descriptor_set_layouts.front().second + buffer_count < frame_count)
+        Retire(callbacks);
+        if (!callbacks.empty())
         {
-            auto item = destroyer_descriptor_set_layouts.front();
-            destroyer_descriptor_set_layouts.pop_front();
-            vkDestroyDescriptorSetLayout(device, item.first, nullptr);
+            lock.unlock();
+            for (auto& callback : callbacks)
+            {
+                callback();
+            }
+            callbacks.clear();
+            lock.lock();
+            continue;
         }
-        else
+
+        if (budget_frame != frame_index)
         {
-            break;
+            budget_frame = frame_index;
+            budget_used = 0;
         }
-    }
-    while (!destroyer_descriptor_update_templates.empty())
-    {
-        if (destroyer_descriptor_update_templates.front().second + buffer_count < frame_count)
+
+        // 提前的请求不受预算限制, 其余请求按优先级消耗本帧的预算
+        while (!requests[STREAM_PRIORITY_COUNT].empty())
         {
-            auto item = destroyer_descriptor_update_templates.front();
-            destroyer_descriptor_update_templates.pop_front();
-            vkDestroyDescriptorUpdateTemplate(device, item.first, nullptr);
+            pending.push_back(requests[STREAM_PRIORITY_COUNT].front());
+            requests[STREAM_PRIORITY_COUNT].pop_front();
         }
-        else
+        for (uint32_t i = 0; i < STREAM_PRIORITY_COUNT; ++i)
         {
-            break;
+            while (!requests[i].empty() && budget_used < budget)
+            {
+                budget_used += requests[i].front().desc.size;
+                pending.push_back(requests[i].front());
+                requests[i].pop_front();
+            }
         }
+
+        if (pending.empty())
+        {
+            // 有在执行的批次时轮询它们的回调
+            if (worklist.empty())
+            {
+                condition.wait(lock);
+            }
+            else
+            {
+                condition.wait_for(lock, std::chrono::milliseconds(1));
+            }
+            continue;
+        }
+
+        Batch* batch = nullptr;
+        if (freelist.empty())
+        {
+            batch = new Batch();
+            batch->stage_buffer = new StageBuffer();
+            batch->stage_buffer->Init(device, false);
+
+            VkCommandPoolCreateInfo pool_info = {};
+            pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            pool_info.queueFamilyIndex = device->copy_family;
+            pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            VK_ASSERT(vkCreateCommandPool(device->device, &pool_info, nullptr, &batch->command_pool));
+
+            VkCommandBufferAllocateInfo command_buffer_info = {};
+            command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            command_buffer_info.commandBufferCount = 1;
+            command_buffer_info.commandPool = batch->command_pool;
+            command_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            VK_ASSERT(vkAllocateCommandBuffers(device->device, &command_buffer_info, &batch->command_buffer));
+        }
+        else
+        {
+            batch = freelist.back();
+            freelist.pop_back();
+        }
+
+        std::vector<std::pair<VulkanTexture*, ResourceState>> transitions;
+        for (auto& request : pending)
+        {
+            auto it = initial_states.find((VulkanTexture*)request.desc.texture);
+            if (it != initial_states.end())
+            {
+                transitions.push_back(*it);
+                initial_states.erase(it);
+            }
+        }
+
+        lock.unlock();
+
+        // 回到freelist的批次已经执行完毕
+        batch->stage_buffer->Reset();
+        VK_ASSERT(vkResetCommandPool(device->device, batch->command_pool, 0));
+
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        begin_info.pInheritanceInfo = nullptr;
+        VK_ASSERT(vkBeginCommandBuffer(batch->command_buffer, &begin_info));
+
+        // 整个纹理先转换到SHADER_RESOURCE, 没有上传的子资源也和记录的状态一致
+        if (!transitions.empty())
+        {
+            std::vector<VkImageMemoryBarrier> barriers(transitions.size());
+            for (uint32_t i = 0; i < transitions.size(); ++i)
+            {
+                VkImageMemoryBarrier& barrier = barriers[i];
+                barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barrier.image = transitions[i].first->resource;
+                barrier.oldLayout = ToVulkanImageLayout(transitions[i].second);
+                barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = 0;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.subresourceRange.aspectMask = ToVulkanAspectMask(transitions[i].first->format);
+                barrier.subresourceRange.baseMipLevel = 0;
+                barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+                barrier.subresourceRange.baseArrayLayer = 0;
+                barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+            }
+            vkCmdPipelineBarrier(batch->command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+                                 (uint32_t)barriers.size(), barriers.data());
+        }
+
+        for (auto& request : pending)
+        {
+            Record(batch, request);
+            if (request.desc.callback)
+            {
+                batch->callbacks.push_back(request.desc.callback);
+            }
+        }
+
+        VK_ASSERT(vkEndCommandBuffer(batch->command_buffer));
+
+        // 只有工作线程会推进fence_value
+        batch->target = ++fence_value;
+
+        VkSubmitInfo submit_info = {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &batch->command_buffer;
+        submit_info.pSignalSemaphores = &semaphore;
+        submit_info.signalSemaphoreCount = 1;
+
+        VkTimelineSemaphoreSubmitInfo timeline_info = {};
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline_info.pNext = nullptr;
+        timeline_info.waitSemaphoreValueCount = 0;
+        timeline_info.pWaitSemaphoreValues = nullptr;
+        timeline_info.signalSemaphoreValueCount = 1;
+        timeline_info.pSignalSemaphoreValues = &batch->target;
+
+        submit_info.pNext = &timeline_info;
+
+        device->copy_queue_locker.lock();
+        VK_ASSERT(vkQueueSubmit(device->copy_queue, 1, &submit_info, VK_NULL_HANDLE));
+        device->copy_queue_locker.unlock();
+
+        // 在WaitStream返回之前让工作队列可以获取这些资源, 已经销毁的资源没有对应的记录
+        device->acquire_locker.lock();
+        for (auto& request : pending)
+        {
+            GfxResource* target = request.desc.buffer ? (GfxResource*)request.desc.buffer : (GfxResource*)request.desc.texture;
+            auto it = device->pending_acquires.find(target);
+            if (it != device->pending_acquires.end())
+            {
+                it->second.stream_value = batch->target;
+                it->second.stream_requests--;
+            }
+        }
+        for (auto& release : batch->buffer_releases)
+        {
+            auto it = device->pending_acquires.find(release.first);
+            if (it != device->pending_acquires.end())
+            {
+                it->second.buffer_barriers.push_back(release.second);
+            }
+        }
+        for (auto& release : batch->image_releases)
+        {
+            auto it = device->pending_acquires.find(release.first);
+            if (it != device->pending_acquires.end())
+            {
+                it->second.image_barriers.push_back(release.second);
+            }
+        }
+        device->acquire_locker.unlock();
+        batch->buffer_releases.clear();
+        batch->image_releases.clear();
+
+        lock.lock();
+        for (auto& request : pending)
+        {
+            tickets[request.ticket] = batch->target;
+        }
+        pending.clear();
+        worklist.push_back(batch);
+        condition.notify_all();
     }
-    while (!destroyer_shadermodules.empty())
+}
+
+void VulkanDevice::StreamingService::Record(Batch* batch, const Request& request)
+{
+    // 纹理的bufferOffset需要同时是4和像素(压缩块)大小的倍数
+    uint64_t alignment = 16;
+    if (request.desc.texture)
     {
-        if (destroyer_shadermodules.front().second + buffer_count < frame_count)
+        uint32_t stride = GetFormatStride(request.desc.texture->format);
+        alignment = stride % 4 == 0 ? stride : 4;
+    }
+
+    StageBuffer::Allocation allocation = batch->stage_buffer->Allocate(request.desc.size, alignment);
+    memcpy(allocation.data, request.desc.data, static_cast<size_t>(request.desc.size));
+    VulkanBuffer* internal_stage_buffer = (VulkanBuffer*)allocation.buffer;
+
+    if (request.desc.buffer)
+    {
+        VkBufferCopy copy = {};
+        copy.srcOffset = allocation.offset;
+        copy.dstOffset = request.desc.buffer_offset;
+        copy.size = request.desc.size;
+        vkCmdCopyBuffer(batch->command_buffer, internal_stage_buffer->resource, ((VulkanBuffer*)request.desc.buffer)->resource, 1, &copy);
+
+        // 流式上传的使用者未知, EXCLUSIVE资源释放给图形队列
+        if (device->copy_family != device->graphics_family && !((VulkanBuffer*)request.desc.buffer)->concurrent)
         {
-            auto item = destroyer_shadermodules.front();
-            destroyer_shadermodules.pop_front();
-            vkDestroyShaderModule(device, item.first, nullptr);
+            VkBufferMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            barrier.srcQueueFamilyIndex = device->copy_family;
+            barrier.dstQueueFamilyIndex = device->graphics_family;
+            barrier.buffer = ((VulkanBuffer*)request.desc.buffer)->resource;
+            barrier.offset = copy.dstOffset;
+            barrier.size = copy.size;
+            vkCmdPipelineBarrier(batch->command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+            batch->buffer_releases.push_back(std::make_pair((GfxResource*)request.desc.buffer, barrier));
         }
-        else
+        return;
+    }
+
+    // 整个子资源都会被覆盖, 从UNDEFINED转换即可, 上传完成后回到整个纹理所在的SHADER_RESOURCE状态
+    VulkanTexture* internal_texture = (VulkanTexture*)request.desc.texture;
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = internal_texture->resource;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask = ToVulkanAspectMask(internal_texture->format);
+    barrier.subresourceRange.baseMipLevel = request.desc.level;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = request.desc.layer;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(batch->command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy copy = {};
+    copy.bufferOffset = allocation.offset;
+    copy.bufferRowLength = 0;
+    copy.bufferImageHeight = 0;
+    copy.imageSubresource.aspectMask = barrier.subresourceRange.aspectMask;
+    copy.imageSubresource.mipLevel = request.desc.level;
+    copy.imageSubresource.baseArrayLayer = request.desc.layer;
+    copy.imageSubresource.layerCount = 1;
+    copy.imageExtent.width = std::max(internal_texture->width >> request.desc.level, 1u);
+    copy.imageExtent.height = std::max(internal_texture->height >> request.desc.level, 1u);
+    copy.imageExtent.depth = std::max(internal_texture->depth >> request.desc.level, 1u);
+    vkCmdCopyBufferToImage(batch->command_buffer, internal_stage_buffer->resource, internal_texture->resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+    // 可见性由等待semaphore保证, EXCLUSIVE资源在有独立的copy队列族时同时释放给图形队列
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    if (device->copy_family != device->graphics_family && !internal_texture->concurrent)
+    {
+        barrier.srcQueueFamilyIndex = device->copy_family;
+        barrier.dstQueueFamilyIndex = device->graphics_family;
+        batch->image_releases.push_back(std::make_pair((GfxResource*)internal_texture, barrier));
+    }
+    vkCmdPipelineBarrier(batch->command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void VulkanDevice::StreamingService::Retire(std::vector<std::function<void()>>& callbacks)
+{
+    if (worklist.empty())
+    {
+        return;
+    }
+
+    uint64_t completed_value;
+    VK_ASSERT(vkGetSemaphoreCounterValue(device->device, semaphore, &completed_value));
+    for (uint32_t i = 0; i < worklist.size(); ++i)
+    {
+        if (worklist[i]->target <= completed_value)
         {
-            break;
+            callbacks.insert(callbacks.end(), worklist[i]->callbacks.begin(), worklist[i]->callbacks.end());
+            worklist[i]->callbacks.clear();
+            freelist.push_back(worklist[i]);
+            worklist[i] = worklist.back();
+            worklist.pop_back();
+            i--;
         }
     }
-    while (!destroyer_pipeline_layouts.empty())
+
+    for (auto it = tickets.begin(); it != tickets.end();)
     {
-        if (destroyer_pipeline_layouts.front().second + buffer_count < frame_count)
+        if (it->second != 0 && it->second <= completed_value)
         {
-            auto item = destroyer_pipeline_layouts.front();
-            destroyer_pipeline_layouts.pop_front();
-            vkDestroyPipelineLayout(device, item.first, nullptr);
+            it = tickets.erase(it);
         }
         else
         {
-            break;
+            ++it;
         }
     }
-    while (!destroyer_pipelines.empty())
+}
+
+void VulkanDevice::MemoryAllocator::Init(VulkanDevice* device)
+{
+    this->device = device;
+
+    // 粒度不超过最小分配大小时, buddy节点的边界天然满足bufferImageGranularity
+    separate_images = device->phy_device_properties.limits.bufferImageGranularity > MIN_ALLOCATION_SIZE;
+
+    for (uint32_t i = 0; i < device->phy_device_memory_properties.memoryTypeCount; ++i)
     {
-        if (destroyer_pipelines.front().second + buffer_count < frame_count)
+        // 较小的堆使用不超过堆大小1/8的块
+        uint32_t heap_index = device->phy_device_memory_properties.memoryTypes[i].heapIndex;
+        uint64_t heap_size = device->phy_device_memory_properties.memoryHeaps[heap_index].size;
+        uint64_t block_size = MAX_BLOCK_SIZE;
+        while (block_size > MIN_ALLOCATION_SIZE && block_size > heap_size / 8)
         {
-            auto item = destroyer_pipelines.front();
-            destroyer_pipelines.pop_front();
-            vkDestroyPipeline(device, item.first, nullptr);
+            block_size >>= 1;
         }
-        else
+        block_sizes[i] = block_size;
+    }
+}
+
+void VulkanDevice::MemoryAllocator::Destroy()
+{
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; ++i)
+    {
+        for (uint32_t j = 0; j < POOL_COUNT; ++j)
         {
-            break;
+            for (auto block : pools[i][j])
+            {
+                if (block)
+                {
+                    vkFreeMemory(device->device, block->memory, nullptr);
+                    BLAST_SAFE_DELETE(block);
+                }
+            }
+            pools[i][j].clear();
         }
     }
-    while (!destroyer_renderpasses.empty())
+}
+
+VkResult VulkanDevice::MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear, MemoryCategory category, VulkanAllocation& allocation)
+{
+    uint32_t memory_type = device->FindMemoryType(requirements.memoryTypeBits, properties);
+    if (memory_type == (uint32_t)-1)
     {
-        if (destroyer_renderpasses.front().second + buffer_count < frame_count)
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+
+    bool host_visible = (device->phy_device_memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+    uint64_t block_size = block_sizes[memory_type];
+    uint64_t size = requirements.size > requirements.alignment ? requirements.size : requirements.alignment;
+    size = GetNextPowerOfTwo(size > MIN_ALLOCATION_SIZE ? size : MIN_ALLOCATION_SIZE);
+
+    allocation.memory_type = memory_type;
+    allocation.pool = (separate_images && !linear) ? 1 : 0;
+    allocation.mapped = nullptr;
+    allocation.category = category;
+
+    // 大资源直接使用独立的VkDeviceMemory
+    if (size > block_size / 2)
+    {
+        VkMemoryAllocateInfo memory_allocate_info = {};
+        memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memory_allocate_info.allocationSize = requirements.size;
+        memory_allocate_info.memoryTypeIndex = memory_type;
+
+        VkResult result = vkAllocateMemory(device->device, &memory_allocate_info, nullptr, &allocation.memory);
+        if (result != VK_SUCCESS)
         {
-            auto item = destroyer_renderpasses.front();
-            destroyer_renderpasses.pop_front();
-            vkDestroyRenderPass(device, item.first, nullptr);
+            return result;
         }
-        else
+
+        if (host_visible)
         {
-            break;
+            VK_ASSERT(vkMapMemory(device->device, allocation.memory, 0, VK_WHOLE_SIZE, 0, (void**)&allocation.mapped));
         }
+
+        allocation.offset = 0;
+        allocation.size = requirements.size;
+        allocation.block = -1;
+        allocation.order = 0;
+
+        locker.lock();
+        allocated_bytes[memory_type] += allocation.size;
+        used_bytes[memory_type] += allocation.size;
+        allocation_counts[memory_type]++;
+        categories[category].bytes += allocation.size;
+        categories[category].count++;
+        locker.unlock();
+        return VK_SUCCESS;
     }
-    while (!destroyer_framebuffers.empty())
+
+    uint32_t order = 0;
+    while ((MIN_ALLOCATION_SIZE << order) < size)
     {
-        if (destroyer_framebuffers.front().second + buffer_count < frame_count)
+        order++;
+    }
+
+    locker.lock();
+    std::vector<Block*>& blocks = pools[memory_type][allocation.pool];
+
+    uint32_t block_index = -1;
+    uint32_t free_order = 0;
+    for (uint32_t i = 0; i < blocks.size() && block_index == (uint32_t)-1; ++i)
+    {
+        Block* block = blocks[i];
+        if (block == nullptr || block->defragment || block->size - block->used < size)
         {
-            auto item = destroyer_framebuffers.front();
-            destroyer_framebuffers.pop_front();
-            vkDestroyFramebuffer(device, item.first, nullptr);
+            continue;
         }
-        else
+
+        for (uint32_t j = order; j < block->free_lists.size(); ++j)
         {
-            break;
+            if (!block->free_lists[j].empty())
+            {
+                block_index = i;
+                free_order = j;
+                break;
+            }
         }
     }
-    while (!destroyer_querypools.empty())
+
+    if (block_index == (uint32_t)-1)
     {
-        if (destroyer_querypools.front().second + buffer_count < frame_count)
+        Block* block = new Block();
+        block->size = block_size;
+
+        VkMemoryAllocateInfo memory_allocate_info = {};
+        memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        memory_allocate_info.allocationSize = block_size;
+        memory_allocate_info.memoryTypeIndex = memory_type;
+
+        VkResult result = vkAllocateMemory(device->device, &memory_allocate_info, nullptr, &block->memory);
+        if (result != VK_SUCCESS)
         {
-            auto item = destroyer_querypools.front();
-            destroyer_querypools.pop_front();
-            vkDestroyQueryPool(device, item.first, nullptr);
+            BLAST_SAFE_DELETE(block);
+            locker.unlock();
+            return result;
         }
-        else
+
+        if (host_visible)
         {
-            break;
+            VK_ASSERT(vkMapMemory(device->device, block->memory, 0, VK_WHOLE_SIZE, 0, (void**)&block->mapped));
+        }
+
+        free_order = 0;
+        while ((MIN_ALLOCATION_SIZE << free_order) < block_size)
+        {
+            free_order++;
+        }
+        block->free_lists.resize(free_order + 1);
+        block->free_lists[free_order].insert(0);
+        allocated_bytes[memory_type] += block_size;
+        block_counts[memory_type]++;
+
+        for (uint32_t i = 0; i < blocks.size(); ++i)
+        {
+            if (blocks[i] == nullptr)
+            {
+                block_index = i;
+                blocks[i] = block;
+                break;
+            }
+        }
+
+        if (block_index == (uint32_t)-1)
+        {
+            block_index = blocks.size();
+            blocks.push_back(block);
         }
     }
 
-    destroy_locker.unlock();
-}
+    Block* block = blocks[block_index];
+    uint64_t offset = *block->free_lists[free_order].begin();
+    block->free_lists[free_order].erase(block->free_lists[free_order].begin());
 
-void VulkanDevice::ResourceManager::Clear()
-{
-    Update(~0, 0);
+    // 拆分较大的空闲节点, 后半部分放回低一阶的空闲列表
+    while (free_order > order)
+    {
+        free_order--;
+        block->free_lists[free_order].insert(offset + (MIN_ALLOCATION_SIZE << free_order));
+    }
+    block->used += size;
+
+    allocation.memory = block->memory;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.mapped = block->mapped ? block->mapped + offset : nullptr;
+    allocation.block = block_index;
+    allocation.order = order;
+    used_bytes[memory_type] += size;
+    allocation_counts[memory_type]++;
+    categories[category].bytes += size;
+    categories[category].count++;
+    locker.unlock();
+
+    return VK_SUCCESS;
 }
 
-VulkanDevice::VulkanDevice()
-    : GfxDevice()
+void VulkanDevice::MemoryAllocator::SetCategory(VulkanAllocation& allocation, MemoryCategory category)
 {
-    if (volkInitialize() != VK_SUCCESS)
+    if (allocation.memory == VK_NULL_HANDLE || allocation.category == (uint32_t)category)
     {
         return;
     }
-    uint32_t num_instance_available_layers;
-    VK_ASSERT(vkEnumerateInstanceLayerProperties(&num_instance_available_layers, nullptr));
-    std::vector<VkLayerProperties> instance_supported_layers(num_instance_available_layers);
-    VK_ASSERT(vkEnumerateInstanceLayerProperties(&num_instance_available_layers, instance_supported_layers.data()));
 
-    uint32_t num_instance_available_extensions;
-    VK_ASSERT(vkEnumerateInstanceExtensionProperties(nullptr, &num_instance_available_extensions, nullptr));
-    std::vector<VkExtensionProperties> instance_supported_extensions(num_instance_available_extensions);
-    VK_ASSERT(vkEnumerateInstanceExtensionProperties(nullptr, &num_instance_available_extensions, instance_supported_extensions.data()));
+    locker.lock();
+    categories[allocation.category].bytes -= allocation.size;
+    categories[allocation.category].count--;
+    categories[category].bytes += allocation.size;
+    categories[category].count++;
+    allocation.category = category;
+    locker.unlock();
+}
 
-    std::vector<const char*> instance_required_layers;
-    std::vector<const char*> instance_required_extensions;
-    std::vector<const char*> instance_layers;
-    std::vector<const char*> instance_extensions;
+void VulkanDevice::MemoryAllocator::GetStats(GfxMemoryStats& stats)
+{
+    const VkPhysicalDeviceMemoryProperties& memory_properties = device->phy_device_memory_properties;
 
-#if VULKAN_DEBUG
-    if (IsLayerSupported("VK_LAYER_KHRONOS_validation", instance_supported_layers))
+    locker.lock();
+    stats.num_types = memory_properties.memoryTypeCount;
+    stats.total_allocated_bytes = 0;
+    stats.total_used_bytes = 0;
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i)
     {
-        instance_required_layers.push_back("VK_LAYER_KHRONOS_validation");
+        GfxMemoryTypeStats& type_stats = stats.types[i];
+        type_stats.heap_index = memory_properties.memoryTypes[i].heapIndex;
+        type_stats.allocated_bytes = allocated_bytes[i];
+        type_stats.used_bytes = used_bytes[i];
+        type_stats.block_count = block_counts[i];
+        type_stats.allocation_count = allocation_counts[i];
+        stats.total_allocated_bytes += allocated_bytes[i];
+        stats.total_used_bytes += used_bytes[i];
     }
-    else
+
+    for (uint32_t i = 0; i < MEMORY_CATEGORY_COUNT; ++i)
     {
-        instance_required_layers.push_back("VK_LAYER_LUNARG_standard_validation");
+        stats.categories[i] = categories[i];
     }
-    bool debug_utils = false;
-    if (IsExtensionSupported(VK_EXT_DEBUG_UTILS_EXTENSION_NAME, instance_supported_extensions))
+    locker.unlock();
+}
+
+void VulkanDevice::MemoryAllocator::Free(const VulkanAllocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE)
     {
-        debug_utils = true;
-        instance_required_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        return;
     }
-    else
+
+    locker.lock();
+    used_bytes[allocation.memory_type] -= allocation.size;
+    allocation_counts[allocation.memory_type]--;
+    categories[allocation.category].bytes -= allocation.size;
+    categories[allocation.category].count--;
+
+    if (allocation.block == (uint32_t)-1)
     {
-        instance_required_extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+        allocated_bytes[allocation.memory_type] -= allocation.size;
+        locker.unlock();
+        vkFreeMemory(device->device, allocation.memory, nullptr);
+        return;
     }
-#endif
-    instance_required_extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
-    instance_required_extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 
-    for (auto it = instance_required_layers.begin(); it != instance_required_layers.end(); ++it)
+    std::vector<Block*>& blocks = pools[allocation.memory_type][allocation.pool];
+    Block* block = blocks[allocation.block];
+
+    // 与空闲的伙伴节点合并
+    uint64_t offset = allocation.offset;
+    uint32_t order = allocation.order;
+    while (order + 1 < block->free_lists.size())
     {
-        if (IsLayerSupported(*it, instance_supported_layers))
+        uint64_t buddy = offset ^ (MIN_ALLOCATION_SIZE << order);
+        auto iter = block->free_lists[order].find(buddy);
+        if (iter == block->free_lists[order].end())
         {
-            instance_layers.push_back(*it);
+            break;
         }
+        block->free_lists[order].erase(iter);
+        offset = std::min(offset, buddy);
+        order++;
     }
+    block->free_lists[order].insert(offset);
+    block->used -= allocation.size;
 
-    for (auto it = instance_required_extensions.begin(); it != instance_required_extensions.end(); ++it)
+    // 碎片整理腾空的块直接释放, 其余情况每种内存类型最多保留一个空块
+    if (block->used == 0)
     {
-        if (IsExtensionSupported(*it, instance_supported_extensions))
+        bool release = block->defragment;
+        for (uint32_t i = 0; i < blocks.size() && !release; ++i)
         {
-            instance_extensions.push_back(*it);
+            release = i != allocation.block && blocks[i] && blocks[i]->used == 0;
+        }
+
+        if (release)
+        {
+            allocated_bytes[allocation.memory_type] -= block->size;
+            block_counts[allocation.memory_type]--;
+            vkFreeMemory(device->device, block->memory, nullptr);
+            BLAST_SAFE_DELETE(block);
+            blocks[allocation.block] = nullptr;
         }
     }
+    locker.unlock();
+}
 
-    VkApplicationInfo app_info = {};
-    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    app_info.pEngineName = "BlastEngine";
-    app_info.apiVersion = VK_API_VERSION_1_3;
-
-    VkInstanceCreateInfo ici;
-    ici.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    ici.pNext = nullptr;
-    ici.flags = 0;
-    ici.pApplicationInfo = &app_info;
-    ici.enabledLayerCount = instance_layers.size();
-    ici.ppEnabledLayerNames = instance_layers.data();
-    ici.enabledExtensionCount = instance_extensions.size();
-    ici.ppEnabledExtensionNames = instance_extensions.data();
-
-    VK_ASSERT(vkCreateInstance(&ici, nullptr, &instance));
+void VulkanDevice::MemoryAllocator::BeginDefragment(const std::unordered_map<VkDeviceMemory, uint64_t>& evictable_bytes)
+{
+    locker.lock();
+    for (uint32_t i = 0; i < device->phy_device_memory_properties.memoryTypeCount; ++i)
+    {
+        for (uint32_t j = 0; j < POOL_COUNT; ++j)
+        {
+            // 每个池同时只整理一个块, 选择占用最少且能够腾空的块并停止在其中分配
+            Block* source = nullptr;
+            uint32_t num_blocks = 0;
+            bool in_progress = false;
+            for (auto block : pools[i][j])
+            {
+                if (block == nullptr || block->used == 0)
+                {
+                    continue;
+                }
 
-    volkLoadInstance(instance);
+                auto evictable = evictable_bytes.find(block->memory);
+                bool movable = evictable != evictable_bytes.end() && evictable->second >= block->used;
+                if (block->defragment)
+                {
+                    // 块中出现了无法移动的资源(例如开始流式上传), 放弃这个块并恢复在其中分配
+                    if (!movable)
+                    {
+                        block->defragment = false;
+                        continue;
+                    }
+                    in_progress = true;
+                    break;
+                }
 
-#if VULKAN_DEBUG
-    if (debug_utils)
-    {
-        VkDebugUtilsMessengerCreateInfoEXT dumci{VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT};
-        dumci.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
-        dumci.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT;
-        dumci.pfnUserCallback = DebugUtilsMessengerCallback;
+                num_blocks++;
+                if (movable && (source == nullptr || block->used < source->used))
+                {
+                    source = block;
+                }
+            }
 
-        VK_ASSERT(vkCreateDebugUtilsMessengerEXT(instance, &dumci, nullptr, &debug_messenger));
+            if (!in_progress && num_blocks > 1 && source && source->used <= source->size / 2)
+            {
+                source->defragment = true;
+            }
+        }
     }
-    else
-    {
-        VkDebugReportCallbackCreateInfoEXT drcci{VK_STRUCTURE_TYPE_DEBUG_REPORT_CREATE_INFO_EXT};
-        drcci.flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT;
-        drcci.pfnCallback = DebugReportCallback;
+    locker.unlock();
+}
 
-        VK_ASSERT(vkCreateDebugReportCallbackEXT(instance, &drcci, nullptr, &debug_report_callback));
+bool VulkanDevice::MemoryAllocator::IsDefragmentSource(const VulkanAllocation& allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE || allocation.block == (uint32_t)-1)
+    {
+        return false;
     }
-#endif
-    uint32_t num_gpus = 0;
-    VK_ASSERT(vkEnumeratePhysicalDevices(instance, &num_gpus, nullptr));
 
-    std::vector<VkPhysicalDevice> gpus(num_gpus);
-    VK_ASSERT(vkEnumeratePhysicalDevices(instance, &num_gpus, gpus.data()));
+    locker.lock();
+    Block* block = pools[allocation.memory_type][allocation.pool][allocation.block];
+    bool result = block && block->defragment;
+    locker.unlock();
+    return result;
+}
 
-    for (auto& g : gpus)
+void VulkanDevice::ResourceManager::Update(uint64_t current_frame_count, uint32_t buffer_count)
+{
+    destroy_locker.lock();
+    frame_count = current_frame_count;
+    while (!destroyer_images.empty())
     {
-        VkPhysicalDeviceProperties props;
-        vkGetPhysicalDeviceProperties(g, &props);
-        BLAST_LOGI("Found Vulkan GPU: %s\n", props.deviceName);
-        BLAST_LOGI("API: %u.%u.%u\n",
-                   VK_VERSION_MAJOR(props.apiVersion),
-                   VK_VERSION_MINOR(props.apiVersion),
-                   VK_VERSION_PATCH(props.apiVersion));
-        BLAST_LOGI("Driver: %u.%u.%u\n",
-                   VK_VERSION_MAJOR(props.driverVersion),
-                   VK_VERSION_MINOR(props.driverVersion),
-                   VK_VERSION_PATCH(props.driverVersion));
+        if (destroyer_images.front().second + buffer_count < frame_count)
+        {
+            auto item = destroyer_images.front();
+            destroyer_images.pop_front();
+            vkDestroyImage(device, item.first.first, nullptr);
+            allocator->Free(item.first.second);
+        }
+        else
+        {
+            break;
+        }
     }
-
-    // todo: 支持多个GPU选择
-    phy_device = gpus.front();
-
-    vkGetPhysicalDeviceProperties(phy_device, &phy_device_properties);
-    vkGetPhysicalDeviceMemoryProperties(phy_device, &phy_device_memory_properties);
-
-    // feature
-    VkPhysicalDeviceFeatures2KHR phy_device_features2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR};
-    VkPhysicalDeviceVulkan11Features features_1_1 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES};
-    VkPhysicalDeviceVulkan12Features features_1_2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
-    phy_device_features2.pNext = &features_1_1;
-    features_1_1.pNext = &features_1_2;
-    vkGetPhysicalDeviceFeatures2(phy_device, &phy_device_features2);
-
-    uint32_t num_queue_families;
-    vkGetPhysicalDeviceQueueFamilyProperties(phy_device, &num_queue_families, nullptr);
-
-    queue_family_properties.resize(num_queue_families);
-    vkGetPhysicalDeviceQueueFamilyProperties(phy_device, &num_queue_families, queue_family_properties.data());
-
-    graphics_family = -1;
-    compute_family = -1;
-    copy_family = -1;
-    for (uint32_t i = 0; i < (uint32_t)queue_family_properties.size(); i++)
+    while (!destroyer_imageviews.empty())
     {
-        if ((queue_family_properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && (queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0)
+        if (destroyer_imageviews.front().second + buffer_count < frame_count)
+        {
+            auto item = destroyer_imageviews.front();
+            destroyer_imageviews.pop_front();
+            vkDestroyImageView(device, item.first, nullptr);
+        }
+        else
         {
-            compute_family = i;
             break;
         }
     }
-
-    for (uint32_t i = 0; i < (uint32_t)queue_family_properties.size(); i++)
+    while (!destroyer_buffers.empty())
     {
-        if ((queue_family_properties[i].queueFlags & VK_QUEUE_TRANSFER_BIT) && ((queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0) && ((queue_family_properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) == 0))
+        if (destroyer_buffers.front().second + buffer_count < frame_count)
+        {
+            auto item = destroyer_buffers.front();
+            destroyer_buffers.pop_front();
+            vkDestroyBuffer(device, item.first.first, nullptr);
+            allocator->Free(item.first.second);
+        }
+        else
         {
-            copy_family = i;
             break;
         }
     }
-
-    for (uint32_t i = 0; i < (uint32_t)queue_family_properties.size(); i++)
+    while (!destroyer_allocations.empty())
     {
-        if (queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        if (destroyer_allocations.front().second + buffer_count < frame_count)
+        {
+            auto item = destroyer_allocations.front();
+            destroyer_allocations.pop_front();
+            allocator->Free(item.first);
+        }
+        else
         {
-            graphics_family = i;
             break;
         }
     }
-
-    const float graphics_queue_prio = 0.0f;
-    const float compute_queue_prio = 0.1f;
-    const float transfer_queue_prio = 0.2f;
-
-    // note:目前只使用三个queue
-    std::vector<VkDeviceQueueCreateInfo> qci{};
-    qci.resize(3);
-
-    qci[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    qci[0].queueFamilyIndex = graphics_family;
-    qci[0].queueCount = 1;//queue_Family_properties[mGraphicsFamily].queueCount;
-    qci[0].pQueuePriorities = &graphics_queue_prio;
-
-    qci[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    qci[1].queueFamilyIndex = compute_family;
-    qci[1].queueCount = 1;//queue_Family_properties[mComputeFamily].queueCount;
-    qci[1].pQueuePriorities = &compute_queue_prio;
-
-    qci[2].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    qci[2].queueFamilyIndex = copy_family;
-    qci[2].queueCount = 1;//queue_Family_properties[mTransferFamily].queueCount;
-    qci[2].pQueuePriorities = &transfer_queue_prio;
-
-    uint32_t num_device_available_extensions = 0;
-    VK_ASSERT(vkEnumerateDeviceExtensionProperties(phy_device, nullptr, &num_device_available_extensions, nullptr));
-
-    std::vector<VkExtensionProperties> device_available_extensions(num_device_available_extensions);
-    VK_ASSERT(vkEnumerateDeviceExtensionProperties(phy_device, nullptr, &num_device_available_extensions, device_available_extensions.data()));
-
-    std::vector<const char*> device_required_extensions;
-    std::vector<const char*> device_extensions;
-    device_required_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
-    device_required_extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
-    device_required_extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
-    device_required_extensions.push_back(VK_KHR_MAINTENANCE1_EXTENSION_NAME);
-    device_required_extensions.push_back(VK_KHR_MAINTENANCE2_EXTENSION_NAME);
-    device_required_extensions.push_back(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME);
-    device_required_extensions.push_back(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME);
-
-    for (auto it = device_required_extensions.begin(); it != device_required_extensions.end(); ++it)
+    while (!destroyer_placements.empty())
     {
-        if (IsExtensionSupported(*it, device_available_extensions))
+        if (destroyer_placements.front().second + buffer_count < frame_count)
         {
-            device_extensions.push_back(*it);
+            auto item = destroyer_placements.front();
+            destroyer_placements.pop_front();
+            VulkanMemoryHeap* heap = item.first.first;
+            heap->locker.lock();
+            for (uint32_t i = 0; i < heap->placements.size(); ++i)
+            {
+                if (heap->placements[i].id == item.first.second)
+                {
+                    heap->placements[i] = heap->placements.back();
+                    heap->placements.pop_back();
+                    break;
+                }
+            }
+            heap->locker.unlock();
+        }
+        else
+        {
+            break;
         }
     }
-
-    VkDeviceCreateInfo dci;
-    dci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    dci.pNext = &phy_device_features2;
-    dci.flags = 0;
-    dci.queueCreateInfoCount = qci.size();
-    dci.pQueueCreateInfos = qci.data();
-    dci.pEnabledFeatures = nullptr;
-    dci.enabledExtensionCount = device_extensions.size();
-    dci.ppEnabledExtensionNames = device_extensions.data();
-    dci.enabledLayerCount = 0;
-    dci.ppEnabledLayerNames = nullptr;
-
-    VK_ASSERT(vkCreateDevice(phy_device, &dci, nullptr, &device));
-
-    vkGetDeviceQueue(device, graphics_family, 0, &graphics_queue);
-    vkGetDeviceQueue(device, compute_family, 0, &compute_queue);
-    vkGetDeviceQueue(device, copy_family, 0, &copy_queue);
-
-    // resource manager
-    resource_manager.device = device;
-    resource_manager.instance = instance;
-
-    // queues
+    while (!destroyer_bufferviews.empty())
     {
-        queues[QUEUE_GRAPHICS].queue = graphics_queue;
-        queues[QUEUE_COMPUTE].queue = compute_queue;
-
-        VkSemaphoreTypeCreateInfo stci = {};
-        stci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
-        stci.pNext = nullptr;
-        stci.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
-        stci.initialValue = 0;
-
-        VkSemaphoreCreateInfo sci = {};
-        sci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-        sci.pNext = &stci;
-        sci.flags = 0;
-
-        VK_ASSERT(vkCreateSemaphore(device, &sci, nullptr, &queues[QUEUE_GRAPHICS].semaphore));
-        VK_ASSERT(vkCreateSemaphore(device, &sci, nullptr, &queues[QUEUE_COMPUTE].semaphore));
+        if (destroyer_bufferviews.front().second + buffer_count < frame_count)
+        {
+            auto item = destroyer_bufferviews.front();
+            destroyer_bufferviews.pop_front();
+            vkDestroyBufferView(device, item.first, nullptr);
+        }
+        else
+        {
+            break;
+        }
     }
-
-    // frames
-    for (uint32_t i = 0; i < BLAST_BUFFER_COUNT; ++i)
+    while (!destroyer_bvhs.empty())
     {
-        for (uint32_t j = 0; j < BLAST_CMD_COUNT; ++j)
+        if (destroyer_bvhs.front().second + buffer_count < frame_count)
         {
-            frames[i].stage_buffers[j] = nullptr;
+            auto item = destroyer_bvhs.front();
+            destroyer_bvhs.pop_front();
+            vkDestroyAccelerationStructureKHR(device, item.first, nullptr);
         }
-
-        for (uint32_t j = 0; j < BLAST_QUEUE_COUNT; ++j)
+        else
         {
-            VkFenceCreateInfo fci = {};
-            fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-            VK_ASSERT(vkCreateFence(device, &fci, nullptr, &frames[i].fence[j]));
+            break;
         }
-        VkCommandPoolCreateInfo cpci = {};
-        cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        cpci.queueFamilyIndex = graphics_family;
-        cpci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
-        VK_ASSERT(vkCreateCommandPool(device, &cpci, nullptr, &frames[i].init_command_pool));
-
-        VkCommandBufferAllocateInfo cbai = {};
-        cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        cbai.commandBufferCount = 1;
-        cbai.commandPool = frames[i].init_command_pool;
-        cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        VK_ASSERT(vkAllocateCommandBuffers(device, &cbai, &frames[i].init_command_buffer));
-
-        VkCommandBufferBeginInfo cbi = {};
-        cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        cbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-        cbi.pInheritanceInfo = nullptr;
-
-        VK_ASSERT(vkBeginCommandBuffer(frames[i].init_command_buffer, &cbi));
     }
-
-    // CopyPool
-    copy_pool.Init(this);
-}
-
-VulkanDevice::~VulkanDevice()
-{
-    vkDeviceWaitIdle(device);
-
-    // 清理
-    for (auto& queue : queues)
+    while (!destroyer_samplers.empty())
     {
-        vkDestroySemaphore(device, queue.semaphore, nullptr);
+        if (destroyer_samplers.front().second + buffer_count < frame_count)
+        {
+            auto item = destroyer_samplers.front();
+            destroyer_samplers.pop_front();
+            vkDestroySampler(device, item.first, nullptr);
+        }
+        else
+        {
+            break;
+        }
     }
-
-    for (auto& frame : frames)
+    while (!destroyer_descriptor_pools.empty())
     {
-        for (int queue = 0; queue < BLAST_QUEUE_COUNT; ++queue)
+        if (destroyer_descriptor_pools.front().second + buffer_count < frame_count)
         {
-            vkDestroyFence(device, frame.fence[queue], nullptr);
-            for (int cmd = 0; cmd < BLAST_CMD_COUNT; ++cmd)
-            {
-                vkDestroyCommandPool(device, frame.command_pools[cmd][queue], nullptr);
-
-                if (frame.stage_buffers[cmd])
-                {
-                    frame.stage_buffers[cmd]->Destroy();
-                    BLAST_SAFE_DELETE(frame.stage_buffers[cmd]);
-                }
-            }
+            auto item = destroyer_descriptor_pools.front();
+            destroyer_descriptor_pools.pop_front();
+            vkDestroyDescriptorPool(device, item.first, nullptr);
         }
-        vkDestroyCommandPool(device, frame.init_command_pool, nullptr);
-
-        for (auto& descriptormanager : frame.descriptor_pools)
+        else
         {
-            descriptormanager.Destroy();
+            break;
         }
     }
-
-    copy_pool.Destroy();
-    resource_manager.Clear();
-
-    vkDestroyDevice(device, nullptr);
-
-#if VULKAN_DEBUG
-    if (debug_messenger != VK_NULL_HANDLE)
+    while (!destroyer_descriptor_set_layouts.empty())
     {
-        vkDestroyDebugUtilsMessengerEXT(instance, debug_messenger, nullptr);
-        debug_messenger = VK_NULL_HANDLE;
+        if (destroyer_descriptor_set_layouts.front().second + buffer_count < frame_count)
+        {
+            auto item = destroyer_descriptor_set_layouts.front();
+            destroyer_descriptor_set_layouts.pop_front();
+            vkDestroyDescriptorSetLayout(device, item.first, nullptr);
+        }
+        else
+        {
+            break;
+        }
     }
-    if (debug_report_callback != VK_NULL_HANDLE)
+    while (!destroyer_descriptor_update_templates.empty())
     {
-        vkDestroyDebugReportCallbackEXT(instance, debug_report_callback, nullptr);
-        debug_report_callback = VK_NULL_HANDLE;
+        if (destroyer_descriptor_update_templates.front().second + buffer_count < frame_count)
+        {
+            auto item = destroyer_descriptor_update_templates.front();
+            destroyer_descriptor_update_templates.pop_front();
+            vkDestroyDescriptorUpdateTemplate(device, item.first, nullptr);
+        }
+        else
+        {
+            break;
+        }
     }
-#endif
-    vkDestroyInstance(instance, nullptr);
-}
-
-uint32_t VulkanDevice::FindMemoryType(const uint32_t& typeFilter, const VkMemoryPropertyFlags& properties)
-{
-    for (uint32_t i = 0; i < phy_device_memory_properties.memoryTypeCount; i++)
+    while (!destroyer_shadermodules.empty())
     {
-        if ((typeFilter & (1 << i)) && (phy_device_memory_properties.memoryTypes[i].propertyFlags & properties) == properties)
+        if (destroyer_shadermodules.front().second + buffer_count < frame_count)
         {
-            return i;
+            auto item = destroyer_shadermodules.front();
+            destroyer_shadermodules.pop_front();
+            vkDestroyShaderModule(device, item.first, nullptr);
+        }
+        else
+        {
+            break;
         }
     }
-
-    return -1;
-}
-
-GfxBuffer* VulkanDevice::CreateBuffer(const GfxBufferDesc& desc)
-{
-    VulkanBuffer* internal_buffer = new VulkanBuffer(this);
-    internal_buffer->size = desc.size;
-    internal_buffer->mem_usage = desc.mem_usage;
-    internal_buffer->res_usage = desc.res_usage;
-
-    VkBufferCreateInfo buffer_info;
-    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_info.pNext = nullptr;
-    buffer_info.flags = 0;
-    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    buffer_info.queueFamilyIndexCount = 0;
-    buffer_info.pQueueFamilyIndices = nullptr;
-    buffer_info.size = desc.size;
-    buffer_info.usage = 0;
-
-    if (desc.res_usage & RESOURCE_USAGE_RW_BUFFER)
+    while (!destroyer_pipeline_layouts.empty())
     {
-        buffer_info.usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        if (destroyer_pipeline_layouts.front().second + buffer_count < frame_count)
+        {
+            auto item = destroyer_pipeline_layouts.front();
+            destroyer_pipeline_layouts.pop_front();
+            vkDestroyPipelineLayout(device, item.first, nullptr);
+        }
+        else
+        {
+            break;
+        }
     }
-
-    if (desc.res_usage & RESOURCE_USAGE_UNIFORM_BUFFER)
+    while (!destroyer_pipelines.empty())
     {
-        buffer_info.usage |= VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        if (destroyer_pipelines.front().second + buffer_count < frame_count)
+        {
+            auto item = destroyer_pipelines.front();
+            destroyer_pipelines.pop_front();
+            vkDestroyPipeline(device, item.first, nullptr);
+        }
+        else
+        {
+            break;
+        }
     }
-
-    if (desc.res_usage & RESOURCE_USAGE_VERTEX_BUFFER)
+    while (!destroyer_renderpasses.empty())
     {
-        buffer_info.usage |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        if (destroyer_renderpasses.front().second + buffer_count < frame_count)
+        {
+            auto item = destroyer_renderpasses.front();
+            destroyer_renderpasses.pop_front();
+            vkDestroyRenderPass(device, item.first, nullptr);
+        }
+        else
+        {
+            break;
+        }
     }
-
-    if (desc.res_usage & RESOURCE_USAGE_INDEX_BUFFER)
+    while (!destroyer_framebuffers.empty())
     {
-        buffer_info.usage |= VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+        if (destroyer_framebuffers.front().second + buffer_count < frame_count)
+        {
+            auto item = destroyer_framebuffers.front();
+            destroyer_framebuffers.pop_front();
+            vkDestroyFramebuffer(device, item.first, nullptr);
+        }
+        else
+        {
+            break;
+        }
     }
-
-    if (desc.res_usage & RESOURCE_USAGE_INDIRECT_BUFFER)
+    while (!destroyer_querypools.empty())
     {
-        buffer_info.usage |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+        if (destroyer_querypools.front().second + buffer_count < frame_count)
+        {
+            auto item = destroyer_querypools.front();
+            destroyer_querypools.pop_front();
+            vkDestroyQueryPool(device, item.first, nullptr);
+        }
+        else
+        {
+            break;
+        }
     }
 
-    buffer_info.usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    buffer_info.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    destroy_locker.unlock();
+}
 
-    VK_ASSERT(vkCreateBuffer(device, &buffer_info, nullptr, &internal_buffer->resource));
+void VulkanDevice::ResourceManager::Clear()
+{
+    Update(~0, 0);
+}
 
-    VkMemoryRequirements memory_requirements;
-    vkGetBufferMemoryRequirements(device, internal_buffer->resource, &memory_requirements);
+static bool IsSameDesc(const GfxBufferDesc& a, const GfxBufferDesc& b)
+{
+    return a.size == b.size && a.mem_usage == b.mem_usage && a.res_usage == b.res_usage && a.write_direct == b.write_direct;
+}
 
-    VkMemoryPropertyFlags memory_propertys;
-    if (desc.mem_usage == MEMORY_USAGE_GPU_ONLY)
-    {
-        memory_propertys = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    }
+static bool IsSameDesc(const GfxTextureDesc& a, const GfxTextureDesc& b)
+{
+    return a.width == b.width && a.height == b.height && a.depth == b.depth &&
+           a.num_layers == b.num_layers && a.num_levels == b.num_levels && a.format == b.format &&
+           a.sample_count == b.sample_count && a.mem_usage == b.mem_usage && a.res_usage == b.res_usage;
+}
 
-    if (desc.mem_usage == MEMORY_USAGE_CPU_TO_GPU)
-    {
-        memory_propertys = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    }
+void VulkanDevice::ResourceCache::Init(VulkanDevice* device)
+{
+    this->device = device;
+}
 
-    if (desc.mem_usage == MEMORY_USAGE_GPU_TO_CPU)
+bool VulkanDevice::ResourceCache::RecycleBuffer(VulkanBuffer* buffer)
+{
+    if (buffer->allocation.size > capacity)
     {
-        memory_propertys = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        return false;
     }
 
-    VkMemoryAllocateInfo memory_allocate_info = {};
-    memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memory_allocate_info.allocationSize = memory_requirements.size;
-    memory_allocate_info.memoryTypeIndex = FindMemoryType(memory_requirements.memoryTypeBits, memory_propertys);
+    BufferEntry entry;
+    entry.desc.size = buffer->size;
+    entry.desc.mem_usage = buffer->mem_usage;
+    entry.desc.res_usage = buffer->res_usage;
+    entry.desc.write_direct = buffer->write_direct;
+    entry.resource = buffer->resource;
+    entry.allocation = buffer->allocation;
+    entry.res_state = buffer->res_state;
+    entry.frame = device->resource_manager.frame_count;
+    buffers.push_front(entry);
+    cached_bytes += entry.allocation.size;
 
-    VK_ASSERT(vkAllocateMemory(device, &memory_allocate_info, nullptr, &internal_buffer->memory));
-    VK_ASSERT(vkBindBufferMemory(device, internal_buffer->resource, internal_buffer->memory, 0));
+    Evict(capacity, 0);
+    return true;
+}
 
-    return internal_buffer;
+bool VulkanDevice::ResourceCache::RecycleTexture(VulkanTexture* texture)
+{
+    // 放置在堆上的资源不拥有内存, 不参与回收
+    if (texture->heap || texture->allocation.size > capacity)
+    {
+        return false;
+    }
+
+    TextureEntry entry;
+    entry.desc.width = texture->width;
+    entry.desc.height = texture->height;
+    entry.desc.depth = texture->depth;
+    entry.desc.num_layers = texture->num_layers;
+    entry.desc.num_levels = texture->num_levels;
+    entry.desc.format = texture->format;
+    entry.desc.sample_count = texture->sample_count;
+    entry.desc.mem_usage = texture->mem_usage;
+    entry.desc.res_usage = texture->res_usage;
+    entry.resource = texture->resource;
+    entry.allocation = texture->allocation;
+    entry.res_state = texture->res_state;
+    entry.srv = texture->srv;
+    entry.uav = texture->uav;
+    entry.rtv = texture->rtv;
+    entry.dsv = texture->dsv;
+    entry.subresources_srv = std::move(texture->subresources_srv);
+    entry.subresources_uav = std::move(texture->subresources_uav);
+    entry.subresources_rtv = std::move(texture->subresources_rtv);
+    entry.subresources_dsv = std::move(texture->subresources_dsv);
+    for (uint32_t i = 0; i <= DSV; ++i)
+    {
+        entry.subresource_ranges[i] = std::move(texture->subresource_ranges[i]);
+    }
+    entry.frame = device->resource_manager.frame_count;
+    textures.push_front(std::move(entry));
+    cached_bytes += texture->allocation.size;
+
+    Evict(capacity, 0);
+    return true;
 }
 
-void VulkanDevice::DestroyBuffer(GfxBuffer* buffer)
+bool VulkanDevice::ResourceCache::AcquireBuffer(const GfxBufferDesc& desc, VulkanBuffer* buffer)
 {
-    resource_manager.destroy_locker.lock();
-    VulkanBuffer* internal_buffer = (VulkanBuffer*)buffer;
-    uint64_t frame_count = resource_manager.frame_count;
-    resource_manager.destroyer_buffers.push_back(std::make_pair(std::make_pair(internal_buffer->resource, internal_buffer->memory), frame_count));
-    resource_manager.destroy_locker.unlock();
+    device->resource_manager.destroy_locker.lock();
+    uint64_t frame_count = device->resource_manager.frame_count;
+    for (auto it = buffers.begin(); it != buffers.end(); ++it)
+    {
+        // 回收时间过短的资源可能仍在被GPU使用
+        if (it->frame + BLAST_BUFFER_COUNT >= frame_count || !IsSameDesc(it->desc, desc))
+        {
+            continue;
+        }
+
+        buffer->resource = it->resource;
+        buffer->allocation = it->allocation;
+        buffer->res_state = it->res_state;
+        buffer->concurrent = device->IsSharedWithCopyQueue(desc.res_usage);
+        cached_bytes -= it->allocation.size;
+        buffers.erase(it);
+        device->resource_manager.destroy_locker.unlock();
+
+        device->memory_allocator.SetCategory(buffer->allocation, MEMORY_CATEGORY_BUFFER);
+        return true;
+    }
+    device->resource_manager.destroy_locker.unlock();
+    return false;
 }
 
-GfxTexture* VulkanDevice::CreateTexture(const GfxTextureDesc& desc)
+bool VulkanDevice::ResourceCache::AcquireTexture(const GfxTextureDesc& desc, VulkanTexture* texture)
 {
-    VulkanTexture* internal_texture = new VulkanTexture(this);
-    internal_texture->width = desc.width;
-    internal_texture->height = desc.height;
-    internal_texture->depth = desc.depth;
-    internal_texture->num_layers = desc.num_layers;
-    internal_texture->num_levels = desc.num_levels;
-    internal_texture->format = desc.format;
-    internal_texture->clear = desc.clear;
-    internal_texture->sample_count = desc.sample_count;
-    internal_texture->state = desc.state;
-    internal_texture->mem_usage = desc.mem_usage;
-    internal_texture->res_usage = desc.res_usage;
-
-    VkImageType image_type = VK_IMAGE_TYPE_MAX_ENUM;
-    if (desc.depth > 1)
-        image_type = VK_IMAGE_TYPE_3D;
-    else if (desc.height > 1)
-        image_type = VK_IMAGE_TYPE_2D;
-    else
-        image_type = VK_IMAGE_TYPE_1D;
-
-    VkImageCreateInfo image_info = {};
-    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    image_info.pNext = nullptr;
-    image_info.imageType = image_type;
-    image_info.format = ToVulkanFormat(desc.format);
-    image_info.extent.width = desc.width;
-    image_info.extent.height = desc.height;
-    image_info.extent.depth = desc.depth;
-    image_info.mipLevels = desc.num_levels;
-    image_info.arrayLayers = desc.num_layers;
-    image_info.samples = ToVulkanSampleCount(desc.sample_count);
-    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    image_info.queueFamilyIndexCount = 0;
-    image_info.pQueueFamilyIndices = nullptr;
-    image_info.flags = 0;
-    if (RESOURCE_USAGE_CUBE_TEXTURE == (desc.res_usage & RESOURCE_USAGE_CUBE_TEXTURE))
-    {
-        image_info.flags |= VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
-    }
-    if (image_type == VK_IMAGE_TYPE_3D)
+    if (desc.heap)
     {
-        image_info.flags |= VK_IMAGE_CREATE_2D_ARRAY_COMPATIBLE_BIT_KHR;
+        return false;
     }
 
-    image_info.usage = 0;
-    if (desc.res_usage & RESOURCE_USAGE_SHADER_RESOURCE)
-    {
-        image_info.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
-    }
-    if (desc.res_usage & RESOURCE_USAGE_UNORDERED_ACCESS)
+    device->resource_manager.destroy_locker.lock();
+    uint64_t frame_count = device->resource_manager.frame_count;
+    for (auto it = textures.begin(); it != textures.end(); ++it)
     {
-        image_info.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
-    }
-    if (desc.res_usage & RESOURCE_USAGE_RENDER_TARGET)
-    {
-        image_info.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-    }
-    if (desc.res_usage & RESOURCE_USAGE_DEPTH_STENCIL)
-    {
-        image_info.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        if (it->frame + BLAST_BUFFER_COUNT >= frame_count || !IsSameDesc(it->desc, desc))
+        {
+            continue;
+        }
+
+        // 视图和资源状态随资源一起复用
+        texture->resource = it->resource;
+        texture->allocation = it->allocation;
+        texture->res_state = it->res_state;
+        texture->concurrent = device->IsSharedWithCopyQueue(desc.res_usage);
+        texture->srv = it->srv;
+        texture->uav = it->uav;
+        texture->rtv = it->rtv;
+        texture->dsv = it->dsv;
+        texture->subresources_srv = std::move(it->subresources_srv);
+        texture->subresources_uav = std::move(it->subresources_uav);
+        texture->subresources_rtv = std::move(it->subresources_rtv);
+        texture->subresources_dsv = std::move(it->subresources_dsv);
+        for (uint32_t i = 0; i <= DSV; ++i)
+        {
+            texture->subresource_ranges[i] = std::move(it->subresource_ranges[i]);
+        }
+        cached_bytes -= it->allocation.size;
+        textures.erase(it);
+        device->resource_manager.destroy_locker.unlock();
+        return true;
     }
-    image_info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-    image_info.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    device->resource_manager.destroy_locker.unlock();
+    return false;
+}
 
-    VK_ASSERT(vkCreateImage(device, &image_info, nullptr, &internal_texture->resource));
+void VulkanDevice::ResourceCache::Update()
+{
+    device->resource_manager.destroy_locker.lock();
+    uint64_t frame_count = device->resource_manager.frame_count;
+    Evict(capacity, frame_count > max_age ? frame_count - max_age : 0);
+    device->resource_manager.destroy_locker.unlock();
+}
 
-    VkMemoryRequirements memory_requirements;
-    vkGetImageMemoryRequirements(device, internal_texture->resource, &memory_requirements);
+void VulkanDevice::ResourceCache::Clear()
+{
+    device->resource_manager.destroy_locker.lock();
+    Evict(0, ~0);
+    device->resource_manager.destroy_locker.unlock();
+}
 
-    VkMemoryPropertyFlags memory_propertys;
-    if (desc.mem_usage == MEMORY_USAGE_GPU_ONLY)
-    {
-        memory_propertys = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    }
-    if (desc.mem_usage == MEMORY_USAGE_CPU_TO_GPU)
+void VulkanDevice::ResourceCache::Evict(uint64_t target_bytes, uint64_t min_frame)
+{
+    ResourceManager& resource_manager = device->resource_manager;
+    while (!buffers.empty() || !textures.empty())
     {
-        memory_propertys = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        // 比较两个链表尾部, 先释放回收最早的资源
+        bool evict_buffer = textures.empty() || (!buffers.empty() && buffers.back().frame <= textures.back().frame);
+        uint64_t frame = evict_buffer ? buffers.back().frame : textures.back().frame;
+        if (cached_bytes <= target_bytes && frame >= min_frame)
+        {
+            break;
+        }
+
+        // 按回收时的帧号进入销毁队列, 保证GPU不再使用
+        if (evict_buffer)
+        {
+            BufferEntry& entry = buffers.back();
+            resource_manager.destroyer_buffers.push_back(std::make_pair(std::make_pair(entry.resource, entry.allocation), entry.frame));
+            cached_bytes -= entry.allocation.size;
+            buffers.pop_back();
+        }
+        else
+        {
+            TextureEntry& entry = textures.back();
+            resource_manager.destroyer_images.push_back(std::make_pair(std::make_pair(entry.resource, entry.allocation), entry.frame));
+            VkImageView views[] = {entry.srv, entry.uav, entry.rtv, entry.dsv};
+            for (auto view : views)
+            {
+                if (view != VK_NULL_HANDLE)
+                {
+                    resource_manager.destroyer_imageviews.push_back(std::make_pair(view, entry.frame));
+                }
+            }
+            for (auto subresources : {&entry.subresources_srv, &entry.subresources_uav, &entry.subresources_rtv, &entry.subresources_dsv})
+            {
+                for (auto view : *subresources)
+                {
+                    resource_manager.destroyer_imageviews.push_back(std::make_pair(view, entry.frame));
+                }
+            }
+            cached_bytes -= entry.allocation.size;
+            textures.pop_back();
+        }
     }
+}
 
-    if (desc.mem_usage == MEMORY_USAGE_GPU_TO_CPU)
+VulkanDevice::VulkanDevice()
+    : GfxDevice()
+{
+    if (volkInitialize() != VK_SUCCESS)
     {
-        memory_propertys = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        return;
     }
+    uint32_t num_instance_available_layers;
+    VK_ASSERT(vkEnumerateInstanceLayerProperties(&num_instance_available_layers, nullptr));
+    std::vector<VkLayerProperties> instance_supported_layers(num_instance_available_layers);
+    VK_ASSERT(vkEnumerateInstanceLayerProperties(&num_instance_available_layers, instance_supported_layers.data()));
 
-    VkMemoryAllocateInfo mai = {};
-    mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    mai.allocationSize = memory_requirements.size;
-    mai.memoryTypeIndex = FindMemoryType(memory_requirements.memoryTypeBits, memory_propertys);
+    uint32_t num_instance_available_extensions;
+    VK_ASSERT(vkEnumerateInstanceExtensionProperties(nullptr, &num_instance_available_extensions, nullptr));
+    std::vector<VkExtensionProperties> instance_supported_extensions(num_instance_available_extensions);
+    VK_ASSERT(vkEnumerateInstanceExtensionProperties(nullptr, &num_instance_available_extensions, instance_supported_extensions.data()));
 
-    VK_ASSERT(vkAllocateMemory(device, &mai, nullptr, &internal_texture->memory));
-    VK_ASSERT(vkBindImageMemory(device, internal_texture->resource, internal_texture->memory, 0));
+    std::vector<const char*> instance_required_layers;
+    std::vector<const char*> instance_required_extensions;
+    std::vector<const char*> instance_layers;
+    std::vector<const char*> instance_extensions;
 
-    if (desc.res_usage & RESOURCE_USAGE_SHADER_RESOURCE)
+#if VULKAN_DEBUG
+    if (IsLayerSupported("VK_LAYER_KHRONOS_validation", instance_supported_layers))
     {
-        CreateSubresource(internal_texture, SRV, 0, -1, 0, -1);
+        instance_required_layers.push_back("VK_LAYER_KHRONOS_validation");
     }
-    if (desc.res_usage & RESOURCE_USAGE_UNORDERED_ACCESS)
+    else
     {
-        CreateSubresource(internal_texture, UAV, 0, -1, 0, -1);
+        instance_required_layers.push_back("VK_LAYER_LUNARG_standard_validation");
     }
-    if (desc.res_usage & RESOURCE_USAGE_RENDER_TARGET)
+    bool debug_utils = false;
+    if (IsExtensionSupported(VK_EXT_DEBUG_UTILS_EXTENSION_NAME, instance_supported_extensions))
     {
-        CreateSubresource(internal_texture, RTV, 0, -1, 0, -1);
+        debug_utils = true;
+        instance_required_extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
-    if (desc.res_usage & RESOURCE_USAGE_DEPTH_STENCIL)
+    else
     {
-        CreateSubresource(internal_texture, DSV, 0, -1, 0, -1);
+        instance_required_extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
     }
+#endif
+    instance_required_extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+    instance_required_extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 
-    return internal_texture;
-}
-
-void VulkanDevice::DestroyTexture(GfxTexture* texture)
-{
-    resource_manager.destroy_locker.lock();
-    VulkanTexture* internal_texture = (VulkanTexture*)texture;
-    uint64_t frame_count = resource_manager.frame_count;
-    resource_manager.destroyer_images.push_back(std::make_pair(std::make_pair(internal_texture->resource, internal_texture->memory), frame_count));
-
-    if (internal_texture->srv != VK_NULL_HANDLE)
+    for (auto it = instance_required_layers.begin(); it != instance_required_layers.end(); ++it)
     {
-        resource_manager.destroyer_imageviews.push_back(std::make_pair(internal_texture->srv, frame_count));
+        if (IsLayerSupported(*it, instance_supported_layers))
+        {
+            instance_layers.push_back(*it);
+        }
     }
-    if (internal_texture->uav != VK_NULL_HANDLE)
+
+    for (auto it = instance_required_extensions.begin(); it != instance_required_extensions.end(); ++it)
     {
-        resource_manager.destroyer_imageviews.push_back(std::make_pair(internal_texture->uav, frame_count));
+        if (IsExtensionSupported(*it, instance_supported_extensions))
+        {
+            instance_extensions.push_back(*it);
+        }
     }
-    if (internal_texture->rtv != VK_NULL_HANDLE)
+
+    VkApplicationInfo app_info = {};
+    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app_info.pEngineName = "BlastEngine";
+    app_info.apiVersion = VK_API_VERSION_1_3;
+
+    VkInstanceCreateInfo ici;
+    ici.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    ici.pNext = nullptr;
+    ici.flags = 0;
+    ici.pApplicationInfo = &app_info;
+    ici.enabledLayerCount = instance_layers.size();
+    ici.ppEnabledLayerNames = instance_layers.data();
+    ici.enabledExtensionCount = instance_extensions.size();
+    ici.ppEnabledExtensionNames = instance_extensions.data();
+
+    VK_ASSERT(vkCreateInstance(&ici, nullptr, &instance));
+
+    volkLoadInstance(instance);
+
+#if VULKAN_DEBUG
+    if (debug_utils)
     {
-        resource_manager.destroyer_imageviews.push_back(std::make_pair(internal_texture->rtv, frame_count));
+        VkDebugUtilsMessengerCreateInfoEXT dumci{VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT};
+        dumci.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+        dumci.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT;
+        dumci.pfnUserCallback = DebugUtilsMessengerCallback;
+
+        VK_ASSERT(vkCreateDebugUtilsMessengerEXT(instance, &dumci, nullptr, &debug_messenger));
     }
-    if (internal_texture->dsv != VK_NULL_HANDLE)
+    else
     {
-        resource_manager.destroyer_imageviews.push_back(std::make_pair(internal_texture->dsv, frame_count));
-    }
+        VkDebugReportCallbackCreateInfoEXT drcci{VK_STRUCTURE_TYPE_DEBUG_REPORT_CREATE_INFO_EXT};
+        drcci.flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT;
+        drcci.pfnCallback = DebugReportCallback;
 
-    for (auto x : internal_texture->subresources_srv)
-    {
-        resource_manager.destroyer_imageviews.push_back(std::make_pair(x, frame_count));
+        VK_ASSERT(vkCreateDebugReportCallbackEXT(instance, &drcci, nullptr, &debug_report_callback));
     }
+#endif
+    uint32_t num_gpus = 0;
+    VK_ASSERT(vkEnumeratePhysicalDevices(instance, &num_gpus, nullptr));
 
-    for (auto x : internal_texture->subresources_uav)
-    {
-        resource_manager.destroyer_imageviews.push_back(std::make_pair(x, frame_count));
-    }
+    std::vector<VkPhysicalDevice> gpus(num_gpus);
+    VK_ASSERT(vkEnumeratePhysicalDevices(instance, &num_gpus, gpus.data()));
 
-    for (auto x : internal_texture->subresources_rtv)
+    for (auto& g : gpus)
     {
-        resource_manager.destroyer_imageviews.push_back(std::make_pair(x, frame_count));
+        VkPhysicalDeviceProperties props;
+        vkGetPhysicalDeviceProperties(g, &props);
+        BLAST_LOGI("Found Vulkan GPU: %s\n", props.deviceName);
+        BLAST_LOGI("API: %u.%u.%u\n",
+                   VK_VERSION_MAJOR(props.apiVersion),
+                   VK_VERSION_MINOR(props.apiVersion),
+                   VK_VERSION_PATCH(props.apiVersion));
+        BLAST_LOGI("Driver: %u.%u.%u\n",
+                   VK_VERSION_MAJOR(props.driverVersion),
+                   VK_VERSION_MINOR(props.driverVersion),
+                   VK_VERSION_PATCH(props.driverVersion));
     }
 
-    for (auto x : internal_texture->subresources_dsv)
-    {
-        resource_manager.destroyer_imageviews.push_back(std::make_pair(x, frame_count));
-    }
+    // todo: 支持多个GPU选择
+    phy_device = gpus.front();
 
-    resource_manager.destroy_locker.unlock();
-}
+    vkGetPhysicalDeviceProperties(phy_device, &phy_device_properties);
+    vkGetPhysicalDeviceMemoryProperties(phy_device, &phy_device_memory_properties);
 
-int32_t VulkanDevice::CreateSubresource(GfxTexture* texture, SubResourceType type, uint32_t first_slice, uint32_t slice_count, uint32_t first_mip, uint32_t mip_count)
-{
-    VulkanTexture* internal_texture = (VulkanTexture*)texture;
+    // feature
+    VkPhysicalDeviceFeatures2KHR phy_device_features2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR};
+    VkPhysicalDeviceVulkan11Features features_1_1 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES};
+    VkPhysicalDeviceVulkan12Features features_1_2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    phy_device_features2.pNext = &features_1_1;
+    features_1_1.pNext = &features_1_2;
+    vkGetPhysicalDeviceFeatures2(phy_device, &phy_device_features2);
 
-    VkImageViewCreateInfo ivci = {};
-    ivci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    ivci.flags = 0;
-    ivci.image = internal_texture->resource;
-    ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    ivci.subresourceRange.baseArrayLayer = first_slice;
-    ivci.subresourceRange.layerCount = slice_count;
-    ivci.subresourceRange.baseMipLevel = first_mip;
-    ivci.subresourceRange.levelCount = mip_count;
-    ivci.format = ToVulkanFormat(texture->format);
+    uint32_t num_queue_families;
+    vkGetPhysicalDeviceQueueFamilyProperties(phy_device, &num_queue_families, nullptr);
 
-    VkImageType image_type = VK_IMAGE_TYPE_MAX_ENUM;
-    if (texture->depth > 1)
-        image_type = VK_IMAGE_TYPE_3D;
-    else if (texture->height > 1)
-        image_type = VK_IMAGE_TYPE_2D;
-    else
-        image_type = VK_IMAGE_TYPE_1D;
+    queue_family_properties.resize(num_queue_families);
+    vkGetPhysicalDeviceQueueFamilyProperties(phy_device, &num_queue_families, queue_family_properties.data());
 
-    VkImageViewType view_type = VK_IMAGE_VIEW_TYPE_MAX_ENUM;
-    switch (image_type)
+    graphics_family = -1;
+    compute_family = -1;
+    copy_family = -1;
+    for (uint32_t i = 0; i < (uint32_t)queue_family_properties.size(); i++)
     {
-        case VK_IMAGE_TYPE_1D:
-            view_type = texture->num_layers > 1 ? VK_IMAGE_VIEW_TYPE_1D_ARRAY : VK_IMAGE_VIEW_TYPE_1D;
-            break;
-        case VK_IMAGE_TYPE_2D:
-            if (RESOURCE_USAGE_CUBE_TEXTURE == (texture->res_usage & RESOURCE_USAGE_CUBE_TEXTURE))
-                view_type = (texture->num_layers > 6) ? VK_IMAGE_VIEW_TYPE_CUBE_ARRAY : VK_IMAGE_VIEW_TYPE_CUBE;
-            else
-                view_type = texture->num_layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+        if ((queue_family_properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && (queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0)
+        {
+            compute_family = i;
             break;
-        case VK_IMAGE_TYPE_3D:
-            if (texture->num_layers > 1)
-                assert(false);
+        }
+    }
 
-            view_type = VK_IMAGE_VIEW_TYPE_3D;
+    for (uint32_t i = 0; i < (uint32_t)queue_family_properties.size(); i++)
+    {
+        if ((queue_family_properties[i].queueFlags & VK_QUEUE_TRANSFER_BIT) && ((queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0) && ((queue_family_properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) == 0))
+        {
+            copy_family = i;
             break;
-        default:
-            assert(false && "image format not supported!");
+        }
+    }
+
+    for (uint32_t i = 0; i < (uint32_t)queue_family_properties.size(); i++)
+    {
+        if (queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        {
+            graphics_family = i;
             break;
+        }
     }
-    ivci.viewType = view_type;
 
-    switch (type)
+    for (uint32_t family : {graphics_family, compute_family, copy_family})
     {
-        case SRV:
+        if (family != (uint32_t)-1 && std::find(queue_families.begin(), queue_families.end(), family) == queue_families.end())
         {
-            switch (ivci.format)
-            {
-                case VK_FORMAT_D16_UNORM:
-                    ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-                    break;
-                case VK_FORMAT_D32_SFLOAT:
-                    ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-                    break;
-                case VK_FORMAT_D24_UNORM_S8_UINT:
-                    ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-                    break;
-                case VK_FORMAT_D32_SFLOAT_S8_UINT:
-                    ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-                    break;
-            }
+            queue_families.push_back(family);
+        }
+    }
 
-            VkImageView srv;
-            VK_ASSERT(vkCreateImageView(device, &ivci, nullptr, &srv));
+    const float graphics_queue_prio = 0.0f;
+    const float compute_queue_prio = 0.1f;
+    const float transfer_queue_prio = 0.2f;
 
-            if (internal_texture->srv == VK_NULL_HANDLE)
-            {
-                internal_texture->srv = srv;
-                return -1;
-            }
-            internal_texture->subresources_srv.push_back(srv);
-            return int32_t(internal_texture->subresources_srv.size() - 1);
-        }
-        break;
-        case UAV:
-        {
-            if (ivci.viewType == VK_IMAGE_VIEW_TYPE_CUBE || ivci.viewType == VK_IMAGE_VIEW_TYPE_CUBE_ARRAY)
-            {
-                ivci.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
-            }
+    // note:目前只使用三个queue
+    std::vector<VkDeviceQueueCreateInfo> qci{};
+    qci.resize(3);
 
-            VkImageView uav;
-            VK_ASSERT(vkCreateImageView(device, &ivci, nullptr, &uav));
+    qci[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    qci[0].queueFamilyIndex = graphics_family;
+    qci[0].queueCount = 1;//queue_Family_properties[mGraphicsFamily].queueCount;
+    qci[0].pQueuePriorities = &graphics_queue_prio;
 
-            if (internal_texture->uav == VK_NULL_HANDLE)
-            {
-                internal_texture->uav = uav;
-                return -1;
-            }
-            internal_texture->subresources_uav.push_back(uav);
-            return int32_t(internal_texture->subresources_uav.size() - 1);
-        }
-        break;
-        case RTV:
-        {
-            VkImageView rtv;
-            ivci.subresourceRange.levelCount = 1;
-            VK_ASSERT(vkCreateImageView(device, &ivci, nullptr, &rtv));
+    qci[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    qci[1].queueFamilyIndex = compute_family;
+    qci[1].queueCount = 1;//queue_Family_properties[mComputeFamily].queueCount;
+    qci[1].pQueuePriorities = &compute_queue_prio;
 
-            if (internal_texture->rtv == VK_NULL_HANDLE)
-            {
-                internal_texture->rtv = rtv;
-                return -1;
-            }
-            internal_texture->subresources_rtv.push_back(rtv);
-            return int32_t(internal_texture->subresources_rtv.size() - 1);
-        }
-        break;
-        case DSV:
-        {
-            ivci.subresourceRange.levelCount = 1;
-            ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    qci[2].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    qci[2].queueFamilyIndex = copy_family;
+    qci[2].queueCount = 1;//queue_Family_properties[mTransferFamily].queueCount;
+    qci[2].pQueuePriorities = &transfer_queue_prio;
 
-            switch (texture->format)
-            {
-                case FORMAT_D24_UNORM_S8_UINT:
-                    ivci.format = VK_FORMAT_D24_UNORM_S8_UINT;
-                    ivci.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-                    break;
-            }
+    uint32_t num_device_available_extensions = 0;
+    VK_ASSERT(vkEnumerateDeviceExtensionProperties(phy_device, nullptr, &num_device_available_extensions, nullptr));
 
-            VkImageView dsv;
-            VK_ASSERT(vkCreateImageView(device, &ivci, nullptr, &dsv));
+    std::vector<VkExtensionProperties> device_available_extensions(num_device_available_extensions);
+    VK_ASSERT(vkEnumerateDeviceExtensionProperties(phy_device, nullptr, &num_device_available_extensions, device_available_extensions.data()));
 
-            if (internal_texture->dsv == VK_NULL_HANDLE)
-            {
-                internal_texture->dsv = dsv;
-                return -1;
-            }
-            internal_texture->subresources_dsv.push_back(dsv);
-            return int32_t(internal_texture->subresources_dsv.size() - 1);
+    std::vector<const char*> device_required_extensions;
+    std::vector<const char*> device_extensions;
+    device_required_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    device_required_extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+    device_required_extensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+    device_required_extensions.push_back(VK_KHR_MAINTENANCE1_EXTENSION_NAME);
+    device_required_extensions.push_back(VK_KHR_MAINTENANCE2_EXTENSION_NAME);
+    device_required_extensions.push_back(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME);
+    device_required_extensions.push_back(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME);
+    device_required_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    device_required_extensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+
+    for (auto it = device_required_extensions.begin(); it != device_required_extensions.end(); ++it)
+    {
+        if (IsExtensionSupported(*it, device_available_extensions))
+        {
+            device_extensions.push_back(*it);
         }
-        break;
-        default:
-            break;
     }
-    return -1;
-}
+    memory_budget_supported = IsExtensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, device_available_extensions);
+    push_descriptor_supported = IsExtensionSupported(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME, device_available_extensions);
 
-GfxSampler* VulkanDevice::CreateSampler(const GfxSamplerDesc& desc)
-{
-    VulkanSampler* internal_sampler = new VulkanSampler(this);
-    internal_sampler->desc = desc;
+    VkDeviceCreateInfo dci;
+    dci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    dci.pNext = &phy_device_features2;
+    dci.flags = 0;
+    dci.queueCreateInfoCount = qci.size();
+    dci.pQueueCreateInfos = qci.data();
+    dci.pEnabledFeatures = nullptr;
+    dci.enabledExtensionCount = device_extensions.size();
+    dci.ppEnabledExtensionNames = device_extensions.data();
+    dci.enabledLayerCount = 0;
+    dci.ppEnabledLayerNames = nullptr;
 
-    VkSamplerCreateInfo sci = {};
-    sci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    sci.magFilter = ToVulkanFilter(desc.mag_filter);
-    sci.minFilter = ToVulkanFilter(desc.min_filter);
-    sci.mipmapMode = ToVulkanMipmapMode(desc.mipmap_mode);
-    sci.addressModeU = ToVulkanAddressMode(desc.address_u);
-    sci.addressModeV = ToVulkanAddressMode(desc.address_v);
-    sci.addressModeW = ToVulkanAddressMode(desc.address_w);
-    sci.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-    sci.anisotropyEnable = VK_FALSE;
-    sci.maxAnisotropy = 0.0f;
-    sci.unnormalizedCoordinates = VK_FALSE;
-    sci.compareEnable = VK_FALSE;
-    sci.compareOp = VK_COMPARE_OP_ALWAYS;
-    VK_ASSERT(vkCreateSampler(device, &sci, nullptr, &internal_sampler->sampler));
+    VK_ASSERT(vkCreateDevice(phy_device, &dci, nullptr, &device));
 
-    return internal_sampler;
-}
+    vkGetDeviceQueue(device, graphics_family, 0, &graphics_queue);
+    vkGetDeviceQueue(device, compute_family, 0, &compute_queue);
+    vkGetDeviceQueue(device, copy_family, 0, &copy_queue);
 
-void VulkanDevice::DestroySampler(GfxSampler* sampler)
-{
-    resource_manager.destroy_locker.lock();
-    VulkanSampler* internal_sampler = (VulkanSampler*)sampler;
-    uint64_t frame_count = resource_manager.frame_count;
-    resource_manager.destroyer_samplers.push_back(std::make_pair(internal_sampler->sampler, frame_count));
-    resource_manager.destroy_locker.unlock();
-}
+    // resource manager
+    resource_manager.device = device;
+    resource_manager.instance = instance;
+    resource_manager.allocator = &memory_allocator;
 
-GfxSwapChain* VulkanDevice::CreateSwapChain(const GfxSwapChainDesc& desc, GfxSwapChain* old_swapchain)
-{
-    VulkanSwapChain* internal_swapchain = nullptr;
-    if (old_swapchain)
-    {
-        internal_swapchain = (VulkanSwapChain*)old_swapchain;
-    }
-    else
-    {
-        internal_swapchain = new VulkanSwapChain(this);
-    }
-    internal_swapchain->desc = desc;
+    // memory allocator
+    memory_allocator.Init(this);
+    write_direct_supported = FindMemoryType(~0u, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != (uint32_t)-1;
 
-    if (internal_swapchain->surface == VK_NULL_HANDLE)
-    {
-#ifdef WIN32
-        VkWin32SurfaceCreateInfoKHR sci = {};
-        sci.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
-        sci.pNext = nullptr;
-        sci.flags = 0;
-        sci.hinstance = ::GetModuleHandle(nullptr);
-        sci.hwnd = (HWND)desc.window;
-        VK_ASSERT(vkCreateWin32SurfaceKHR(instance, &sci, nullptr, &internal_swapchain->surface));
-#endif
-    }
+    // resource cache
+    resource_cache.Init(this);
 
-    // Get present family
-    uint32_t present_family = VK_QUEUE_FAMILY_IGNORED;
-    uint32_t family_index = 0;
-    for (const auto& queue_family : queue_family_properties)
+    // queues
     {
-        VkBool32 present_support = false;
-        VK_ASSERT(vkGetPhysicalDeviceSurfaceSupportKHR(phy_device, (uint32_t)family_index, internal_swapchain->surface, &present_support));
+        queues[QUEUE_GRAPHICS].queue = graphics_queue;
+        queues[QUEUE_COMPUTE].queue = compute_queue;
 
-        if (present_family == VK_QUEUE_FAMILY_IGNORED && queue_family.queueCount > 0 && present_support)
+        VkSemaphoreTypeCreateInfo stci = {};
+        stci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        stci.pNext = nullptr;
+        stci.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        stci.initialValue = 0;
+
+        VkSemaphoreCreateInfo sci = {};
+        sci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        sci.pNext = &stci;
+        sci.flags = 0;
+
+        VK_ASSERT(vkCreateSemaphore(device, &sci, nullptr, &queues[QUEUE_GRAPHICS].semaphore));
+        VK_ASSERT(vkCreateSemaphore(device, &sci, nullptr, &queues[QUEUE_COMPUTE].semaphore));
+    }
+
+    // frames
+    for (uint32_t i = 0; i < BLAST_BUFFER_COUNT; ++i)
+    {
+        for (uint32_t j = 0; j < BLAST_QUEUE_COUNT; ++j)
         {
-            present_family = family_index;
-            break;
+            VkFenceCreateInfo fci = {};
+            fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            VK_ASSERT(vkCreateFence(device, &fci, nullptr, &frames[i].fence[j]));
         }
+        VkCommandPoolCreateInfo cpci = {};
+        cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        cpci.queueFamilyIndex = graphics_family;
+        cpci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        VK_ASSERT(vkCreateCommandPool(device, &cpci, nullptr, &frames[i].init_command_pool));
 
-        family_index++;
+        VkCommandBufferAllocateInfo cbai = {};
+        cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cbai.commandBufferCount = 1;
+        cbai.commandPool = frames[i].init_command_pool;
+        cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        VK_ASSERT(vkAllocateCommandBuffers(device, &cbai, &frames[i].init_command_buffer));
+
+        VkCommandBufferBeginInfo cbi = {};
+        cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        cbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        cbi.pInheritanceInfo = nullptr;
+
+        VK_ASSERT(vkBeginCommandBuffer(frames[i].init_command_buffer, &cbi));
     }
 
-    if (present_family == VK_QUEUE_FAMILY_IGNORED)
+    // bindless, push descriptor
     {
-        return nullptr;
+        VkPhysicalDeviceVulkan12Properties properties_1_2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES};
+        VkPhysicalDevicePushDescriptorPropertiesKHR push_descriptor_properties = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR};
+        VkPhysicalDeviceProperties2 properties2 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+        properties2.pNext = &properties_1_2;
+        if (push_descriptor_supported)
+        {
+            properties_1_2.pNext = &push_descriptor_properties;
+        }
+        vkGetPhysicalDeviceProperties2(phy_device, &properties2);
+        max_push_descriptors = push_descriptor_supported ? push_descriptor_properties.maxPushDescriptors : 0;
+
+        uint32_t capacities[BINDLESS_HEAP_COUNT];
+        capacities[BINDLESS_HEAP_TEXTURE] = std::min(16384u, std::min(properties_1_2.maxPerStageDescriptorUpdateAfterBindSampledImages, properties_1_2.maxDescriptorSetUpdateAfterBindSampledImages));
+        capacities[BINDLESS_HEAP_RW_TEXTURE] = std::min(4096u, std::min(properties_1_2.maxPerStageDescriptorUpdateAfterBindStorageImages, properties_1_2.maxDescriptorSetUpdateAfterBindStorageImages));
+        capacities[BINDLESS_HEAP_BUFFER] = std::min(16384u, std::min(properties_1_2.maxPerStageDescriptorUpdateAfterBindStorageBuffers, properties_1_2.maxDescriptorSetUpdateAfterBindStorageBuffers));
+        capacities[BINDLESS_HEAP_SAMPLER] = std::min(1024u, std::min(properties_1_2.maxPerStageDescriptorUpdateAfterBindSamplers, properties_1_2.maxDescriptorSetUpdateAfterBindSamplers));
+
+        uint64_t total_capacity = 0;
+        for (uint32_t i = 0; i < BINDLESS_HEAP_COUNT; ++i)
+        {
+            total_capacity += capacities[i];
+        }
+
+        bindless_supported = features_1_2.descriptorIndexing && features_1_2.runtimeDescriptorArray &&
+                             features_1_2.descriptorBindingPartiallyBound && features_1_2.descriptorBindingUpdateUnusedWhilePending &&
+                             features_1_2.descriptorBindingSampledImageUpdateAfterBind && features_1_2.descriptorBindingStorageImageUpdateAfterBind &&
+                             features_1_2.descriptorBindingStorageBufferUpdateAfterBind &&
+                             phy_device_properties.limits.maxBoundDescriptorSets > BLAST_BINDLESS_SAMPLER_SET &&
+                             total_capacity <= properties_1_2.maxPerStageUpdateAfterBindResources;
+
+        if (bindless_supported)
+        {
+            bindless_heaps[BINDLESS_HEAP_TEXTURE].Init(this, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, capacities[BINDLESS_HEAP_TEXTURE]);
+            bindless_heaps[BINDLESS_HEAP_RW_TEXTURE].Init(this, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, capacities[BINDLESS_HEAP_RW_TEXTURE]);
+            bindless_heaps[BINDLESS_HEAP_BUFFER].Init(this, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, capacities[BINDLESS_HEAP_BUFFER]);
+            bindless_heaps[BINDLESS_HEAP_SAMPLER].Init(this, VK_DESCRIPTOR_TYPE_SAMPLER, capacities[BINDLESS_HEAP_SAMPLER]);
+        }
     }
 
-    VkSurfaceCapabilitiesKHR swapchain_capabilities;
-    VK_ASSERT(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(phy_device, internal_swapchain->surface, &swapchain_capabilities));
+    {
+        VkDescriptorSetLayoutCreateInfo dslci = {};
+        dslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        VK_ASSERT(vkCreateDescriptorSetLayout(device, &dslci, nullptr, &empty_set_layout));
+    }
 
-    uint32_t format_count;
-    VK_ASSERT(vkGetPhysicalDeviceSurfaceFormatsKHR(phy_device, internal_swapchain->surface, &format_count, nullptr));
+    // CopyPool
+    copy_pool.Init(this);
 
-    std::vector<VkSurfaceFormatKHR> swapchain_formats(format_count);
-    VK_ASSERT(vkGetPhysicalDeviceSurfaceFormatsKHR(phy_device, internal_swapchain->surface, &format_count, swapchain_formats.data()));
+    init_stage_buffer = new StageBuffer();
+    init_stage_buffer->Init(this);
 
-    uint32_t present_mode_count;
-    VK_ASSERT(vkGetPhysicalDeviceSurfacePresentModesKHR(phy_device, internal_swapchain->surface, &present_mode_count, nullptr));
+    readback_ring.Init(this);
 
-    std::vector<VkPresentModeKHR> swapchain_present_modes(present_mode_count);
-    VK_ASSERT(vkGetPhysicalDeviceSurfacePresentModesKHR(phy_device, internal_swapchain->surface, &present_mode_count, swapchain_present_modes.data()));
+    streaming.Init(this);
+}
 
-    // Todo: Using outside format
-    VkSurfaceFormatKHR surface_format = {VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
-    surface_format.format = VK_FORMAT_B8G8R8A8_UNORM;
+VulkanDevice::~VulkanDevice()
+{
+    streaming.Destroy();
 
-    internal_swapchain->swapchain_extent = {};
-    internal_swapchain->swapchain_extent.width = std::max(swapchain_capabilities.minImageExtent.width, swapchain_capabilities.maxImageExtent.width);
-    internal_swapchain->swapchain_extent.height = std::max(swapchain_capabilities.minImageExtent.height, swapchain_capabilities.maxImageExtent.height);
+    vkDeviceWaitIdle(device);
 
-    uint32_t image_count = desc.buffer_count;
-    if ((swapchain_capabilities.maxImageCount > 0) && (image_count > swapchain_capabilities.maxImageCount))
+    // 清理
+    for (auto& queue : queues)
     {
-        image_count = swapchain_capabilities.maxImageCount;
+        vkDestroySemaphore(device, queue.semaphore, nullptr);
     }
 
-    VkSwapchainCreateInfoKHR scci = {};
-    scci.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-    scci.surface = internal_swapchain->surface;
-    scci.minImageCount = image_count;
-    scci.imageFormat = surface_format.format;
-    scci.imageColorSpace = surface_format.colorSpace;
-    scci.imageExtent = internal_swapchain->swapchain_extent;
-    scci.imageArrayLayers = 1;
-    scci.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-    scci.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    for (auto& frame : frames)
+    {
+        for (int queue = 0; queue < BLAST_QUEUE_COUNT; ++queue)
+        {
+            vkDestroyFence(device, frame.fence[queue], nullptr);
+            for (int cmd = 0; cmd < BLAST_CMD_COUNT; ++cmd)
+            {
+                vkDestroyCommandPool(device, frame.command_pools[cmd][queue], nullptr);
+                vkDestroyCommandPool(device, frame.acquire_command_pools[cmd][queue], nullptr);
+            }
+        }
+        vkDestroyCommandPool(device, frame.init_command_pool, nullptr);
 
-    // transform
-    if (swapchain_capabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
-        scci.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-    else
-        scci.preTransform = swapchain_capabilities.currentTransform;
+        for (auto& descriptormanager : frame.descriptor_pools)
+        {
+            descriptormanager.Destroy();
+        }
 
-    // composite alpha
-    std::vector<VkCompositeAlphaFlagBitsKHR> composite_alpha_flags = {
-        VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-        VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR,
-        VK_COMPOSITE_ALPHA_POST_MULTIPLIED_BIT_KHR,
-        VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,
-    };
-    for (auto& composite_alpha_flag : composite_alpha_flags)
+        for (auto& transient_allocator : frame.transient_allocators)
+        {
+            transient_allocator.Destroy();
+        }
+    }
+
+    for (auto& stage_buffer : stage_buffers)
     {
-        if (swapchain_capabilities.supportedCompositeAlpha & composite_alpha_flag)
+        if (stage_buffer)
         {
-            scci.compositeAlpha = composite_alpha_flag;
-            break;
-        };
+            stage_buffer->Destroy();
+            BLAST_SAFE_DELETE(stage_buffer);
+        }
     }
+    init_stage_buffer->Destroy();
+    BLAST_SAFE_DELETE(init_stage_buffer);
+    readback_ring.Destroy();
 
-    scci.presentMode = VK_PRESENT_MODE_FIFO_KHR;
-    if (!desc.vsync)
+    for (auto& x : mip_shaders)
     {
-        for (auto& presentMode : swapchain_present_modes)
+        BLAST_SAFE_DELETE(x.second);
+    }
+    mip_shaders.clear();
+
+    copy_pool.Destroy();
+    resource_cache.Clear();
+    resource_manager.Clear();
+    memory_allocator.Destroy();
+
+    // 没有被销毁的管线和shader留下的布局
+    for (auto& x : layout_cache)
+    {
+        vkDestroyPipelineLayout(device, x.second->pipeline_layout, nullptr);
+        for (uint32_t i = 0; i < x.second->set_count; ++i)
         {
-            if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+            auto& set = x.second->sets[i];
+            if (set.descriptor_set_layout != empty_set_layout)
             {
-                scci.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
-                break;
+                vkDestroyDescriptorSetLayout(device, set.descriptor_set_layout, nullptr);
             }
-            if (presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+            if (set.descriptor_update_template)
             {
-                scci.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+                vkDestroyDescriptorUpdateTemplate(device, set.descriptor_update_template, nullptr);
             }
         }
+        BLAST_SAFE_DELETE(x.second);
     }
-    scci.clipped = VK_TRUE;
-    scci.oldSwapchain = internal_swapchain->swapchain;
-    VK_ASSERT(vkCreateSwapchainKHR(device, &scci, nullptr, &internal_swapchain->swapchain));
+    layout_cache.clear();
 
-    if (scci.oldSwapchain != VK_NULL_HANDLE)
+    for (auto& heap : bindless_heaps)
     {
-        vkDestroySwapchainKHR(device, scci.oldSwapchain, nullptr);
+        heap.Destroy();
+    }
+    if (empty_set_layout != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorSetLayout(device, empty_set_layout, nullptr);
     }
 
-    // Images
-    VK_ASSERT(vkGetSwapchainImagesKHR(device, internal_swapchain->swapchain, &image_count, nullptr));
-    internal_swapchain->swapchain_images.resize(image_count);
-    VK_ASSERT(vkGetSwapchainImagesKHR(device, internal_swapchain->swapchain, &image_count, internal_swapchain->swapchain_images.data()));
-    internal_swapchain->swapchain_image_format = surface_format.format;
+    vkDestroyDevice(device, nullptr);
 
-    // Create default render pass:
+#if VULKAN_DEBUG
+    if (debug_messenger != VK_NULL_HANDLE)
     {
-        VkAttachmentDescription color_attachment = {};
-        color_attachment.format = surface_format.format;
-        color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-        VkAttachmentReference color_attachment_ref = {};
-        color_attachment_ref.attachment = 0;
-        color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        vkDestroyDebugUtilsMessengerEXT(instance, debug_messenger, nullptr);
+        debug_messenger = VK_NULL_HANDLE;
+    }
+    if (debug_report_callback != VK_NULL_HANDLE)
+    {
+        vkDestroyDebugReportCallbackEXT(instance, debug_report_callback, nullptr);
+        debug_report_callback = VK_NULL_HANDLE;
+    }
+#endif
+    vkDestroyInstance(instance, nullptr);
+}
 
-        VkSubpassDescription subpass = {};
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 1;
-        subpass.pColorAttachments = &color_attachment_ref;
+uint32_t VulkanDevice::FindMemoryType(const uint32_t& typeFilter, const VkMemoryPropertyFlags& properties)
+{
+    for (uint32_t i = 0; i < phy_device_memory_properties.memoryTypeCount; i++)
+    {
+        if ((typeFilter & (1 << i)) && (phy_device_memory_properties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
+    }
 
-        VkRenderPassCreateInfo rpci = {};
-        rpci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        rpci.attachmentCount = 1;
-        rpci.pAttachments = &color_attachment;
-        rpci.subpassCount = 1;
-        rpci.pSubpasses = &subpass;
+    return -1;
+}
 
-        VkSubpassDependency dependency = {};
-        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependency.dstSubpass = 0;
-        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.srcAccessMask = 0;
-        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+GfxBuffer* VulkanDevice::CreateBuffer(const GfxBufferDesc& desc)
+{
+    VulkanBuffer* internal_buffer = new VulkanBuffer(this);
+    internal_buffer->size = desc.size;
+    internal_buffer->mem_usage = desc.mem_usage;
+    internal_buffer->res_usage = desc.res_usage;
+    internal_buffer->write_direct = desc.write_direct;
 
-        rpci.dependencyCount = 1;
-        rpci.pDependencies = &dependency;
-        if (internal_swapchain->renderpass != VK_NULL_HANDLE)
+    if (resource_cache.AcquireBuffer(desc, internal_buffer))
+    {
+        if (desc.mem_usage != MEMORY_USAGE_GPU_ONLY || desc.write_direct)
         {
-            resource_manager.destroyer_renderpasses.push_back(std::make_pair(internal_swapchain->renderpass, resource_manager.frame_count));
+            internal_buffer->mapped_data = internal_buffer->allocation.mapped;
         }
+    }
+    else
+    {
+        CreateBufferResource(internal_buffer, desc);
+    }
 
-        VK_ASSERT(vkCreateRenderPass(device, &rpci, nullptr, &internal_swapchain->renderpass));
+    // 只有storage buffer可以放入bindless堆, 它们会被GPU写入, 不参与碎片整理
+    if (desc.bindless && bindless_supported && (desc.res_usage & RESOURCE_USAGE_RW_BUFFER))
+    {
+        internal_buffer->srv_index = bindless_heaps[BINDLESS_HEAP_BUFFER].Allocate();
+        internal_buffer->uav_index = internal_buffer->srv_index;
+        if (internal_buffer->srv_index >= 0)
+        {
+            internal_buffer->bindless = true;
+            VulkanDescriptorData data;
+            memset(&data, 0, sizeof(data));
+            data.buffer.buffer = internal_buffer->resource;
+            data.buffer.range = VK_WHOLE_SIZE;
+            bindless_heaps[BINDLESS_HEAP_BUFFER].Write(internal_buffer->srv_index, data);
+        }
+        else
+        {
+            BLAST_LOGW("Bindless buffer heap is full\n");
+        }
+    }
 
-        // Compute renderpass hash
-        internal_swapchain->renderpass_hash = 0;
-        hash_combine(internal_swapchain->renderpass_hash, internal_swapchain->swapchain_image_format);
+    // 不会被GPU写入的资源可以在碎片整理时移动, 直接写入的缓存对外暴露了映射地址, 不能移动
+    resource_manager.destroy_locker.lock();
+    if (desc.mem_usage == MEMORY_USAGE_GPU_ONLY && !internal_buffer->mapped_data && !(desc.res_usage & RESOURCE_USAGE_RW_BUFFER))
+    {
+        internal_buffer->frame_written = frame_count;
+        movable_resources.buffers.insert(internal_buffer);
     }
+    resource_manager.destroy_locker.unlock();
 
-    // Create swap chain render targets
-    internal_swapchain->swapchain_image_views.resize(internal_swapchain->swapchain_images.size());
-    internal_swapchain->swapchain_framebuffers.resize(internal_swapchain->swapchain_images.size());
-    for (uint32_t i = 0; i < internal_swapchain->swapchain_images.size(); ++i)
+    if (desc.data)
     {
-        VkImageViewCreateInfo ivci = {};
-        ivci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        ivci.image = internal_swapchain->swapchain_images[i];
-        ivci.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        ivci.format = internal_swapchain->swapchain_image_format;
-        ivci.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-        ivci.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-        ivci.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-        ivci.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-        ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        ivci.subresourceRange.baseMipLevel = 0;
-        ivci.subresourceRange.levelCount = 1;
-        ivci.subresourceRange.baseArrayLayer = 0;
-        ivci.subresourceRange.layerCount = 1;
-
-        if (internal_swapchain->swapchain_image_views[i] != VK_NULL_HANDLE)
+        if (internal_buffer->mapped_data)
         {
-            resource_manager.destroyer_imageviews.push_back(std::make_pair(internal_swapchain->swapchain_image_views[i], resource_manager.frame_count));
+            memcpy(internal_buffer->mapped_data, desc.data, desc.size);
         }
-        VK_ASSERT(vkCreateImageView(device, &ivci, nullptr, &internal_swapchain->swapchain_image_views[i]));
-
-        VkImageView attachments[] = {internal_swapchain->swapchain_image_views[i]};
-
-        VkFramebufferCreateInfo fci = {};
-        fci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        fci.renderPass = internal_swapchain->renderpass;
-        fci.attachmentCount = 1;
-        fci.pAttachments = attachments;
-        fci.width = internal_swapchain->swapchain_extent.width;
-        fci.height = internal_swapchain->swapchain_extent.height;
-        fci.layers = 1;
-
-        if (internal_swapchain->swapchain_framebuffers[i] != VK_NULL_HANDLE)
+        else
         {
-            resource_manager.destroyer_framebuffers.push_back(std::make_pair(internal_swapchain->swapchain_framebuffers[i], resource_manager.frame_count));
+            // 通过init命令缓存上传, 在本帧的第一个提交之前执行
+            init_locker.lock();
+            StageBuffer::Allocation allocation = init_stage_buffer->Allocate(desc.size);
+            memcpy(allocation.data, desc.data, desc.size);
+
+            VkBufferCopy copy = {};
+            copy.srcOffset = allocation.offset;
+            copy.dstOffset = 0;
+            copy.size = desc.size;
+            vkCmdCopyBuffer(GetFrameResources().init_command_buffer, ((VulkanBuffer*)allocation.buffer)->resource, internal_buffer->resource, 1, &copy);
+            internal_buffer->frame_written = frame_count;
+            submit_inits = true;
+            init_locker.unlock();
         }
-        VK_ASSERT(vkCreateFramebuffer(device, &fci, nullptr, &internal_swapchain->swapchain_framebuffers[i]));
     }
 
-    VkSemaphoreCreateInfo sci = {};
-    sci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    return internal_buffer;
+}
 
-    if (internal_swapchain->swapchain_acquire_semaphore == VK_NULL_HANDLE)
+void VulkanDevice::CreateBufferResource(VulkanBuffer* internal_buffer, const GfxBufferDesc& desc)
+{
+    VkBufferCreateInfo buffer_info;
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.pNext = nullptr;
+    buffer_info.flags = 0;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    buffer_info.queueFamilyIndexCount = 0;
+    buffer_info.pQueueFamilyIndices = nullptr;
+    internal_buffer->concurrent = IsSharedWithCopyQueue(desc.res_usage);
+    if (internal_buffer->concurrent)
     {
-        VK_ASSERT(vkCreateSemaphore(device, &sci, nullptr, &internal_swapchain->swapchain_acquire_semaphore));
+        buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        buffer_info.queueFamilyIndexCount = (uint32_t)queue_families.size();
+        buffer_info.pQueueFamilyIndices = queue_families.data();
     }
+    buffer_info.size = desc.size;
+    buffer_info.usage = 0;
 
-    if (internal_swapchain->swapchain_release_semaphore == VK_NULL_HANDLE)
+    if (desc.res_usage & RESOURCE_USAGE_RW_BUFFER)
     {
-        VK_ASSERT(vkCreateSemaphore(device, &sci, nullptr, &internal_swapchain->swapchain_release_semaphore));
+        buffer_info.usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
     }
 
-    return internal_swapchain;
-}
-
-void VulkanDevice::DestroySwapChain(GfxSwapChain* swapchain)
-{
-    vkDeviceWaitIdle(device);
-    VulkanSwapChain* internal_swapchain = (VulkanSwapChain*)swapchain;
-    for (size_t i = 0; i < internal_swapchain->swapchain_images.size(); ++i)
+    if (desc.res_usage & RESOURCE_USAGE_UNIFORM_BUFFER)
     {
-        vkDestroyFramebuffer(device, internal_swapchain->swapchain_framebuffers[i], nullptr);
-        vkDestroyImageView(device, internal_swapchain->swapchain_image_views[i], nullptr);
+        buffer_info.usage |= VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
     }
-    vkDestroyRenderPass(device, internal_swapchain->renderpass, nullptr);
 
-    vkDestroySwapchainKHR(device, internal_swapchain->swapchain, nullptr);
-    vkDestroySurfaceKHR(instance, internal_swapchain->surface, nullptr);
-    vkDestroySemaphore(device, internal_swapchain->swapchain_acquire_semaphore, nullptr);
-    vkDestroySemaphore(device, internal_swapchain->swapchain_release_semaphore, nullptr);
-}
+    if (desc.res_usage & RESOURCE_USAGE_VERTEX_BUFFER)
+    {
+        buffer_info.usage |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    }
 
-GfxRenderPass* VulkanDevice::CreateRenderPass(const GfxRenderPassDesc& desc)
-{
-    auto internal_renderpass = new VulkanRenderPass(this);
-    internal_renderpass->desc = desc;
+    if (desc.res_usage & RESOURCE_USAGE_INDEX_BUFFER)
+    {
+        buffer_info.usage |= VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    }
 
-    internal_renderpass->hash = 0;
-    hash_combine(internal_renderpass->hash, desc.attachments.size());
-    for (auto& attachment : desc.attachments)
+    if (desc.res_usage & RESOURCE_USAGE_INDIRECT_BUFFER)
     {
-        if (attachment.type == RenderPassAttachment::RENDERTARGET || attachment.type == RenderPassAttachment::DEPTH_STENCIL)
-        {
-            hash_combine(internal_renderpass->hash, attachment.texture->format);
-            hash_combine(internal_renderpass->hash, attachment.texture->sample_count);
-        }
+        buffer_info.usage |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
     }
 
-    VkImageView attachments[18] = {};
-    VkAttachmentDescription2 attachment_descriptions[18] = {};
-    VkAttachmentReference2 color_attachment_refs[8] = {};
-    VkAttachmentReference2 resolve_attachment_refs[8] = {};
-    VkAttachmentReference2 depth_attachment_ref = {};
+    buffer_info.usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
-    uint32_t resolve_count = 0;
+    VK_ASSERT(vkCreateBuffer(device, &buffer_info, nullptr, &internal_buffer->resource));
 
-    VkSubpassDescription2 subpass = {};
-    subpass.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2;
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, internal_buffer->resource, &memory_requirements);
 
-    uint32_t valid_attachment_count = 0;
-    for (auto& attachment : desc.attachments)
+    VkMemoryPropertyFlags memory_propertys;
+    if (desc.mem_usage == MEMORY_USAGE_GPU_ONLY)
     {
-        const GfxTexture* texture = attachment.texture;
-        int subresource = attachment.subresource;
-        VulkanTexture* internal_texture = (VulkanTexture*)texture;
+        memory_propertys = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    }
 
-        attachment_descriptions[valid_attachment_count].sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
-        attachment_descriptions[valid_attachment_count].format = ToVulkanFormat(texture->format);
-        attachment_descriptions[valid_attachment_count].samples = (VkSampleCountFlagBits)texture->sample_count;
+    if (desc.mem_usage == MEMORY_USAGE_CPU_TO_GPU)
+    {
+        memory_propertys = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
 
-        switch (attachment.loadop)
+    if (desc.mem_usage == MEMORY_USAGE_GPU_TO_CPU)
+    {
+        memory_propertys = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+
+    VulkanAllocation& allocation = internal_buffer->allocation;
+    bool mapped = desc.mem_usage != MEMORY_USAGE_GPU_ONLY;
+    VkResult result = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    if (desc.mem_usage == MEMORY_USAGE_GPU_ONLY && desc.write_direct && write_direct_supported)
+    {
+        // 可映射的显存容量有限, 分配失败时退回普通显存
+        VkMemoryPropertyFlags direct_propertys = memory_propertys | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        result = memory_allocator.Allocate(memory_requirements, direct_propertys, true, MEMORY_CATEGORY_BUFFER, allocation);
+        mapped = result == VK_SUCCESS;
+    }
+    if (desc.mem_usage == MEMORY_USAGE_GPU_TO_CPU)
+    {
+        // 依次尝试一致的缓存内存, 非一致的缓存内存(读取前需要invalidate)以及不带缓存的内存
+        result = memory_allocator.Allocate(memory_requirements, memory_propertys, true, MEMORY_CATEGORY_BUFFER, allocation);
+        if (result != VK_SUCCESS)
         {
-            default:
-            case LOAD_LOAD:
-                attachment_descriptions[valid_attachment_count].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-                break;
-            case LOAD_CLEAR:
-                attachment_descriptions[valid_attachment_count].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-                break;
-            case LOAD_DONTCARE:
-                attachment_descriptions[valid_attachment_count].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-                break;
+            result = memory_allocator.Allocate(memory_requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, true, MEMORY_CATEGORY_BUFFER, allocation);
         }
-
-        switch (attachment.storeop)
+        if (result != VK_SUCCESS)
         {
-            default:
-            case STORE_STORE:
-                attachment_descriptions[valid_attachment_count].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-                break;
-            case STORE_DONTCARE:
-                attachment_descriptions[valid_attachment_count].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-                break;
+            memory_propertys = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
         }
+    }
+    if (result != VK_SUCCESS)
+    {
+        VK_ASSERT(memory_allocator.Allocate(memory_requirements, memory_propertys, true, MEMORY_CATEGORY_BUFFER, allocation));
+    }
+    VK_ASSERT(vkBindBufferMemory(device, internal_buffer->resource, allocation.memory, allocation.offset));
 
-        attachment_descriptions[valid_attachment_count].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        attachment_descriptions[valid_attachment_count].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    if (mapped)
+    {
+        internal_buffer->mapped_data = allocation.mapped;
+    }
+}
 
-        if (attachment.type == RenderPassAttachment::RENDERTARGET)
-        {
-            if (subresource < 0)
-            {
-                attachments[valid_attachment_count] = internal_texture->rtv;
-            }
-            else
-            {
-                attachments[valid_attachment_count] = internal_texture->subresources_rtv[subresource];
-            }
+void VulkanDevice::DestroyBuffer(GfxBuffer* buffer)
+{
+    resource_manager.destroy_locker.lock();
+    VulkanBuffer* internal_buffer = (VulkanBuffer*)buffer;
+    uint64_t frame_count = resource_manager.frame_count;
+    movable_resources.buffers.erase(internal_buffer);
+    ForgetPendingAcquire(internal_buffer);
+    if (internal_buffer->bindless)
+    {
+        bindless_heaps[BINDLESS_HEAP_BUFFER].Free(internal_buffer->srv_index, frame_count);
+    }
+    if (!resource_cache.RecycleBuffer(internal_buffer))
+    {
+        resource_manager.destroyer_buffers.push_back(std::make_pair(std::make_pair(internal_buffer->resource, internal_buffer->allocation), frame_count));
+    }
+    resource_manager.destroy_locker.unlock();
+}
 
-            attachment_descriptions[valid_attachment_count].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-            attachment_descriptions[valid_attachment_count].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+GfxTexture* VulkanDevice::CreateTexture(const GfxTextureDesc& desc)
+{
+    VulkanTexture* internal_texture = new VulkanTexture(this);
+    internal_texture->width = desc.width;
+    internal_texture->height = desc.height;
+    internal_texture->depth = desc.depth;
+    internal_texture->num_layers = desc.num_layers;
+    internal_texture->num_levels = desc.num_levels;
+    internal_texture->format = desc.format;
+    internal_texture->clear = desc.clear;
+    internal_texture->sample_count = desc.sample_count;
+    internal_texture->state = desc.state;
+    internal_texture->mem_usage = desc.mem_usage;
+    internal_texture->res_usage = desc.res_usage;
+    internal_texture->bindless = desc.bindless && bindless_supported;
 
-            color_attachment_refs[subpass.colorAttachmentCount].sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
-            color_attachment_refs[subpass.colorAttachmentCount].attachment = valid_attachment_count;
-            color_attachment_refs[subpass.colorAttachmentCount].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-            color_attachment_refs[subpass.colorAttachmentCount].aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            subpass.colorAttachmentCount++;
-            subpass.pColorAttachments = color_attachment_refs;
-        }
-        else if (attachment.type == RenderPassAttachment::DEPTH_STENCIL)
-        {
-            if (subresource < 0)
-            {
-                attachments[valid_attachment_count] = internal_texture->dsv;
-            }
-            else
-            {
-                attachments[valid_attachment_count] = internal_texture->subresources_dsv[subresource];
-            }
+    if (!resource_cache.AcquireTexture(desc, internal_texture))
+    {
+        internal_texture->res_state = RESOURCE_STATE_UNDEFINED;
+        CreateTextureResource(internal_texture, desc);
+    }
 
-            attachment_descriptions[valid_attachment_count].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-            attachment_descriptions[valid_attachment_count].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    // 不会被GPU写入的资源可以在碎片整理时移动
+    resource_manager.destroy_locker.lock();
+    if (desc.mem_usage == MEMORY_USAGE_GPU_ONLY && !internal_texture->heap && !internal_texture->bindless && !(desc.res_usage & (RESOURCE_USAGE_UNORDERED_ACCESS | RESOURCE_USAGE_RENDER_TARGET | RESOURCE_USAGE_DEPTH_STENCIL)))
+    {
+        internal_texture->frame_used = frame_count;
+        movable_resources.textures.insert(internal_texture);
+    }
+    resource_manager.destroy_locker.unlock();
 
-            depth_attachment_ref.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
-            depth_attachment_ref.attachment = valid_attachment_count;
-            depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-            depth_attachment_ref.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-            subpass.pDepthStencilAttachment = &depth_attachment_ref;
+    // 回收的资源已经带有这些视图, 不会重复创建
+    if (desc.res_usage & RESOURCE_USAGE_SHADER_RESOURCE)
+    {
+        CreateSubresource(internal_texture, SRV, 0, -1, 0, -1);
+    }
+    if (desc.res_usage & RESOURCE_USAGE_UNORDERED_ACCESS)
+    {
+        CreateSubresource(internal_texture, UAV, 0, -1, 0, -1);
+    }
+    if (desc.res_usage & RESOURCE_USAGE_RENDER_TARGET)
+    {
+        CreateSubresource(internal_texture, RTV, 0, -1, 0, -1);
+    }
+    if (desc.res_usage & RESOURCE_USAGE_DEPTH_STENCIL)
+    {
+        CreateSubresource(internal_texture, DSV, 0, -1, 0, -1);
+    }
 
-            if (IsFormatStencilSupport(texture->format))
-            {
-                depth_attachment_ref.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-                switch (attachment.loadop)
-                {
-                    default:
-                    case LOAD_LOAD:
-                        attachment_descriptions[valid_attachment_count].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-                        break;
-                    case LOAD_CLEAR:
-                        attachment_descriptions[valid_attachment_count].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-                        break;
-                    case LOAD_DONTCARE:
-                        attachment_descriptions[valid_attachment_count].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-                        break;
-                }
+    return internal_texture;
+}
+
+void VulkanDevice::CreateTextureResource(VulkanTexture* internal_texture, const GfxTextureDesc& desc)
+{
+    VkImageType image_type = VK_IMAGE_TYPE_MAX_ENUM;
+    if (desc.depth > 1)
+        image_type = VK_IMAGE_TYPE_3D;
+    else if (desc.height > 1)
+        image_type = VK_IMAGE_TYPE_2D;
+    else
+        image_type = VK_IMAGE_TYPE_1D;
+
+    VkImageCreateInfo image_info = {};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.pNext = nullptr;
+    image_info.imageType = image_type;
+    image_info.format = ToVulkanFormat(desc.format);
+    image_info.extent.width = desc.width;
+    image_info.extent.height = desc.height;
+    image_info.extent.depth = desc.depth;
+    image_info.mipLevels = desc.num_levels;
+    image_info.arrayLayers = desc.num_layers;
+    image_info.samples = ToVulkanSampleCount(desc.sample_count);
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.queueFamilyIndexCount = 0;
+    image_info.pQueueFamilyIndices = nullptr;
+    internal_texture->concurrent = IsSharedWithCopyQueue(desc.res_usage);
+    if (internal_texture->concurrent)
+    {
+        image_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        image_info.queueFamilyIndexCount = (uint32_t)queue_families.size();
+        image_info.pQueueFamilyIndices = queue_families.data();
+    }
+    image_info.flags = 0;
+    if (RESOURCE_USAGE_CUBE_TEXTURE == (desc.res_usage & RESOURCE_USAGE_CUBE_TEXTURE))
+    {
+        image_info.flags |= VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+    }
+    if (image_type == VK_IMAGE_TYPE_3D)
+    {
+        image_info.flags |= VK_IMAGE_CREATE_2D_ARRAY_COMPATIBLE_BIT_KHR;
+    }
+
+    image_info.usage = 0;
+    if (desc.res_usage & RESOURCE_USAGE_SHADER_RESOURCE)
+    {
+        image_info.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
+    if (desc.res_usage & RESOURCE_USAGE_UNORDERED_ACCESS)
+    {
+        image_info.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+    if (desc.res_usage & RESOURCE_USAGE_RENDER_TARGET)
+    {
+        image_info.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    }
+    if (desc.res_usage & RESOURCE_USAGE_DEPTH_STENCIL)
+    {
+        image_info.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    }
+    image_info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_info.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+    VK_ASSERT(vkCreateImage(device, &image_info, nullptr, &internal_texture->resource));
+
+    VkMemoryRequirements memory_requirements;
+    vkGetImageMemoryRequirements(device, internal_texture->resource, &memory_requirements);
+
+    VkMemoryPropertyFlags memory_propertys;
+    if (desc.mem_usage == MEMORY_USAGE_GPU_ONLY)
+    {
+        memory_propertys = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    }
+    if (desc.mem_usage == MEMORY_USAGE_CPU_TO_GPU)
+    {
+        memory_propertys = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+
+    if (desc.mem_usage == MEMORY_USAGE_GPU_TO_CPU)
+    {
+        memory_propertys = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+
+    VulkanAllocation& allocation = internal_texture->allocation;
+    if (desc.heap == nullptr || !PlaceTexture(internal_texture, (VulkanMemoryHeap*)desc.heap, memory_requirements, desc.lifetime_begin, desc.lifetime_end))
+    {
+        VK_ASSERT(memory_allocator.Allocate(memory_requirements, memory_propertys, false, MEMORY_CATEGORY_TEXTURE, allocation));
+    }
+    VK_ASSERT(vkBindImageMemory(device, internal_texture->resource, allocation.memory, allocation.offset));
+}
+
+void VulkanDevice::DestroyTexture(GfxTexture* texture)
+{
+    resource_manager.destroy_locker.lock();
+    VulkanTexture* internal_texture = (VulkanTexture*)texture;
+    uint64_t frame_count = resource_manager.frame_count;
+    movable_resources.textures.erase(internal_texture);
+    ForgetPendingAcquire(internal_texture);
+    streaming.locker.lock();
+    streaming.initial_states.erase(internal_texture);
+    streaming.locker.unlock();
+    if (internal_texture->bindless)
+    {
+        // 视图可能随资源进入回收缓存, 下标不随视图复用
+        bindless_heaps[BINDLESS_HEAP_TEXTURE].Free(internal_texture->srv_index, frame_count);
+        bindless_heaps[BINDLESS_HEAP_RW_TEXTURE].Free(internal_texture->uav_index, frame_count);
+        for (auto index : internal_texture->subresources_srv_index)
+        {
+            bindless_heaps[BINDLESS_HEAP_TEXTURE].Free(index, frame_count);
+        }
+        for (auto index : internal_texture->subresources_uav_index)
+        {
+            bindless_heaps[BINDLESS_HEAP_RW_TEXTURE].Free(index, frame_count);
+        }
+    }
+    if (resource_cache.RecycleTexture(internal_texture))
+    {
+        resource_manager.destroy_locker.unlock();
+        return;
+    }
+
+    if (internal_texture->heap)
+    {
+        // 放置在堆上的资源不拥有内存, 占用的区间在GPU执行完该帧后才能重新放置其他资源
+        VulkanMemoryHeap* heap = internal_texture->heap;
+        heap->locker.lock();
+        for (auto& placement : heap->placements)
+        {
+            if (placement.texture == internal_texture)
+            {
+                placement.texture = nullptr;
+                resource_manager.destroyer_placements.push_back(std::make_pair(std::make_pair(heap, placement.id), frame_count));
+                break;
+            }
+        }
+        heap->locker.unlock();
+        resource_manager.destroyer_images.push_back(std::make_pair(std::make_pair(internal_texture->resource, VulkanAllocation()), frame_count));
+    }
+    else
+    {
+        resource_manager.destroyer_images.push_back(std::make_pair(std::make_pair(internal_texture->resource, internal_texture->allocation), frame_count));
+    }
+
+    if (internal_texture->srv != VK_NULL_HANDLE)
+    {
+        resource_manager.destroyer_imageviews.push_back(std::make_pair(internal_texture->srv, frame_count));
+    }
+    if (internal_texture->uav != VK_NULL_HANDLE)
+    {
+        resource_manager.destroyer_imageviews.push_back(std::make_pair(internal_texture->uav, frame_count));
+    }
+    if (internal_texture->rtv != VK_NULL_HANDLE)
+    {
+        resource_manager.destroyer_imageviews.push_back(std::make_pair(internal_texture->rtv, frame_count));
+    }
+    if (internal_texture->dsv != VK_NULL_HANDLE)
+    {
+        resource_manager.destroyer_imageviews.push_back(std::make_pair(internal_texture->dsv, frame_count));
+    }
+
+    for (auto x : internal_texture->subresources_srv)
+    {
+        resource_manager.destroyer_imageviews.push_back(std::make_pair(x, frame_count));
+    }
+
+    for (auto x : internal_texture->subresources_uav)
+    {
+        resource_manager.destroyer_imageviews.push_back(std::make_pair(x, frame_count));
+    }
+
+    for (auto x : internal_texture->subresources_rtv)
+    {
+        resource_manager.destroyer_imageviews.push_back(std::make_pair(x, frame_count));
+    }
+
+    for (auto x : internal_texture->subresources_dsv)
+    {
+        resource_manager.destroyer_imageviews.push_back(std::make_pair(x, frame_count));
+    }
+
+    resource_manager.destroy_locker.unlock();
+}
+
+GfxMemoryHeap* VulkanDevice::CreateMemoryHeap(const GfxMemoryHeapDesc& desc)
+{
+    VulkanMemoryHeap* internal_heap = new VulkanMemoryHeap(this);
+    internal_heap->desc = desc;
+    return internal_heap;
+}
+
+void VulkanDevice::DestroyMemoryHeap(GfxMemoryHeap* heap)
+{
+    resource_manager.destroy_locker.lock();
+    VulkanMemoryHeap* internal_heap = (VulkanMemoryHeap*)heap;
+    uint64_t frame_count = resource_manager.frame_count;
+
+    // 放置在堆上的纹理必须先销毁, 否则它们的内存会随堆一起释放
+    internal_heap->locker.lock();
+    for (auto& placement : internal_heap->placements)
+    {
+        if (placement.texture != nullptr)
+        {
+            BLAST_LOGE("memory heap destroyed while textures are still placed in it\n");
+            assert(0);
+            placement.texture->heap = nullptr;
+            placement.texture->allocation = VulkanAllocation();
+        }
+    }
+    internal_heap->placements.clear();
+    internal_heap->locker.unlock();
+
+    // 等待归还的区间随堆一起失效
+    auto& placements = resource_manager.destroyer_placements;
+    placements.erase(std::remove_if(placements.begin(), placements.end(), [&](const std::pair<std::pair<VulkanMemoryHeap*, uint64_t>, uint64_t>& x) { return x.first.first == internal_heap; }), placements.end());
+
+    resource_manager.destroyer_allocations.push_back(std::make_pair(internal_heap->allocation, frame_count));
+    resource_manager.destroy_locker.unlock();
+}
+
+bool VulkanDevice::PlaceTexture(VulkanTexture* texture, VulkanMemoryHeap* heap, const VkMemoryRequirements& requirements, uint32_t lifetime_begin, uint32_t lifetime_end)
+{
+    heap->locker.lock();
+    if (heap->allocation.memory == VK_NULL_HANDLE)
+    {
+        VkMemoryRequirements heap_requirements = requirements;
+        heap_requirements.size = heap->desc.size;
+        if (memory_allocator.Allocate(heap_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, MEMORY_CATEGORY_TEXTURE, heap->allocation) != VK_SUCCESS)
+        {
+            heap->locker.unlock();
+            BLAST_LOGW("failed to allocate memory heap of %llu bytes\n", (unsigned long long)heap->desc.size);
+            return false;
+        }
+    }
+
+    if ((requirements.memoryTypeBits & (1 << heap->allocation.memory_type)) == 0)
+    {
+        heap->locker.unlock();
+        return false;
+    }
+
+    // 生命周期重叠的资源不能共享内存, 在它们占用的区间之间寻找第一个足够大的空隙
+    std::vector<std::pair<uint64_t, uint64_t>> occupied;
+    for (auto& placement : heap->placements)
+    {
+        if (placement.lifetime_begin <= lifetime_end && lifetime_begin <= placement.lifetime_end)
+        {
+            occupied.push_back(std::make_pair(placement.offset, placement.offset + placement.size));
+        }
+    }
+    std::sort(occupied.begin(), occupied.end());
+
+    uint64_t offset = 0;
+    for (auto& range : occupied)
+    {
+        if (AlignTo(offset, (uint64_t)requirements.alignment) + requirements.size <= range.first)
+        {
+            break;
+        }
+        offset = std::max(offset, range.second);
+    }
+    offset = AlignTo(offset, (uint64_t)requirements.alignment);
+
+    if (offset + requirements.size > heap->desc.size)
+    {
+        heap->locker.unlock();
+        BLAST_LOGW("memory heap is full, texture falls back to its own allocation\n");
+        return false;
+    }
+
+    VulkanMemoryHeap::Placement placement;
+    placement.id = heap->next_placement_id++;
+    placement.texture = texture;
+    placement.offset = offset;
+    placement.size = requirements.size;
+    placement.lifetime_begin = lifetime_begin;
+    placement.lifetime_end = lifetime_end;
+    heap->placements.push_back(placement);
+    heap->locker.unlock();
+
+    texture->heap = heap;
+    texture->allocation = heap->allocation;
+    texture->allocation.offset += offset;
+    texture->allocation.size = requirements.size;
+    texture->allocation.mapped = nullptr;
+    return true;
+}
+
+int32_t VulkanDevice::CreateSubresource(GfxTexture* texture, SubResourceType type, uint32_t first_slice, uint32_t slice_count, uint32_t first_mip, uint32_t mip_count)
+{
+    VulkanTexture* internal_texture = (VulkanTexture*)texture;
+    int32_t subresource = CreateSubresourceView(texture, type, first_slice, slice_count, first_mip, mip_count);
+    if (internal_texture->bindless && (type == SRV || type == UAV))
+    {
+        RegisterBindlessView(internal_texture, type, subresource);
+    }
+    return subresource;
+}
+
+void VulkanDevice::RegisterBindlessView(VulkanTexture* texture, SubResourceType type, int32_t subresource)
+{
+    int* index = nullptr;
+    VkImageView view = VK_NULL_HANDLE;
+    std::vector<int>& indices = type == SRV ? texture->subresources_srv_index : texture->subresources_uav_index;
+    if (subresource < 0)
+    {
+        index = type == SRV ? &texture->srv_index : &texture->uav_index;
+        view = type == SRV ? texture->srv : texture->uav;
+    }
+    else
+    {
+        if (indices.size() <= (size_t)subresource)
+        {
+            indices.resize(subresource + 1, -1);
+        }
+        index = &indices[subresource];
+        view = type == SRV ? texture->subresources_srv[subresource] : texture->subresources_uav[subresource];
+    }
+
+    if (*index >= 0)
+    {
+        return;
+    }
+
+    BindlessHeap& heap = bindless_heaps[type == SRV ? BINDLESS_HEAP_TEXTURE : BINDLESS_HEAP_RW_TEXTURE];
+    *index = heap.Allocate();
+    if (*index < 0)
+    {
+        BLAST_LOGW("Bindless texture heap is full\n");
+        return;
+    }
+
+    VulkanDescriptorData data;
+    memset(&data, 0, sizeof(data));
+    data.image.imageView = view;
+    data.image.imageLayout = type == SRV ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+    heap.Write(*index, data);
+}
+
+int32_t VulkanDevice::CreateSubresourceView(GfxTexture* texture, SubResourceType type, uint32_t first_slice, uint32_t slice_count, uint32_t first_mip, uint32_t mip_count)
+{
+    VulkanTexture* internal_texture = (VulkanTexture*)texture;
+
+    // 相同参数的视图只创建一次
+    if (type <= DSV)
+    {
+        std::vector<VulkanSubresourceRange>& ranges = internal_texture->subresource_ranges[type];
+        for (uint32_t i = 0; i < ranges.size(); ++i)
+        {
+            if (ranges[i].first_slice == first_slice && ranges[i].slice_count == slice_count &&
+                ranges[i].first_mip == first_mip && ranges[i].mip_count == mip_count)
+            {
+                return int32_t(i) - 1;
+            }
+        }
+
+        VulkanSubresourceRange range;
+        range.first_slice = first_slice;
+        range.slice_count = slice_count;
+        range.first_mip = first_mip;
+        range.mip_count = mip_count;
+        ranges.push_back(range);
+    }
+
+    VkImageViewCreateInfo ivci = {};
+    ivci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    ivci.flags = 0;
+    ivci.image = internal_texture->resource;
+    ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    ivci.subresourceRange.baseArrayLayer = first_slice;
+    ivci.subresourceRange.layerCount = slice_count;
+    ivci.subresourceRange.baseMipLevel = first_mip;
+    ivci.subresourceRange.levelCount = mip_count;
+    ivci.format = ToVulkanFormat(texture->format);
+
+    VkImageType image_type = VK_IMAGE_TYPE_MAX_ENUM;
+    if (texture->depth > 1)
+        image_type = VK_IMAGE_TYPE_3D;
+    else if (texture->height > 1)
+        image_type = VK_IMAGE_TYPE_2D;
+    else
+        image_type = VK_IMAGE_TYPE_1D;
+
+    VkImageViewType view_type = VK_IMAGE_VIEW_TYPE_MAX_ENUM;
+    switch (image_type)
+    {
+        case VK_IMAGE_TYPE_1D:
+            view_type = texture->num_layers > 1 ? VK_IMAGE_VIEW_TYPE_1D_ARRAY : VK_IMAGE_VIEW_TYPE_1D;
+            break;
+        case VK_IMAGE_TYPE_2D:
+            if (RESOURCE_USAGE_CUBE_TEXTURE == (texture->res_usage & RESOURCE_USAGE_CUBE_TEXTURE))
+                view_type = (texture->num_layers > 6) ? VK_IMAGE_VIEW_TYPE_CUBE_ARRAY : VK_IMAGE_VIEW_TYPE_CUBE;
+            else
+                view_type = texture->num_layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+            break;
+        case VK_IMAGE_TYPE_3D:
+            if (texture->num_layers > 1)
+                assert(false);
+
+            view_type = VK_IMAGE_VIEW_TYPE_3D;
+            break;
+        default:
+            assert(false && "image format not supported!");
+            break;
+    }
+    ivci.viewType = view_type;
+
+    switch (type)
+    {
+        case SRV:
+        {
+            switch (ivci.format)
+            {
+                case VK_FORMAT_D16_UNORM:
+                    ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+                    break;
+                case VK_FORMAT_D32_SFLOAT:
+                    ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+                    break;
+                case VK_FORMAT_D24_UNORM_S8_UINT:
+                    ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+                    break;
+                case VK_FORMAT_D32_SFLOAT_S8_UINT:
+                    ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+                    break;
+            }
+
+            VkImageView srv;
+            VK_ASSERT(vkCreateImageView(device, &ivci, nullptr, &srv));
+
+            if (internal_texture->srv == VK_NULL_HANDLE)
+            {
+                internal_texture->srv = srv;
+                return -1;
+            }
+            internal_texture->subresources_srv.push_back(srv);
+            return int32_t(internal_texture->subresources_srv.size() - 1);
+        }
+        break;
+        case UAV:
+        {
+            if (ivci.viewType == VK_IMAGE_VIEW_TYPE_CUBE || ivci.viewType == VK_IMAGE_VIEW_TYPE_CUBE_ARRAY)
+            {
+                ivci.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+            }
+
+            VkImageView uav;
+            VK_ASSERT(vkCreateImageView(device, &ivci, nullptr, &uav));
+
+            if (internal_texture->uav == VK_NULL_HANDLE)
+            {
+                internal_texture->uav = uav;
+                return -1;
+            }
+            internal_texture->subresources_uav.push_back(uav);
+            return int32_t(internal_texture->subresources_uav.size() - 1);
+        }
+        break;
+        case RTV:
+        {
+            VkImageView rtv;
+            ivci.subresourceRange.levelCount = 1;
+            VK_ASSERT(vkCreateImageView(device, &ivci, nullptr, &rtv));
+
+            if (internal_texture->rtv == VK_NULL_HANDLE)
+            {
+                internal_texture->rtv = rtv;
+                return -1;
+            }
+            internal_texture->subresources_rtv.push_back(rtv);
+            return int32_t(internal_texture->subresources_rtv.size() - 1);
+        }
+        break;
+        case DSV:
+        {
+            ivci.subresourceRange.levelCount = 1;
+            ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+            switch (texture->format)
+            {
+                case FORMAT_D24_UNORM_S8_UINT:
+                    ivci.format = VK_FORMAT_D24_UNORM_S8_UINT;
+                    ivci.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+                    break;
+            }
+
+            VkImageView dsv;
+            VK_ASSERT(vkCreateImageView(device, &ivci, nullptr, &dsv));
+
+            if (internal_texture->dsv == VK_NULL_HANDLE)
+            {
+                internal_texture->dsv = dsv;
+                return -1;
+            }
+            internal_texture->subresources_dsv.push_back(dsv);
+            return int32_t(internal_texture->subresources_dsv.size() - 1);
+        }
+        break;
+        default:
+            break;
+    }
+    return -1;
+}
+
+GfxSampler* VulkanDevice::CreateSampler(const GfxSamplerDesc& desc)
+{
+    VulkanSampler* internal_sampler = new VulkanSampler(this);
+    internal_sampler->desc = desc;
+
+    VkSamplerCreateInfo sci = {};
+    sci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sci.magFilter = ToVulkanFilter(desc.mag_filter);
+    sci.minFilter = ToVulkanFilter(desc.min_filter);
+    sci.mipmapMode = ToVulkanMipmapMode(desc.mipmap_mode);
+    sci.addressModeU = ToVulkanAddressMode(desc.address_u);
+    sci.addressModeV = ToVulkanAddressMode(desc.address_v);
+    sci.addressModeW = ToVulkanAddressMode(desc.address_w);
+    sci.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    sci.anisotropyEnable = VK_FALSE;
+    sci.maxAnisotropy = 0.0f;
+    sci.unnormalizedCoordinates = VK_FALSE;
+    sci.compareEnable = VK_FALSE;
+    sci.compareOp = VK_COMPARE_OP_ALWAYS;
+    VK_ASSERT(vkCreateSampler(device, &sci, nullptr, &internal_sampler->sampler));
+
+    if (bindless_supported)
+    {
+        internal_sampler->bindless_index = bindless_heaps[BINDLESS_HEAP_SAMPLER].Allocate();
+        if (internal_sampler->bindless_index >= 0)
+        {
+            VulkanDescriptorData data;
+            memset(&data, 0, sizeof(data));
+            data.image.sampler = internal_sampler->sampler;
+            bindless_heaps[BINDLESS_HEAP_SAMPLER].Write(internal_sampler->bindless_index, data);
+        }
+        else
+        {
+            BLAST_LOGW("Bindless sampler heap is full\n");
+        }
+    }
+
+    return internal_sampler;
+}
+
+void VulkanDevice::DestroySampler(GfxSampler* sampler)
+{
+    resource_manager.destroy_locker.lock();
+    VulkanSampler* internal_sampler = (VulkanSampler*)sampler;
+    uint64_t frame_count = resource_manager.frame_count;
+    resource_manager.destroyer_samplers.push_back(std::make_pair(internal_sampler->sampler, frame_count));
+    bindless_heaps[BINDLESS_HEAP_SAMPLER].Free(internal_sampler->bindless_index, frame_count);
+    resource_manager.destroy_locker.unlock();
+}
+
+GfxSwapChain* VulkanDevice::CreateSwapChain(const GfxSwapChainDesc& desc, GfxSwapChain* old_swapchain)
+{
+    VulkanSwapChain* internal_swapchain = nullptr;
+    if (old_swapchain)
+    {
+        internal_swapchain = (VulkanSwapChain*)old_swapchain;
+    }
+    else
+    {
+        internal_swapchain = new VulkanSwapChain(this);
+    }
+    internal_swapchain->desc = desc;
+
+    if (internal_swapchain->surface == VK_NULL_HANDLE)
+    {
+#ifdef WIN32
+        VkWin32SurfaceCreateInfoKHR sci = {};
+        sci.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
+        sci.pNext = nullptr;
+        sci.flags = 0;
+        sci.hinstance = ::GetModuleHandle(nullptr);
+        sci.hwnd = (HWND)desc.window;
+        VK_ASSERT(vkCreateWin32SurfaceKHR(instance, &sci, nullptr, &internal_swapchain->surface));
+#endif
+    }
+
+    // Get present family
+    uint32_t present_family = VK_QUEUE_FAMILY_IGNORED;
+    uint32_t family_index = 0;
+    for (const auto& queue_family : queue_family_properties)
+    {
+        VkBool32 present_support = false;
+        VK_ASSERT(vkGetPhysicalDeviceSurfaceSupportKHR(phy_device, (uint32_t)family_index, internal_swapchain->surface, &present_support));
+
+        if (present_family == VK_QUEUE_FAMILY_IGNORED && queue_family.queueCount > 0 && present_support)
+        {
+            present_family = family_index;
+            break;
+        }
+
+        family_index++;
+    }
+
+    if (present_family == VK_QUEUE_FAMILY_IGNORED)
+    {
+        return nullptr;
+    }
+
+    VkSurfaceCapabilitiesKHR swapchain_capabilities;
+    VK_ASSERT(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(phy_device, internal_swapchain->surface, &swapchain_capabilities));
+
+    uint32_t format_count;
+    VK_ASSERT(vkGetPhysicalDeviceSurfaceFormatsKHR(phy_device, internal_swapchain->surface, &format_count, nullptr));
+
+    std::vector<VkSurfaceFormatKHR> swapchain_formats(format_count);
+    VK_ASSERT(vkGetPhysicalDeviceSurfaceFormatsKHR(phy_device, internal_swapchain->surface, &format_count, swapchain_formats.data()));
+
+    uint32_t present_mode_count;
+    VK_ASSERT(vkGetPhysicalDeviceSurfacePresentModesKHR(phy_device, internal_swapchain->surface, &present_mode_count, nullptr));
+
+    std::vector<VkPresentModeKHR> swapchain_present_modes(present_mode_count);
+    VK_ASSERT(vkGetPhysicalDeviceSurfacePresentModesKHR(phy_device, internal_swapchain->surface, &present_mode_count, swapchain_present_modes.data()));
+
+    // Todo: Using outside format
+    VkSurfaceFormatKHR surface_format = {VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+    surface_format.format = VK_FORMAT_B8G8R8A8_UNORM;
+
+    internal_swapchain->swapchain_extent = {};
+    internal_swapchain->swapchain_extent.width = std::max(swapchain_capabilities.minImageExtent.width, swapchain_capabilities.maxImageExtent.width);
+    internal_swapchain->swapchain_extent.height = std::max(swapchain_capabilities.minImageExtent.height, swapchain_capabilities.maxImageExtent.height);
+
+    uint32_t image_count = desc.buffer_count;
+    if ((swapchain_capabilities.maxImageCount > 0) && (image_count > swapchain_capabilities.maxImageCount))
+    {
+        image_count = swapchain_capabilities.maxImageCount;
+    }
+
+    VkSwapchainCreateInfoKHR scci = {};
+    scci.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    scci.surface = internal_swapchain->surface;
+    scci.minImageCount = image_count;
+    scci.imageFormat = surface_format.format;
+    scci.imageColorSpace = surface_format.colorSpace;
+    scci.imageExtent = internal_swapchain->swapchain_extent;
+    scci.imageArrayLayers = 1;
+    scci.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    scci.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // transform
+    if (swapchain_capabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
+        scci.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+    else
+        scci.preTransform = swapchain_capabilities.currentTransform;
+
+    // composite alpha
+    std::vector<VkCompositeAlphaFlagBitsKHR> composite_alpha_flags = {
+        VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+        VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR,
+        VK_COMPOSITE_ALPHA_POST_MULTIPLIED_BIT_KHR,
+        VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR,
+    };
+    for (auto& composite_alpha_flag : composite_alpha_flags)
+    {
+        if (swapchain_capabilities.supportedCompositeAlpha & composite_alpha_flag)
+        {
+            scci.compositeAlpha = composite_alpha_flag;
+            break;
+        };
+    }
+
+    scci.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    if (!desc.vsync)
+    {
+        for (auto& presentMode : swapchain_present_modes)
+        {
+            if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+            {
+                scci.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+                break;
+            }
+            if (presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+            {
+                scci.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            }
+        }
+    }
+    scci.clipped = VK_TRUE;
+    scci.oldSwapchain = internal_swapchain->swapchain;
+    VK_ASSERT(vkCreateSwapchainKHR(device, &scci, nullptr, &internal_swapchain->swapchain));
+
+    if (scci.oldSwapchain != VK_NULL_HANDLE)
+    {
+        vkDestroySwapchainKHR(device, scci.oldSwapchain, nullptr);
+    }
+
+    // Images
+    VK_ASSERT(vkGetSwapchainImagesKHR(device, internal_swapchain->swapchain, &image_count, nullptr));
+    internal_swapchain->swapchain_images.resize(image_count);
+    VK_ASSERT(vkGetSwapchainImagesKHR(device, internal_swapchain->swapchain, &image_count, internal_swapchain->swapchain_images.data()));
+    internal_swapchain->swapchain_image_format = surface_format.format;
+
+    // Create default render pass:
+    {
+        VkAttachmentDescription color_attachment = {};
+        color_attachment.format = surface_format.format;
+        color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        VkAttachmentReference color_attachment_ref = {};
+        color_attachment_ref.attachment = 0;
+        color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+        VkSubpassDescription subpass = {};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &color_attachment_ref;
+
+        VkRenderPassCreateInfo rpci = {};
+        rpci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        rpci.attachmentCount = 1;
+        rpci.pAttachments = &color_attachment;
+        rpci.subpassCount = 1;
+        rpci.pSubpasses = &subpass;
+
+        VkSubpassDependency dependency = {};
+        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependency.dstSubpass = 0;
+        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependency.srcAccessMask = 0;
+        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+        rpci.dependencyCount = 1;
+        rpci.pDependencies = &dependency;
+        if (internal_swapchain->renderpass != VK_NULL_HANDLE)
+        {
+            resource_manager.destroyer_renderpasses.push_back(std::make_pair(internal_swapchain->renderpass, resource_manager.frame_count));
+        }
+
+        VK_ASSERT(vkCreateRenderPass(device, &rpci, nullptr, &internal_swapchain->renderpass));
+
+        // Compute renderpass hash
+        internal_swapchain->renderpass_hash = 0;
+        hash_combine(internal_swapchain->renderpass_hash, internal_swapchain->swapchain_image_format);
+    }
+
+    // Create swap chain render targets
+    internal_swapchain->swapchain_image_views.resize(internal_swapchain->swapchain_images.size());
+    internal_swapchain->swapchain_framebuffers.resize(internal_swapchain->swapchain_images.size());
+    for (uint32_t i = 0; i < internal_swapchain->swapchain_images.size(); ++i)
+    {
+        VkImageViewCreateInfo ivci = {};
+        ivci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        ivci.image = internal_swapchain->swapchain_images[i];
+        ivci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        ivci.format = internal_swapchain->swapchain_image_format;
+        ivci.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+        ivci.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+        ivci.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+        ivci.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+        ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        ivci.subresourceRange.baseMipLevel = 0;
+        ivci.subresourceRange.levelCount = 1;
+        ivci.subresourceRange.baseArrayLayer = 0;
+        ivci.subresourceRange.layerCount = 1;
+
+        if (internal_swapchain->swapchain_image_views[i] != VK_NULL_HANDLE)
+        {
+            resource_manager.destroyer_imageviews.push_back(std::make_pair(internal_swapchain->swapchain_image_views[i], resource_manager.frame_count));
+        }
+        VK_ASSERT(vkCreateImageView(device, &ivci, nullptr, &internal_swapchain->swapchain_image_views[i]));
+
+        VkImageView attachments[] = {internal_swapchain->swapchain_image_views[i]};
+
+        VkFramebufferCreateInfo fci = {};
+        fci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        fci.renderPass = internal_swapchain->renderpass;
+        fci.attachmentCount = 1;
+        fci.pAttachments = attachments;
+        fci.width = internal_swapchain->swapchain_extent.width;
+        fci.height = internal_swapchain->swapchain_extent.height;
+        fci.layers = 1;
+
+        if (internal_swapchain->swapchain_framebuffers[i] != VK_NULL_HANDLE)
+        {
+            resource_manager.destroyer_framebuffers.push_back(std::make_pair(internal_swapchain->swapchain_framebuffers[i], resource_manager.frame_count));
+        }
+        VK_ASSERT(vkCreateFramebuffer(device, &fci, nullptr, &internal_swapchain->swapchain_framebuffers[i]));
+    }
+
+    VkSemaphoreCreateInfo sci = {};
+    sci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    if (internal_swapchain->swapchain_acquire_semaphore == VK_NULL_HANDLE)
+    {
+        VK_ASSERT(vkCreateSemaphore(device, &sci, nullptr, &internal_swapchain->swapchain_acquire_semaphore));
+    }
+
+    if (internal_swapchain->swapchain_release_semaphore == VK_NULL_HANDLE)
+    {
+        VK_ASSERT(vkCreateSemaphore(device, &sci, nullptr, &internal_swapchain->swapchain_release_semaphore));
+    }
+
+    return internal_swapchain;
+}
+
+void VulkanDevice::DestroySwapChain(GfxSwapChain* swapchain)
+{
+    vkDeviceWaitIdle(device);
+    VulkanSwapChain* internal_swapchain = (VulkanSwapChain*)swapchain;
+    for (size_t i = 0; i < internal_swapchain->swapchain_images.size(); ++i)
+    {
+        vkDestroyFramebuffer(device, internal_swapchain->swapchain_framebuffers[i], nullptr);
+        vkDestroyImageView(device, internal_swapchain->swapchain_image_views[i], nullptr);
+    }
+    vkDestroyRenderPass(device, internal_swapchain->renderpass, nullptr);
+
+    vkDestroySwapchainKHR(device, internal_swapchain->swapchain, nullptr);
+    vkDestroySurfaceKHR(instance, internal_swapchain->surface, nullptr);
+    vkDestroySemaphore(device, internal_swapchain->swapchain_acquire_semaphore, nullptr);
+    vkDestroySemaphore(device, internal_swapchain->swapchain_release_semaphore, nullptr);
+}
+
+GfxRenderPass* VulkanDevice::CreateRenderPass(const GfxRenderPassDesc& desc)
+{
+    auto internal_renderpass = new VulkanRenderPass(this);
+    internal_renderpass->desc = desc;
+
+    internal_renderpass->hash = 0;
+    hash_combine(internal_renderpass->hash, desc.attachments.size());
+    for (auto& attachment : desc.attachments)
+    {
+        if (attachment.type == RenderPassAttachment::RENDERTARGET || attachment.type == RenderPassAttachment::DEPTH_STENCIL)
+        {
+            hash_combine(internal_renderpass->hash, attachment.texture->format);
+            hash_combine(internal_renderpass->hash, attachment.texture->sample_count);
+        }
+    }
+
+    VkImageView attachments[18] = {};
+    VkAttachmentDescription2 attachment_descriptions[18] = {};
+    VkAttachmentReference2 color_attachment_refs[8] = {};
+    VkAttachmentReference2 resolve_attachment_refs[8] = {};
+    VkAttachmentReference2 depth_attachment_ref = {};
+
+    uint32_t resolve_count = 0;
+
+    VkSubpassDescription2 subpass = {};
+    subpass.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2;
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+
+    uint32_t valid_attachment_count = 0;
+    for (auto& attachment : desc.attachments)
+    {
+        const GfxTexture* texture = attachment.texture;
+        int subresource = attachment.subresource;
+        VulkanTexture* internal_texture = (VulkanTexture*)texture;
+
+        attachment_descriptions[valid_attachment_count].sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+        attachment_descriptions[valid_attachment_count].format = ToVulkanFormat(texture->format);
+        attachment_descriptions[valid_attachment_count].samples = (VkSampleCountFlagBits)texture->sample_count;
+
+        switch (attachment.loadop)
+        {
+            default:
+            case LOAD_LOAD:
+                attachment_descriptions[valid_attachment_count].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+                break;
+            case LOAD_CLEAR:
+                attachment_descriptions[valid_attachment_count].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                break;
+            case LOAD_DONTCARE:
+                attachment_descriptions[valid_attachment_count].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                break;
+        }
+
+        switch (attachment.storeop)
+        {
+            default:
+            case STORE_STORE:
+                attachment_descriptions[valid_attachment_count].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+                break;
+            case STORE_DONTCARE:
+                attachment_descriptions[valid_attachment_count].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                break;
+        }
+
+        attachment_descriptions[valid_attachment_count].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment_descriptions[valid_attachment_count].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+        if (attachment.type == RenderPassAttachment::RENDERTARGET)
+        {
+            if (subresource < 0)
+            {
+                attachments[valid_attachment_count] = internal_texture->rtv;
+            }
+            else
+            {
+                attachments[valid_attachment_count] = internal_texture->subresources_rtv[subresource];
+            }
+
+            attachment_descriptions[valid_attachment_count].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            attachment_descriptions[valid_attachment_count].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+            color_attachment_refs[subpass.colorAttachmentCount].sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+            color_attachment_refs[subpass.colorAttachmentCount].attachment = valid_attachment_count;
+            color_attachment_refs[subpass.colorAttachmentCount].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            color_attachment_refs[subpass.colorAttachmentCount].aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            subpass.colorAttachmentCount++;
+            subpass.pColorAttachments = color_attachment_refs;
+        }
+        else if (attachment.type == RenderPassAttachment::DEPTH_STENCIL)
+        {
+            if (subresource < 0)
+            {
+                attachments[valid_attachment_count] = internal_texture->dsv;
+            }
+            else
+            {
+                attachments[valid_attachment_count] = internal_texture->subresources_dsv[subresource];
+            }
+
+            attachment_descriptions[valid_attachment_count].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            attachment_descriptions[valid_attachment_count].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+            depth_attachment_ref.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+            depth_attachment_ref.attachment = valid_attachment_count;
+            depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+            depth_attachment_ref.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+            subpass.pDepthStencilAttachment = &depth_attachment_ref;
+
+            if (IsFormatStencilSupport(texture->format))
+            {
+                depth_attachment_ref.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+                switch (attachment.loadop)
+                {
+                    default:
+                    case LOAD_LOAD:
+                        attachment_descriptions[valid_attachment_count].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+                        break;
+                    case LOAD_CLEAR:
+                        attachment_descriptions[valid_attachment_count].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                        break;
+                    case LOAD_DONTCARE:
+                        attachment_descriptions[valid_attachment_count].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                        break;
+                }
+
+                switch (attachment.storeop)
+                {
+                    default:
+                    case STORE_STORE:
+                        attachment_descriptions[valid_attachment_count].stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
+                        break;
+                    case STORE_DONTCARE:
+                        attachment_descriptions[valid_attachment_count].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                        break;
+                }
+            }
+        }
+        else if (attachment.type == RenderPassAttachment::RESOLVE)
+        {
+            attachment_descriptions[valid_attachment_count].initialLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            attachment_descriptions[valid_attachment_count].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+            resolve_attachment_refs[resolve_count].sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+
+            if (attachment.texture == nullptr)
+            {
+                resolve_attachment_refs[resolve_count].attachment = VK_ATTACHMENT_UNUSED;
+            }
+            else
+            {
+                if (subresource < 0)
+                {
+                    attachments[valid_attachment_count] = internal_texture->srv;
+                }
+                else
+                {
+                    attachments[valid_attachment_count] = internal_texture->subresources_srv[subresource];
+                }
+
+                resolve_attachment_refs[resolve_count].attachment = valid_attachment_count;
+                resolve_attachment_refs[resolve_count].layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                resolve_attachment_refs[resolve_count].aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            }
+
+            resolve_count++;
+            subpass.pResolveAttachments = resolve_attachment_refs;
+        }
+
+        valid_attachment_count++;
+    }
+    assert(desc.attachments.size() == valid_attachment_count);
+
+    VkRenderPassCreateInfo2 rpci = {};
+    rpci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2;
+    rpci.attachmentCount = valid_attachment_count;
+    rpci.pAttachments = attachment_descriptions;
+    rpci.subpassCount = 1;
+    rpci.pSubpasses = &subpass;
+    VK_ASSERT(vkCreateRenderPass2(device, &rpci, nullptr, &internal_renderpass->renderpass));
+
+    auto internal_texture = (VulkanTexture*)desc.attachments[0].texture;
+    VkFramebufferCreateInfo fci = {};
+    fci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    fci.renderPass = internal_renderpass->renderpass;
+    fci.attachmentCount = valid_attachment_count;
+    fci.pAttachments = attachments;
+    fci.width = internal_texture->width;
+    fci.height = internal_texture->height;
+    fci.layers = 1;
+    VK_ASSERT(vkCreateFramebuffer(device, &fci, nullptr, &internal_renderpass->framebuffer));
+
+    internal_renderpass->begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    internal_renderpass->begin_info.renderPass = internal_renderpass->renderpass;
+    internal_renderpass->begin_info.framebuffer = internal_renderpass->framebuffer;
+    internal_renderpass->begin_info.renderArea.offset = {0, 0};
+    internal_renderpass->begin_info.renderArea.extent.width = fci.width;
+    internal_renderpass->begin_info.renderArea.extent.height = fci.height;
+    internal_renderpass->begin_info.clearValueCount = valid_attachment_count;
+    internal_renderpass->begin_info.pClearValues = internal_renderpass->clear_colors;
+
+    uint32_t i = 0;
+    for (auto& attachment : desc.attachments)
+    {
+        if (desc.attachments[i].type == RenderPassAttachment::RESOLVE || attachment.texture == nullptr)
+            continue;
+
+        const ClearValue& clear = desc.attachments[i].texture->clear;
+        if (desc.attachments[i].type == RenderPassAttachment::RENDERTARGET)
+        {
+            internal_renderpass->clear_colors[i].color.float32[0] = clear.color[0];
+            internal_renderpass->clear_colors[i].color.float32[1] = clear.color[1];
+            internal_renderpass->clear_colors[i].color.float32[2] = clear.color[2];
+            internal_renderpass->clear_colors[i].color.float32[3] = clear.color[3];
+        }
+        else if (desc.attachments[i].type == RenderPassAttachment::DEPTH_STENCIL)
+        {
+            internal_renderpass->clear_colors[i].depthStencil.depth = clear.depthstencil.depth;
+            internal_renderpass->clear_colors[i].depthStencil.stencil = clear.depthstencil.stencil;
+        }
+        else
+        {
+            assert(0);
+        }
+        i++;
+    }
+    return internal_renderpass;
+}
+
+void VulkanDevice::DestroyRenderPass(GfxRenderPass* renderpass)
+{
+    resource_manager.destroy_locker.lock();
+    VulkanRenderPass* internal_renderpass = (VulkanRenderPass*)renderpass;
+    uint64_t frame_count = resource_manager.frame_count;
+    resource_manager.destroyer_renderpasses.push_back(std::make_pair(internal_renderpass->renderpass, frame_count));
+    resource_manager.destroyer_framebuffers.push_back(std::make_pair(internal_renderpass->framebuffer, frame_count));
+    resource_manager.destroy_locker.unlock();
+}
+
+GfxShader* VulkanDevice::CreateShader(const GfxShaderDesc& desc)
+{
+    VulkanShader* internal_shader = new VulkanShader(this);
+    internal_shader->stage = desc.stage;
+
+    VkShaderModuleCreateInfo smci = {};
+    smci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    smci.codeSize = desc.bytecode_length;
+    smci.pCode = (const uint32_t*)desc.bytecode;
+    VK_ASSERT(vkCreateShaderModule(device, &smci, nullptr, &internal_shader->shader_module));
+
+    internal_shader->stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    internal_shader->stage_info.module = internal_shader->shader_module;
+    internal_shader->stage_info.pName = "main";
+    switch (desc.stage)
+    {
+        case SHADER_STAGE_VERT:
+            internal_shader->stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+            break;
+        case SHADER_STAGE_HULL:
+            internal_shader->stage_info.stage = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+            break;
+        case SHADER_STAGE_DOMN:
+            internal_shader->stage_info.stage = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+            break;
+        case SHADER_STAGE_GEOM:
+            internal_shader->stage_info.stage = VK_SHADER_STAGE_GEOMETRY_BIT;
+            break;
+        case SHADER_STAGE_FRAG:
+            internal_shader->stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+            break;
+        case SHADER_STAGE_COMP:
+            internal_shader->stage_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+            break;
+        default:
+            internal_shader->stage_info.stage = VK_SHADER_STAGE_ALL;
+            break;
+    }
+
+    {
+        // 获取反射信息
+        SpvReflectShaderModule module;
+        SpvReflectResult result = spvReflectCreateShaderModule(smci.codeSize, smci.pCode, &module);
+        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+        uint32_t binding_count = 0;
+        result = spvReflectEnumerateDescriptorBindings(
+            &module, &binding_count, nullptr);
+        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+        std::vector<SpvReflectDescriptorBinding*> bindings(binding_count);
+        result = spvReflectEnumerateDescriptorBindings(
+            &module, &binding_count, bindings.data());
+        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+        uint32_t push_count = 0;
+        result = spvReflectEnumeratePushConstantBlocks(&module, &push_count, nullptr);
+        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+        std::vector<SpvReflectBlockVariable*> pushconstants(push_count);
+        result = spvReflectEnumeratePushConstantBlocks(&module, &push_count, pushconstants.data());
+        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+        std::vector<VkSampler> staticsamplers;
+
+        for (auto& x : pushconstants)
+        {
+            auto& push = internal_shader->pushconstants;
+            push.stageFlags = internal_shader->stage_info.stage;
+            push.offset = x->offset;
+            push.size = x->size;
+        }
+
+        for (auto& x : bindings)
+        {
+            // bindless堆的布局由设备创建, 设备不支持bindless时这些绑定没有对应的布局
+            if (x->set >= BLAST_BINDLESS_TEXTURE_SET)
+            {
+                if (!bindless_supported)
+                {
+                    BLAST_LOGE("shader binding %s (set %u, binding %u) uses the bindless heap, but bindless is not supported\n", x->name ? x->name : "", x->set, x->binding);
+                    assert(0);
+                }
+                continue;
+            }
+
+            VkDescriptorSetLayoutBinding descriptor = {};
+            descriptor.stageFlags = internal_shader->stage_info.stage;
+            descriptor.binding = x->binding;
+            descriptor.descriptorCount = x->count;
+            descriptor.descriptorType = (VkDescriptorType)x->descriptor_type;
+
+            VkImageViewType image_view_type;
+            image_view_type = VK_IMAGE_VIEW_TYPE_MAX_ENUM;
+
+            switch (x->descriptor_type)
+            {
+                default:
+                    break;
+                case SPV_REFLECT_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+                case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+                    switch (x->image.dim)
+                    {
+                        default:
+                        case SpvDim1D:
+                            if (x->image.arrayed == 0)
+                            {
+                                image_view_type = VK_IMAGE_VIEW_TYPE_1D;
+                            }
+                            else
+                            {
+                                image_view_type = VK_IMAGE_VIEW_TYPE_1D_ARRAY;
+                            }
+                            break;
+                        case SpvDim2D:
+                            if (x->image.arrayed == 0)
+                            {
+                                image_view_type = VK_IMAGE_VIEW_TYPE_2D;
+                            }
+                            else
+                            {
+                                image_view_type = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+                            }
+                            break;
+                        case SpvDim3D:
+                            image_view_type = VK_IMAGE_VIEW_TYPE_3D;
+                            break;
+                        case SpvDimCube:
+                            if (x->image.arrayed == 0)
+                            {
+                                image_view_type = VK_IMAGE_VIEW_TYPE_CUBE;
+                            }
+                            else
+                            {
+                                image_view_type = VK_IMAGE_VIEW_TYPE_CUBE_ARRAY;
+                            }
+                            break;
+                    }
+                    break;
+            }
+
+            internal_shader->layout_bindings.push_back(descriptor);
+            internal_shader->image_view_types.push_back(image_view_type);
+            internal_shader->layout_sets.push_back(x->set);
+        }
+
+        spvReflectDestroyShaderModule(&module);
+
+        if (desc.stage == SHADER_STAGE_COMP || desc.stage == SHADER_STAGE_RAYTRACING)
+        {
+            int32_t push_set = SelectPushSet(internal_shader->layout_bindings, internal_shader->layout_sets);
+            PrepareLayoutBindings(internal_shader->layout_bindings, internal_shader->image_view_types, internal_shader->layout_sets, push_set);
+
+            VkPipelineBindPoint bind_point = desc.stage == SHADER_STAGE_RAYTRACING ? VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR : VK_PIPELINE_BIND_POINT_COMPUTE;
+            VulkanPipelineLayout* layout = AcquirePipelineLayout(internal_shader->layout_bindings, internal_shader->image_view_types, internal_shader->layout_sets,
+                                                                 internal_shader->pushconstants, push_set, bind_point);
+            internal_shader->layout = layout;
+            internal_shader->binding_hash = layout->hash;
+            internal_shader->pipeline_layout_cs = layout->pipeline_layout;
+        }
+    }
+
+    if (desc.stage == SHADER_STAGE_COMP)
+    {
+        VkComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.layout = internal_shader->pipeline_layout_cs;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.stage = internal_shader->stage_info;
+        VK_ASSERT(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &internal_shader->pipeline_cs));
+    }
+
+    return internal_shader;
+}
+
+void VulkanDevice::DestroyShader(GfxShader* shader)
+{
+    resource_manager.destroy_locker.lock();
+    VulkanShader* internal_shader = (VulkanShader*)shader;
+    uint64_t frame_count = resource_manager.frame_count;
+    resource_manager.destroyer_shadermodules.push_back(std::make_pair(internal_shader->shader_module, frame_count));
+    if (internal_shader->pipeline_cs)
+    {
+        resource_manager.destroyer_pipelines.push_back(std::make_pair(internal_shader->pipeline_cs, frame_count));
+    }
+    if (internal_shader->layout)
+    {
+        ReleasePipelineLayout(internal_shader->layout);
+    }
+    resource_manager.destroy_locker.unlock();
+}
+
+GfxPipeline* VulkanDevice::CreatePipeline(const GfxPipelineDesc& desc)
+{
+    VulkanPipeline* internal_pipeline = new VulkanPipeline(this);
+    internal_pipeline->desc = desc;
+
+    internal_pipeline->hash = 0;
+    hash_combine(internal_pipeline->hash, desc.sc);
+    hash_combine(internal_pipeline->hash, desc.rp);
+    hash_combine(internal_pipeline->hash, desc.vs);
+    hash_combine(internal_pipeline->hash, desc.fs);
+    hash_combine(internal_pipeline->hash, desc.hs);
+    hash_combine(internal_pipeline->hash, desc.ds);
+    hash_combine(internal_pipeline->hash, desc.gs);
+    hash_combine(internal_pipeline->hash, desc.il);
+    hash_combine(internal_pipeline->hash, desc.rs);
+    hash_combine(internal_pipeline->hash, desc.bs);
+    hash_combine(internal_pipeline->hash, desc.dss);
+    hash_combine(internal_pipeline->hash, desc.primitive_topo);
+    hash_combine(internal_pipeline->hash, desc.patch_control_points);
+
+    {
+        auto insert_shader = [&](const GfxShader* shader)
+        {
+            if (shader == nullptr)
+                return;
+
+            VulkanShader* internal_shader = (VulkanShader*)shader;
+            uint32_t i = 0;
+            for (auto& x : internal_shader->layout_bindings)
+            {
+                bool found = false;
+                for (uint32_t j = 0; j < internal_pipeline->layout_bindings.size(); ++j)
+                {
+                    auto& y = internal_pipeline->layout_bindings[j];
+                    if (x.binding == y.binding)
+                    {
+                        assert(x.descriptorCount == y.descriptorCount);
+                        assert(x.descriptorType == y.descriptorType);
+                        // 同一个槽位在所有阶段中必须属于同一个set
+                        assert(internal_shader->layout_sets[i] == internal_pipeline->layout_sets[j]);
+                        found = true;
+                        y.stageFlags |= x.stageFlags;
+                        break;
+                    }
+                }
 
-                switch (attachment.storeop)
+                if (!found)
                 {
-                    default:
-                    case STORE_STORE:
-                        attachment_descriptions[valid_attachment_count].stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
-                        break;
-                    case STORE_DONTCARE:
-                        attachment_descriptions[valid_attachment_count].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-                        break;
+                    internal_pipeline->layout_bindings.push_back(x);
+                    internal_pipeline->image_view_types.push_back(internal_shader->image_view_types[i]);
+                    internal_pipeline->layout_sets.push_back(internal_shader->layout_sets[i]);
                 }
+                i++;
+            }
+
+            if (internal_shader->pushconstants.size > 0)
+            {
+                internal_pipeline->pushconstants.offset = std::min(internal_pipeline->pushconstants.offset, internal_shader->pushconstants.offset);
+                internal_pipeline->pushconstants.size = std::max(internal_pipeline->pushconstants.size, internal_shader->pushconstants.size);
+                internal_pipeline->pushconstants.stageFlags |= internal_shader->pushconstants.stageFlags;
+            }
+        };
+
+        insert_shader(desc.vs);
+        insert_shader(desc.hs);
+        insert_shader(desc.ds);
+        insert_shader(desc.gs);
+        insert_shader(desc.fs);
+
+        int32_t push_set = SelectPushSet(internal_pipeline->layout_bindings, internal_pipeline->layout_sets);
+        PrepareLayoutBindings(internal_pipeline->layout_bindings, internal_pipeline->image_view_types, internal_pipeline->layout_sets, push_set);
+
+        VulkanPipelineLayout* layout = AcquirePipelineLayout(internal_pipeline->layout_bindings, internal_pipeline->image_view_types, internal_pipeline->layout_sets,
+                                                             internal_pipeline->pushconstants, push_set, VK_PIPELINE_BIND_POINT_GRAPHICS);
+        internal_pipeline->layout = layout;
+        internal_pipeline->binding_hash = layout->hash;
+        internal_pipeline->pipeline_layout = layout->pipeline_layout;
+    }
+
+    VkGraphicsPipelineCreateInfo& pipeline_info = internal_pipeline->pipeline_info;
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.layout = internal_pipeline->pipeline_layout;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+
+    // shaders
+    uint32_t shader_stage_count = 0;
+    auto& shader_stages = internal_pipeline->shader_stages;
+    if (desc.vs != nullptr)
+    {
+        VulkanShader* internal_shader = (VulkanShader*)desc.vs;
+        shader_stages[shader_stage_count++] = internal_shader->stage_info;
+    }
+    if (desc.hs != nullptr)
+    {
+        VulkanShader* internal_shader = (VulkanShader*)desc.hs;
+        shader_stages[shader_stage_count++] = internal_shader->stage_info;
+    }
+    if (desc.ds != nullptr)
+    {
+        VulkanShader* internal_shader = (VulkanShader*)desc.ds;
+        shader_stages[shader_stage_count++] = internal_shader->stage_info;
+    }
+    if (desc.gs != nullptr)
+    {
+        VulkanShader* internal_shader = (VulkanShader*)desc.gs;
+        shader_stages[shader_stage_count++] = internal_shader->stage_info;
+    }
+    if (desc.fs != nullptr)
+    {
+        VulkanShader* internal_shader = (VulkanShader*)desc.fs;
+        shader_stages[shader_stage_count++] = internal_shader->stage_info;
+    }
+    pipeline_info.stageCount = shader_stage_count;
+    pipeline_info.pStages = shader_stages;
+
+    // input assembly
+    VkPipelineInputAssemblyStateCreateInfo& input_assembly = internal_pipeline->input_assembly;
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    switch (desc.primitive_topo)
+    {
+        case PRIMITIVE_TOPO_POINT_LIST:
+            input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+            break;
+        case PRIMITIVE_TOPO_LINE_LIST:
+            input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+            break;
+        case PRIMITIVE_TOPO_LINE_STRIP:
+            input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_LINE_STRIP;
+            break;
+        case PRIMITIVE_TOPO_TRI_STRIP:
+            input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+            break;
+        case PRIMITIVE_TOPO_PATCH_LIST:
+            input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+            break;
+        case PRIMITIVE_TOPO_TRI_LIST:
+            input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+            break;
+    }
+    input_assembly.primitiveRestartEnable = VK_FALSE;
+    pipeline_info.pInputAssemblyState = &input_assembly;
+
+    // rasterizer
+    VkPipelineRasterizationStateCreateInfo& rasterizer = internal_pipeline->rasterizer;
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_TRUE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_FALSE;
+    rasterizer.depthBiasConstantFactor = 0.0f;
+    rasterizer.depthBiasClamp = 0.0f;
+    rasterizer.depthBiasSlopeFactor = 0.0f;
+
+    if (desc.rs != nullptr)
+    {
+        const GfxRasterizerState& rs = *desc.rs;
+
+        switch (rs.fill_mode)
+        {
+            case FILL_WIREFRAME:
+                rasterizer.polygonMode = VK_POLYGON_MODE_LINE;
+                break;
+            case FILL_SOLID:
+            default:
+                rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+                break;
+        }
+
+        switch (rs.cull_mode)
+        {
+            case CULL_BACK:
+                rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+                break;
+            case CULL_FRONT:
+                rasterizer.cullMode = VK_CULL_MODE_FRONT_BIT;
+                break;
+            case CULL_NONE:
+            default:
+                rasterizer.cullMode = VK_CULL_MODE_NONE;
+                break;
+        }
+
+        switch (rs.front_face)
+        {
+            case FRONT_FACE_CCW:
+                rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+                break;
+            case FRONT_FACE_CW:
+            default:
+                rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+                break;
+        }
+        rasterizer.depthBiasEnable = rs.depth_bias != 0 || rs.slope_scaled_depth_bias != 0;
+        rasterizer.depthBiasConstantFactor = static_cast<float>(rs.depth_bias);
+        rasterizer.depthBiasClamp = 0.0f;
+        rasterizer.depthBiasSlopeFactor = rs.slope_scaled_depth_bias;
+    }
+    pipeline_info.pRasterizationState = &rasterizer;
+
+    // viewport state
+    VkPipelineViewportStateCreateInfo& viewport_state = internal_pipeline->viewport_state;
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.pViewports = nullptr;
+    viewport_state.scissorCount = 1;
+    viewport_state.pScissors = nullptr;
+    pipeline_info.pViewportState = &viewport_state;
+
+    // depth stencil
+    VkPipelineDepthStencilStateCreateInfo& depthstencil = internal_pipeline->depthstencil;
+    depthstencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    if (desc.dss != nullptr)
+    {
+        depthstencil.depthTestEnable = desc.dss->depth_test ? VK_TRUE : VK_FALSE;
+        depthstencil.depthWriteEnable = desc.dss->depth_write ? VK_TRUE : VK_FALSE;
+        depthstencil.depthCompareOp = ToVulkanCompareOp(desc.dss->depth_func);
+
+        depthstencil.stencilTestEnable = desc.dss->stencil_test ? VK_TRUE : VK_FALSE;
+
+        depthstencil.front.compareMask = desc.dss->stencil_read_mask;
+        depthstencil.front.writeMask = desc.dss->stencil_write_mask;
+        depthstencil.front.reference = 0;
+        depthstencil.front.compareOp = ToVulkanCompareOp(desc.dss->front_face.stencil_func);
+        depthstencil.front.passOp = ToVulkanStencilOp(desc.dss->front_face.stencil_pass_op);
+        depthstencil.front.failOp = ToVulkanStencilOp(desc.dss->front_face.stencil_fail_op);
+        depthstencil.front.depthFailOp = ToVulkanStencilOp(desc.dss->front_face.stencil_depth_fail_op);
+
+        depthstencil.back.compareMask = desc.dss->stencil_read_mask;
+        depthstencil.back.writeMask = desc.dss->stencil_write_mask;
+        depthstencil.back.reference = 0;
+        depthstencil.back.compareOp = ToVulkanCompareOp(desc.dss->back_face.stencil_func);
+        depthstencil.back.passOp = ToVulkanStencilOp(desc.dss->back_face.stencil_pass_op);
+        depthstencil.back.failOp = ToVulkanStencilOp(desc.dss->back_face.stencil_fail_op);
+        depthstencil.back.depthFailOp = ToVulkanStencilOp(desc.dss->back_face.stencil_depth_fail_op);
+
+        depthstencil.depthBoundsTestEnable = VK_FALSE;
+    }
+    pipeline_info.pDepthStencilState = &depthstencil;
+
+    // tessellation
+    VkPipelineTessellationStateCreateInfo& tessellation_info = internal_pipeline->tessellation_state;
+    tessellation_info.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
+    tessellation_info.patchControlPoints = desc.patch_control_points;
+    pipeline_info.pTessellationState = &tessellation_info;
+
+    VkDynamicState dynamic_states[6];
+    dynamic_states[0] = VK_DYNAMIC_STATE_VIEWPORT;
+    dynamic_states[1] = VK_DYNAMIC_STATE_SCISSOR;
+    dynamic_states[2] = VK_DYNAMIC_STATE_DEPTH_BIAS;
+    dynamic_states[3] = VK_DYNAMIC_STATE_BLEND_CONSTANTS;
+    dynamic_states[4] = VK_DYNAMIC_STATE_DEPTH_BOUNDS;
+    //dynamic_states[5] = VK_DYNAMIC_STATE_STENCIL_REFERENCE;
+
+    VkPipelineDynamicStateCreateInfo dynamic_state = {};
+    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state.pNext = NULL;
+    dynamic_state.flags = 0;
+    dynamic_state.dynamicStateCount = 5;
+    dynamic_state.pDynamicStates = dynamic_states;
+    pipeline_info.pDynamicState = &dynamic_state;
+
+    if (desc.sc)
+    {
+        pipeline_info.renderPass = ((VulkanSwapChain*)desc.sc)->renderpass;
+        pipeline_info.subpass = 0;
+    }
+    else
+    {
+        pipeline_info.renderPass = ((VulkanRenderPass*)desc.rp)->renderpass;
+        pipeline_info.subpass = 0;
+    }
+
+    // MSAA
+    VkPipelineMultisampleStateCreateInfo multisampling = {};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    if (desc.rs != nullptr)
+    {
+        multisampling.rasterizationSamples = ToVulkanSampleCount(desc.sample_count);
+    }
+    if (desc.bs != nullptr)
+    {
+        multisampling.alphaToCoverageEnable = desc.bs->alpha_to_coverage_eEnable ? VK_TRUE : VK_FALSE;
+    }
+    else
+    {
+        multisampling.alphaToCoverageEnable = VK_FALSE;
+    }
+    multisampling.alphaToOneEnable = VK_FALSE;
+    pipeline_info.pMultisampleState = &multisampling;
+
+    // Blending
+    uint32_t render_target_count = 0;
+    if (desc.sc)
+    {
+        render_target_count = 1;
+    }
+    else
+    {
+        for (uint32_t i = 0; i < desc.rp->desc.attachments.size(); ++i)
+        {
+            if (desc.rp->desc.attachments[i].type == RenderPassAttachment::RENDERTARGET)
+            {
+                render_target_count++;
             }
         }
-        else if (attachment.type == RenderPassAttachment::RESOLVE)
-        {
-            attachment_descriptions[valid_attachment_count].initialLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            attachment_descriptions[valid_attachment_count].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    }
 
-            resolve_attachment_refs[resolve_count].sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+    uint32_t num_blend_attachments = 0;
+    VkPipelineColorBlendAttachmentState color_blend_attachments[8] = {};
+    for (uint32_t i = 0; i < render_target_count; ++i)
+    {
+        size_t attachment_index = 0;
+        if (desc.bs->independent_blend_enable)
+            attachment_index = i;
 
-            if (attachment.texture == nullptr)
-            {
-                resolve_attachment_refs[resolve_count].attachment = VK_ATTACHMENT_UNUSED;
-            }
-            else
-            {
-                if (subresource < 0)
-                {
-                    attachments[valid_attachment_count] = internal_texture->srv;
-                }
-                else
-                {
-                    attachments[valid_attachment_count] = internal_texture->subresources_srv[subresource];
-                }
+        const auto& rt_desc = desc.bs->rt[attachment_index];
+        VkPipelineColorBlendAttachmentState& attachment = color_blend_attachments[num_blend_attachments];
+        num_blend_attachments++;
 
-                resolve_attachment_refs[resolve_count].attachment = valid_attachment_count;
-                resolve_attachment_refs[resolve_count].layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                resolve_attachment_refs[resolve_count].aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            }
+        attachment.blendEnable = rt_desc.blend_enable ? VK_TRUE : VK_FALSE;
 
-            resolve_count++;
-            subpass.pResolveAttachments = resolve_attachment_refs;
+        attachment.colorWriteMask = 0;
+        if (rt_desc.render_target_write_mask & COLOR_WRITE_ENABLE_RED)
+        {
+            attachment.colorWriteMask |= VK_COLOR_COMPONENT_R_BIT;
+        }
+        if (rt_desc.render_target_write_mask & COLOR_WRITE_ENABLE_GREEN)
+        {
+            attachment.colorWriteMask |= VK_COLOR_COMPONENT_G_BIT;
+        }
+        if (rt_desc.render_target_write_mask & COLOR_WRITE_ENABLE_BLUE)
+        {
+            attachment.colorWriteMask |= VK_COLOR_COMPONENT_B_BIT;
+        }
+        if (rt_desc.render_target_write_mask & COLOR_WRITE_ENABLE_ALPHA)
+        {
+            attachment.colorWriteMask |= VK_COLOR_COMPONENT_A_BIT;
         }
 
-        valid_attachment_count++;
+        attachment.srcColorBlendFactor = ToVulkanBlendFactor(rt_desc.src_factor);
+        attachment.dstColorBlendFactor = ToVulkanBlendFactor(rt_desc.dst_factor);
+        attachment.colorBlendOp = ToVulkanBlendOp(rt_desc.blend_op);
+        attachment.srcAlphaBlendFactor = ToVulkanBlendFactor(rt_desc.src_factor_alpha);
+        attachment.dstAlphaBlendFactor = ToVulkanBlendFactor(rt_desc.dst_factor_alpha);
+        attachment.alphaBlendOp = ToVulkanBlendOp(rt_desc.blend_op_alpha);
     }
-    assert(desc.attachments.size() == valid_attachment_count);
-
-    VkRenderPassCreateInfo2 rpci = {};
-    rpci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2;
-    rpci.attachmentCount = valid_attachment_count;
-    rpci.pAttachments = attachment_descriptions;
-    rpci.subpassCount = 1;
-    rpci.pSubpasses = &subpass;
-    VK_ASSERT(vkCreateRenderPass2(device, &rpci, nullptr, &internal_renderpass->renderpass));
 
-    auto internal_texture = (VulkanTexture*)desc.attachments[0].texture;
-    VkFramebufferCreateInfo fci = {};
-    fci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    fci.renderPass = internal_renderpass->renderpass;
-    fci.attachmentCount = valid_attachment_count;
-    fci.pAttachments = attachments;
-    fci.width = internal_texture->width;
-    fci.height = internal_texture->height;
-    fci.layers = 1;
-    VK_ASSERT(vkCreateFramebuffer(device, &fci, nullptr, &internal_renderpass->framebuffer));
-
-    internal_renderpass->begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    internal_renderpass->begin_info.renderPass = internal_renderpass->renderpass;
-    internal_renderpass->begin_info.framebuffer = internal_renderpass->framebuffer;
-    internal_renderpass->begin_info.renderArea.offset = {0, 0};
-    internal_renderpass->begin_info.renderArea.extent.width = fci.width;
-    internal_renderpass->begin_info.renderArea.extent.height = fci.height;
-    internal_renderpass->begin_info.clearValueCount = valid_attachment_count;
-    internal_renderpass->begin_info.pClearValues = internal_renderpass->clear_colors;
+    VkPipelineColorBlendStateCreateInfo color_blending_info = {};
+    color_blending_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blending_info.logicOpEnable = VK_FALSE;
+    color_blending_info.logicOp = VK_LOGIC_OP_COPY;
+    color_blending_info.attachmentCount = num_blend_attachments;
+    color_blending_info.pAttachments = color_blend_attachments;
+    color_blending_info.blendConstants[0] = 1.0f;
+    color_blending_info.blendConstants[1] = 1.0f;
+    color_blending_info.blendConstants[2] = 1.0f;
+    color_blending_info.blendConstants[3] = 1.0f;
+    pipeline_info.pColorBlendState = &color_blending_info;
 
-    uint32_t i = 0;
-    for (auto& attachment : desc.attachments)
+    // InputLayout
+    uint32_t num_input_bindings = 0;
+    VkVertexInputBindingDescription input_bindings[MAX_VERTEX_BINDINGS] = {{0}};
+    uint32_t num_input_attributes = 0;
+    VkVertexInputAttributeDescription input_attributes[MAX_VERTEX_ATTRIBS] = {{0}};
+    uint32_t binding_value = UINT32_MAX;
+    for (auto& element : desc.il->elements)
     {
-        if (desc.attachments[i].type == RenderPassAttachment::RESOLVE || attachment.texture == nullptr)
-            continue;
-
-        const ClearValue& clear = desc.attachments[i].texture->clear;
-        if (desc.attachments[i].type == RenderPassAttachment::RENDERTARGET)
+        if (binding_value != element.binding)
         {
-            internal_renderpass->clear_colors[i].color.float32[0] = clear.color[0];
-            internal_renderpass->clear_colors[i].color.float32[1] = clear.color[1];
-            internal_renderpass->clear_colors[i].color.float32[2] = clear.color[2];
-            internal_renderpass->clear_colors[i].color.float32[3] = clear.color[3];
+            binding_value = element.binding;
+            ++num_input_bindings;
         }
-        else if (desc.attachments[i].type == RenderPassAttachment::DEPTH_STENCIL)
+
+        input_bindings[num_input_bindings - 1].binding = binding_value;
+        if (element.rate == VERTEX_ATTRIB_RATE_INSTANCE)
         {
-            internal_renderpass->clear_colors[i].depthStencil.depth = clear.depthstencil.depth;
-            internal_renderpass->clear_colors[i].depthStencil.stencil = clear.depthstencil.stencil;
+            input_bindings[num_input_bindings - 1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
         }
         else
         {
-            assert(0);
+            input_bindings[num_input_bindings - 1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
         }
-        i++;
+        input_bindings[num_input_bindings - 1].stride += GetFormatStride(element.format);
+
+        input_attributes[num_input_attributes].location = element.location;
+        input_attributes[num_input_attributes].binding = element.binding;
+        input_attributes[num_input_attributes].format = ToVulkanFormat(element.format);
+        input_attributes[num_input_attributes].offset = element.offset;
+        ++num_input_attributes;
     }
-    return internal_renderpass;
+
+    VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
+    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertex_input_info.vertexBindingDescriptionCount = num_input_bindings;
+    vertex_input_info.pVertexBindingDescriptions = input_bindings;
+    vertex_input_info.vertexAttributeDescriptionCount = num_input_attributes;
+    vertex_input_info.pVertexAttributeDescriptions = input_attributes;
+    pipeline_info.pVertexInputState = &vertex_input_info;
+
+    VK_ASSERT(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &internal_pipeline->pipeline));
+
+    return internal_pipeline;
 }
 
-void VulkanDevice::DestroyRenderPass(GfxRenderPass* renderpass)
+void VulkanDevice::DestroyPipeline(GfxPipeline* pipeline)
 {
     resource_manager.destroy_locker.lock();
-    VulkanRenderPass* internal_renderpass = (VulkanRenderPass*)renderpass;
+    VulkanPipeline* internal_pipeline = (VulkanPipeline*)pipeline;
     uint64_t frame_count = resource_manager.frame_count;
-    resource_manager.destroyer_renderpasses.push_back(std::make_pair(internal_renderpass->renderpass, frame_count));
-    resource_manager.destroyer_framebuffers.push_back(std::make_pair(internal_renderpass->framebuffer, frame_count));
+    resource_manager.destroyer_pipelines.push_back(std::make_pair(internal_pipeline->pipeline, frame_count));
+    ReleasePipelineLayout(internal_pipeline->layout);
     resource_manager.destroy_locker.unlock();
 }
 
-GfxShader* VulkanDevice::CreateShader(const GfxShaderDesc& desc)
+GfxCommandBuffer* VulkanDevice::RequestCommandBuffer(QueueType type)
 {
-    VulkanShader* internal_shader = new VulkanShader(this);
-    internal_shader->stage = desc.stage;
-
-    VkShaderModuleCreateInfo smci = {};
-    smci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    smci.codeSize = desc.bytecode_length;
-    smci.pCode = (const uint32_t*)desc.bytecode;
-    VK_ASSERT(vkCreateShaderModule(device, &smci, nullptr, &internal_shader->shader_module));
-
-    internal_shader->stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    internal_shader->stage_info.module = internal_shader->shader_module;
-    internal_shader->stage_info.pName = "main";
-    switch (desc.stage)
+    if (type == QUEUE_COPY)
     {
-        case SHADER_STAGE_VERT:
-            internal_shader->stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-            break;
-        case SHADER_STAGE_HULL:
-            internal_shader->stage_info.stage = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
-            break;
-        case SHADER_STAGE_DOMN:
-            internal_shader->stage_info.stage = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
-            break;
-        case SHADER_STAGE_GEOM:
-            internal_shader->stage_info.stage = VK_SHADER_STAGE_GEOMETRY_BIT;
-            break;
-        case SHADER_STAGE_FRAG:
-            internal_shader->stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-            break;
-        case SHADER_STAGE_COMP:
-            internal_shader->stage_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-            break;
-        default:
-            internal_shader->stage_info.stage = VK_SHADER_STAGE_ALL;
-            break;
+        VulkanCommandBuffer* internal_cmd = nullptr;
+        internal_cmd = new VulkanCommandBuffer();
+        internal_cmd->idx = copy_pool.Allocate();
+        internal_cmd->is_copy = true;
+        copy_cmds.push_back(internal_cmd);
+        return internal_cmd;
     }
 
+    VulkanCommandBuffer* internal_cmd = nullptr;
+    internal_cmd = new VulkanCommandBuffer();
+    internal_cmd->idx = work_cmds.size();
+    work_cmds.push_back(internal_cmd);
+
+    uint32_t cmd = internal_cmd->idx;
+    cmd_meta[cmd].queue = type;
+    cmd_meta[cmd].waits.clear();
+    cmd_meta[cmd].stream_wait = 0;
+    cmd_meta[cmd].uses.clear();
+    pending_copies[cmd].clear();
+
+    if (GetCommandBuffer(cmd) == VK_NULL_HANDLE)
     {
-        // 获取反射信息
-        SpvReflectShaderModule module;
-        SpvReflectResult result = spvReflectCreateShaderModule(smci.codeSize, smci.pCode, &module);
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+        for (auto& frame : frames)
+        {
+            VkCommandPoolCreateInfo pool_info = {};
+            pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            switch (type)
+            {
+                case QUEUE_GRAPHICS:
+                    pool_info.queueFamilyIndex = graphics_family;
+                    break;
+                case QUEUE_COMPUTE:
+                    pool_info.queueFamilyIndex = compute_family;
+                    break;
+                default:
+                    assert(0);
+                    break;
+            }
+            pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            VK_ASSERT(vkCreateCommandPool(device, &pool_info, nullptr, &frame.command_pools[cmd][type]));
+
+            VkCommandBufferAllocateInfo cmd_info = {};
+            cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            cmd_info.commandBufferCount = 1;
+            cmd_info.commandPool = frame.command_pools[cmd][type];
+            cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            VK_ASSERT(vkAllocateCommandBuffers(device, &cmd_info, &frame.command_buffers[cmd][type]));
+
+            frame.descriptor_pools[cmd].Init(this);
+            frame.transient_allocators[cmd].Init(this);
+        }
+
+        if (stage_buffers[cmd] == nullptr)
+        {
+            stage_buffers[cmd] = new StageBuffer();
+            stage_buffers[cmd]->Init(this);
+        }
 
-        uint32_t binding_count = 0;
-        result = spvReflectEnumerateDescriptorBindings(
-            &module, &binding_count, nullptr);
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+        binders[cmd].Init(this);
+    }
 
-        std::vector<SpvReflectDescriptorBinding*> bindings(binding_count);
-        result = spvReflectEnumerateDescriptorBindings(
-            &module, &binding_count, bindings.data());
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+    VK_ASSERT(vkResetCommandPool(device, GetFrameResources().command_pools[cmd][type], 0));
 
-        uint32_t push_count = 0;
-        result = spvReflectEnumeratePushConstantBlocks(&module, &push_count, nullptr);
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    begin_info.pInheritanceInfo = nullptr;
+    VK_ASSERT(vkBeginCommandBuffer(GetFrameResources().command_buffers[cmd][type], &begin_info));
 
-        std::vector<SpvReflectBlockVariable*> pushconstants(push_count);
-        result = spvReflectEnumeratePushConstantBlocks(&module, &push_count, pushconstants.data());
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
+    // 重置Descriptor对象
+    GetFrameResources().descriptor_pools[cmd].Reset();
+    binders[cmd].Reset();
 
-        std::vector<VkSampler> staticsamplers;
+    GetFrameResources().transient_allocators[cmd].Reset();
 
-        for (auto& x : pushconstants)
+    active_pipeline[cmd] = nullptr;
+    active_cs[cmd] = nullptr;
+    dirty_pipeline[cmd] = false;
+    pushconstants[cmd] = {};
+    for (int i = 0; i < BLAST_SCISSOR_COUNT; ++i)
+    {
+        scissors[cmd][i] = {};
+    }
+    for (int i = 0; i < BLAST_VIEWPORT_COUNT; ++i)
+    {
+        viewports[cmd][i] = {};
+    }
+    active_swapchains[cmd].clear();
+    return internal_cmd;
+}
+
+void VulkanDevice::SubmitAllCommandBuffer()
+{
+    init_locker.lock();
+    {
+        auto& frame = GetFrameResources();
+        QueueType submit_queue = QUEUE_GRAPHICS;
+
+        if (submit_inits)
         {
-            auto& push = internal_shader->pushconstants;
-            push.stageFlags = internal_shader->stage_info.stage;
-            push.offset = x->offset;
-            push.size = x->size;
+            // 初始数据的拷贝对之后的所有命令可见
+            VkMemoryBarrier memory_barrier = {};
+            memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            memory_barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+            vkCmdPipelineBarrier(frame.init_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+            vkEndCommandBuffer(frame.init_command_buffer);
         }
 
-        for (auto& x : bindings)
+        acquire_locker.lock();
+        if (!pending_acquires.empty())
         {
-            VkDescriptorSetLayoutBinding descriptor = {};
-            descriptor.stageFlags = internal_shader->stage_info.stage;
-            descriptor.binding = x->binding;
-            descriptor.descriptorCount = x->count;
-            descriptor.descriptorType = (VkDescriptorType)x->descriptor_type;
-
-            VkImageViewType image_view_type;
-            image_view_type = VK_IMAGE_VIEW_TYPE_MAX_ENUM;
-
-            switch (x->descriptor_type)
+            // EXCLUSIVE资源释放给这一帧中第一个使用它的队列, 没有被使用的资源释放给图形队列
+            std::unordered_map<GfxResource*, uint32_t> families;
+            for (uint32_t i = 0; i < work_cmds.size(); ++i)
             {
-                default:
-                    break;
-                case SPV_REFLECT_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
-                case SPV_REFLECT_DESCRIPTOR_TYPE_STORAGE_IMAGE:
-                    switch (x->image.dim)
-                    {
-                        default:
-                        case SpvDim1D:
-                            if (x->image.arrayed == 0)
-                            {
-                                image_view_type = VK_IMAGE_VIEW_TYPE_1D;
-                            }
-                            else
-                            {
-                                image_view_type = VK_IMAGE_VIEW_TYPE_1D_ARRAY;
-                            }
-                            break;
-                        case SpvDim2D:
-                            if (x->image.arrayed == 0)
-                            {
-                                image_view_type = VK_IMAGE_VIEW_TYPE_2D;
-                            }
-                            else
-                            {
-                                image_view_type = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
-                            }
-                            break;
-                        case SpvDim3D:
-                            image_view_type = VK_IMAGE_VIEW_TYPE_3D;
-                            break;
-                        case SpvDimCube:
-                            if (x->image.arrayed == 0)
-                            {
-                                image_view_type = VK_IMAGE_VIEW_TYPE_CUBE;
-                            }
-                            else
-                            {
-                                image_view_type = VK_IMAGE_VIEW_TYPE_CUBE_ARRAY;
-                            }
-                            break;
-                    }
-                    break;
+                const CommandListMetadata& meta = cmd_meta[((VulkanCommandBuffer*)work_cmds[i])->idx];
+                for (auto resource : meta.uses)
+                {
+                    families.emplace(resource, meta.queue == QUEUE_COMPUTE ? compute_family : graphics_family);
+                }
             }
 
-            internal_shader->layout_bindings.push_back(descriptor);
-            internal_shader->image_view_types.push_back(image_view_type);
-        }
+            for (auto& x : pending_acquires)
+            {
+                PendingAcquire& pending = x.second;
+                if (pending.copy_cmd == 0 || IsConcurrent(x.first))
+                {
+                    continue;
+                }
 
-        spvReflectDestroyShaderModule(&module);
+                auto family = families.find(x.first);
+                uint32_t dst_family = family != families.end() ? family->second : graphics_family;
+                if (dst_family == copy_family)
+                {
+                    continue;
+                }
 
-        if (desc.stage == SHADER_STAGE_COMP || desc.stage == SHADER_STAGE_RAYTRACING)
+                VkCommandBuffer command_buffer = GetCopyCommandBuffer(pending.copy_cmd).command_buffer;
+                if (x.first->GetType() == GfxResource::ResourceType::BUFFER)
+                {
+                    VkBufferMemoryBarrier barrier = {};
+                    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                    barrier.dstAccessMask = 0;
+                    barrier.srcQueueFamilyIndex = copy_family;
+                    barrier.dstQueueFamilyIndex = dst_family;
+                    barrier.buffer = ((VulkanBuffer*)x.first)->resource;
+                    barrier.offset = 0;
+                    barrier.size = VK_WHOLE_SIZE;
+                    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+                    pending.buffer_barriers.push_back(barrier);
+                }
+                else
+                {
+                    // 所有权转移时不改变布局
+                    VulkanTexture* texture = (VulkanTexture*)x.first;
+                    VkImageMemoryBarrier barrier = {};
+                    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                    barrier.dstAccessMask = 0;
+                    barrier.oldLayout = ToVulkanImageLayout(pending.state);
+                    barrier.newLayout = barrier.oldLayout;
+                    barrier.srcQueueFamilyIndex = copy_family;
+                    barrier.dstQueueFamilyIndex = dst_family;
+                    barrier.image = texture->resource;
+                    barrier.subresourceRange.aspectMask = ToVulkanAspectMask(texture->format);
+                    barrier.subresourceRange.baseMipLevel = 0;
+                    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+                    barrier.subresourceRange.baseArrayLayer = 0;
+                    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+                    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+                    pending.image_barriers.push_back(barrier);
+                }
+            }
+        }
+
+        uint64_t copy_sync = copy_pool.Submit();
+        for (auto& x : pending_acquires)
         {
-            std::vector<VkDescriptorSetLayout> layouts;
+            if (x.second.copy_cmd != 0)
             {
-                VkDescriptorSetLayoutCreateInfo dslci = {};
-                dslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-                dslci.pBindings = internal_shader->layout_bindings.data();
-                dslci.bindingCount = uint32_t(internal_shader->layout_bindings.size());
-                VK_ASSERT(vkCreateDescriptorSetLayout(device, &dslci, nullptr, &internal_shader->descriptor_set_layout));
-                layouts.push_back(internal_shader->descriptor_set_layout);
+                x.second.copy_value = copy_sync;
+                x.second.copy_cmd = 0;
             }
+        }
 
-            VkPipelineLayoutCreateInfo plci = {};
-            plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-            plci.pSetLayouts = layouts.data();
-            plci.setLayoutCount = (uint32_t)layouts.size();
-            if (internal_shader->pushconstants.size > 0)
+        std::vector<VkBufferMemoryBarrier> acquire_buffer_barriers;
+        std::vector<VkImageMemoryBarrier> acquire_image_barriers;
+        for (uint32_t i = 0; i < work_cmds.size(); ++i)
+        {
+            uint32_t cmd = ((VulkanCommandBuffer*)work_cmds[i])->idx;
+            FlushBufferCopies(cmd);
+            vkEndCommandBuffer(GetCommandBuffer(cmd));
+
+            descriptor_stats.cache_hits += binders[cmd].cache_hits;
+            descriptor_stats.cache_misses += binders[cmd].cache_misses;
+            descriptor_stats.pushes += binders[cmd].pushes;
+            descriptor_stats.allocations += binders[cmd].allocations;
+            descriptor_stats.pool_creations += binders[cmd].pool_creations;
+            binders[cmd].cache_hits = 0;
+            binders[cmd].cache_misses = 0;
+            binders[cmd].pushes = 0;
+            binders[cmd].allocations = 0;
+            binders[cmd].pool_creations = 0;
+
+            const CommandListMetadata& meta = cmd_meta[cmd];
+
+            if (submit_queue == QUEUE_GRAPHICS)
             {
-                plci.pushConstantRangeCount = 1;
-                plci.pPushConstantRanges = &internal_shader->pushconstants;
+                submit_queue = meta.queue;
             }
-            else
+
+            // 只等待该命令缓存用到的上传, 并在它之前获取这些资源的所有权
+            uint64_t copy_wait = 0;
+            uint64_t stream_wait = meta.stream_wait;
+            acquire_buffer_barriers.clear();
+            acquire_image_barriers.clear();
+            uint32_t family = meta.queue == QUEUE_COMPUTE ? compute_family : graphics_family;
+            for (auto resource : meta.uses)
             {
-                plci.pushConstantRangeCount = 0;
-                plci.pPushConstantRanges = nullptr;
-            }
+                uint32_t* queue_family = GetQueueFamily(resource);
+                if (queue_family)
+                {
+                    *queue_family = family;
+                }
 
-            VK_ASSERT(vkCreatePipelineLayout(device, &plci, nullptr, &internal_shader->pipeline_layout_cs));
-        }
-    }
+                // 已经被之前的命令缓存获取
+                auto it = pending_acquires.find(resource);
+                if (it == pending_acquires.end())
+                {
+                    continue;
+                }
 
-    if (desc.stage == SHADER_STAGE_COMP)
-    {
-        VkComputePipelineCreateInfo pipelineInfo = {};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-        pipelineInfo.layout = internal_shader->pipeline_layout_cs;
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-        pipelineInfo.stage = internal_shader->stage_info;
-        VK_ASSERT(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &internal_shader->pipeline_cs));
-    }
+                // 流式上传尚未提交
+                PendingAcquire& pending = it->second;
+                if (pending.copy_value == 0 && pending.stream_value == 0)
+                {
+                    continue;
+                }
 
-    return internal_shader;
-}
+                copy_wait = std::max(copy_wait, pending.copy_value);
+                stream_wait = std::max(stream_wait, pending.stream_value);
+                for (auto barrier : pending.buffer_barriers)
+                {
+                    if (barrier.dstQueueFamilyIndex != family)
+                    {
+                        BLAST_LOGE("buffer released to queue family %u is used on queue family %u\n", barrier.dstQueueFamilyIndex, family);
+                        assert(0);
+                        continue;
+                    }
+                    barrier.srcAccessMask = 0;
+                    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+                    acquire_buffer_barriers.push_back(barrier);
+                }
+                for (auto barrier : pending.image_barriers)
+                {
+                    if (barrier.dstQueueFamilyIndex != family)
+                    {
+                        BLAST_LOGE("texture released to queue family %u is used on queue family %u\n", barrier.dstQueueFamilyIndex, family);
+                        assert(0);
+                        continue;
+                    }
+                    barrier.srcAccessMask = 0;
+                    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+                    acquire_image_barriers.push_back(barrier);
+                }
 
-void VulkanDevice::DestroyShader(GfxShader* shader)
-{
-    resource_manager.destroy_locker.lock();
-    VulkanShader* internal_shader = (VulkanShader*)shader;
-    uint64_t frame_count = resource_manager.frame_count;
-    resource_manager.destroyer_shadermodules.push_back(std::make_pair(internal_shader->shader_module, frame_count));
-    if (internal_shader->pipeline_cs)
-    {
-        resource_manager.destroyer_pipelines.push_back(std::make_pair(internal_shader->pipeline_cs, frame_count));
-        resource_manager.destroyer_pipeline_layouts.push_back(std::make_pair(internal_shader->pipeline_layout_cs, frame_count));
-        resource_manager.destroyer_descriptor_set_layouts.push_back(std::make_pair(internal_shader->descriptor_set_layout, frame_count));
-    }
-    resource_manager.destroy_locker.unlock();
-}
+                if (pending.stream_requests == 0)
+                {
+                    pending_acquires.erase(it);
+                }
+                else
+                {
+                    pending.copy_value = 0;
+                    pending.stream_value = 0;
+                    pending.buffer_barriers.clear();
+                    pending.image_barriers.clear();
+                }
+            }
 
-GfxPipeline* VulkanDevice::CreatePipeline(const GfxPipelineDesc& desc)
-{
-    VulkanPipeline* internal_pipeline = new VulkanPipeline(this);
-    internal_pipeline->desc = desc;
+            if (submit_queue != meta.queue || !meta.waits.empty() || copy_wait > 0 || stream_wait > 0)
+            {
+                queues[submit_queue].submit_signal_semaphores.push_back(queues[submit_queue].semaphore);
+                queues[submit_queue].submit_signal_values.push_back(frame_count * BLAST_CMD_COUNT + (uint64_t)cmd);
+                queues[submit_queue].Submit(VK_NULL_HANDLE);
+                submit_queue = meta.queue;
 
-    internal_pipeline->hash = 0;
-    hash_combine(internal_pipeline->hash, desc.sc);
-    hash_combine(internal_pipeline->hash, desc.rp);
-    hash_combine(internal_pipeline->hash, desc.vs);
-    hash_combine(internal_pipeline->hash, desc.fs);
-    hash_combine(internal_pipeline->hash, desc.hs);
-    hash_combine(internal_pipeline->hash, desc.ds);
-    hash_combine(internal_pipeline->hash, desc.gs);
-    hash_combine(internal_pipeline->hash, desc.il);
-    hash_combine(internal_pipeline->hash, desc.rs);
-    hash_combine(internal_pipeline->hash, desc.bs);
-    hash_combine(internal_pipeline->hash, desc.dss);
-    hash_combine(internal_pipeline->hash, desc.primitive_topo);
-    hash_combine(internal_pipeline->hash, desc.patch_control_points);
+                for (auto& wait : meta.waits)
+                {
+                    const CommandListMetadata& wait_meta = cmd_meta[wait];
+                    queues[submit_queue].submit_wait_stages.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+                    queues[submit_queue].submit_wait_semaphores.push_back(queues[wait_meta.queue].semaphore);
+                    queues[submit_queue].submit_wait_values.push_back(frame_count * BLAST_CMD_COUNT + (uint64_t)wait);
+                }
 
-    {
-        auto insert_shader = [&](const GfxShader* shader)
-        {
-            if (shader == nullptr)
-                return;
+                if (copy_wait > 0)
+                {
+                    queues[submit_queue].submit_wait_stages.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+                    queues[submit_queue].submit_wait_semaphores.push_back(copy_pool.semaphore);
+                    queues[submit_queue].submit_wait_values.push_back(copy_wait);
+                }
 
-            VulkanShader* internal_shader = (VulkanShader*)shader;
-            uint32_t i = 0;
-            for (auto& x : internal_shader->layout_bindings)
+                if (stream_wait > 0)
+                {
+                    queues[submit_queue].submit_wait_stages.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+                    queues[submit_queue].submit_wait_semaphores.push_back(streaming.semaphore);
+                    queues[submit_queue].submit_wait_values.push_back(stream_wait);
+                }
+            }
+
+            if (submit_inits)
+            {
+                queues[submit_queue].submit_cmds.push_back(frame.init_command_buffer);
+                submit_inits = false;
+            }
+
+            for (auto& swapchain : active_swapchains[cmd])
+            {
+                VulkanSwapChain* internal_swapchain = (VulkanSwapChain*)swapchain;
+                queues[submit_queue].submit_swapchains.push_back(internal_swapchain->swapchain);
+                queues[submit_queue].submit_swapchain_image_indices.push_back(internal_swapchain->swapchain_image_index);
+                queues[submit_queue].submit_wait_stages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+                queues[submit_queue].submit_wait_semaphores.push_back(internal_swapchain->swapchain_acquire_semaphore);
+                queues[submit_queue].submit_wait_values.push_back(0);
+                queues[submit_queue].submit_signal_semaphores.push_back(internal_swapchain->swapchain_release_semaphore);
+                queues[submit_queue].submit_signal_values.push_back(0);
+            }
+
+            if (!acquire_buffer_barriers.empty() || !acquire_image_barriers.empty())
             {
-                bool found = false;
-                for (auto& y : internal_pipeline->layout_bindings)
+                VkCommandPool& acquire_command_pool = frame.acquire_command_pools[cmd][meta.queue];
+                VkCommandBuffer& acquire_command_buffer = frame.acquire_command_buffers[cmd][meta.queue];
+                if (acquire_command_buffer == VK_NULL_HANDLE)
                 {
-                    if (x.binding == y.binding)
-                    {
-                        assert(x.descriptorCount == y.descriptorCount);
-                        assert(x.descriptorType == y.descriptorType);
-                        found = true;
-                        y.stageFlags |= x.stageFlags;
-                        break;
-                    }
+                    VkCommandPoolCreateInfo pool_info = {};
+                    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+                    pool_info.queueFamilyIndex = family;
+                    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+                    VK_ASSERT(vkCreateCommandPool(device, &pool_info, nullptr, &acquire_command_pool));
+
+                    VkCommandBufferAllocateInfo cmd_info = {};
+                    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                    cmd_info.commandBufferCount = 1;
+                    cmd_info.commandPool = acquire_command_pool;
+                    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+                    VK_ASSERT(vkAllocateCommandBuffers(device, &cmd_info, &acquire_command_buffer));
                 }
-
-                if (!found)
+                else
                 {
-                    internal_pipeline->layout_bindings.push_back(x);
-                    internal_pipeline->image_view_types.push_back(internal_shader->image_view_types[i]);
+                    VK_ASSERT(vkResetCommandPool(device, acquire_command_pool, 0));
                 }
-                i++;
-            }
 
-            if (internal_shader->pushconstants.size > 0)
-            {
-                internal_pipeline->pushconstants.offset = std::min(internal_pipeline->pushconstants.offset, internal_shader->pushconstants.offset);
-                internal_pipeline->pushconstants.size = std::max(internal_pipeline->pushconstants.size, internal_shader->pushconstants.size);
-                internal_pipeline->pushconstants.stageFlags |= internal_shader->pushconstants.stageFlags;
+                VkCommandBufferBeginInfo begin_info = {};
+                begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+                begin_info.pInheritanceInfo = nullptr;
+                VK_ASSERT(vkBeginCommandBuffer(acquire_command_buffer, &begin_info));
+                vkCmdPipelineBarrier(acquire_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr,
+                                     (uint32_t)acquire_buffer_barriers.size(), acquire_buffer_barriers.data(),
+                                     (uint32_t)acquire_image_barriers.size(), acquire_image_barriers.data());
+                VK_ASSERT(vkEndCommandBuffer(acquire_command_buffer));
+                queues[submit_queue].submit_cmds.push_back(acquire_command_buffer);
             }
-        };
-
-        insert_shader(desc.vs);
-        insert_shader(desc.hs);
-        insert_shader(desc.ds);
-        insert_shader(desc.gs);
-        insert_shader(desc.fs);
 
-        std::vector<VkDescriptorSetLayout> layouts;
-        VkDescriptorSetLayoutCreateInfo dslci = {};
-        dslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        dslci.pBindings = internal_pipeline->layout_bindings.data();
-        dslci.bindingCount = static_cast<uint32_t>(internal_pipeline->layout_bindings.size());
-        VK_ASSERT(vkCreateDescriptorSetLayout(device, &dslci, nullptr, &internal_pipeline->descriptor_set_layout));
-        layouts.push_back(internal_pipeline->descriptor_set_layout);
+            queues[submit_queue].submit_cmds.push_back(GetCommandBuffer(cmd));
+        }
+        acquire_locker.unlock();
 
-        VkPipelineLayoutCreateInfo plci = {};
-        plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        plci.pSetLayouts = layouts.data();
-        plci.setLayoutCount = (uint32_t)layouts.size();
-        if (internal_pipeline->pushconstants.size > 0)
+        // 没有工作命令时单独提交init命令缓存
+        if (submit_inits)
         {
-            plci.pushConstantRangeCount = 1;
-            plci.pPushConstantRanges = &internal_pipeline->pushconstants;
+            queues[QUEUE_GRAPHICS].submit_cmds.push_back(frame.init_command_buffer);
+            submit_inits = false;
         }
-        else
+
+        // 清理当前帧的命令缓存
+        for (uint32_t i = 0; i < copy_cmds.size(); ++i)
         {
-            plci.pushConstantRangeCount = 0;
-            plci.pPushConstantRanges = nullptr;
+            BLAST_SAFE_DELETE(copy_cmds[i]);
         }
-        VK_ASSERT(vkCreatePipelineLayout(device, &plci, nullptr, &internal_pipeline->pipeline_layout));
-    }
-
-    VkGraphicsPipelineCreateInfo& pipeline_info = internal_pipeline->pipeline_info;
-    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipeline_info.layout = internal_pipeline->pipeline_layout;
-    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+        copy_cmds.clear();
 
-    // shaders
-    uint32_t shader_stage_count = 0;
-    auto& shader_stages = internal_pipeline->shader_stages;
-    if (desc.vs != nullptr)
-    {
-        VulkanShader* internal_shader = (VulkanShader*)desc.vs;
-        shader_stages[shader_stage_count++] = internal_shader->stage_info;
-    }
-    if (desc.hs != nullptr)
-    {
-        VulkanShader* internal_shader = (VulkanShader*)desc.hs;
-        shader_stages[shader_stage_count++] = internal_shader->stage_info;
-    }
-    if (desc.ds != nullptr)
-    {
-        VulkanShader* internal_shader = (VulkanShader*)desc.ds;
-        shader_stages[shader_stage_count++] = internal_shader->stage_info;
-    }
-    if (desc.gs != nullptr)
-    {
-        VulkanShader* internal_shader = (VulkanShader*)desc.gs;
-        shader_stages[shader_stage_count++] = internal_shader->stage_info;
-    }
-    if (desc.fs != nullptr)
-    {
-        VulkanShader* internal_shader = (VulkanShader*)desc.fs;
-        shader_stages[shader_stage_count++] = internal_shader->stage_info;
-    }
-    pipeline_info.stageCount = shader_stage_count;
-    pipeline_info.pStages = shader_stages;
+        for (uint32_t i = 0; i < work_cmds.size(); ++i)
+        {
+            BLAST_SAFE_DELETE(work_cmds[i]);
+        }
+        work_cmds.clear();
 
-    // input assembly
-    VkPipelineInputAssemblyStateCreateInfo& input_assembly = internal_pipeline->input_assembly;
-    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    switch (desc.primitive_topo)
-    {
-        case PRIMITIVE_TOPO_POINT_LIST:
-            input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
-            break;
-        case PRIMITIVE_TOPO_LINE_LIST:
-            input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
-            break;
-        case PRIMITIVE_TOPO_LINE_STRIP:
-            input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_LINE_STRIP;
-            break;
-        case PRIMITIVE_TOPO_TRI_STRIP:
-            input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
-            break;
-        case PRIMITIVE_TOPO_PATCH_LIST:
-            input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
-            break;
-        case PRIMITIVE_TOPO_TRI_LIST:
-            input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-            break;
+        for (int queue = 0; queue < BLAST_QUEUE_COUNT; ++queue)
+        {
+            queues[queue].Submit(frame.fence[queue]);
+        }
     }
-    input_assembly.primitiveRestartEnable = VK_FALSE;
-    pipeline_info.pInputAssemblyState = &input_assembly;
 
-    // rasterizer
-    VkPipelineRasterizationStateCreateInfo& rasterizer = internal_pipeline->rasterizer;
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_TRUE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_NONE;
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-    rasterizer.depthBiasConstantFactor = 0.0f;
-    rasterizer.depthBiasClamp = 0.0f;
-    rasterizer.depthBiasSlopeFactor = 0.0f;
+    frame_count++;
 
-    if (desc.rs != nullptr)
     {
-        const GfxRasterizerState& rs = *desc.rs;
+        auto& frame = GetFrameResources();
 
-        switch (rs.fill_mode)
+        if (frame_count >= BLAST_BUFFER_COUNT)
         {
-            case FILL_WIREFRAME:
-                rasterizer.polygonMode = VK_POLYGON_MODE_LINE;
-                break;
-            case FILL_SOLID:
-            default:
-                rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-                break;
+            for (int queue = 0; queue < BLAST_QUEUE_COUNT; ++queue)
+            {
+                VK_ASSERT(vkWaitForFences(device, 1, &frame.fence[queue], true, 0xFFFFFFFFFFFFFFFF));
+                VK_ASSERT(vkResetFences(device, 1, &frame.fence[queue]));
+            }
         }
 
-        switch (rs.cull_mode)
+        // 销毁上一帧需要清理的资源
+        resource_manager.Update(frame_count, BLAST_BUFFER_COUNT);
+        resource_cache.Update();
+        for (auto& heap : bindless_heaps)
         {
-            case CULL_BACK:
-                rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-                break;
-            case CULL_FRONT:
-                rasterizer.cullMode = VK_CULL_MODE_FRONT_BIT;
-                break;
-            case CULL_NONE:
-            default:
-                rasterizer.cullMode = VK_CULL_MODE_NONE;
-                break;
+            heap.Update(frame_count, BLAST_BUFFER_COUNT);
         }
 
-        switch (rs.front_face)
+        // 重置transfer命令缓存状态
         {
-            case FRONT_FACE_CCW:
-                rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-                break;
-            case FRONT_FACE_CW:
-            default:
-                rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-                break;
+            VK_ASSERT(vkResetCommandPool(device, frame.init_command_pool, 0));
+
+            VkCommandBufferBeginInfo begin_info = {};
+            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            begin_info.pInheritanceInfo = nullptr;
+            VK_ASSERT(vkBeginCommandBuffer(frame.init_command_buffer, &begin_info));
         }
-        rasterizer.depthBiasEnable = rs.depth_bias != 0 || rs.slope_scaled_depth_bias != 0;
-        rasterizer.depthBiasConstantFactor = static_cast<float>(rs.depth_bias);
-        rasterizer.depthBiasClamp = 0.0f;
-        rasterizer.depthBiasSlopeFactor = rs.slope_scaled_depth_bias;
     }
-    pipeline_info.pRasterizationState = &rasterizer;
 
-    // viewport state
-    VkPipelineViewportStateCreateInfo& viewport_state = internal_pipeline->viewport_state;
-    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewport_state.viewportCount = 1;
-    viewport_state.pViewports = nullptr;
-    viewport_state.scissorCount = 1;
-    viewport_state.pScissors = nullptr;
-    pipeline_info.pViewportState = &viewport_state;
+    submit_inits = false;
+    init_locker.unlock();
 
-    // depth stencil
-    VkPipelineDepthStencilStateCreateInfo& depthstencil = internal_pipeline->depthstencil;
-    depthstencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    if (desc.dss != nullptr)
-    {
-        depthstencil.depthTestEnable = desc.dss->depth_test ? VK_TRUE : VK_FALSE;
-        depthstencil.depthWriteEnable = desc.dss->depth_write ? VK_TRUE : VK_FALSE;
-        depthstencil.depthCompareOp = ToVulkanCompareOp(desc.dss->depth_func);
+    streaming.OnFrame(frame_count);
+}
 
-        depthstencil.stencilTestEnable = desc.dss->stencil_test ? VK_TRUE : VK_FALSE;
+void VulkanDevice::WaitCommandBuffer(GfxCommandBuffer* cmd, GfxCommandBuffer* wait_for)
+{
+    VulkanCommandBuffer* internal_cmd = (VulkanCommandBuffer*)cmd;
+    VulkanCommandBuffer* internal_wait_for = (VulkanCommandBuffer*)wait_for;
+    cmd_meta[internal_cmd->idx].waits.push_back(internal_wait_for->idx);
+}
 
-        depthstencil.front.compareMask = desc.dss->stencil_read_mask;
-        depthstencil.front.writeMask = desc.dss->stencil_write_mask;
-        depthstencil.front.reference = 0;
-        depthstencil.front.compareOp = ToVulkanCompareOp(desc.dss->front_face.stencil_func);
-        depthstencil.front.passOp = ToVulkanStencilOp(desc.dss->front_face.stencil_pass_op);
-        depthstencil.front.failOp = ToVulkanStencilOp(desc.dss->front_face.stencil_fail_op);
-        depthstencil.front.depthFailOp = ToVulkanStencilOp(desc.dss->front_face.stencil_depth_fail_op);
+void VulkanDevice::RenderPassBegin(GfxCommandBuffer* cmd, GfxSwapChain* swapchain)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    VulkanSwapChain* internal_swapchain = (VulkanSwapChain*)swapchain;
+    FlushBufferCopies(internal_cmd);
 
-        depthstencil.back.compareMask = desc.dss->stencil_read_mask;
-        depthstencil.back.writeMask = desc.dss->stencil_write_mask;
-        depthstencil.back.reference = 0;
-        depthstencil.back.compareOp = ToVulkanCompareOp(desc.dss->back_face.stencil_func);
-        depthstencil.back.passOp = ToVulkanStencilOp(desc.dss->back_face.stencil_pass_op);
-        depthstencil.back.failOp = ToVulkanStencilOp(desc.dss->back_face.stencil_fail_op);
-        depthstencil.back.depthFailOp = ToVulkanStencilOp(desc.dss->back_face.stencil_depth_fail_op);
+    bool has_active_swapchain = false;
+    for (uint32_t i = 0; i < active_swapchains[internal_cmd].size(); ++i)
+    {
+        if (active_swapchains[internal_cmd][i] == swapchain)
+        {
+            has_active_swapchain = true;
+            break;
+        }
+    }
+    if (!has_active_swapchain)
+    {
+        active_swapchains[internal_cmd].push_back(swapchain);
+        VK_ASSERT(vkAcquireNextImageKHR(
+            device,
+            internal_swapchain->swapchain,
+            0xFFFFFFFFFFFFFFFF,
+            internal_swapchain->swapchain_acquire_semaphore,
+            VK_NULL_HANDLE,
+            &internal_swapchain->swapchain_image_index));
+    }
+
+    std::vector<VkClearValue> clear_values;
+    VkClearValue clear_color = {
+        swapchain->desc.clear_color[0],
+        swapchain->desc.clear_color[1],
+        swapchain->desc.clear_color[2],
+        swapchain->desc.clear_color[3],
+    };
+    clear_values.push_back(clear_color);
+
+    VkRenderPassBeginInfo renderpass_info = {};
+    renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderpass_info.renderPass = internal_swapchain->renderpass;
+    renderpass_info.framebuffer = internal_swapchain->swapchain_framebuffers[internal_swapchain->swapchain_image_index];
+    renderpass_info.renderArea.offset = {0, 0};
+    renderpass_info.renderArea.extent = internal_swapchain->swapchain_extent;
+    renderpass_info.clearValueCount = clear_values.size();
+    renderpass_info.pClearValues = clear_values.data();
+    vkCmdBeginRenderPass(GetCommandBuffer(internal_cmd), &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
+}
 
-        depthstencil.depthBoundsTestEnable = VK_FALSE;
-    }
-    pipeline_info.pDepthStencilState = &depthstencil;
+void VulkanDevice::RenderPassBegin(GfxCommandBuffer* cmd, GfxRenderPass* renderpass)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    VulkanRenderPass* internal_renderpass = (VulkanRenderPass*)renderpass;
+    FlushBufferCopies(internal_cmd);
 
-    // tessellation
-    VkPipelineTessellationStateCreateInfo& tessellation_info = internal_pipeline->tessellation_state;
-    tessellation_info.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
-    tessellation_info.patchControlPoints = desc.patch_control_points;
-    pipeline_info.pTessellationState = &tessellation_info;
+    vkCmdBeginRenderPass(GetCommandBuffer(internal_cmd), &internal_renderpass->begin_info, VK_SUBPASS_CONTENTS_INLINE);
+}
 
-    VkDynamicState dynamic_states[6];
-    dynamic_states[0] = VK_DYNAMIC_STATE_VIEWPORT;
-    dynamic_states[1] = VK_DYNAMIC_STATE_SCISSOR;
-    dynamic_states[2] = VK_DYNAMIC_STATE_DEPTH_BIAS;
-    dynamic_states[3] = VK_DYNAMIC_STATE_BLEND_CONSTANTS;
-    dynamic_states[4] = VK_DYNAMIC_STATE_DEPTH_BOUNDS;
-    //dynamic_states[5] = VK_DYNAMIC_STATE_STENCIL_REFERENCE;
+void VulkanDevice::RenderPassEnd(GfxCommandBuffer* cmd)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    vkCmdEndRenderPass(GetCommandBuffer(internal_cmd));
+}
 
-    VkPipelineDynamicStateCreateInfo dynamic_state = {};
-    dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamic_state.pNext = NULL;
-    dynamic_state.flags = 0;
-    dynamic_state.dynamicStateCount = 5;
-    dynamic_state.pDynamicStates = dynamic_states;
-    pipeline_info.pDynamicState = &dynamic_state;
+void VulkanDevice::BindScissor(GfxCommandBuffer* cmd, int32_t left, int32_t top, int32_t right, int32_t bottom, uint32_t idx)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    scissors[internal_cmd][idx].extent.width = abs(right - left);
+    scissors[internal_cmd][idx].extent.height = abs(top - bottom);
+    scissors[internal_cmd][idx].offset.x = std::max(0, left);
+    scissors[internal_cmd][idx].offset.y = std::max(0, top);
+    vkCmdSetScissor(GetCommandBuffer(internal_cmd), 0, BLAST_VIEWPORT_COUNT, scissors[internal_cmd]);
+}
 
-    if (desc.sc)
-    {
-        pipeline_info.renderPass = ((VulkanSwapChain*)desc.sc)->renderpass;
-        pipeline_info.subpass = 0;
-    }
-    else
-    {
-        pipeline_info.renderPass = ((VulkanRenderPass*)desc.rp)->renderpass;
-        pipeline_info.subpass = 0;
-    }
+void VulkanDevice::BindViewport(GfxCommandBuffer* cmd, float x, float y, float w, float h, float min_depth, float max_depth, uint32_t idx)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    viewports[internal_cmd][idx].x = x;
+    viewports[internal_cmd][idx].y = y;
+    viewports[internal_cmd][idx].width = w;
+    viewports[internal_cmd][idx].height = h;
+    viewports[internal_cmd][idx].minDepth = min_depth;
+    viewports[internal_cmd][idx].maxDepth = max_depth;
+    vkCmdSetViewport(GetCommandBuffer(internal_cmd), 0, BLAST_VIEWPORT_COUNT, viewports[internal_cmd]);
+}
 
-    // MSAA
-    VkPipelineMultisampleStateCreateInfo multisampling = {};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    if (desc.rs != nullptr)
-    {
-        multisampling.rasterizationSamples = ToVulkanSampleCount(desc.sample_count);
-    }
-    if (desc.bs != nullptr)
-    {
-        multisampling.alphaToCoverageEnable = desc.bs->alpha_to_coverage_eEnable ? VK_TRUE : VK_FALSE;
-    }
-    else
+void VulkanDevice::BindResource(GfxCommandBuffer* cmd, GfxResource* resource, uint32_t slot, int32_t subresource)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    auto& binder = binders[internal_cmd];
+    if (resource && resource->GetType() == GfxResource::ResourceType::TEXTURE)
     {
-        multisampling.alphaToCoverageEnable = VK_FALSE;
+        ((VulkanTexture*)resource)->frame_used = frame_count;
     }
-    multisampling.alphaToOneEnable = VK_FALSE;
-    pipeline_info.pMultisampleState = &multisampling;
+    TrackResourceUse(internal_cmd, resource);
 
-    // Blending
-    uint32_t render_target_count = 0;
-    if (desc.sc)
-    {
-        render_target_count = 1;
-    }
-    else
+    if (binder.table.srv[slot] != resource || binder.table.srv_index[slot] != subresource)
     {
-        for (uint32_t i = 0; i < desc.rp->desc.attachments.size(); ++i)
+        binder.table.srv[slot] = resource;
+        binder.table.srv_index[slot] = subresource;
+        for (auto& slots : binder.dirty_slots)
         {
-            if (desc.rp->desc.attachments[i].type == RenderPassAttachment::RENDERTARGET)
-            {
-                render_target_count++;
-            }
+            slots.srv |= 1ull << slot;
         }
     }
+}
 
-    uint32_t num_blend_attachments = 0;
-    VkPipelineColorBlendAttachmentState color_blend_attachments[8] = {};
-    for (uint32_t i = 0; i < render_target_count; ++i)
+void VulkanDevice::BindUAV(GfxCommandBuffer* cmd, GfxResource* resource, uint32_t slot, int32_t subresource)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    auto& binder = binders[internal_cmd];
+    TrackResourceUse(internal_cmd, resource);
+    if (binder.table.uav[slot] != resource || binder.table.uav_index[slot] != subresource)
     {
-        size_t attachment_index = 0;
-        if (desc.bs->independent_blend_enable)
-            attachment_index = i;
-
-        const auto& rt_desc = desc.bs->rt[attachment_index];
-        VkPipelineColorBlendAttachmentState& attachment = color_blend_attachments[num_blend_attachments];
-        num_blend_attachments++;
-
-        attachment.blendEnable = rt_desc.blend_enable ? VK_TRUE : VK_FALSE;
-
-        attachment.colorWriteMask = 0;
-        if (rt_desc.render_target_write_mask & COLOR_WRITE_ENABLE_RED)
+        binder.table.uav[slot] = resource;
+        binder.table.uav_index[slot] = subresource;
+        for (auto& slots : binder.dirty_slots)
         {
-            attachment.colorWriteMask |= VK_COLOR_COMPONENT_R_BIT;
+            slots.uav |= 1u << slot;
         }
-        if (rt_desc.render_target_write_mask & COLOR_WRITE_ENABLE_GREEN)
+    }
+}
+
+void VulkanDevice::BindSampler(GfxCommandBuffer* cmd, GfxSampler* sampler, uint32_t slot)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    auto& binder = binders[internal_cmd];
+    if (binder.table.sam[slot] != sampler)
+    {
+        binder.table.sam[slot] = sampler;
+        for (auto& slots : binder.dirty_slots)
         {
-            attachment.colorWriteMask |= VK_COLOR_COMPONENT_G_BIT;
+            slots.sampler |= 1u << slot;
         }
-        if (rt_desc.render_target_write_mask & COLOR_WRITE_ENABLE_BLUE)
+    }
+};
+
+void VulkanDevice::BindConstantBuffer(GfxCommandBuffer* cmd, GfxBuffer* buffer, uint32_t slot, uint64_t size, uint64_t offset)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    auto& binder = binders[internal_cmd];
+    TrackResourceUse(internal_cmd, buffer);
+    if (binder.table.cbv[slot] != buffer || binder.table.cbv_size[slot] != size)
+    {
+        binder.table.cbv[slot] = buffer;
+        binder.table.cbv_offset[slot] = offset;
+        binder.table.cbv_size[slot] = size;
+        for (auto& slots : binder.dirty_slots)
         {
-            attachment.colorWriteMask |= VK_COLOR_COMPONENT_B_BIT;
+            slots.cbv |= 1u << slot;
         }
-        if (rt_desc.render_target_write_mask & COLOR_WRITE_ENABLE_ALPHA)
+    }
+    else if (binder.table.cbv_offset[slot] != offset)
+    {
+        binder.table.cbv_offset[slot] = offset;
+        for (auto& slots : binder.dirty_slots)
         {
-            attachment.colorWriteMask |= VK_COLOR_COMPONENT_A_BIT;
+            slots.cbv_offset |= 1u << slot;
         }
-
-        attachment.srcColorBlendFactor = ToVulkanBlendFactor(rt_desc.src_factor);
-        attachment.dstColorBlendFactor = ToVulkanBlendFactor(rt_desc.dst_factor);
-        attachment.colorBlendOp = ToVulkanBlendOp(rt_desc.blend_op);
-        attachment.srcAlphaBlendFactor = ToVulkanBlendFactor(rt_desc.src_factor_alpha);
-        attachment.dstAlphaBlendFactor = ToVulkanBlendFactor(rt_desc.dst_factor_alpha);
-        attachment.alphaBlendOp = ToVulkanBlendOp(rt_desc.blend_op_alpha);
     }
+}
 
-    VkPipelineColorBlendStateCreateInfo color_blending_info = {};
-    color_blending_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    color_blending_info.logicOpEnable = VK_FALSE;
-    color_blending_info.logicOp = VK_LOGIC_OP_COPY;
-    color_blending_info.attachmentCount = num_blend_attachments;
-    color_blending_info.pAttachments = color_blend_attachments;
-    color_blending_info.blendConstants[0] = 1.0f;
-    color_blending_info.blendConstants[1] = 1.0f;
-    color_blending_info.blendConstants[2] = 1.0f;
-    color_blending_info.blendConstants[3] = 1.0f;
-    pipeline_info.pColorBlendState = &color_blending_info;
+void VulkanDevice::BindVertexBuffers(GfxCommandBuffer* cmd, GfxBuffer** vertex_buffers, uint32_t slot, uint32_t count, uint64_t* offsets)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
 
-    // InputLayout
-    uint32_t num_input_bindings = 0;
-    VkVertexInputBindingDescription input_bindings[MAX_VERTEX_BINDINGS] = {{0}};
-    uint32_t num_input_attributes = 0;
-    VkVertexInputAttributeDescription input_attributes[MAX_VERTEX_ATTRIBS] = {{0}};
-    uint32_t binding_value = UINT32_MAX;
-    for (auto& element : desc.il->elements)
+    VkDeviceSize voffsets[8] = {};
+    VkBuffer vbuffers[8] = {};
+    for (uint32_t i = 0; i < count; ++i)
     {
-        if (binding_value != element.binding)
-        {
-            binding_value = element.binding;
-            ++num_input_bindings;
-        }
+        VulkanBuffer* internal_buffer = (VulkanBuffer*)vertex_buffers[i];
+        vbuffers[i] = internal_buffer->resource;
+        voffsets[i] = offsets[i];
+        TrackResourceUse(internal_cmd, internal_buffer);
+    }
 
-        input_bindings[num_input_bindings - 1].binding = binding_value;
-        if (element.rate == VERTEX_ATTRIB_RATE_INSTANCE)
-        {
-            input_bindings[num_input_bindings - 1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
-        }
-        else
-        {
-            input_bindings[num_input_bindings - 1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-        }
-        input_bindings[num_input_bindings - 1].stride += GetFormatStride(element.format);
+    vkCmdBindVertexBuffers(GetCommandBuffer(internal_cmd), static_cast<uint32_t>(slot), static_cast<uint32_t>(count), vbuffers, voffsets);
+}
 
-        input_attributes[num_input_attributes].location = element.location;
-        input_attributes[num_input_attributes].binding = element.binding;
-        input_attributes[num_input_attributes].format = ToVulkanFormat(element.format);
-        input_attributes[num_input_attributes].offset = element.offset;
-        ++num_input_attributes;
+void VulkanDevice::BindIndexBuffer(GfxCommandBuffer* cmd, GfxBuffer* index_buffer, IndexType type, uint64_t offset)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    if (index_buffer != nullptr)
+    {
+        VulkanBuffer* internal_buffer = (VulkanBuffer*)index_buffer;
+        TrackResourceUse(internal_cmd, internal_buffer);
+        vkCmdBindIndexBuffer(GetCommandBuffer(internal_cmd), internal_buffer->resource, offset, ToVulkanIndexType(type));
     }
+}
 
-    VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
-    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertex_input_info.vertexBindingDescriptionCount = num_input_bindings;
-    vertex_input_info.pVertexBindingDescriptions = input_bindings;
-    vertex_input_info.vertexAttributeDescriptionCount = num_input_attributes;
-    vertex_input_info.pVertexAttributeDescriptions = input_attributes;
-    pipeline_info.pVertexInputState = &vertex_input_info;
+void VulkanDevice::BindStencilRef(GfxCommandBuffer* cmd, uint32_t value)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    vkCmdSetStencilReference(GetCommandBuffer(internal_cmd), VK_STENCIL_FRONT_AND_BACK, value);
+}
 
-    VK_ASSERT(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &internal_pipeline->pipeline));
+void VulkanDevice::BindBlendFactor(GfxCommandBuffer* cmd, float r, float g, float b, float a)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    float blend_constants[] = {r, g, b, a};
+    vkCmdSetBlendConstants(GetCommandBuffer(internal_cmd), blend_constants);
+}
+
+void VulkanDevice::BindPipeline(GfxCommandBuffer* cmd, GfxPipeline* pipeline)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    VulkanPipeline* internal_pipeline = (VulkanPipeline*)pipeline;
+    if (!active_pipeline[internal_cmd])
+    {
+        active_pipeline[internal_cmd] = pipeline;
+        dirty_pipeline[internal_cmd] = true;
+    }
+    else
+    {
+        VulkanPipeline* internal_active_pipeline = (VulkanPipeline*)active_pipeline[internal_cmd];
+        if (internal_active_pipeline->hash != internal_pipeline->hash)
+        {
+            active_pipeline[internal_cmd] = pipeline;
+            dirty_pipeline[internal_cmd] = true;
+        }
+    }
+}
 
-    return internal_pipeline;
+void VulkanDevice::BindComputeShader(GfxCommandBuffer* cmd, GfxShader* cs)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    if (active_cs[internal_cmd] != cs)
+    {
+        VulkanShader* internal_shader = (VulkanShader*)cs;
+        active_cs[internal_cmd] = cs;
+        vkCmdBindPipeline(GetCommandBuffer(internal_cmd), VK_PIPELINE_BIND_POINT_COMPUTE, internal_shader->pipeline_cs);
+    }
 }
 
-void VulkanDevice::DestroyPipeline(GfxPipeline* pipeline)
+void VulkanDevice::PushConstants(GfxCommandBuffer* cmd, const void* data, uint32_t size)
 {
-    resource_manager.destroy_locker.lock();
-    VulkanPipeline* internal_pipeline = (VulkanPipeline*)pipeline;
-    uint64_t frame_count = resource_manager.frame_count;
-    resource_manager.destroyer_pipelines.push_back(std::make_pair(internal_pipeline->pipeline, frame_count));
-    resource_manager.destroyer_pipeline_layouts.push_back(std::make_pair(internal_pipeline->pipeline_layout, frame_count));
-    resource_manager.destroyer_descriptor_set_layouts.push_back(std::make_pair(internal_pipeline->descriptor_set_layout, frame_count));
-    resource_manager.destroy_locker.unlock();
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    memcpy(pushconstants[internal_cmd].data, data, size);
+    pushconstants[internal_cmd].size = size;
 }
 
-GfxCommandBuffer* VulkanDevice::RequestCommandBuffer(QueueType type)
+int32_t VulkanDevice::SelectPushSet(const std::vector<VkDescriptorSetLayoutBinding>& layout_bindings, const std::vector<uint32_t>& layout_sets)
 {
-    if (type == QUEUE_COPY)
+    // 最高的set更新最频繁, 只有它使用push descriptor
+    int32_t push_set = -1;
+    for (auto& x : layout_sets)
     {
-        VulkanCommandBuffer* internal_cmd = nullptr;
-        internal_cmd = new VulkanCommandBuffer();
-        internal_cmd->idx = copy_pool.Allocate();
-        internal_cmd->is_copy = true;
-        copy_cmds.push_back(internal_cmd);
-        return internal_cmd;
+        push_set = std::max(push_set, (int32_t)x);
+    }
+    if (push_set < 0)
+    {
+        return -1;
     }
 
-    VulkanCommandBuffer* internal_cmd = nullptr;
-    internal_cmd = new VulkanCommandBuffer();
-    internal_cmd->idx = work_cmds.size();
-    work_cmds.push_back(internal_cmd);
-
-    uint32_t cmd = internal_cmd->idx;
-    cmd_meta[cmd].queue = type;
-    cmd_meta[cmd].waits.clear();
-
-    if (GetCommandBuffer(cmd) == VK_NULL_HANDLE)
+    uint32_t descriptor_count = 0;
+    for (uint32_t i = 0; i < layout_bindings.size(); ++i)
     {
-        for (auto& frame : frames)
+        if (layout_sets[i] == (uint32_t)push_set)
         {
-            VkCommandPoolCreateInfo pool_info = {};
-            pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-            switch (type)
-            {
-                case QUEUE_GRAPHICS:
-                    pool_info.queueFamilyIndex = graphics_family;
-                    break;
-                case QUEUE_COMPUTE:
-                    pool_info.queueFamilyIndex = compute_family;
-                    break;
-                default:
-                    assert(0);
-                    break;
-            }
-            pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
-            VK_ASSERT(vkCreateCommandPool(device, &pool_info, nullptr, &frame.command_pools[cmd][type]));
+            descriptor_count += layout_bindings[i].descriptorCount;
+        }
+    }
+    return descriptor_count > 0 && descriptor_count <= push_descriptor_limit ? push_set : -1;
+}
 
-            VkCommandBufferAllocateInfo cmd_info = {};
-            cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-            cmd_info.commandBufferCount = 1;
-            cmd_info.commandPool = frame.command_pools[cmd][type];
-            cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-            VK_ASSERT(vkAllocateCommandBuffers(device, &cmd_info, &frame.command_buffers[cmd][type]));
+void VulkanDevice::PrepareLayoutBindings(std::vector<VkDescriptorSetLayoutBinding>& layout_bindings, std::vector<VkImageViewType>& image_view_types,
+                                         std::vector<uint32_t>& layout_sets, int32_t push_set)
+{
+    std::vector<uint32_t> order(layout_bindings.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return layout_sets[a] != layout_sets[b] ? layout_sets[a] < layout_sets[b] : layout_bindings[a].binding < layout_bindings[b].binding; });
 
-            frame.descriptor_pools[cmd].Init(this);
+    std::vector<VkDescriptorSetLayoutBinding> sorted_bindings(layout_bindings.size());
+    std::vector<VkImageViewType> sorted_view_types(image_view_types.size());
+    std::vector<uint32_t> sorted_sets(layout_sets.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        sorted_bindings[i] = layout_bindings[order[i]];
+        sorted_view_types[i] = image_view_types[order[i]];
+        sorted_sets[i] = layout_sets[order[i]];
+    }
 
-            frame.stage_buffers[cmd] = new StageBuffer();
-            frame.stage_buffers[cmd]->Init(this);
+    // 上限针对整个管线布局, 优先分配给低频的set
+    uint32_t dynamic_count = 0;
+    for (uint32_t i = 0; i < sorted_bindings.size(); ++i)
+    {
+        auto& x = sorted_bindings[i];
+        // push descriptor的布局不能包含动态描述符
+        if ((int32_t)sorted_sets[i] != push_set && x.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER &&
+            dynamic_count + x.descriptorCount <= phy_device_properties.limits.maxDescriptorSetUniformBuffersDynamic)
+        {
+            x.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+            dynamic_count += x.descriptorCount;
         }
-
-        binders[cmd].Init(this);
     }
 
-    VK_ASSERT(vkResetCommandPool(device, GetFrameResources().command_pools[cmd][type], 0));
+    layout_bindings.swap(sorted_bindings);
+    image_view_types.swap(sorted_view_types);
+    layout_sets.swap(sorted_sets);
+}
 
-    VkCommandBufferBeginInfo begin_info = {};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    begin_info.pInheritanceInfo = nullptr;
-    VK_ASSERT(vkBeginCommandBuffer(GetFrameResources().command_buffers[cmd][type], &begin_info));
+VkDescriptorUpdateTemplate VulkanDevice::CreateDescriptorUpdateTemplate(const std::vector<VkDescriptorSetLayoutBinding>& layout_bindings, VkDescriptorSetLayout descriptor_set_layout,
+                                                                        VkPipelineLayout push_pipeline_layout, VkPipelineBindPoint bind_point, uint32_t set)
+{
+    // 每个binding一项, 数据块中的偏移与DescriptorBinder::WriteDescriptorData的写入顺序一致
+    std::vector<VkDescriptorUpdateTemplateEntry> entries;
+    uint32_t data_index = 0;
+    for (auto& x : layout_bindings)
+    {
+        if (x.pImmutableSamplers != nullptr || x.descriptorCount == 0)
+        {
+            continue;
+        }
 
-    // 重置Descriptor对象
-    GetFrameResources().descriptor_pools[cmd].Reset();
-    binders[cmd].Reset();
+        VkDescriptorUpdateTemplateEntry entry = {};
+        entry.dstBinding = x.binding;
+        entry.dstArrayElement = 0;
+        entry.descriptorCount = x.descriptorCount;
+        entry.descriptorType = x.descriptorType;
+        entry.offset = data_index * sizeof(VulkanDescriptorData);
+        entry.stride = sizeof(VulkanDescriptorData);
+        entries.push_back(entry);
+        data_index += x.descriptorCount;
+    }
 
-    active_pipeline[cmd] = nullptr;
-    active_cs[cmd] = nullptr;
-    dirty_pipeline[cmd] = false;
-    pushconstants[cmd] = {};
-    for (int i = 0; i < BLAST_SCISSOR_COUNT; ++i)
+    if (entries.empty())
     {
-        scissors[cmd][i] = {};
+        return VK_NULL_HANDLE;
     }
-    for (int i = 0; i < BLAST_VIEWPORT_COUNT; ++i)
+
+    VkDescriptorUpdateTemplateCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    info.descriptorUpdateEntryCount = (uint32_t)entries.size();
+    info.pDescriptorUpdateEntries = entries.data();
+    info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    info.descriptorSetLayout = descriptor_set_layout;
+    if (push_pipeline_layout != VK_NULL_HANDLE)
     {
-        viewports[cmd][i] = {};
+        info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR;
+        info.pipelineBindPoint = bind_point;
+        info.pipelineLayout = push_pipeline_layout;
+        info.set = set;
     }
-    active_swapchains[cmd].clear();
-    return internal_cmd;
+
+    VkDescriptorUpdateTemplate update_template = VK_NULL_HANDLE;
+    VK_ASSERT(vkCreateDescriptorUpdateTemplate(device, &info, nullptr, &update_template));
+    return update_template;
 }
 
-void VulkanDevice::SubmitAllCommandBuffer()
+VulkanPipelineLayout* VulkanDevice::AcquirePipelineLayout(const std::vector<VkDescriptorSetLayoutBinding>& layout_bindings, const std::vector<VkImageViewType>& image_view_types,
+                                                          const std::vector<uint32_t>& layout_sets, const VkPushConstantRange& pushconstants, int32_t push_set,
+                                                          VkPipelineBindPoint bind_point)
 {
-    init_locker.lock();
+    // layout_bindings已经按set和binding排序, 可以直接逐项计算
+    size_t hash = 0;
+    for (auto& x : layout_bindings)
     {
-        auto& frame = GetFrameResources();
-        QueueType submit_queue = QUEUE_GRAPHICS;
+        hash_combine(hash, x.binding);
+        hash_combine(hash, (uint32_t)x.descriptorType);
+        hash_combine(hash, x.descriptorCount);
+        hash_combine(hash, x.stageFlags);
+        hash_combine(hash, x.pImmutableSamplers);
+    }
+    for (auto& x : image_view_types)
+    {
+        hash_combine(hash, (uint32_t)x);
+    }
+    for (auto& x : layout_sets)
+    {
+        hash_combine(hash, x);
+    }
+    hash_combine(hash, pushconstants.stageFlags);
+    hash_combine(hash, pushconstants.offset);
+    hash_combine(hash, pushconstants.size);
+    hash_combine(hash, push_set);
+    hash_combine(hash, (uint32_t)bind_point);
 
-        if (submit_inits)
+    auto is_same_binding = [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b)
+    {
+        return a.binding == b.binding && a.descriptorType == b.descriptorType && a.descriptorCount == b.descriptorCount &&
+               a.stageFlags == b.stageFlags && a.pImmutableSamplers == b.pImmutableSamplers;
+    };
+
+    std::lock_guard<std::mutex> lock(layout_locker);
+    auto range = layout_cache.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        VulkanPipelineLayout* layout = it->second;
+        if (layout->push_set != push_set || layout->bind_point != bind_point ||
+            layout->pushconstants.stageFlags != pushconstants.stageFlags || layout->pushconstants.offset != pushconstants.offset || layout->pushconstants.size != pushconstants.size ||
+            layout->image_view_types != image_view_types || layout->layout_sets != layout_sets || layout->layout_bindings.size() != layout_bindings.size() ||
+            !std::equal(layout_bindings.begin(), layout_bindings.end(), layout->layout_bindings.begin(), is_same_binding))
         {
-            vkEndCommandBuffer(frame.init_command_buffer);
+            continue;
         }
 
-        uint64_t copy_sync = copy_pool.Submit();
+        layout->ref_count++;
+        return layout;
+    }
 
-        for (uint32_t i = 0; i < work_cmds.size(); ++i)
-        {
-            uint32_t cmd = ((VulkanCommandBuffer*)work_cmds[i])->idx;
-            vkEndCommandBuffer(GetCommandBuffer(cmd));
+    VulkanPipelineLayout* layout = new VulkanPipelineLayout();
+    layout->hash = hash;
+    layout->layout_bindings = layout_bindings;
+    layout->image_view_types = image_view_types;
+    layout->layout_sets = layout_sets;
+    layout->pushconstants = pushconstants;
+    layout->push_set = push_set;
+    layout->bind_point = bind_point;
+    layout->ref_count = 1;
 
-            const CommandListMetadata& meta = cmd_meta[cmd];
+    // 按set拆分binding, 并记录每个set读取的绑定表槽位
+    for (uint32_t i = 0; i < layout_bindings.size(); ++i)
+    {
+        const auto& x = layout_bindings[i];
+        auto& set = layout->sets[layout_sets[i]];
+        set.layout_bindings.push_back(x);
+        set.image_view_types.push_back(image_view_types[i]);
 
-            if (submit_queue == QUEUE_GRAPHICS)
-            {
-                submit_queue = meta.queue;
-            }
+        auto pool_size = std::find_if(set.pool_sizes.begin(), set.pool_sizes.end(), [&](const VkDescriptorPoolSize& y) { return y.type == x.descriptorType; });
+        if (pool_size == set.pool_sizes.end())
+        {
+            set.pool_sizes.push_back({x.descriptorType, 0});
+            pool_size = set.pool_sizes.end() - 1;
+        }
+        pool_size->descriptorCount += x.descriptorCount;
+        layout->set_count = std::max(layout->set_count, layout_sets[i] + 1);
+        layout->used_sets |= 1u << layout_sets[i];
 
-            if (copy_sync > 0)
+        for (uint32_t descriptor_index = 0; descriptor_index < x.descriptorCount; ++descriptor_index)
+        {
+            uint32_t unrolled_binding = x.binding + descriptor_index;
+            if (unrolled_binding >= VULKAN_BINDING_SHIFT_S)
             {
-                queues[submit_queue].submit_wait_stages.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT);
-                queues[submit_queue].submit_wait_semaphores.push_back(copy_pool.semaphore);
-                queues[submit_queue].submit_wait_values.push_back(copy_sync);
-                copy_sync = 0;
+                set.sampler_mask |= 1u << (unrolled_binding - VULKAN_BINDING_SHIFT_S);
             }
-
-            if (submit_queue != meta.queue || !meta.waits.empty())
+            else if (unrolled_binding >= VULKAN_BINDING_SHIFT_U)
             {
-                queues[submit_queue].submit_signal_semaphores.push_back(queues[submit_queue].semaphore);
-                queues[submit_queue].submit_signal_values.push_back(frame_count * BLAST_CMD_COUNT + (uint64_t)cmd);
-                queues[submit_queue].Submit(VK_NULL_HANDLE);
-                submit_queue = meta.queue;
-
-                for (auto& wait : meta.waits)
-                {
-                    const CommandListMetadata& wait_meta = cmd_meta[wait];
-                    queues[submit_queue].submit_wait_stages.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
-                    queues[submit_queue].submit_wait_semaphores.push_back(queues[wait_meta.queue].semaphore);
-                    queues[submit_queue].submit_wait_values.push_back(frame_count * BLAST_CMD_COUNT + (uint64_t)wait);
-                }
+                set.uav_mask |= 1u << (unrolled_binding - VULKAN_BINDING_SHIFT_U);
             }
-
-            if (submit_inits)
+            else if (unrolled_binding >= VULKAN_BINDING_SHIFT_T)
             {
-                queues[submit_queue].submit_cmds.push_back(frame.init_command_buffer);
-                submit_inits = false;
+                set.srv_mask |= 1ull << (unrolled_binding - VULKAN_BINDING_SHIFT_T);
             }
-
-            for (auto& swapchain : active_swapchains[cmd])
+            else
             {
-                VulkanSwapChain* internal_swapchain = (VulkanSwapChain*)swapchain;
-                queues[submit_queue].submit_swapchains.push_back(internal_swapchain->swapchain);
-                queues[submit_queue].submit_swapchain_image_indices.push_back(internal_swapchain->swapchain_image_index);
-                queues[submit_queue].submit_wait_stages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-                queues[submit_queue].submit_wait_semaphores.push_back(internal_swapchain->swapchain_acquire_semaphore);
-                queues[submit_queue].submit_wait_values.push_back(0);
-                queues[submit_queue].submit_signal_semaphores.push_back(internal_swapchain->swapchain_release_semaphore);
-                queues[submit_queue].submit_signal_values.push_back(0);
+                set.cbv_mask |= 1u << (unrolled_binding - VULKAN_BINDING_SHIFT_B);
+                if (x.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC)
+                {
+                    set.dynamic_cbv_mask |= 1u << (unrolled_binding - VULKAN_BINDING_SHIFT_B);
+                }
             }
-
-            queues[submit_queue].submit_cmds.push_back(GetCommandBuffer(cmd));
         }
+    }
 
-        // 清理当前帧的命令缓存
-        for (uint32_t i = 0; i < copy_cmds.size(); ++i)
+    std::vector<VkDescriptorSetLayout> layouts;
+    for (uint32_t i = 0; i < layout->set_count; ++i)
+    {
+        auto& set = layout->sets[i];
+        if (set.layout_bindings.empty())
         {
-            BLAST_SAFE_DELETE(copy_cmds[i]);
+            set.descriptor_set_layout = empty_set_layout;
         }
-        copy_cmds.clear();
+        else
+        {
+            VkDescriptorSetLayoutCreateInfo dslci = {};
+            dslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            dslci.flags = (int32_t)i == push_set ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0;
+            dslci.pBindings = set.layout_bindings.data();
+            dslci.bindingCount = (uint32_t)set.layout_bindings.size();
+            VK_ASSERT(vkCreateDescriptorSetLayout(device, &dslci, nullptr, &set.descriptor_set_layout));
+        }
+        layouts.push_back(set.descriptor_set_layout);
+    }
+    AppendBindlessLayouts(layouts);
 
-        for (uint32_t i = 0; i < work_cmds.size(); ++i)
+    VkPipelineLayoutCreateInfo plci = {};
+    plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    plci.pSetLayouts = layouts.data();
+    plci.setLayoutCount = (uint32_t)layouts.size();
+    if (pushconstants.size > 0)
+    {
+        plci.pushConstantRangeCount = 1;
+        plci.pPushConstantRanges = &layout->pushconstants;
+    }
+    else
+    {
+        plci.pushConstantRangeCount = 0;
+        plci.pPushConstantRanges = nullptr;
+    }
+    VK_ASSERT(vkCreatePipelineLayout(device, &plci, nullptr, &layout->pipeline_layout));
+
+    for (uint32_t i = 0; i < layout->set_count; ++i)
+    {
+        auto& set = layout->sets[i];
+        VkPipelineLayout push_pipeline_layout = (int32_t)i == push_set ? layout->pipeline_layout : VK_NULL_HANDLE;
+        set.descriptor_update_template = CreateDescriptorUpdateTemplate(set.layout_bindings, set.descriptor_set_layout, push_pipeline_layout, bind_point, i);
+    }
+
+    layout_cache.emplace(hash, layout);
+    return layout;
+}
+
+void VulkanDevice::ReleasePipelineLayout(VulkanPipelineLayout* layout)
+{
+    std::lock_guard<std::mutex> lock(layout_locker);
+    if (--layout->ref_count > 0)
+    {
+        return;
+    }
+
+    auto range = layout_cache.equal_range(layout->hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (it->second == layout)
         {
-            BLAST_SAFE_DELETE(work_cmds[i]);
+            layout_cache.erase(it);
+            break;
         }
-        work_cmds.clear();
+    }
 
-        for (int queue = 0; queue < BLAST_QUEUE_COUNT; ++queue)
+    uint64_t frame_count = resource_manager.frame_count;
+    resource_manager.destroyer_pipeline_layouts.push_back(std::make_pair(layout->pipeline_layout, frame_count));
+    for (uint32_t i = 0; i < layout->set_count; ++i)
+    {
+        auto& set = layout->sets[i];
+        if (set.descriptor_set_layout != empty_set_layout)
         {
-            queues[queue].Submit(frame.fence[queue]);
+            resource_manager.destroyer_descriptor_set_layouts.push_back(std::make_pair(set.descriptor_set_layout, frame_count));
+        }
+        if (set.descriptor_update_template)
+        {
+            resource_manager.destroyer_descriptor_update_templates.push_back(std::make_pair(set.descriptor_update_template, frame_count));
         }
     }
+    delete layout;
+}
 
-    frame_count++;
+void VulkanDevice::AppendBindlessLayouts(std::vector<VkDescriptorSetLayout>& layouts)
+{
+    if (!bindless_supported)
+    {
+        return;
+    }
 
+    while (layouts.size() < BLAST_BINDLESS_TEXTURE_SET)
     {
-        auto& frame = GetFrameResources();
+        layouts.push_back(empty_set_layout);
+    }
+    for (auto& heap : bindless_heaps)
+    {
+        layouts.push_back(heap.descriptor_set_layout);
+    }
+}
 
-        if (frame_count >= BLAST_BUFFER_COUNT)
+void VulkanDevice::PipelineStateValidate(uint32_t cmd)
+{
+    if (!dirty_pipeline[cmd])
+        return;
+
+    VulkanPipeline* internal_pipeline = (VulkanPipeline*)active_pipeline[cmd];
+    vkCmdBindPipeline(GetCommandBuffer(cmd), VK_PIPELINE_BIND_POINT_GRAPHICS, internal_pipeline->pipeline);
+}
+
+void VulkanDevice::FlushBufferCopies(uint32_t cmd)
+{
+    if (pending_copies[cmd].empty())
+    {
+        return;
+    }
+
+    VkCommandBuffer command_buffer = GetCommandBuffer(cmd);
+    std::vector<VkBufferCopy> regions;
+    for (auto& x : pending_copies[cmd])
+    {
+        VulkanBuffer* dst_buffer = x.first;
+        std::vector<PendingBufferCopy>& copies = x.second;
+        dst_buffer->frame_written = frame_count;
+
+        // 区域互不重叠, 按上传缓存分组后每组一次拷贝
+        std::sort(copies.begin(), copies.end(), [](const PendingBufferCopy& a, const PendingBufferCopy& b) { return a.src < b.src; });
+        for (uint32_t i = 0; i < copies.size();)
         {
-            for (int queue = 0; queue < BLAST_QUEUE_COUNT; ++queue)
+            regions.clear();
+            uint32_t j = i;
+            while (j < copies.size() && copies[j].src == copies[i].src)
             {
-                VK_ASSERT(vkWaitForFences(device, 1, &frame.fence[queue], true, 0xFFFFFFFFFFFFFFFF));
-                VK_ASSERT(vkResetFences(device, 1, &frame.fence[queue]));
+                regions.push_back(copies[j].region);
+                j++;
             }
+            vkCmdCopyBuffer(command_buffer, copies[i].src, dst_buffer->resource, (uint32_t)regions.size(), regions.data());
+            i = j;
         }
+    }
+    pending_copies[cmd].clear();
+}
 
-        // 销毁上一帧需要清理的资源
-        resource_manager.Update(frame_count, BLAST_BUFFER_COUNT);
-
-        // 重置transfer命令缓存状态
-        {
-            VK_ASSERT(vkResetCommandPool(device, frame.init_command_pool, 0));
+void VulkanDevice::TrackCopyWrite(uint32_t copy_cmd, GfxResource* resource)
+{
+    std::lock_guard<std::mutex> lock(acquire_locker);
+    CheckCopyQueueWrite(resource);
+    PendingAcquire& pending = pending_acquires[resource];
+    pending.copy_cmd = copy_cmd;
+    if (resource->GetType() == GfxResource::ResourceType::BUFFER)
+    {
+        pending.state = ((VulkanBuffer*)resource)->res_state;
+    }
+    else
+    {
+        pending.state = ((VulkanTexture*)resource)->res_state;
+    }
+}
 
-            VkCommandBufferBeginInfo begin_info = {};
-            begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-            begin_info.pInheritanceInfo = nullptr;
-            VK_ASSERT(vkBeginCommandBuffer(frame.init_command_buffer, &begin_info));
-        }
+void VulkanDevice::TrackResourceUse(uint32_t cmd, GfxResource* resource)
+{
+    // 命令缓存只在一个线程上记录, 不需要加锁
+    if (resource)
+    {
+        cmd_meta[cmd].uses.insert(resource);
     }
+}
 
-    submit_inits = false;
-    init_locker.unlock();
+bool VulkanDevice::IsSharedWithCopyQueue(ResourceUsage usage)
+{
+    const uint32_t exclusive_usage = RESOURCE_USAGE_RENDER_TARGET | RESOURCE_USAGE_DEPTH_STENCIL | RESOURCE_USAGE_UNORDERED_ACCESS | RESOURCE_USAGE_RW_BUFFER;
+    return queue_families.size() > 1 && (usage & exclusive_usage) == 0;
 }
 
-void VulkanDevice::WaitCommandBuffer(GfxCommandBuffer* cmd, GfxCommandBuffer* wait_for)
+bool VulkanDevice::IsConcurrent(GfxResource* resource)
 {
-    VulkanCommandBuffer* internal_cmd = (VulkanCommandBuffer*)cmd;
-    VulkanCommandBuffer* internal_wait_for = (VulkanCommandBuffer*)wait_for;
-    cmd_meta[internal_cmd->idx].waits.push_back(internal_wait_for->idx);
+    if (resource->GetType() == GfxResource::ResourceType::BUFFER)
+    {
+        return ((VulkanBuffer*)resource)->concurrent;
+    }
+    return ((VulkanTexture*)resource)->concurrent;
 }
 
-void VulkanDevice::RenderPassBegin(GfxCommandBuffer* cmd, GfxSwapChain* swapchain)
+uint32_t* VulkanDevice::GetQueueFamily(GfxResource* resource)
 {
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    VulkanSwapChain* internal_swapchain = (VulkanSwapChain*)swapchain;
+    if (resource->GetType() == GfxResource::ResourceType::BUFFER)
+    {
+        VulkanBuffer* internal_buffer = (VulkanBuffer*)resource;
+        return internal_buffer->concurrent ? nullptr : &internal_buffer->queue_family;
+    }
+    VulkanTexture* internal_texture = (VulkanTexture*)resource;
+    return internal_texture->concurrent ? nullptr : &internal_texture->queue_family;
+}
 
-    bool has_active_swapchain = false;
-    for (uint32_t i = 0; i < active_swapchains[internal_cmd].size(); ++i)
+bool VulkanDevice::CheckCopyQueueWrite(GfxResource* resource)
+{
+    // 内容需要保留时, 图形队列必须先释放所有权, copy命令缓存在记录时无法做到
+    uint32_t* queue_family = GetQueueFamily(resource);
+    if (queue_family && *queue_family != VK_QUEUE_FAMILY_IGNORED && *queue_family != copy_family)
     {
-        if (active_swapchains[internal_cmd][i] == swapchain)
-        {
-            has_active_swapchain = true;
-            break;
-        }
+        BLAST_LOGE("exclusive resource owned by queue family %u is written on the copy queue, update attachments and UAVs on a work command buffer\n", *queue_family);
+        assert(0);
+        return false;
     }
-    if (!has_active_swapchain)
+    return true;
+}
+
+void VulkanDevice::ForgetPendingAcquire(GfxResource* resource)
+{
+    std::lock_guard<std::mutex> lock(acquire_locker);
+    pending_acquires.erase(resource);
+}
+
+void VulkanDevice::PreDraw(uint32_t cmd)
+{
+    FlushBufferCopies(cmd);
+
+    PipelineStateValidate(cmd);
+
+    binders[cmd].Flush(true, cmd);
+
+    VulkanPipeline* internal_pipeline = (VulkanPipeline*)active_pipeline[cmd];
+    if (internal_pipeline->pushconstants.size > 0)
     {
-        active_swapchains[internal_cmd].push_back(swapchain);
-        VK_ASSERT(vkAcquireNextImageKHR(
-            device,
-            internal_swapchain->swapchain,
-            0xFFFFFFFFFFFFFFFF,
-            internal_swapchain->swapchain_acquire_semaphore,
-            VK_NULL_HANDLE,
-            &internal_swapchain->swapchain_image_index));
+        vkCmdPushConstants(
+            GetCommandBuffer(cmd),
+            internal_pipeline->pipeline_layout,
+            internal_pipeline->pushconstants.stageFlags,
+            internal_pipeline->pushconstants.offset,
+            internal_pipeline->pushconstants.size,
+            pushconstants[cmd].data);
     }
+}
 
-    std::vector<VkClearValue> clear_values;
-    VkClearValue clear_color = {
-        swapchain->desc.clear_color[0],
-        swapchain->desc.clear_color[1],
-        swapchain->desc.clear_color[2],
-        swapchain->desc.clear_color[3],
-    };
-    clear_values.push_back(clear_color);
+void VulkanDevice::PreDispatch(uint32_t cmd)
+{
+    FlushBufferCopies(cmd);
 
-    VkRenderPassBeginInfo renderpass_info = {};
-    renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderpass_info.renderPass = internal_swapchain->renderpass;
-    renderpass_info.framebuffer = internal_swapchain->swapchain_framebuffers[internal_swapchain->swapchain_image_index];
-    renderpass_info.renderArea.offset = {0, 0};
-    renderpass_info.renderArea.extent = internal_swapchain->swapchain_extent;
-    renderpass_info.clearValueCount = clear_values.size();
-    renderpass_info.pClearValues = clear_values.data();
-    vkCmdBeginRenderPass(GetCommandBuffer(internal_cmd), &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
+    binders[cmd].Flush(false, cmd);
+
+    VulkanShader* internal_cs = (VulkanShader*)active_cs[cmd];
+    if (internal_cs->pushconstants.size > 0)
+    {
+        vkCmdPushConstants(
+            GetCommandBuffer(cmd),
+            internal_cs->pipeline_layout_cs,
+            internal_cs->pushconstants.stageFlags,
+            internal_cs->pushconstants.offset,
+            internal_cs->pushconstants.size,
+            pushconstants[cmd].data);
+    }
 }
 
-void VulkanDevice::RenderPassBegin(GfxCommandBuffer* cmd, GfxRenderPass* renderpass)
+void VulkanDevice::Draw(GfxCommandBuffer* cmd, uint32_t vertex_count, uint32_t vertex_offset)
 {
     uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    VulkanRenderPass* internal_renderpass = (VulkanRenderPass*)renderpass;
+    PreDraw(internal_cmd);
+    vkCmdDraw(GetCommandBuffer(internal_cmd), vertex_count, 1, vertex_offset, 0);
+}
 
-    vkCmdBeginRenderPass(GetCommandBuffer(internal_cmd), &internal_renderpass->begin_info, VK_SUBPASS_CONTENTS_INLINE);
+void VulkanDevice::DrawIndexed(GfxCommandBuffer* cmd, uint32_t index_count, uint32_t index_offset, int32_t vertex_offset)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    PreDraw(internal_cmd);
+    vkCmdDrawIndexed(GetCommandBuffer(internal_cmd), index_count, 1, index_offset, vertex_offset, 0);
 }
 
-void VulkanDevice::RenderPassEnd(GfxCommandBuffer* cmd)
+void VulkanDevice::DrawInstanced(GfxCommandBuffer* cmd, uint32_t vertex_count, uint32_t instance_count, uint32_t vertex_offset, uint32_t instance_offset)
 {
     uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    vkCmdEndRenderPass(GetCommandBuffer(internal_cmd));
+    PreDraw(internal_cmd);
+    vkCmdDraw(GetCommandBuffer(internal_cmd), vertex_count, instance_count, vertex_offset, instance_offset);
 }
 
-void VulkanDevice::BindScissor(GfxCommandBuffer* cmd, int32_t left, int32_t top, int32_t right, int32_t bottom, uint32_t idx)
+void VulkanDevice::DrawIndexedInstanced(GfxCommandBuffer* cmd, uint32_t index_count, uint32_t instance_count, uint32_t index_offset, int32_t vertex_offset, uint32_t instance_offset)
 {
     uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    scissors[internal_cmd][idx].extent.width = abs(right - left);
-    scissors[internal_cmd][idx].extent.height = abs(top - bottom);
-    scissors[internal_cmd][idx].offset.x = std::max(0, left);
-    scissors[internal_cmd][idx].offset.y = std::max(0, top);
-    vkCmdSetScissor(GetCommandBuffer(internal_cmd), 0, BLAST_VIEWPORT_COUNT, scissors[internal_cmd]);
+    PreDraw(internal_cmd);
+    vkCmdDrawIndexed(GetCommandBuffer(internal_cmd), index_count, instance_count, index_offset, vertex_offset, instance_offset);
 }
 
-void VulkanDevice::BindViewport(GfxCommandBuffer* cmd, float x, float y, float w, float h, float min_depth, float max_depth, uint32_t idx)
+void VulkanDevice::Dispatch(GfxCommandBuffer* cmd, uint32_t thread_group_x, uint32_t thread_group_y, uint32_t thread_group_z)
 {
     uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    viewports[internal_cmd][idx].x = x;
-    viewports[internal_cmd][idx].y = y;
-    viewports[internal_cmd][idx].width = w;
-    viewports[internal_cmd][idx].height = h;
-    viewports[internal_cmd][idx].minDepth = min_depth;
-    viewports[internal_cmd][idx].maxDepth = max_depth;
-    vkCmdSetViewport(GetCommandBuffer(internal_cmd), 0, BLAST_VIEWPORT_COUNT, viewports[internal_cmd]);
+    PreDispatch(internal_cmd);
+    vkCmdDispatch(GetCommandBuffer(internal_cmd), thread_group_x, thread_group_y, thread_group_z);
 }
 
-void VulkanDevice::BindResource(GfxCommandBuffer* cmd, GfxResource* resource, uint32_t slot, int32_t subresource)
+GfxTransientAllocation VulkanDevice::AllocateTransient(GfxCommandBuffer* cmd, uint64_t size, ResourceUsage usage)
 {
+    assert(!((VulkanCommandBuffer*)cmd)->is_copy);
     uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    auto& binder = binders[internal_cmd];
-    if (binder.table.srv[slot] != resource || binder.table.srv_index[slot] != subresource)
+
+    uint64_t alignment = 16;
+    if (usage & RESOURCE_USAGE_UNIFORM_BUFFER)
     {
-        binder.table.srv[slot] = resource;
-        binder.table.srv_index[slot] = subresource;
-        binder.dirty = true;
+        alignment = std::max(alignment, (uint64_t)phy_device_properties.limits.minUniformBufferOffsetAlignment);
+    }
+    if (usage & RESOURCE_USAGE_RW_BUFFER)
+    {
+        alignment = std::max(alignment, (uint64_t)phy_device_properties.limits.minStorageBufferOffsetAlignment);
     }
+
+    return GetFrameResources().transient_allocators[internal_cmd].Allocate(size, alignment);
 }
 
-void VulkanDevice::BindUAV(GfxCommandBuffer* cmd, GfxResource* resource, uint32_t slot, int32_t subresource)
+void VulkanDevice::GetMemoryStats(GfxMemoryStats& stats)
 {
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    auto& binder = binders[internal_cmd];
-    if (binder.table.uav[slot] != resource || binder.table.uav_index[slot] != subresource)
+    memory_allocator.GetStats(stats);
+
+    stats.num_heaps = phy_device_memory_properties.memoryHeapCount;
+    for (uint32_t i = 0; i < phy_device_memory_properties.memoryHeapCount; ++i)
     {
-        binder.table.uav[slot] = resource;
-        binder.table.uav_index[slot] = subresource;
-        binder.dirty = true;
+        GfxMemoryHeapStats& heap_stats = stats.heaps[i];
+        heap_stats.size = phy_device_memory_properties.memoryHeaps[i].size;
+        heap_stats.budget = heap_stats.size;
+        heap_stats.usage = 0;
+        heap_stats.device_local = (phy_device_memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    }
+
+    if (memory_budget_supported)
+    {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = {};
+        budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 memory_properties2 = {};
+        memory_properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memory_properties2.pNext = &budget_properties;
+        vkGetPhysicalDeviceMemoryProperties2(phy_device, &memory_properties2);
+
+        for (uint32_t i = 0; i < stats.num_heaps; ++i)
+        {
+            stats.heaps[i].budget = budget_properties.heapBudget[i];
+            stats.heaps[i].usage = budget_properties.heapUsage[i];
+        }
+    }
+    else
+    {
+        for (uint32_t i = 0; i < stats.num_types; ++i)
+        {
+            stats.heaps[stats.types[i].heap_index].usage += stats.types[i].allocated_bytes;
+        }
+    }
+
+    stats.descriptor_pool_count = 0;
+    stats.descriptor_count = 0;
+    for (auto& frame : frames)
+    {
+        for (auto& pool : frame.descriptor_pools)
+        {
+            stats.descriptor_pool_count += (uint32_t)pool.descriptor_pools.size();
+            stats.descriptor_count += pool.descriptor_count;
+        }
     }
 }
 
-void VulkanDevice::BindSampler(GfxCommandBuffer* cmd, GfxSampler* sampler, uint32_t slot)
+void VulkanDevice::GetDescriptorStats(GfxDescriptorStats& stats)
 {
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    auto& binder = binders[internal_cmd];
-    if (binder.table.sam[slot] != sampler)
+    init_locker.lock();
+    stats = descriptor_stats;
+    init_locker.unlock();
+}
+
+void VulkanDevice::SetPushDescriptorLimit(uint32_t max_descriptors)
+{
+    push_descriptor_limit = std::min(max_descriptors, max_push_descriptors);
+}
+
+bool VulkanDevice::IsBindlessSupported()
+{
+    return bindless_supported;
+}
+
+int32_t VulkanDevice::GetBindlessIndex(GfxResource* resource, SubResourceType type, int32_t subresource)
+{
+    if (resource == nullptr)
     {
-        binder.table.sam[slot] = sampler;
-        binder.dirty = true;
+        return -1;
     }
-};
 
-void VulkanDevice::BindConstantBuffer(GfxCommandBuffer* cmd, GfxBuffer* buffer, uint32_t slot, uint64_t size, uint64_t offset)
-{
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    auto& binder = binders[internal_cmd];
-    if (binder.table.cbv[slot] != buffer || binder.table.cbv_offset[slot] != offset || binder.table.cbv_size[slot] != size)
+    if (resource->GetType() == GfxResource::ResourceType::BUFFER)
     {
-        binder.table.cbv[slot] = buffer;
-        binder.table.cbv_offset[slot] = offset;
-        binder.table.cbv_size[slot] = size;
-        binder.dirty = true;
+        return ((VulkanBuffer*)resource)->srv_index;
+    }
+
+    VulkanTexture* internal_texture = (VulkanTexture*)resource;
+    if (type != SRV && type != UAV)
+    {
+        return -1;
     }
+    if (subresource < 0)
+    {
+        return type == SRV ? internal_texture->srv_index : internal_texture->uav_index;
+    }
+
+    const std::vector<int>& indices = type == SRV ? internal_texture->subresources_srv_index : internal_texture->subresources_uav_index;
+    return (size_t)subresource < indices.size() ? indices[subresource] : -1;
 }
 
-void VulkanDevice::BindVertexBuffers(GfxCommandBuffer* cmd, GfxBuffer** vertex_buffers, uint32_t slot, uint32_t count, uint64_t* offsets)
+int32_t VulkanDevice::GetBindlessIndex(GfxSampler* sampler)
 {
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    return sampler ? ((VulkanSampler*)sampler)->bindless_index : -1;
+}
+
+uint64_t VulkanDevice::Defragment(uint64_t max_bytes)
+{
+    resource_manager.destroy_locker.lock();
+    uint64_t destroy_frame = resource_manager.frame_count;
+
+    // 只有全部由可移动资源和等待销毁的旧资源占用的块才能被腾空
+    std::unordered_map<VkDeviceMemory, uint64_t> evictable_bytes;
+    for (auto buffer : movable_resources.buffers)
+    {
+        evictable_bytes[buffer->allocation.memory] += buffer->allocation.size;
+    }
+    for (auto texture : movable_resources.textures)
+    {
+        evictable_bytes[texture->allocation.memory] += texture->allocation.size;
+    }
+    for (auto& item : resource_manager.destroyer_buffers)
+    {
+        evictable_bytes[item.first.second.memory] += item.first.second.size;
+    }
+    for (auto& item : resource_manager.destroyer_images)
+    {
+        evictable_bytes[item.first.second.memory] += item.first.second.size;
+    }
+    memory_allocator.BeginDefragment(evictable_bytes);
+
+    // 只移动最近BLAST_BUFFER_COUNT帧内没有被GPU写入(纹理为访问)的资源, 保证旧资源上的工作已经完成
+    uint64_t moved_bytes = 0;
+    std::vector<VulkanBuffer*> buffers;
+    for (auto buffer : movable_resources.buffers)
+    {
+        if (moved_bytes + buffer->allocation.size > max_bytes)
+        {
+            continue;
+        }
+        if (buffer->frame_written + BLAST_BUFFER_COUNT > frame_count || !memory_allocator.IsDefragmentSource(buffer->allocation))
+        {
+            continue;
+        }
+        buffers.push_back(buffer);
+        moved_bytes += buffer->allocation.size;
+    }
+
+    std::vector<VulkanTexture*> textures;
+    for (auto texture : movable_resources.textures)
+    {
+        if (moved_bytes + texture->allocation.size > max_bytes)
+        {
+            continue;
+        }
+        if (texture->frame_used + BLAST_BUFFER_COUNT > frame_count || !memory_allocator.IsDefragmentSource(texture->allocation))
+        {
+            continue;
+        }
+        textures.push_back(texture);
+        moved_bytes += texture->allocation.size;
+    }
+
+    if (buffers.empty() && textures.empty())
+    {
+        resource_manager.destroy_locker.unlock();
+        return 0;
+    }
+
+    // 拷贝随本帧的copy命令一起提交, 之后使用这些资源的工作命令缓存会等待它完成
+    // 可移动的资源不是附件或UAV, 以CONCURRENT模式共享, copy队列读取旧资源不需要转移所有权
+    uint32_t copy_cmd = copy_pool.Allocate();
+    VkCommandBuffer command_buffer = GetCopyCommandBuffer(copy_cmd).command_buffer;
+
+    for (auto buffer : buffers)
+    {
+        VkBuffer old_resource = buffer->resource;
+        VulkanAllocation old_allocation = buffer->allocation;
+
+        GfxBufferDesc desc;
+        desc.size = buffer->size;
+        desc.mem_usage = buffer->mem_usage;
+        desc.res_usage = buffer->res_usage;
+        CreateBufferResource(buffer, desc);
+
+        VkBufferCopy copy = {};
+        copy.srcOffset = 0;
+        copy.dstOffset = 0;
+        copy.size = buffer->size;
+        vkCmdCopyBuffer(command_buffer, old_resource, buffer->resource, 1, &copy);
+        TrackCopyWrite(copy_cmd, buffer);
+
+        resource_manager.destroyer_buffers.push_back(std::make_pair(std::make_pair(old_resource, old_allocation), destroy_frame));
+    }
+
+    for (auto texture : textures)
+    {
+        VkImage old_resource = texture->resource;
+        VulkanAllocation old_allocation = texture->allocation;
+
+        GfxTextureDesc desc;
+        desc.width = texture->width;
+        desc.height = texture->height;
+        desc.depth = texture->depth;
+        desc.num_layers = texture->num_layers;
+        desc.num_levels = texture->num_levels;
+        desc.format = texture->format;
+        desc.sample_count = texture->sample_count;
+        desc.mem_usage = texture->mem_usage;
+        desc.res_usage = texture->res_usage;
+        CreateTextureResource(texture, desc);
+
+        // 内容未定义的纹理不需要拷贝
+        if (texture->res_state != RESOURCE_STATE_UNDEFINED)
+        {
+            VkImageMemoryBarrier barriers[2] = {};
+            for (auto& barrier : barriers)
+            {
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.subresourceRange.aspectMask = ToVulkanAspectMask(texture->format);
+                barrier.subresourceRange.baseMipLevel = 0;
+                barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+                barrier.subresourceRange.baseArrayLayer = 0;
+                barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+            }
+            barriers[0].image = old_resource;
+            barriers[0].srcAccessMask = 0;
+            barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            barriers[0].oldLayout = ToVulkanImageLayout(texture->res_state);
+            barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barriers[1].image = texture->resource;
+            barriers[1].srcAccessMask = 0;
+            barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+            std::vector<VkImageCopy> copies(texture->num_levels);
+            for (uint32_t level = 0; level < texture->num_levels; ++level)
+            {
+                VkImageCopy& copy = copies[level];
+                copy = {};
+                copy.srcSubresource.aspectMask = ToVulkanAspectMask(texture->format);
+                copy.srcSubresource.mipLevel = level;
+                copy.srcSubresource.baseArrayLayer = 0;
+                copy.srcSubresource.layerCount = texture->num_layers;
+                copy.dstSubresource = copy.srcSubresource;
+                copy.extent.width = std::max(texture->width >> level, 1u);
+                copy.extent.height = std::max(texture->height >> level, 1u);
+                copy.extent.depth = std::max(texture->depth >> level, 1u);
+            }
+            vkCmdCopyImage(command_buffer, old_resource, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texture->resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)copies.size(), copies.data());
+
+            barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barriers[1].dstAccessMask = 0;
+            barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barriers[1].newLayout = ToVulkanImageLayout(texture->res_state);
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barriers[1]);
+            TrackCopyWrite(copy_cmd, texture);
+        }
+
+        resource_manager.destroyer_images.push_back(std::make_pair(std::make_pair(old_resource, old_allocation), destroy_frame));
+
+        // 按原来的顺序重建视图, 已有的子资源下标保持不变
+        VkImageView views[] = {texture->srv, texture->uav, texture->rtv, texture->dsv};
+        for (auto view : views)
+        {
+            if (view != VK_NULL_HANDLE)
+            {
+                resource_manager.destroyer_imageviews.push_back(std::make_pair(view, destroy_frame));
+            }
+        }
+        for (auto subresources : {&texture->subresources_srv, &texture->subresources_uav, &texture->subresources_rtv, &texture->subresources_dsv})
+        {
+            for (auto view : *subresources)
+            {
+                resource_manager.destroyer_imageviews.push_back(std::make_pair(view, destroy_frame));
+            }
+            subresources->clear();
+        }
+        texture->srv = VK_NULL_HANDLE;
+        texture->uav = VK_NULL_HANDLE;
+        texture->rtv = VK_NULL_HANDLE;
+        texture->dsv = VK_NULL_HANDLE;
 
-    VkDeviceSize voffsets[8] = {};
-    VkBuffer vbuffers[8] = {};
-    for (uint32_t i = 0; i < count; ++i)
-    {
-        VulkanBuffer* internal_buffer = (VulkanBuffer*)vertex_buffers[i];
-        vbuffers[i] = internal_buffer->resource;
-        voffsets[i] = offsets[i];
+        for (uint32_t type = 0; type <= DSV; ++type)
+        {
+            std::vector<VulkanSubresourceRange> ranges = std::move(texture->subresource_ranges[type]);
+            texture->subresource_ranges[type].clear();
+            for (auto& range : ranges)
+            {
+                CreateSubresource(texture, (SubResourceType)type, range.first_slice, range.slice_count, range.first_mip, range.mip_count);
+            }
+        }
     }
+    resource_manager.destroy_locker.unlock();
 
-    vkCmdBindVertexBuffers(GetCommandBuffer(internal_cmd), static_cast<uint32_t>(slot), static_cast<uint32_t>(count), vbuffers, voffsets);
+    return moved_bytes;
 }
 
-void VulkanDevice::BindIndexBuffer(GfxCommandBuffer* cmd, GfxBuffer* index_buffer, IndexType type, uint64_t offset)
+bool VulkanDevice::IsFrameComplete(uint64_t frame, bool wait)
 {
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    if (index_buffer != nullptr)
+    // 已经在SubmitAllCommandBuffer中等待过该帧的fence
+    if (frame + BLAST_BUFFER_COUNT <= frame_count)
     {
-        VulkanBuffer* internal_buffer = (VulkanBuffer*)index_buffer;
-        vkCmdBindIndexBuffer(GetCommandBuffer(internal_cmd), internal_buffer->resource, offset, ToVulkanIndexType(type));
+        return true;
     }
-}
-
-void VulkanDevice::BindStencilRef(GfxCommandBuffer* cmd, uint32_t value)
-{
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    vkCmdSetStencilReference(GetCommandBuffer(internal_cmd), VK_STENCIL_FRONT_AND_BACK, value);
-}
 
-void VulkanDevice::BindBlendFactor(GfxCommandBuffer* cmd, float r, float g, float b, float a)
-{
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    float blend_constants[] = {r, g, b, a};
-    vkCmdSetBlendConstants(GetCommandBuffer(internal_cmd), blend_constants);
-}
+    // 尚未提交
+    if (frame >= frame_count)
+    {
+        return false;
+    }
 
-void VulkanDevice::BindPipeline(GfxCommandBuffer* cmd, GfxPipeline* pipeline)
-{
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    VulkanPipeline* internal_pipeline = (VulkanPipeline*)pipeline;
-    if (!active_pipeline[internal_cmd])
+    VkFence* fences = frames[frame % BLAST_BUFFER_COUNT].fence;
+    if (wait)
     {
-        active_pipeline[internal_cmd] = pipeline;
-        dirty_pipeline[internal_cmd] = true;
-        binders[internal_cmd].dirty = true;
+        return vkWaitForFences(device, BLAST_QUEUE_COUNT, fences, true, 0xFFFFFFFFFFFFFFFF) == VK_SUCCESS;
     }
-    else
+
+    for (uint32_t i = 0; i < BLAST_QUEUE_COUNT; ++i)
     {
-        VulkanPipeline* internal_active_pipeline = (VulkanPipeline*)active_pipeline[internal_cmd];
-        if (internal_active_pipeline->hash != internal_pipeline->hash)
+        if (vkGetFenceStatus(device, fences[i]) != VK_SUCCESS)
         {
-            active_pipeline[internal_cmd] = pipeline;
-            dirty_pipeline[internal_cmd] = true;
-            binders[internal_cmd].dirty = true;
+            return false;
         }
     }
+    return true;
 }
 
-void VulkanDevice::BindComputeShader(GfxCommandBuffer* cmd, GfxShader* cs)
+VulkanReadback* VulkanDevice::CreateReadback(GfxCommandBuffer* cmd, uint64_t size, uint64_t alignment)
 {
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    if (active_cs[internal_cmd] != cs)
-    {
-        binders[internal_cmd].dirty = true;
-        active_cs[internal_cmd] = cs;
-        VulkanShader* internal_shader = (VulkanShader*)cs;
-        vkCmdBindPipeline(GetCommandBuffer(internal_cmd), VK_PIPELINE_BIND_POINT_COMPUTE, internal_shader->pipeline_cs);
-    }
+    assert(!((VulkanCommandBuffer*)cmd)->is_copy);
+
+    VulkanReadback* internal_readback = new VulkanReadback(this);
+    internal_readback->size = size;
+    internal_readback->frame = frame_count;
+    internal_readback->buffer = readback_ring.Allocate(size, alignment, internal_readback->chunk, internal_readback->offset);
+    return internal_readback;
 }
 
-void VulkanDevice::PushConstants(GfxCommandBuffer* cmd, const void* data, uint32_t size)
+GfxReadback* VulkanDevice::ReadbackBuffer(GfxCommandBuffer* cmd, GfxBuffer* buffer, uint64_t size, uint64_t offset)
 {
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    memcpy(pushconstants[internal_cmd].data, data, size);
-    pushconstants[internal_cmd].size = size;
+    if (size == 0)
+    {
+        size = buffer->size - offset;
+    }
+
+    VulkanReadback* internal_readback = CreateReadback(cmd, size, 16);
+    VulkanBuffer* dst_buffer = internal_readback->buffer;
+
+    VkBufferCopy copy = {};
+    copy.srcOffset = offset;
+    copy.dstOffset = internal_readback->offset;
+    copy.size = size;
+
+    FlushBufferCopies(((VulkanCommandBuffer*)cmd)->idx);
+    TrackResourceUse(((VulkanCommandBuffer*)cmd)->idx, buffer);
+    VkCommandBuffer command_buffer = GetCommandBuffer(((VulkanCommandBuffer*)cmd)->idx);
+    vkCmdCopyBuffer(command_buffer, ((VulkanBuffer*)buffer)->resource, dst_buffer->resource, 1, &copy);
+
+    // 拷贝结果对CPU可见
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = dst_buffer->resource;
+    barrier.offset = internal_readback->offset;
+    barrier.size = size;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    return internal_readback;
 }
 
-void VulkanDevice::PipelineStateValidate(uint32_t cmd)
+GfxReadback* VulkanDevice::ReadbackTexture(GfxCommandBuffer* cmd, GfxTexture* texture, uint32_t layer, uint32_t level)
 {
-    if (!dirty_pipeline[cmd])
-        return;
+    uint32_t width = std::max(texture->width >> level, 1u);
+    uint32_t height = std::max(texture->height >> level, 1u);
+    uint32_t depth = std::max(texture->depth >> level, 1u);
+    uint32_t stride = GetFormatStride(texture->format);
+    uint64_t size = GetSubresourceSize(texture->format, width, height, depth);
+
+    // bufferOffset需要同时是4和像素大小的倍数
+    VulkanReadback* internal_readback = CreateReadback(cmd, size, stride * 4);
+    VulkanBuffer* dst_buffer = internal_readback->buffer;
+    VulkanTexture* internal_texture = (VulkanTexture*)texture;
+    internal_texture->frame_used = frame_count;
 
-    VulkanPipeline* internal_pipeline = (VulkanPipeline*)active_pipeline[cmd];
-    vkCmdBindPipeline(GetCommandBuffer(cmd), VK_PIPELINE_BIND_POINT_GRAPHICS, internal_pipeline->pipeline);
+    VkBufferImageCopy copy = {};
+    copy.bufferOffset = internal_readback->offset;
+    copy.bufferRowLength = 0;
+    copy.bufferImageHeight = 0;
+    copy.imageSubresource.aspectMask = ToVulkanAspectMask(texture->format);
+    copy.imageSubresource.mipLevel = level;
+    copy.imageSubresource.baseArrayLayer = layer;
+    copy.imageSubresource.layerCount = 1;
+    copy.imageOffset = {0, 0, 0};
+    copy.imageExtent.width = width;
+    copy.imageExtent.height = height;
+    copy.imageExtent.depth = depth;
+
+    TrackResourceUse(((VulkanCommandBuffer*)cmd)->idx, texture);
+    VkCommandBuffer command_buffer = GetCommandBuffer(((VulkanCommandBuffer*)cmd)->idx);
+    vkCmdCopyImageToBuffer(command_buffer, internal_texture->resource, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dst_buffer->resource, 1, &copy);
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = dst_buffer->resource;
+    barrier.offset = internal_readback->offset;
+    barrier.size = size;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    return internal_readback;
 }
 
-void VulkanDevice::PreDraw(uint32_t cmd)
+const void* VulkanDevice::GetReadbackData(GfxReadback* readback)
 {
-    PipelineStateValidate(cmd);
-
-    binders[cmd].Flush(true, cmd);
+    VulkanReadback* internal_readback = (VulkanReadback*)readback;
+    if (!IsFrameComplete(internal_readback->frame, false))
+    {
+        return nullptr;
+    }
 
-    VulkanPipeline* internal_pipeline = (VulkanPipeline*)active_pipeline[cmd];
-    if (internal_pipeline->pushconstants.size > 0)
+    VulkanBuffer* buffer = internal_readback->buffer;
+    const VulkanAllocation& allocation = buffer->allocation;
+    if (!internal_readback->invalidated)
     {
-        vkCmdPushConstants(
-            GetCommandBuffer(cmd),
-            internal_pipeline->pipeline_layout,
-            internal_pipeline->pushconstants.stageFlags,
-            internal_pipeline->pushconstants.offset,
-            internal_pipeline->pushconstants.size,
-            pushconstants[cmd].data);
+        // 非一致内存需要invalidate后CPU才能看到GPU的写入, 范围按nonCoherentAtomSize对齐
+        if (!(phy_device_memory_properties.memoryTypes[allocation.memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+        {
+            uint64_t atom_size = phy_device_properties.limits.nonCoherentAtomSize;
+            uint64_t begin = allocation.offset + internal_readback->offset;
+            uint64_t end = begin + internal_readback->size;
+            begin = begin / atom_size * atom_size;
+            end = AlignTo(end, atom_size);
+
+            VkMappedMemoryRange range = {};
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = allocation.memory;
+            range.offset = begin;
+            range.size = end - begin;
+            VK_ASSERT(vkInvalidateMappedMemoryRanges(device, 1, &range));
+        }
+        internal_readback->invalidated = true;
     }
+
+    return (const uint8_t*)buffer->mapped_data + internal_readback->offset;
 }
 
-void VulkanDevice::PreDispatch(uint32_t cmd)
+bool VulkanDevice::WaitReadback(GfxReadback* readback)
 {
-    binders[cmd].Flush(false, cmd);
-
-    VulkanShader* internal_cs = (VulkanShader*)active_cs[cmd];
-    if (internal_cs->pushconstants.size > 0)
-    {
-        vkCmdPushConstants(
-            GetCommandBuffer(cmd),
-            internal_cs->pipeline_layout_cs,
-            internal_cs->pushconstants.stageFlags,
-            internal_cs->pushconstants.offset,
-            internal_cs->pushconstants.size,
-            pushconstants[cmd].data);
-    }
+    VulkanReadback* internal_readback = (VulkanReadback*)readback;
+    return IsFrameComplete(internal_readback->frame, true);
 }
 
-void VulkanDevice::Draw(GfxCommandBuffer* cmd, uint32_t vertex_count, uint32_t vertex_offset)
+void VulkanDevice::DestroyReadback(GfxReadback* readback)
 {
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    PreDraw(internal_cmd);
-    vkCmdDraw(GetCommandBuffer(internal_cmd), vertex_count, 1, vertex_offset, 0);
+    VulkanReadback* internal_readback = (VulkanReadback*)readback;
+    readback_ring.Release(internal_readback->chunk);
 }
 
-void VulkanDevice::DrawIndexed(GfxCommandBuffer* cmd, uint32_t index_count, uint32_t index_offset, int32_t vertex_offset)
+uint64_t VulkanDevice::StreamUpload(const GfxStreamRequest& request)
 {
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    PreDraw(internal_cmd);
-    vkCmdDrawIndexed(GetCommandBuffer(internal_cmd), index_count, 1, index_offset, vertex_offset, 0);
+    assert((request.buffer != nullptr) != (request.texture != nullptr));
+    return streaming.Enqueue(request);
 }
 
-void VulkanDevice::DrawInstanced(GfxCommandBuffer* cmd, uint32_t vertex_count, uint32_t instance_count, uint32_t vertex_offset, uint32_t instance_offset)
+bool VulkanDevice::IsStreamResident(uint64_t ticket)
 {
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    PreDraw(internal_cmd);
-    vkCmdDraw(GetCommandBuffer(internal_cmd), vertex_count, instance_count, vertex_offset, instance_offset);
+    return streaming.IsResident(ticket);
 }
 
-void VulkanDevice::DrawIndexedInstanced(GfxCommandBuffer* cmd, uint32_t index_count, uint32_t instance_count, uint32_t index_offset, int32_t vertex_offset, uint32_t instance_offset)
+void VulkanDevice::WaitStream(GfxCommandBuffer* cmd, uint64_t ticket)
 {
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    PreDraw(internal_cmd);
-    vkCmdDrawIndexed(GetCommandBuffer(internal_cmd), index_count, instance_count, index_offset, vertex_offset, instance_offset);
+    // copy命令缓存与流式上传在同一队列, 不支持等待
+    VulkanCommandBuffer* internal_cmd = (VulkanCommandBuffer*)cmd;
+    assert(!internal_cmd->is_copy);
+    uint64_t value = streaming.Require(ticket);
+    cmd_meta[internal_cmd->idx].stream_wait = std::max(cmd_meta[internal_cmd->idx].stream_wait, value);
 }
 
-void VulkanDevice::Dispatch(GfxCommandBuffer* cmd, uint32_t thread_group_x, uint32_t thread_group_y, uint32_t thread_group_z)
+void VulkanDevice::SetStreamBudget(uint64_t bytes_per_frame)
 {
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    PreDispatch(internal_cmd);
-    vkCmdDispatch(GetCommandBuffer(internal_cmd), thread_group_x, thread_group_y, thread_group_z);
+    streaming.SetBudget(bytes_per_frame);
 }
 
 void VulkanDevice::BufferCopy(GfxCommandBuffer* cmd, const GfxBufferCopyRange& range)
@@ -3281,15 +6715,20 @@ void VulkanDevice::BufferCopy(GfxCommandBuffer* cmd, const GfxBufferCopyRange& r
     copy.srcOffset = range.src_offset;
     copy.dstOffset = range.dst_offset;
     copy.size = range.size;
+    internel_dst_buffer->frame_written = frame_count;
 
     VkCommandBuffer command_buffer;
     if (((VulkanCommandBuffer*)cmd)->is_copy)
     {
         command_buffer = GetCopyCommandBuffer(((VulkanCommandBuffer*)cmd)->idx).command_buffer;
+        TrackCopyWrite(((VulkanCommandBuffer*)cmd)->idx, internel_dst_buffer);
     }
     else
     {
+        FlushBufferCopies(((VulkanCommandBuffer*)cmd)->idx);
         command_buffer = GetCommandBuffer(((VulkanCommandBuffer*)cmd)->idx);
+        TrackResourceUse(((VulkanCommandBuffer*)cmd)->idx, internel_src_buffer);
+        TrackResourceUse(((VulkanCommandBuffer*)cmd)->idx, internel_dst_buffer);
     }
 
     vkCmdCopyBuffer(command_buffer, internel_src_buffer->resource, internel_dst_buffer->resource, 1, &copy);
@@ -3315,15 +6754,21 @@ void VulkanDevice::ImageCopy(GfxCommandBuffer* cmd, const GfxImageCopyRange& ran
     copy.dstSubresource.mipLevel = range.dst_level;
     copy.dstSubresource.layerCount = 1;
     copy.dstOffset = {0, 0, 0};
+    internel_src_texture->frame_used = frame_count;
+    internel_dst_texture->frame_used = frame_count;
 
     VkCommandBuffer command_buffer;
     if (((VulkanCommandBuffer*)cmd)->is_copy)
     {
         command_buffer = GetCopyCommandBuffer(((VulkanCommandBuffer*)cmd)->idx).command_buffer;
+        TrackCopyWrite(((VulkanCommandBuffer*)cmd)->idx, internel_dst_texture);
     }
     else
     {
+        FlushBufferCopies(((VulkanCommandBuffer*)cmd)->idx);
         command_buffer = GetCommandBuffer(((VulkanCommandBuffer*)cmd)->idx);
+        TrackResourceUse(((VulkanCommandBuffer*)cmd)->idx, internel_src_texture);
+        TrackResourceUse(((VulkanCommandBuffer*)cmd)->idx, internel_dst_texture);
     }
 
     vkCmdCopyImage(command_buffer, internel_src_texture->resource, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, internel_dst_texture->resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
@@ -3344,18 +6789,23 @@ void VulkanDevice::BufferImageCopy(GfxCommandBuffer* cmd, const GfxBufferImageCo
     copy.imageOffset.x = 0;
     copy.imageOffset.y = 0;
     copy.imageOffset.z = 0;
-    copy.imageExtent.width = internel_dst_texture->width;
-    copy.imageExtent.height = internel_dst_texture->height;
-    copy.imageExtent.depth = internel_dst_texture->depth;
+    copy.imageExtent.width = std::max(internel_dst_texture->width >> range.level, 1u);
+    copy.imageExtent.height = std::max(internel_dst_texture->height >> range.level, 1u);
+    copy.imageExtent.depth = std::max(internel_dst_texture->depth >> range.level, 1u);
+    internel_dst_texture->frame_used = frame_count;
 
     VkCommandBuffer command_buffer;
     if (((VulkanCommandBuffer*)cmd)->is_copy)
     {
         command_buffer = GetCopyCommandBuffer(((VulkanCommandBuffer*)cmd)->idx).command_buffer;
+        TrackCopyWrite(((VulkanCommandBuffer*)cmd)->idx, internel_dst_texture);
     }
     else
     {
+        FlushBufferCopies(((VulkanCommandBuffer*)cmd)->idx);
         command_buffer = GetCommandBuffer(((VulkanCommandBuffer*)cmd)->idx);
+        TrackResourceUse(((VulkanCommandBuffer*)cmd)->idx, internel_src_buffer);
+        TrackResourceUse(((VulkanCommandBuffer*)cmd)->idx, internel_dst_texture);
     }
 
     vkCmdCopyBufferToImage(command_buffer, internel_src_buffer->resource, internel_dst_texture->resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
@@ -3363,96 +6813,188 @@ void VulkanDevice::BufferImageCopy(GfxCommandBuffer* cmd, const GfxBufferImageCo
 
 void VulkanDevice::UpdateBuffer(GfxCommandBuffer* cmd, GfxBuffer* buffer, const void* data, uint64_t size, uint64_t offset)
 {
+    if (size == 0)
+    {
+        size = buffer->size - offset;
+    }
+
+    // 可映射的上传缓存以及直接写入的显存不需要拷贝命令
+    if ((buffer->mem_usage == MEMORY_USAGE_CPU_TO_GPU || buffer->write_direct) && buffer->mapped_data)
+    {
+        memcpy((uint8_t*)buffer->mapped_data + offset, data, static_cast<size_t>(size));
+        return;
+    }
+
     uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    StageBuffer::Allocation allocation = {};
     if (((VulkanCommandBuffer*)cmd)->is_copy)
     {
-        allocation = GetCopyCommandBuffer(internal_cmd).stage_buffer->Allocate(size);
+        StageBuffer::Allocation allocation = GetCopyCommandBuffer(internal_cmd).stage_buffer->Allocate(size);
+        memcpy(allocation.data, data, static_cast<size_t>(size));
+
+        GfxBufferCopyRange copy_range;
+        copy_range.size = size;
+        copy_range.src_buffer = allocation.buffer;
+        copy_range.src_offset = allocation.offset;
+        copy_range.dst_buffer = buffer;
+        copy_range.dst_offset = offset;
+        BufferCopy(cmd, copy_range);
+        return;
     }
-    else
+
+    // 工作命令缓存中的更新先记录下来, 在读取之前合并成一次拷贝
+    VulkanBuffer* internal_buffer = (VulkanBuffer*)buffer;
+    TrackResourceUse(internal_cmd, internal_buffer);
+    bool overlapped = false;
+    for (auto& copy : pending_copies[internal_cmd][internal_buffer])
     {
-        allocation = GetFrameResources().stage_buffers[internal_cmd]->Allocate(size);
+        uint64_t begin = copy.region.dstOffset;
+        uint64_t end = copy.region.dstOffset + copy.region.size;
+        if (offset >= begin && offset + size <= end)
+        {
+            // 落在已有区域内时直接改写其上传数据
+            memcpy(copy.data + (offset - begin), data, static_cast<size_t>(size));
+            return;
+        }
+
+        if (offset < end && offset + size > begin)
+        {
+            overlapped = true;
+        }
     }
 
+    if (overlapped)
     {
-        void* dst_data;
-        VulkanBuffer* internal_buffer = (VulkanBuffer*)allocation.buffer;
-        vkMapMemory(device, internal_buffer->memory, allocation.offset, size, 0, &dst_data);
-        memcpy(dst_data, data, static_cast<size_t>(size));
-        vkUnmapMemory(device, internal_buffer->memory);
+        // 同一次拷贝的区域不能重叠, 先提交之前的拷贝, 之后的写入排在它们后面
+        FlushBufferCopies(internal_cmd);
+
+        VkMemoryBarrier memory_barrier = {};
+        memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(GetCommandBuffer(internal_cmd), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
     }
 
-    GfxBufferCopyRange copy_range;
-    copy_range.size = size;
-    copy_range.src_buffer = allocation.buffer;
-    copy_range.src_offset = allocation.offset;
-    copy_range.dst_buffer = buffer;
-    copy_range.dst_offset = offset;
-    BufferCopy(cmd, copy_range);
+    StageBuffer::Allocation allocation = stage_buffers[internal_cmd]->Allocate(size);
+    memcpy(allocation.data, data, static_cast<size_t>(size));
+
+    PendingBufferCopy pending;
+    pending.src = ((VulkanBuffer*)allocation.buffer)->resource;
+    pending.data = allocation.data;
+    pending.region.srcOffset = allocation.offset;
+    pending.region.dstOffset = offset;
+    pending.region.size = size;
+
+    // 上传数据与目标都连续时扩展上一个区域
+    std::vector<PendingBufferCopy>& copies = pending_copies[internal_cmd][internal_buffer];
+    if (!copies.empty())
+    {
+        PendingBufferCopy& last = copies.back();
+        if (last.src == pending.src && last.region.srcOffset + last.region.size == pending.region.srcOffset && last.region.dstOffset + last.region.size == offset)
+        {
+            last.region.size += size;
+            return;
+        }
+    }
+    copies.push_back(pending);
 }
 
 void VulkanDevice::UpdateTexture(GfxCommandBuffer* cmd, GfxTexture* texture, const void* data, uint32_t layer, uint32_t level)
 {
-    uint32_t total_image_size = 0;
+    // data依次存放0到layer的每一层, 每层包含0到level的mip
+    std::vector<GfxTextureRegion> regions;
+    const uint8_t* src = (const uint8_t*)data;
     for (uint32_t i = 0; i < layer + 1; ++i)
     {
         for (uint32_t j = 0; j < level + 1; ++j)
         {
-            uint32_t image_size = 0;
-            if (texture->depth > 1)
-            {
-                image_size = texture->width >> j;
-                image_size *= texture->height >> j;
-                image_size *= texture->depth >> j;
-                image_size *= blast::GetFormatStride(texture->format);
-            }
-            else if (texture->height > 1)
-            {
-                image_size = texture->width >> j;
-                image_size *= texture->height >> j;
-                image_size *= blast::GetFormatStride(texture->format);
-            }
-            else
-            {
-                image_size = texture->width >> j;
-                image_size *= blast::GetFormatStride(texture->format);
-            }
-            total_image_size += image_size;
+            GfxTextureRegion region;
+            region.layer = i;
+            region.level = j;
+            region.data = src;
+            regions.push_back(region);
+
+            src += GetSubresourceSize(texture->format, std::max(texture->width >> j, 1u), std::max(texture->height >> j, 1u), std::max(texture->depth >> j, 1u));
         }
     }
 
-    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
-    StageBuffer::Allocation allocation = {};
-    if (((VulkanCommandBuffer*)cmd)->is_copy)
+    UpdateTextureRegions(cmd, texture, (uint32_t)regions.size(), regions.data());
+}
+
+void VulkanDevice::UpdateTextureRegions(GfxCommandBuffer* cmd, GfxTexture* texture, uint32_t num_regions, const GfxTextureRegion* regions)
+{
+    std::vector<void*> dst(num_regions);
+    MapTextureRegions(cmd, texture, num_regions, regions, dst.data());
+    for (uint32_t i = 0; i < num_regions; ++i)
     {
-        allocation = GetCopyCommandBuffer(internal_cmd).stage_buffer->Allocate(total_image_size);
+        uint32_t level = regions[i].level;
+        uint64_t size = GetSubresourceSize(texture->format, std::max(texture->width >> level, 1u), std::max(texture->height >> level, 1u), std::max(texture->depth >> level, 1u));
+        memcpy(dst[i], regions[i].data, static_cast<size_t>(size));
     }
-    else
+}
+
+void VulkanDevice::MapTextureRegions(GfxCommandBuffer* cmd, GfxTexture* texture, uint32_t num_regions, const GfxTextureRegion* regions, void** dst)
+{
+    if (num_regions == 0)
     {
-        allocation = GetFrameResources().stage_buffers[internal_cmd]->Allocate(total_image_size);
+        return;
     }
 
+    // bufferOffset需要同时是4和像素(压缩块)大小的倍数
+    uint32_t stride = GetFormatStride(texture->format);
+    uint64_t alignment = stride % 4 == 0 ? stride : 4;
+
+    std::vector<uint64_t> offsets(num_regions);
+    std::vector<uint64_t> sizes(num_regions);
+    uint64_t total_size = 0;
+    for (uint32_t i = 0; i < num_regions; ++i)
     {
-        void* dst_data;
-        VulkanBuffer* internal_buffer = (VulkanBuffer*)allocation.buffer;
-        vkMapMemory(device, internal_buffer->memory, allocation.offset, VK_WHOLE_SIZE, 0, &dst_data);
-        memcpy(dst_data, data, static_cast<size_t>(total_image_size));
-        vkUnmapMemory(device, internal_buffer->memory);
+        uint32_t level = regions[i].level;
+        sizes[i] = GetSubresourceSize(texture->format, std::max(texture->width >> level, 1u), std::max(texture->height >> level, 1u), std::max(texture->depth >> level, 1u));
+        offsets[i] = AlignTo(total_size, alignment);
+        total_size = offsets[i] + sizes[i];
     }
 
-    for (uint32_t i = 0; i < layer + 1; ++i)
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    StageBuffer::Allocation allocation = {};
+    VkCommandBuffer command_buffer;
+    if (((VulkanCommandBuffer*)cmd)->is_copy)
     {
-        for (uint32_t j = 0; j < level + 1; ++j)
-        {
-            GfxBufferImageCopyRange copy_range;
-            copy_range.src_buffer = allocation.buffer;
-            copy_range.dst_texture = texture;
-            copy_range.layer = i;
-            copy_range.level = j;
-            copy_range.buffer_offset = allocation.offset;
-            BufferImageCopy(cmd, copy_range);
-        }
+        allocation = GetCopyCommandBuffer(internal_cmd).stage_buffer->Allocate(total_size, alignment);
+        command_buffer = GetCopyCommandBuffer(internal_cmd).command_buffer;
+        TrackCopyWrite(internal_cmd, texture);
+    }
+    else
+    {
+        allocation = stage_buffers[internal_cmd]->Allocate(total_size, alignment);
+        command_buffer = GetCommandBuffer(internal_cmd);
+        TrackResourceUse(internal_cmd, texture);
     }
+
+    VulkanTexture* internal_texture = (VulkanTexture*)texture;
+    internal_texture->frame_used = frame_count;
+
+    std::vector<VkBufferImageCopy> copies(num_regions);
+    for (uint32_t i = 0; i < num_regions; ++i)
+    {
+        uint32_t level = regions[i].level;
+        dst[i] = allocation.data + offsets[i];
+
+        VkBufferImageCopy& copy = copies[i];
+        copy = {};
+        copy.bufferOffset = allocation.offset + offsets[i];
+        copy.bufferRowLength = 0;
+        copy.bufferImageHeight = 0;
+        copy.imageSubresource.aspectMask = ToVulkanAspectMask(texture->format);
+        copy.imageSubresource.mipLevel = level;
+        copy.imageSubresource.baseArrayLayer = regions[i].layer;
+        copy.imageSubresource.layerCount = 1;
+        copy.imageOffset = {0, 0, 0};
+        copy.imageExtent.width = std::max(texture->width >> level, 1u);
+        copy.imageExtent.height = std::max(texture->height >> level, 1u);
+        copy.imageExtent.depth = std::max(texture->depth >> level, 1u);
+    }
+
+    vkCmdCopyBufferToImage(command_buffer, ((VulkanBuffer*)allocation.buffer)->resource, internal_texture->resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, num_regions, copies.data());
 }
 
 void VulkanDevice::SetBarrier(GfxCommandBuffer* cmd, uint32_t num_barriers, GfxResourceBarrier* barriers)
@@ -3462,6 +7004,7 @@ void VulkanDevice::SetBarrier(GfxCommandBuffer* cmd, uint32_t num_barriers, GfxR
 
     VkAccessFlags src_access_flags = 0;
     VkAccessFlags dst_access_flags = 0;
+    bool aliasing = false;
 
     for (uint32_t i = 0; i < num_barriers; ++i)
     {
@@ -3507,9 +7050,24 @@ void VulkanDevice::SetBarrier(GfxCommandBuffer* cmd, uint32_t num_barriers, GfxR
         else if (resource->GetType() == GfxResource::ResourceType::TEXTURE)
         {
             VulkanTexture* texture = dynamic_cast<VulkanTexture*>(resource);
+            texture->frame_used = frame_count;
             bool flag = false;
             VkImageMemoryBarrier image_barrier = {};
-            if (!(barrier->new_state & texture->res_state))
+            if (barrier->aliasing)
+            {
+                // 等待之前占用这块内存的资源的所有写入, 旧内容直接丢弃
+                flag = true;
+                aliasing = true;
+                image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                image_barrier.pNext = nullptr;
+                image_barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+                image_barrier.dstAccessMask = ToVulkanAccessFlags(barrier->new_state);
+                image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                image_barrier.newLayout = ToVulkanImageLayout(barrier->new_state);
+
+                texture->res_state = barrier->new_state;
+            }
+            else if (!(barrier->new_state & texture->res_state))
             {
                 flag = true;
                 image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -3555,15 +7113,29 @@ void VulkanDevice::SetBarrier(GfxCommandBuffer* cmd, uint32_t num_barriers, GfxR
     {
         queue_type = QUEUE_COPY;
         command_buffer = GetCopyCommandBuffer(((VulkanCommandBuffer*)cmd)->idx).command_buffer;
+        // 记录copy命令缓存结束时的状态
+        for (uint32_t i = 0; i < num_barriers; ++i)
+        {
+            TrackCopyWrite(((VulkanCommandBuffer*)cmd)->idx, barriers[i].resource);
+        }
     }
     else
     {
+        FlushBufferCopies(((VulkanCommandBuffer*)cmd)->idx);
         queue_type = cmd_meta[((VulkanCommandBuffer*)cmd)->idx].queue;
         command_buffer = GetCommandBuffer(((VulkanCommandBuffer*)cmd)->idx);
+        for (uint32_t i = 0; i < num_barriers; ++i)
+        {
+            TrackResourceUse(((VulkanCommandBuffer*)cmd)->idx, barriers[i].resource);
+        }
     }
 
     VkPipelineStageFlags src_stage_mask = ToPipelineStageFlags(src_access_flags, queue_type);
     VkPipelineStageFlags dst_stage_mask = ToPipelineStageFlags(dst_access_flags, queue_type);
+    if (aliasing)
+    {
+        src_stage_mask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
 
     if (!internel_image_barriers.empty() || !internel_buffer_barriers.empty())
     {
@@ -3572,4 +7144,240 @@ void VulkanDevice::SetBarrier(GfxCommandBuffer* cmd, uint32_t num_barriers, GfxR
                              internel_image_barriers.size(), internel_image_barriers.data());
     }
 }
+
+void VulkanDevice::GenerateMips(GfxCommandBuffer* cmd, GfxTexture* texture)
+{
+    assert(!((VulkanCommandBuffer*)cmd)->is_copy);
+    if (texture->num_levels <= 1)
+    {
+        return;
+    }
+
+    VulkanTexture* internal_texture = (VulkanTexture*)texture;
+    internal_texture->frame_used = frame_count;
+    TrackResourceUse(((VulkanCommandBuffer*)cmd)->idx, texture);
+
+    GfxShader* shader = nullptr;
+    if ((texture->res_usage & RESOURCE_USAGE_UNORDERED_ACCESS) && texture->depth == 1 && texture->height > 1)
+    {
+        shader = GetMipShader(texture->format, texture->num_layers > 1);
+    }
+
+    bool recorded = false;
+    if (shader)
+    {
+        recorded = GenerateMipsCompute(cmd, internal_texture, shader);
+    }
+    else
+    {
+        // vkCmdBlitImage只能在graphics队列上执行
+        assert(cmd_meta[((VulkanCommandBuffer*)cmd)->idx].queue == QUEUE_GRAPHICS);
+        recorded = GenerateMipsBlit(cmd, internal_texture);
+    }
+
+    // 没有记录barrier时纹理保持原来的状态
+    if (recorded)
+    {
+        internal_texture->res_state = RESOURCE_STATE_SHADER_RESOURCE;
+    }
+}
+
+GfxShader* VulkanDevice::GetMipShader(Format format, bool array)
+{
+    const char* image_format = ToGlslImageFormat(format);
+    if (image_format == nullptr)
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mip_shader_locker);
+    uint32_t key = ((uint32_t)format << 1) | (array ? 1 : 0);
+    auto it = mip_shaders.find(key);
+    if (it != mip_shaders.end())
+    {
+        return it->second;
+    }
+
+    // 编译失败或者格式不支持storage image时同样缓存nullptr, 之后直接走blit
+    GfxShader* shader = nullptr;
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(phy_device, ToVulkanFormat(format), &format_properties);
+    if (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)
+    {
+        ShaderCompileDesc compile_desc;
+        compile_desc.code = mip_generation_source;
+        compile_desc.preamble = std::string("#define IMAGE_FORMAT ") + image_format + "\n";
+        if (array)
+        {
+            compile_desc.preamble += "#define IMAGE_ARRAY 1\n";
+        }
+        compile_desc.stage = SHADER_STAGE_COMP;
+
+        VulkanShaderCompiler compiler;
+        ShaderCompileResult result = compiler.Compile(compile_desc);
+        if (result.success)
+        {
+            GfxShaderDesc shader_desc;
+            shader_desc.bytecode = result.bytes.data();
+            shader_desc.bytecode_length = (uint32_t)(result.bytes.size() * sizeof(uint32_t));
+            shader_desc.stage = SHADER_STAGE_COMP;
+            shader = CreateShader(shader_desc);
+        }
+    }
+
+    mip_shaders[key] = shader;
+    return shader;
+}
+
+bool VulkanDevice::GenerateMipsCompute(GfxCommandBuffer* cmd, VulkanTexture* texture, GfxShader* shader)
+{
+    uint32_t internal_cmd = ((VulkanCommandBuffer*)cmd)->idx;
+    VkCommandBuffer command_buffer = GetCommandBuffer(internal_cmd);
+
+    // 保存调用者的绑定状态
+    GfxBindingTable saved_table = binders[internal_cmd].table;
+    GfxShader* saved_cs = active_cs[internal_cmd];
+    DeferredPushConstantData saved_pushconstants = pushconstants[internal_cmd];
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.image = texture->resource;
+    barrier.oldLayout = ToVulkanImageLayout(texture->res_state);
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcAccessMask = ToVulkanAccessFlags(texture->res_state);
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = texture->num_levels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = texture->num_layers;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    BindComputeShader(cmd, shader);
+    for (uint32_t base = 0; base + 1 < texture->num_levels; base += 4)
+    {
+        uint32_t num_mips = std::min(texture->num_levels - 1 - base, 4u);
+        BindUAV(cmd, texture, 0, CreateSubresource(texture, UAV, 0, texture->num_layers, base, 1));
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            // 多余的输出绑定到最后一级, shader不会写入
+            uint32_t level = base + 1 + std::min(i, num_mips - 1);
+            BindUAV(cmd, texture, i + 1, CreateSubresource(texture, UAV, 0, texture->num_layers, level, 1));
+        }
+
+        int32_t params[3];
+        params[0] = (int32_t)std::max(texture->width >> base, 1u);
+        params[1] = (int32_t)std::max(texture->height >> base, 1u);
+        params[2] = (int32_t)num_mips;
+        PushConstants(cmd, params, sizeof(params));
+
+        uint32_t width = std::max(texture->width >> (base + 1), 1u);
+        uint32_t height = std::max(texture->height >> (base + 1), 1u);
+        Dispatch(cmd, (width + 7) / 8, (height + 7) / 8, texture->num_layers);
+
+        VkMemoryBarrier memory_barrier = {};
+        memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+    }
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    // 恢复调用者的绑定状态
+    binders[internal_cmd].table = saved_table;
+    binders[internal_cmd].Invalidate();
+    pushconstants[internal_cmd] = saved_pushconstants;
+    active_cs[internal_cmd] = saved_cs;
+    if (saved_cs)
+    {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, ((VulkanShader*)saved_cs)->pipeline_cs);
+    }
+    return true;
+}
+
+bool VulkanDevice::GenerateMipsBlit(GfxCommandBuffer* cmd, VulkanTexture* texture)
+{
+    VkCommandBuffer command_buffer = GetCommandBuffer(((VulkanCommandBuffer*)cmd)->idx);
+
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(phy_device, ToVulkanFormat(texture->format), &format_properties);
+    if (!(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) || !(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT))
+    {
+        BLAST_LOGE("format %d does not support mip generation\n", texture->format);
+        return false;
+    }
+
+    VkFilter filter = VK_FILTER_NEAREST;
+    if (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)
+    {
+        filter = VK_FILTER_LINEAR;
+    }
+
+    // 第0级作为源, 其余级别作为目标
+    VkImageMemoryBarrier barriers[2] = {};
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barriers[i].image = texture->resource;
+        barriers[i].oldLayout = ToVulkanImageLayout(texture->res_state);
+        barriers[i].srcAccessMask = ToVulkanAccessFlags(texture->res_state);
+        barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].subresourceRange.aspectMask = ToVulkanAspectMask(texture->format);
+        barriers[i].subresourceRange.baseArrayLayer = 0;
+        barriers[i].subresourceRange.layerCount = texture->num_layers;
+    }
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[0].subresourceRange.baseMipLevel = 0;
+    barriers[0].subresourceRange.levelCount = 1;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].subresourceRange.baseMipLevel = 1;
+    barriers[1].subresourceRange.levelCount = texture->num_levels - 1;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+    for (uint32_t level = 1; level < texture->num_levels; ++level)
+    {
+        VkImageBlit blit = {};
+        blit.srcSubresource.aspectMask = ToVulkanAspectMask(texture->format);
+        blit.srcSubresource.mipLevel = level - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = texture->num_layers;
+        blit.srcOffsets[1].x = (int32_t)std::max(texture->width >> (level - 1), 1u);
+        blit.srcOffsets[1].y = (int32_t)std::max(texture->height >> (level - 1), 1u);
+        blit.srcOffsets[1].z = (int32_t)std::max(texture->depth >> (level - 1), 1u);
+        blit.dstSubresource = blit.srcSubresource;
+        blit.dstSubresource.mipLevel = level;
+        blit.dstOffsets[1].x = (int32_t)std::max(texture->width >> level, 1u);
+        blit.dstOffsets[1].y = (int32_t)std::max(texture->height >> level, 1u);
+        blit.dstOffsets[1].z = (int32_t)std::max(texture->depth >> level, 1u);
+        vkCmdBlitImage(command_buffer, texture->resource, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texture->resource, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, filter);
+
+        // 写完的级别作为下一级的源
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers[1].subresourceRange.baseMipLevel = level;
+        barriers[1].subresourceRange.levelCount = 1;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barriers[1]);
+    }
+
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[0].subresourceRange.baseMipLevel = 0;
+    barriers[0].subresourceRange.levelCount = texture->num_levels;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barriers[0]);
+    return true;
+}
 }// namespace blast
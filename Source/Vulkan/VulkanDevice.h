@@ -3,13 +3,25 @@
 #include "VulkanDefine.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <deque>
+#include <list>
 #include <mutex>
+#include <set>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace blast
 {
+class VulkanBuffer;
+class VulkanTexture;
+class VulkanMemoryHeap;
+class VulkanReadback;
+struct VulkanPipelineLayout;
+
 class VulkanDevice : public GfxDevice
 {
 public:
@@ -31,6 +43,12 @@ public:
 
     void DestroyTexture(GfxTexture*) override;
 
+    GfxMemoryHeap* CreateMemoryHeap(const GfxMemoryHeapDesc& desc) override;
+
+    void DestroyMemoryHeap(GfxMemoryHeap*) override;
+
+    void DestroyReadback(GfxReadback*) override;
+
     int32_t CreateSubresource(GfxTexture*, SubResourceType, uint32_t, uint32_t, uint32_t, uint32_t) override;
 
     GfxSampler* CreateSampler(const GfxSamplerDesc& desc) override;
@@ -105,8 +123,46 @@ public:
 
     void UpdateTexture(GfxCommandBuffer* cmd, GfxTexture* texture, const void* data, uint32_t layer = 0, uint32_t level = 0) override;
 
+    void UpdateTextureRegions(GfxCommandBuffer* cmd, GfxTexture* texture, uint32_t num_regions, const GfxTextureRegion* regions) override;
+
+    void MapTextureRegions(GfxCommandBuffer* cmd, GfxTexture* texture, uint32_t num_regions, const GfxTextureRegion* regions, void** dst) override;
+
     void SetBarrier(GfxCommandBuffer* cmd, uint32_t num_barriers, GfxResourceBarrier* barriers) override;
 
+    void GenerateMips(GfxCommandBuffer* cmd, GfxTexture* texture) override;
+
+    GfxTransientAllocation AllocateTransient(GfxCommandBuffer* cmd, uint64_t size, ResourceUsage usage) override;
+
+    void GetMemoryStats(GfxMemoryStats& stats) override;
+
+    void GetDescriptorStats(GfxDescriptorStats& stats) override;
+
+    void SetPushDescriptorLimit(uint32_t max_descriptors) override;
+
+    bool IsBindlessSupported() override;
+
+    int32_t GetBindlessIndex(GfxResource* resource, SubResourceType type, int32_t subresource = -1) override;
+
+    int32_t GetBindlessIndex(GfxSampler* sampler) override;
+
+    uint64_t Defragment(uint64_t max_bytes) override;
+
+    GfxReadback* ReadbackBuffer(GfxCommandBuffer* cmd, GfxBuffer* buffer, uint64_t size = 0, uint64_t offset = 0) override;
+
+    GfxReadback* ReadbackTexture(GfxCommandBuffer* cmd, GfxTexture* texture, uint32_t layer = 0, uint32_t level = 0) override;
+
+    const void* GetReadbackData(GfxReadback* readback) override;
+
+    bool WaitReadback(GfxReadback* readback) override;
+
+    uint64_t StreamUpload(const GfxStreamRequest& request) override;
+
+    bool IsStreamResident(uint64_t ticket) override;
+
+    void WaitStream(GfxCommandBuffer* cmd, uint64_t ticket) override;
+
+    void SetStreamBudget(uint64_t bytes_per_frame) override;
+
     void BufferCopy(GfxCommandBuffer* cmd, const GfxBufferCopyRange& range);
 
     void ImageCopy(GfxCommandBuffer* cmd, const GfxImageCopyRange& range);
@@ -116,12 +172,80 @@ public:
 protected:
     uint32_t FindMemoryType(const uint32_t& typeFilter, const VkMemoryPropertyFlags& properties);
 
+    void CreateBufferResource(VulkanBuffer* buffer, const GfxBufferDesc& desc);
+
+    void CreateTextureResource(VulkanTexture* texture, const GfxTextureDesc& desc);
+
+    // 该帧提交的所有命令是否执行完毕, wait为true时等待其fence
+    bool IsFrameComplete(uint64_t frame, bool wait);
+
+    VulkanReadback* CreateReadback(GfxCommandBuffer* cmd, uint64_t size, uint64_t alignment);
+
+    bool PlaceTexture(VulkanTexture* texture, VulkanMemoryHeap* heap, const VkMemoryRequirements& requirements, uint32_t lifetime_begin, uint32_t lifetime_end);
+
+    // 最高的非空set描述符数量不超过push_descriptor_limit时使用push descriptor, 返回该set, 否则返回-1
+    int32_t SelectPushSet(const std::vector<VkDescriptorSetLayoutBinding>& layout_bindings, const std::vector<uint32_t>& layout_sets);
+
+    // 按set和binding排序, 并在设备限制内将常量缓存声明为UNIFORM_BUFFER_DYNAMIC
+    void PrepareLayoutBindings(std::vector<VkDescriptorSetLayoutBinding>& layout_bindings, std::vector<VkImageViewType>& image_view_types,
+                               std::vector<uint32_t>& layout_sets, int32_t push_set);
+
+    // push_pipeline_layout不为空时创建push descriptor使用的模板
+    VkDescriptorUpdateTemplate CreateDescriptorUpdateTemplate(const std::vector<VkDescriptorSetLayoutBinding>& layout_bindings, VkDescriptorSetLayout descriptor_set_layout,
+                                                              VkPipelineLayout push_pipeline_layout, VkPipelineBindPoint bind_point, uint32_t set);
+
+    // 按绑定内容查找或创建共享的布局, 引用计数加一
+    VulkanPipelineLayout* AcquirePipelineLayout(const std::vector<VkDescriptorSetLayoutBinding>& layout_bindings, const std::vector<VkImageViewType>& image_view_types,
+                                                const std::vector<uint32_t>& layout_sets, const VkPushConstantRange& pushconstants, int32_t push_set,
+                                                VkPipelineBindPoint bind_point);
+
+    // 引用计数为0时延迟销毁, 调用时需要持有destroy_locker
+    void ReleasePipelineLayout(VulkanPipelineLayout* layout);
+
+    // 支持bindless时在绑定表的set之后补齐空布局和bindless堆的布局
+    void AppendBindlessLayouts(std::vector<VkDescriptorSetLayout>& layouts);
+
+    int32_t CreateSubresourceView(GfxTexture* texture, SubResourceType type, uint32_t first_slice, uint32_t slice_count, uint32_t first_mip, uint32_t mip_count);
+
+    // 为纹理的SRV或UAV视图分配bindless下标, 已经注册过的视图直接返回
+    void RegisterBindlessView(VulkanTexture* texture, SubResourceType type, int32_t subresource);
+
     void PipelineStateValidate(uint32_t cmd);
 
     void PreDraw(uint32_t cmd);
 
     void PreDispatch(uint32_t cmd);
 
+    // 在可能读取缓存的命令之前, 以每个目标一次vkCmdCopyBuffer提交延迟的拷贝
+    void FlushBufferCopies(uint32_t cmd);
+
+    // 按格式与是否为数组编译的mip生成shader, 不支持storage image时返回nullptr
+    GfxShader* GetMipShader(Format format, bool array);
+
+    // 返回是否记录了命令, 成功时纹理被转换到SHADER_RESOURCE
+    bool GenerateMipsCompute(GfxCommandBuffer* cmd, VulkanTexture* texture, GfxShader* shader);
+
+    bool GenerateMipsBlit(GfxCommandBuffer* cmd, VulkanTexture* texture);
+
+    // 记录copy命令缓存写入的资源, 提交时在copy命令缓存末尾释放它们的所有权
+    void TrackCopyWrite(uint32_t copy_cmd, GfxResource* resource);
+
+    // 记录工作命令缓存使用的资源, 提交时等待其中尚未完成的上传并获取所有权
+    void TrackResourceUse(uint32_t cmd, GfxResource* resource);
+
+    void ForgetPendingAcquire(GfxResource* resource);
+
+    // 附件和UAV可能被压缩, 保持EXCLUSIVE并在copy队列写入后转移所有权, 其余资源以CONCURRENT模式共享
+    bool IsSharedWithCopyQueue(ResourceUsage usage);
+
+    static bool IsConcurrent(GfxResource* resource);
+
+    // EXCLUSIVE资源所属队列族的引用, CONCURRENT资源返回nullptr
+    static uint32_t* GetQueueFamily(GfxResource* resource);
+
+    // 工作队列已经拥有的EXCLUSIVE资源不能在copy队列上重新写入, 调用时需要持有acquire_locker
+    bool CheckCopyQueueWrite(GfxResource* resource);
+
 protected:
     struct Queue
     {
@@ -143,29 +267,46 @@ protected:
     mutable std::mutex init_locker;
     mutable bool submit_inits = false;
 
+    // 由固定大小的块串成的环形上传缓存, 块在写入它的帧完成后才会被复用
     struct StageBuffer
     {
         struct Allocation
         {
             GfxBuffer* buffer;
             uint64_t offset = 0;
+            uint8_t* data = nullptr;
         };
 
-        void Init(VulkanDevice* device);
+        struct Chunk
+        {
+            GfxBuffer* buffer = nullptr;
+            uint64_t offset = 0;
+            uint64_t frame_index = 0;
+            bool retired = true;
+        };
 
-        Allocation Allocate(uint32_t size);
+        // per_frame为false时分配跨越多帧, 块只在Reset之后才会重用
+        void Init(VulkanDevice* device, bool per_frame = true);
+
+        Allocation Allocate(uint64_t size, uint64_t alignment = 8);
+
+        // 调用者保证之前的分配已不再被GPU使用
+        void Reset();
 
         void Destroy();
 
+        bool IsRetired(const Chunk& chunk) const;
+
         VulkanDevice* device = nullptr;
-        uint64_t size = 0;
-        uint64_t offset = 0;
-        uint64_t frame_index = 0;
-        GfxBuffer* buffer = nullptr;
+        bool per_frame = true;
+        uint64_t chunk_size = 4 * 1024 * 1024;
+        uint32_t head = 0;
+        std::vector<Chunk> chunks;
     };
 
     struct Frame
     {
+        // 池用尽时在链表末尾追加新池, 已分配的描述符集在本帧内保持有效, 该帧的fence等待后整条链一起重置复用
         struct DescriptorPool
         {
             void Init(VulkanDevice* device);
@@ -174,17 +315,65 @@ protected:
 
             void Reset();
 
+            // pool_sizes为该布局每种描述符的数量
+            VkDescriptorSet Allocate(VkDescriptorSetLayout layout, const std::vector<VkDescriptorPoolSize>& pool_sizes);
+
+            // 按历史峰值和本帧已使用的数量估算剩余需求
+            void CreatePool(const std::vector<VkDescriptorPoolSize>& pool_sizes);
+
+            static const uint32_t DESCRIPTOR_TYPE_COUNT = 9;
+
             VulkanDevice* device = nullptr;
-            VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
-            uint32_t pool_size = 256;
+            std::vector<VkDescriptorPool> descriptor_pools;
+            // 当前分配的池, 之前的池都已经用尽
+            uint32_t current = 0;
+            // 新池至少容纳的描述符集数量
+            uint32_t pool_size = 64;
+            uint64_t descriptor_count = 0;
+            // 本帧和历史峰值的使用量, 下标与描述符类型表一致
+            uint32_t frame_sets = 0;
+            uint32_t frame_descriptors[DESCRIPTOR_TYPE_COUNT] = {};
+            uint32_t peak_sets = 0;
+            uint32_t peak_descriptors[DESCRIPTOR_TYPE_COUNT] = {};
+
+            // 帧内按布局和写入内容缓存已经更新过的描述符集, 与池一起重置
+            struct CachedSet
+            {
+                VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+                uint32_t data_offset = 0;
+                uint32_t data_count = 0;
+                VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+            };
+            std::unordered_multimap<size_t, CachedSet> cached_sets;
+            std::vector<VulkanDescriptorData> cached_data;
         } descriptor_pools[BLAST_CMD_COUNT];
 
-        StageBuffer* stage_buffers[BLAST_CMD_COUNT];
+        // 帧内线性分配的临时缓存, 在该帧的fence等待后整体重置
+        struct TransientAllocator
+        {
+            void Init(VulkanDevice* device);
+
+            void Destroy();
+
+            void Reset();
+
+            GfxTransientAllocation Allocate(uint64_t size, uint64_t alignment);
+
+            VulkanDevice* device = nullptr;
+            std::vector<GfxBuffer*> buffers;
+            uint32_t current = 0;
+            uint64_t offset = 0;
+            uint64_t block_size = 1024 * 1024;
+        } transient_allocators[BLAST_CMD_COUNT];
+
         VkFence fence[BLAST_QUEUE_COUNT] = {};
         VkCommandPool command_pools[BLAST_CMD_COUNT][BLAST_QUEUE_COUNT] = {};
         VkCommandBuffer command_buffers[BLAST_CMD_COUNT][BLAST_QUEUE_COUNT] = {};
         VkCommandPool init_command_pool = VK_NULL_HANDLE;
         VkCommandBuffer init_command_buffer = VK_NULL_HANDLE;
+        // 在工作命令缓存之前提交, 只包含获取上传资源所有权的barrier
+        VkCommandPool acquire_command_pools[BLAST_CMD_COUNT][BLAST_QUEUE_COUNT] = {};
+        VkCommandBuffer acquire_command_buffers[BLAST_CMD_COUNT][BLAST_QUEUE_COUNT] = {};
     } frames[BLAST_BUFFER_COUNT];
 
     Frame& GetFrameResources() { return frames[GetBufferIndex()]; }
@@ -193,6 +382,10 @@ protected:
     {
         QueueType queue = {};
         std::vector<uint32_t> waits;
+        // 需要等待的流式上传的timeline值
+        uint64_t stream_wait = 0;
+        // 记录时使用到的全部资源, 提交时与pending_acquires求交, 同一帧中之后才被copy队列写入的资源同样会被等待
+        std::unordered_set<GfxResource*> uses;
     } cmd_meta[BLAST_CMD_COUNT];
 
     VkCommandBuffer GetCommandBuffer(uint32_t cmd)
@@ -205,20 +398,138 @@ protected:
         GfxBindingTable table;
         VulkanDevice* device;
 
-        std::vector<VkWriteDescriptorSet> descriptor_writes;
-        std::vector<VkDescriptorBufferInfo> buffer_infos;
-        std::vector<VkDescriptorImageInfo> image_infos;
-        std::vector<VkBufferView> texel_buffer_views;
-        std::vector<VkWriteDescriptorSetAccelerationStructureKHR> acceleration_structure_views;
-        bool dirty = false;
+        // 描述符更新模板使用的数据块
+        std::vector<VulkanDescriptorData> descriptor_data;
+        std::vector<uint32_t> dynamic_offsets;
+        // 0: graphics, 1: compute
+        VkDescriptorSet descriptor_sets[2][BLAST_BINDING_SET_COUNT] = {};
+        // 已写入的描述符集所属的布局, 布局变化后所有set都需要重新写入
+        VulkanPipelineLayout* bound_layouts[2] = {};
+        // 绑定bindless描述符集时使用的管线布局, 布局变化后需要重新绑定
+        VkPipelineLayout bindless_layouts[2] = {};
+        // 上次Flush之后修改过的槽位, 两个绑定点各自清除
+        struct DirtySlots
+        {
+            uint32_t cbv = 0;
+            // 只有偏移发生变化的CBV
+            uint32_t cbv_offset = 0;
+            uint64_t srv = 0;
+            uint32_t uav = 0;
+            uint32_t sampler = 0;
+        };
+        DirtySlots dirty_slots[2];
+        // 提交时累加到descriptor_stats
+        uint64_t cache_hits = 0;
+        uint64_t cache_misses = 0;
+        uint64_t pushes = 0;
+        uint64_t allocations = 0;
+        uint64_t pool_creations = 0;
 
         void Init(VulkanDevice* device);
 
         void Reset();
 
+        // 标记所有槽位, 下次Flush时重新写入全部描述符集
+        void Invalidate();
+
         void Flush(bool graphics, uint32_t cmd);
+
+        // 按set的binding顺序把描述符紧密写入descriptor_data
+        void WriteDescriptorData(const VulkanPipelineLayout* layout, uint32_t set);
+
+        // 从缓存中查找与descriptor_data内容相同的描述符集, 没有时分配并写入
+        VkDescriptorSet AcquireDescriptorSet(uint32_t cmd, const VulkanPipelineLayout* layout, uint32_t set);
+
+        void BindBindlessSets(bool graphics, uint32_t cmd, VkPipelineLayout pipeline_layout, VkPipelineBindPoint bind_point);
     };
     DescriptorBinder binders[BLAST_CMD_COUNT];
+    // 由init_locker保护
+    GfxDescriptorStats descriptor_stats;
+
+    // bindless描述符堆, 每类资源一个update-after-bind描述符集, 释放的下标在GPU执行完该帧后才会重用
+    enum BindlessHeapType
+    {
+        BINDLESS_HEAP_TEXTURE = 0,
+        BINDLESS_HEAP_RW_TEXTURE,
+        BINDLESS_HEAP_BUFFER,
+        BINDLESS_HEAP_SAMPLER,
+        BINDLESS_HEAP_COUNT
+    };
+
+    struct BindlessHeap
+    {
+        void Init(VulkanDevice* device, VkDescriptorType type, uint32_t capacity);
+
+        void Destroy();
+
+        // 堆已满时返回-1
+        int32_t Allocate();
+
+        void Free(int32_t index, uint64_t frame);
+
+        void Write(int32_t index, const VulkanDescriptorData& data);
+
+        void Update(uint64_t current_frame_count, uint32_t buffer_count);
+
+        VulkanDevice* device = nullptr;
+        VkDescriptorType type = VK_DESCRIPTOR_TYPE_MAX_ENUM;
+        uint32_t capacity = 0;
+        VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
+        VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+        VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+        std::mutex locker;
+        int32_t next_index = 0;
+        std::vector<int32_t> free_indices;
+        std::deque<std::pair<int32_t, uint64_t>> pending_frees;
+    };
+    BindlessHeap bindless_heaps[BINDLESS_HEAP_COUNT];
+    bool bindless_supported = false;
+    // 管线布局中未使用的set以及绑定表与bindless堆之间的空描述符集布局
+    VkDescriptorSetLayout empty_set_layout = VK_NULL_HANDLE;
+
+    // 按layout_bindings, image_view_types和push constant范围共享的布局
+    std::mutex layout_locker;
+    std::unordered_multimap<size_t, VulkanPipelineLayout*> layout_cache;
+
+    StageBuffer* stage_buffers[BLAST_CMD_COUNT] = {};
+
+    // 工作命令缓存中延迟合并的UpdateBuffer拷贝, 同一目标的区域互不重叠
+    struct PendingBufferCopy
+    {
+        VkBuffer src = VK_NULL_HANDLE;
+        uint8_t* data = nullptr;
+        VkBufferCopy region = {};
+    };
+    std::unordered_map<VulkanBuffer*, std::vector<PendingBufferCopy>> pending_copies[BLAST_CMD_COUNT];
+
+    // 初始数据的上传缓存, 由init_locker保护
+    StageBuffer* init_stage_buffer = nullptr;
+
+    // 回读使用的GPU_TO_CPU缓存块, 块中所有回读都被释放且写入的帧执行完毕后才会重用
+    struct ReadbackRing
+    {
+        struct Chunk
+        {
+            VulkanBuffer* buffer = nullptr;
+            uint64_t offset = 0;
+            uint64_t frame_index = 0;
+            uint32_t refs = 0;
+        };
+
+        void Init(VulkanDevice* device);
+
+        void Destroy();
+
+        VulkanBuffer* Allocate(uint64_t size, uint64_t alignment, uint32_t& chunk, uint64_t& offset);
+
+        void Release(uint32_t chunk);
+
+        VulkanDevice* device = nullptr;
+        std::mutex locker;
+        uint64_t chunk_size = 4 * 1024 * 1024;
+        uint32_t head = -1;
+        std::vector<Chunk> chunks;
+    } readback_ring;
 
     // 负责Copy命令缓存的分配以及管理
     struct CopyCommandBufferPool
@@ -255,16 +566,158 @@ protected:
         return copy_pool.total_cmds[cmd];
     }
 
+    // copy_pool与流式上传线程都会向copy_queue提交
+    std::mutex copy_queue_locker;
+
+    // copy队列写入但还没有被工作队列获取所有权的资源, 由acquire_locker保护
+    struct PendingAcquire
+    {
+        // 写入它且尚未提交的copy命令缓存, 0表示没有
+        uint32_t copy_cmd = 0;
+        // copy命令缓存结束时资源的状态
+        ResourceState state = RESOURCE_STATE_UNDEFINED;
+        // 需要等待的copy_pool与流式上传的timeline值
+        uint64_t copy_value = 0;
+        uint64_t stream_value = 0;
+        // 还未提交的流式上传请求数量
+        uint32_t stream_requests = 0;
+        // copy队列上已经记录的释放barrier, 获取时使用相同的参数
+        std::vector<VkBufferMemoryBarrier> buffer_barriers;
+        std::vector<VkImageMemoryBarrier> image_barriers;
+    };
+    std::mutex acquire_locker;
+    std::unordered_map<GfxResource*, PendingAcquire> pending_acquires;
+
+    // 后台流式上传, 工作线程按优先级和每帧预算把数据写入上传缓存并提交到copy_queue
+    struct StreamingService
+    {
+        struct Request
+        {
+            GfxStreamRequest desc;
+            uint64_t ticket = 0;
+        };
+
+        struct Batch
+        {
+            VkCommandPool command_pool = VK_NULL_HANDLE;
+            VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+            StageBuffer* stage_buffer = nullptr;
+            uint64_t target = 0;
+            std::vector<std::function<void()>> callbacks;
+            // 释放给工作队列的资源
+            std::vector<std::pair<GfxResource*, VkBufferMemoryBarrier>> buffer_releases;
+            std::vector<std::pair<GfxResource*, VkImageMemoryBarrier>> image_releases;
+        };
+
+        void Init(VulkanDevice* device);
+
+        void Destroy();
+
+        uint64_t Enqueue(const GfxStreamRequest& request);
+
+        bool IsResident(uint64_t ticket);
+
+        // 返回上传完成时的timeline值, 已完成时返回0, 尚未提交的请求会被提前处理
+        uint64_t Require(uint64_t ticket);
+
+        void SetBudget(uint64_t bytes_per_frame);
+
+        void OnFrame(uint64_t frame_count);
+
+        void Run();
+
+        void Record(Batch* batch, const Request& request);
+
+        // 回收执行完毕的批次, 返回需要触发的回调
+        void Retire(std::vector<std::function<void()>>& callbacks);
+
+        VulkanDevice* device = nullptr;
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        uint64_t fence_value = 0;
+        std::thread thread;
+        std::mutex locker;
+        std::condition_variable condition;
+        bool running = false;
+        uint64_t next_ticket = 1;
+        uint64_t budget = 32 * 1024 * 1024;
+        uint64_t budget_used = 0;
+        uint64_t frame_index = 0;
+        uint64_t budget_frame = 0;
+        // 最后一个队列存放被WaitStream提前的请求, 不受预算限制
+        std::deque<Request> requests[STREAM_PRIORITY_COUNT + 1];
+        // 未完成的请求对应的timeline值, 0表示还未提交
+        std::unordered_map<uint64_t, uint64_t> tickets;
+        // 首次流式上传的纹理及其之前的状态, 工作线程在第一个批次开头把整个纹理转换到SHADER_RESOURCE
+        std::unordered_map<VulkanTexture*, ResourceState> initial_states;
+        std::vector<Batch*> freelist;
+        std::vector<Batch*> worklist;
+    } streaming;
+
+    // 设备内存子分配器, 每种内存类型维护若干大块VkDeviceMemory, 块内使用buddy算法分配
+    struct MemoryAllocator
+    {
+        struct Block
+        {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            uint8_t* mapped = nullptr;
+            uint64_t size = 0;
+            uint64_t used = 0;
+            // 正在被碎片整理的块不再分配新的资源
+            bool defragment = false;
+            // 每一阶空闲节点的偏移
+            std::vector<std::set<uint64_t>> free_lists;
+        };
+
+        // 0: 线性资源(Buffer), 1: 非线性资源(Image), 仅在bufferImageGranularity大于最小分配粒度时区分
+        static const uint32_t POOL_COUNT = 2;
+        static const uint64_t MIN_ALLOCATION_SIZE = 256;
+        static const uint64_t MAX_BLOCK_SIZE = 64 * 1024 * 1024;
+
+        void Init(VulkanDevice* device);
+
+        void Destroy();
+
+        VkResult Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear, MemoryCategory category, VulkanAllocation& allocation);
+
+        void Free(const VulkanAllocation& allocation);
+
+        // 把已有的分配计入另一个统计类别
+        void SetCategory(VulkanAllocation& allocation, MemoryCategory category);
+
+        void GetStats(GfxMemoryStats& stats);
+
+        // 在每个池中选出需要腾空的块, evictable_bytes为每个块中可以移动或即将释放的字节数
+        void BeginDefragment(const std::unordered_map<VkDeviceMemory, uint64_t>& evictable_bytes);
+
+        bool IsDefragmentSource(const VulkanAllocation& allocation);
+
+        VulkanDevice* device = nullptr;
+        std::mutex locker;
+        bool separate_images = false;
+        uint64_t block_sizes[VK_MAX_MEMORY_TYPES] = {};
+        std::vector<Block*> pools[VK_MAX_MEMORY_TYPES][POOL_COUNT];
+
+        // 统计数据, 在分配和释放时增量更新
+        uint64_t allocated_bytes[VK_MAX_MEMORY_TYPES] = {};
+        uint64_t used_bytes[VK_MAX_MEMORY_TYPES] = {};
+        uint32_t block_counts[VK_MAX_MEMORY_TYPES] = {};
+        uint32_t allocation_counts[VK_MAX_MEMORY_TYPES] = {};
+        GfxMemoryCategoryStats categories[MEMORY_CATEGORY_COUNT];
+    } memory_allocator;
+
     struct ResourceManager
     {
         VkDevice device = VK_NULL_HANDLE;
         VkInstance instance = VK_NULL_HANDLE;
+        MemoryAllocator* allocator = nullptr;
         uint64_t frame_count = 0;
         std::mutex destroy_locker;
 
-        std::deque<std::pair<std::pair<VkImage, VkDeviceMemory>, uint64_t>> destroyer_images;
+        std::deque<std::pair<std::pair<VkImage, VulkanAllocation>, uint64_t>> destroyer_images;
         std::deque<std::pair<VkImageView, uint64_t>> destroyer_imageviews;
-        std::deque<std::pair<std::pair<VkBuffer, VkDeviceMemory>, uint64_t>> destroyer_buffers;
+        std::deque<std::pair<std::pair<VkBuffer, VulkanAllocation>, uint64_t>> destroyer_buffers;
+        std::deque<std::pair<VulkanAllocation, uint64_t>> destroyer_allocations;
+        std::deque<std::pair<std::pair<VulkanMemoryHeap*, uint64_t>, uint64_t>> destroyer_placements;
         std::deque<std::pair<VkBufferView, uint64_t>> destroyer_bufferviews;
         std::deque<std::pair<VkAccelerationStructureKHR, uint64_t>> destroyer_bvhs;
         std::deque<std::pair<VkSampler, uint64_t>> destroyer_samplers;
@@ -283,6 +736,74 @@ protected:
         void Clear();
     } resource_manager;
 
+    // 回收销毁的Buffer和Texture, 描述相同的资源在GPU使用结束后直接复用, 超出容量时按LRU释放
+    struct ResourceCache
+    {
+        struct BufferEntry
+        {
+            GfxBufferDesc desc;
+            VkBuffer resource = VK_NULL_HANDLE;
+            VulkanAllocation allocation;
+            ResourceState res_state = RESOURCE_STATE_UNDEFINED;
+            uint64_t frame = 0;
+        };
+
+        struct TextureEntry
+        {
+            GfxTextureDesc desc;
+            VkImage resource = VK_NULL_HANDLE;
+            VulkanAllocation allocation;
+            ResourceState res_state = RESOURCE_STATE_UNDEFINED;
+            VkImageView srv = VK_NULL_HANDLE;
+            VkImageView uav = VK_NULL_HANDLE;
+            VkImageView rtv = VK_NULL_HANDLE;
+            VkImageView dsv = VK_NULL_HANDLE;
+            std::vector<VkImageView> subresources_srv;
+            std::vector<VkImageView> subresources_uav;
+            std::vector<VkImageView> subresources_rtv;
+            std::vector<VkImageView> subresources_dsv;
+            std::vector<VulkanSubresourceRange> subresource_ranges[DSV + 1];
+            uint64_t frame = 0;
+        };
+
+        void Init(VulkanDevice* device);
+
+        // 以下两个函数需要在持有destroy_locker时调用
+        bool RecycleBuffer(VulkanBuffer* buffer);
+
+        bool RecycleTexture(VulkanTexture* texture);
+
+        bool AcquireBuffer(const GfxBufferDesc& desc, VulkanBuffer* buffer);
+
+        bool AcquireTexture(const GfxTextureDesc& desc, VulkanTexture* texture);
+
+        // 释放过久未使用的资源
+        void Update();
+
+        void Clear();
+
+        void Evict(uint64_t target_bytes, uint64_t min_frame);
+
+        VulkanDevice* device = nullptr;
+        uint64_t capacity = 256 * 1024 * 1024;
+        uint32_t max_age = 120;
+        uint64_t cached_bytes = 0;
+        // 头部为最近回收的资源
+        std::list<BufferEntry> buffers;
+        std::list<TextureEntry> textures;
+    } resource_cache;
+
+    // GenerateMips使用的compute shader
+    std::mutex mip_shader_locker;
+    std::unordered_map<uint32_t, GfxShader*> mip_shaders;
+
+    // 碎片整理时可以移动的资源, 由destroy_locker保护
+    struct MovableResources
+    {
+        std::unordered_set<VulkanBuffer*> buffers;
+        std::unordered_set<VulkanTexture*> textures;
+    } movable_resources;
+
     std::vector<GfxCommandBuffer*> copy_cmds;
     std::vector<GfxCommandBuffer*> work_cmds;
 
@@ -308,6 +829,13 @@ protected:
     VkPhysicalDevice phy_device = VK_NULL_HANDLE;
     VkPhysicalDeviceProperties phy_device_properties;
     VkPhysicalDeviceMemoryProperties phy_device_memory_properties;
+    bool memory_budget_supported = false;
+    bool push_descriptor_supported = false;
+    uint32_t max_push_descriptors = 0;
+    // 0表示不使用push descriptor
+    uint32_t push_descriptor_limit = 0;
+    // 存在同时为DEVICE_LOCAL和HOST_VISIBLE的内存类型(Resizable BAR或统一内存)
+    bool write_direct_supported = false;
     VkDevice device = VK_NULL_HANDLE;
     VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
     VkQueue graphics_queue = VK_NULL_HANDLE;
@@ -316,6 +844,8 @@ protected:
     uint32_t graphics_family = -1;
     uint32_t compute_family = -1;
     uint32_t copy_family = -1;
+    // 可能被copy队列写入的资源以CONCURRENT模式在这些队列族之间共享
+    std::vector<uint32_t> queue_families;
     std::vector<VkQueueFamilyProperties> queue_family_properties;
 };
 }// namespace blast
\ No newline at end of file
@@ -36,6 +36,28 @@ VulkanTexture::~VulkanTexture()
     device->DestroyTexture(this);
 }
 
+VulkanMemoryHeap::VulkanMemoryHeap(blast::VulkanDevice* in_device)
+    : GfxMemoryHeap()
+{
+    device = in_device;
+}
+
+VulkanMemoryHeap::~VulkanMemoryHeap()
+{
+    device->DestroyMemoryHeap(this);
+}
+
+VulkanReadback::VulkanReadback(blast::VulkanDevice* in_device)
+    : GfxReadback()
+{
+    device = in_device;
+}
+
+VulkanReadback::~VulkanReadback()
+{
+    device->DestroyReadback(this);
+}
+
 VulkanRenderPass::VulkanRenderPass(blast::VulkanDevice* in_device)
     : GfxRenderPass()
 {
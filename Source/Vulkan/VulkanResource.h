@@ -1,6 +1,8 @@
 #pragma once
 #include "VulkanDefine.h"
 
+#include <mutex>
+
 namespace blast
 {
 class VulkanDevice;
@@ -16,6 +18,7 @@ private:
     friend VulkanDevice;
     VulkanDevice* device = nullptr;
     VkSampler sampler{};
+    int bindless_index = -1;
 };
 
 class VulkanBuffer : public GfxBuffer
@@ -29,11 +32,49 @@ private:
     friend VulkanDevice;
     VulkanDevice* device = nullptr;
     VkBuffer resource = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VulkanAllocation allocation;
+    // GPU最后一次写入的帧, 用于判断能否在碎片整理时移动
+    uint64_t frame_written = 0;
     VkBufferView srv = VK_NULL_HANDLE;
     int srv_index = -1;
     VkBufferView uav = VK_NULL_HANDLE;
     int uav_index = -1;
+    // srv_index和uav_index共用bindless缓存堆中的同一个下标
+    bool bindless = false;
+    // 以CONCURRENT模式创建, 跨队列使用时不需要转移所有权
+    bool concurrent = false;
+    // EXCLUSIVE资源最后被提交使用的工作队列族, 由acquire_locker保护
+    uint32_t queue_family = VK_QUEUE_FAMILY_IGNORED;
+};
+
+class VulkanTexture;
+
+class VulkanMemoryHeap : public GfxMemoryHeap
+{
+public:
+    VulkanMemoryHeap(VulkanDevice*);
+
+    virtual ~VulkanMemoryHeap();
+
+private:
+    friend VulkanDevice;
+    struct Placement
+    {
+        uint64_t id = 0;
+        // 纹理销毁后为空, 区间在GPU执行完该帧后才归还
+        VulkanTexture* texture = nullptr;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t lifetime_begin = 0;
+        uint32_t lifetime_end = 0;
+    };
+
+    VulkanDevice* device = nullptr;
+    // 第一次放置资源时才分配内存, 以便使用Image的memoryTypeBits
+    VulkanAllocation allocation;
+    std::mutex locker;
+    uint64_t next_placement_id = 0;
+    std::vector<Placement> placements;
 };
 
 class VulkanTexture : public GfxTexture
@@ -47,7 +88,14 @@ private:
     friend VulkanDevice;
     VulkanDevice* device = nullptr;
     VkImage resource = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VulkanAllocation allocation;
+    VulkanMemoryHeap* heap = nullptr;
+    // GPU最后一次访问的帧, 用于判断能否在碎片整理时移动
+    uint64_t frame_used = 0;
+    // 以CONCURRENT模式创建, 跨队列使用时不需要转移所有权
+    bool concurrent = false;
+    // EXCLUSIVE资源最后被提交使用的工作队列族, 由acquire_locker保护
+    uint32_t queue_family = VK_QUEUE_FAMILY_IGNORED;
     VkImageView srv = VK_NULL_HANDLE;
     int srv_index = -1;
     VkImageView uav = VK_NULL_HANDLE;
@@ -58,6 +106,29 @@ private:
     std::vector<VkImageView> subresources_uav;
     std::vector<VkImageView> subresources_rtv;
     std::vector<VkImageView> subresources_dsv;
+    // bindless堆中的下标, 与subresources_xxx一一对应, 未注册时为-1
+    bool bindless = false;
+    std::vector<int> subresources_srv_index;
+    std::vector<int> subresources_uav_index;
+    // 视图的创建参数, 下标0对应默认视图, 其余依次对应subresources_xxx
+    std::vector<VulkanSubresourceRange> subresource_ranges[DSV + 1];
+};
+
+class VulkanReadback : public GfxReadback
+{
+public:
+    VulkanReadback(VulkanDevice*);
+
+    virtual ~VulkanReadback();
+
+private:
+    friend VulkanDevice;
+    VulkanDevice* device = nullptr;
+    VulkanBuffer* buffer = nullptr;
+    uint32_t chunk = 0;
+    uint64_t offset = 0;
+    uint64_t frame = 0;
+    bool invalidated = false;
 };
 
 class VulkanRenderPass : public GfxRenderPass
@@ -103,6 +174,42 @@ private:
     VkSemaphore swapchain_release_semaphore = VK_NULL_HANDLE;
 };
 
+// 绑定相同的管线和compute shader共享的布局, 由VulkanDevice按引用计数管理
+struct VulkanPipelineLayout
+{
+    struct Set
+    {
+        std::vector<VkDescriptorSetLayoutBinding> layout_bindings;
+        std::vector<VkImageViewType> image_view_types;
+        // 没有binding的set使用设备的empty_set_layout
+        VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
+        VkDescriptorUpdateTemplate descriptor_update_template = VK_NULL_HANDLE;
+        // 每种描述符的数量, 分配时用于估算描述符池的大小
+        std::vector<VkDescriptorPoolSize> pool_sizes;
+        // 该set读取的GfxBindingTable槽位
+        uint32_t cbv_mask = 0;
+        uint32_t dynamic_cbv_mask = 0;
+        uint64_t srv_mask = 0;
+        uint32_t uav_mask = 0;
+        uint32_t sampler_mask = 0;
+    };
+
+    size_t hash = 0;
+    std::vector<VkDescriptorSetLayoutBinding> layout_bindings;
+    std::vector<VkImageViewType> image_view_types;
+    std::vector<uint32_t> layout_sets;
+    VkPushConstantRange pushconstants = {};
+    // 使用push descriptor的set, 没有时为-1
+    int32_t push_set = -1;
+    VkPipelineBindPoint bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    Set sets[BLAST_BINDING_SET_COUNT];
+    // 最高的非空set加一, 以及非空set的掩码
+    uint32_t set_count = 0;
+    uint32_t used_sets = 0;
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+    uint32_t ref_count = 0;
+};
+
 class VulkanShader : public GfxShader
 {
 public:
@@ -117,10 +224,12 @@ private:
     VkPipeline pipeline_cs = VK_NULL_HANDLE;
     VkPipelineShaderStageCreateInfo stage_info = {};
     VkPipelineLayout pipeline_layout_cs = VK_NULL_HANDLE;
-    VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
+    VulkanPipelineLayout* layout = nullptr;
     VkPushConstantRange pushconstants = {};
     std::vector<VkDescriptorSetLayoutBinding> layout_bindings;
     std::vector<VkImageViewType> image_view_types;
+    // 与layout_bindings一一对应的描述符集下标
+    std::vector<uint32_t> layout_sets;
     size_t binding_hash = 0;
 };
 
@@ -137,9 +246,11 @@ private:
     size_t hash = 0;
     VkPipeline pipeline = VK_NULL_HANDLE;
     VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
-    VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
+    VulkanPipelineLayout* layout = nullptr;
+    size_t binding_hash = 0;
     std::vector<VkDescriptorSetLayoutBinding> layout_bindings;
     std::vector<VkImageViewType> image_view_types;
+    std::vector<uint32_t> layout_sets;
     VkPushConstantRange pushconstants = {};
     VkGraphicsPipelineCreateInfo pipeline_info = {};
     VkPipelineShaderStageCreateInfo shader_stages[SHADER_STAGE_COUNT] = {};